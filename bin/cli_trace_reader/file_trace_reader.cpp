@@ -6,6 +6,7 @@
 #include <algorithm>
 
 #include <trace_reader.h>
+#include <register_file.h>
 #include <reader_errors.h>
 
 using namespace reven::backend::plugins::file::libbintrace;
@@ -14,20 +15,12 @@ class TracePrinter : public TraceReader {
 public:
 	TracePrinter(const std::string& filename, bool show_initial)
 	  : TraceReader(std::make_unique<std::ifstream>(filename))
+	  , context(initial_registers())
 	{
-		for (const auto& reg : machine().registers) {
-			context[reg.first] = std::vector<std::uint8_t>(reg.second.size, 0);
-		}
-
-		for (const auto& reg : initial_registers()) {
-			if (show_initial) {
-				std::cout << machine().registers.at(reg.first).name << "=";
-				print_buffer_as_value(reg.second.data(), reg.second.size());
-				std::cout << " ";
-			}
-			context[reg.first] = reg.second;
-		}
 		if (show_initial) {
+			for (auto reg_id : context.register_ids()) {
+				print_register(reg_id);
+			}
 			std::cout << std::endl;
 		}
 	}
@@ -92,13 +85,13 @@ protected:
 	{
 		if (std::find(registers_to_show_.begin(), registers_to_show_.end(), reg_id) == registers_to_show_.end())
 			registers_to_show_.push_back(reg_id);
-		return { context[reg_id].data(), context[reg_id].data() };
+		return { context.get(reg_id), context.get(reg_id) };
 	}
 
 	void print_register(RegisterId reg_id)
 	{
 		std::cout << machine().registers.at(reg_id).name << "=";
-		print_buffer_as_value(context[reg_id].data(), machine().registers.at(reg_id).size);
+		print_buffer_as_value(context.get(reg_id), context.register_size(reg_id));
 		std::cout << " ";
 	}
 
@@ -127,7 +120,7 @@ protected:
 		std::cout << "#" << std::dec << next_event_index() << " Other event (" << description << "): ";
 	}
 
-	std::array<std::vector<std::uint8_t>, 0xffff> context;
+	RegisterFile context;
 	std::vector<RegisterId> registers_to_show_;
 	std::uint8_t buffer_[4096];
 };
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! @name A fast LZ77 codec, producing blocks in the LZ4 block format, so that any LZ4 implementation can decode them.
+//!
+//! It favors speed over ratio: a single hash table of recent positions, greedy matching. Memory pages full of zeroes
+//! or repeated patterns shrink to a few bytes.
+//! @{
+
+//! Compress `size` bytes of `source` into `destination`. Returns the compressed size, or 0 if it would be larger than
+//! `capacity`, in which case `destination`'s content is undefined.
+std::size_t compress_block(const std::uint8_t* source, std::size_t size, std::uint8_t* destination,
+                           std::size_t capacity);
+
+//! Decompress a block produced by compress_block, which must decompress to exactly `size` bytes. Returns false if the
+//! block is malformed, without ever reading or writing outside the given buffers.
+bool decompress_block(const std::uint8_t* source, std::size_t compressed_size, std::uint8_t* destination,
+                      std::size_t size);
+
+//! @}
+
+}}}}}
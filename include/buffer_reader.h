@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "reader_errors.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Reads values from a buffer already in memory, with the same interface as SectionReader.
+ *
+ * This object does not own the buffer. It holds no other state than its position, so it is cheap to create and copy.
+ */
+class BufferReader {
+public:
+	BufferReader(const char* name, const std::uint8_t* data, std::uint64_t size, std::uint64_t position = 0)
+	  : name_(name), data_(data), size_(size), position_(position)
+	{
+		if (position > size)
+			throw std::logic_error("Trying to seek outside section");
+	}
+
+	std::uint64_t stream_pos() const { return position_; }
+	std::uint64_t bytes_left() const { return size_ - position_; }
+
+	void seek(std::uint64_t position)
+	{
+		if (position > size_)
+			throw std::logic_error("Trying to seek outside section");
+		position_ = position;
+	}
+
+	void seek_to_end() { position_ = size_; }
+
+	template <typename T>
+	T read()
+	{
+		T value;
+		read(reinterpret_cast<std::uint8_t*>(&value), sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	std::string read_string()
+	{
+		auto size = read<T>();
+		return std::string(reinterpret_cast<const char*>(skip(size)), size);
+	}
+
+	template <typename T>
+	T read(std::size_t max)
+	{
+		T value = 0;
+		read(reinterpret_cast<std::uint8_t*>(&value), std::min(sizeof(T), max));
+		return value;
+	}
+
+	void read(std::uint8_t* buffer, std::size_t size)
+	{
+		std::memcpy(buffer, skip(size), size);
+	}
+
+	//! Advance by `size` bytes, and return a pointer to the skipped bytes.
+	const std::uint8_t* skip(std::uint64_t size)
+	{
+		if (size > bytes_left())
+			throw UnexpectedEndOfSection(name());
+		auto result = data_ + position_;
+		position_ += size;
+		return result;
+	}
+
+	//! Pointer to the next byte to be read.
+	const std::uint8_t* current() const { return data_ + position_; }
+
+	const char* name() const { return name_; }
+
+private:
+	const char* name_;
+	const std::uint8_t* data_;
+	std::uint64_t size_;
+	std::uint64_t position_;
+};
+
+}}}}}
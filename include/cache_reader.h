@@ -2,6 +2,8 @@
 
 #include <string>
 #include <istream>
+#include <memory>
+#include <vector>
 
 #include <rvnmetadata/metadata-common.h>
 #include <rvnmetadata/metadata-bin.h>
@@ -9,6 +11,8 @@
 
 #include "section_reader.h"
 #include "cache_sections.h"
+#include "positional_reader.h"
+#include "register_file.h"
 #include "reader_errors.h"
 
 namespace reven {
@@ -25,7 +29,11 @@ namespace libbintrace {
  *
  * It cannot help you directly with memory dumps though, because usage is different: instead, it gives you access to its
  * underlying index via @ref index(), from which you can build your own index to quickly retrieve the latest known page
- * version from a context id.
+ * version from a context id, and then read page contents with @ref read_memory_page.
+ *
+ * Once constructed, this object is immutable: every method can be called from several threads at once. Reads are done
+ * at absolute positions, without any shared cursor. When created from a file name, concurrent reads use `pread` and do
+ * not block each other; when created from a stream, they are serialized.
  */
 class CacheReader
 {
@@ -33,16 +41,27 @@ public:
 	using ConstIterator = CacheIndex::CacheOffsetsType::const_iterator;
 
 	CacheReader(std::unique_ptr<std::istream>&& input_stream, const MachineDescription& machine);
+	CacheReader(const std::string& filename, const MachineDescription& machine);
 
 	//! find the closest cache point that is strictly before context_id. If none can be found, resulting iterator will
 	//! be equal to @ref none()
 	ConstIterator find_closest(std::uint64_t context_id) const;
 
 	//! Deferencing none() is undefined behavior.
-	ConstIterator none() const { return index_.cache_points.end(); }
+	ConstIterator none() const { return index_->cache_points.end(); }
 
 	//! Will return a comprehensive register dump at specified cache point. See @ref find_closest
-	RegisterContainer read_cache_point(ConstIterator it);
+	//! @note For a delta cache point, this reads every cache point back to the previous full dump.
+	RegisterFile read_cache_point(ConstIterator it) const;
+
+	//! Fill `buffer` with the content of a page of @ref index(), decompressing it if needed. `buffer` must be at least
+	//! as large as the page size declared in @ref header().
+	void read_memory_page(const CacheIndex::PageCacheOffsets& page, std::uint8_t* buffer) const;
+
+	//! Fill `buffer` with the content of the raw page stored at `cache_stream_offset` (see @ref index()). `buffer` must
+	//! be at least as large as the page size declared in @ref header().
+	//! @warning This cannot read compressed pages, use the overload taking an index entry instead.
+	void read_memory_page(std::uint64_t cache_stream_offset, std::uint8_t* buffer) const;
 
 	//! This cache stream's header, which notably contains the page size.
 	const CacheHeader& header() const { return header_; }
@@ -50,10 +69,16 @@ public:
 	//! The cache's index, which you will probably need to get to build your own index to manage memory.
 	//! This index is comprehensive and immutable as soon as the CacheReader object is created.
 	//! Also see @ref cache_points_section_start_pos
-	const CacheIndex& index() const { return index_; }
+	const CacheIndex& index() const { return *index_; }
+
+	//! The same index, for sharing it beyond this object's lifetime without copying it.
+	const std::shared_ptr<const CacheIndex>& shared_index() const { return index_; }
+
+	//! The machine given at construction, which register dumps are read with.
+	const MachineDescription& machine() const { return machine_; }
 
 	//! Returns the metadata of the resource
-	metadata::Metadata metadata() const { return metadata::from_raw_metadata(reader_.metadata()); }
+	metadata::Metadata metadata() const { return metadata::from_raw_metadata(reader_->metadata()); }
 
 	static metadata::Version resource_version();
 
@@ -61,14 +86,42 @@ public:
 
 	//! The starting position of cache points section.
 	//! Useful for converting relative cache_stream_offset of @ref index() into absolute stream offset
-	std::ios::pos_type cache_points_section_start_pos() const { return cache_points_reader_->section_stream_pos(); }
+	std::ios::pos_type cache_points_section_start_pos() const { return cache_points_start_pos_; }
+
+	//! The size of cache points section, excluding its size parameter. If cache points were appended, this spans every
+	//! appended section, along with the indexes between them.
+	std::uint64_t cache_points_section_size() const { return cache_points_size_; }
+
+	//! The stream position right after the last committed section. Anything after it is an unfinished append.
+	std::ios::pos_type committed_end_pos() const { return committed_end_pos_; }
 
 private:
-	binresource::Reader reader_;
-	std::unique_ptr<SectionReader> cache_points_reader_;
+	CacheReader(std::unique_ptr<binresource::Reader>&& reader, std::unique_ptr<PositionalReader>&& input,
+	            const MachineDescription& machine);
+
+	void read_cache_points_section(std::uint64_t offset, std::uint8_t* buffer, std::size_t size) const;
+
+	//! Read the appended sections following the index, up to the last committed one, see cache-format.md.
+	void read_appended_sections(CacheIndex& index);
+
+	//! Parse `reg_count` registers from `buffer` into `registers`. If `found` is not null, duplicates are rejected.
+	void read_registers(const std::vector<std::uint8_t>& buffer, std::uint16_t reg_count, RegisterFile& registers,
+	                    std::vector<bool>* found) const;
+
+	//! Set in the register count of delta cache points, see cache-format.md.
+	static constexpr std::uint16_t delta_cache_point_flag = 0x8000;
+
+	std::unique_ptr<binresource::Reader> reader_;
+	std::unique_ptr<PositionalReader> input_;
+	std::ios::pos_type cache_points_start_pos_;
+	std::uint64_t cache_points_size_;
+	//! Start and end offsets of each cache points section, in order.
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> cache_points_sections_;
+	std::ios::pos_type committed_end_pos_;
 	CacheHeader header_;
-	CacheIndex index_;
+	std::shared_ptr<const CacheIndex> index_;
 	MachineDescription machine_;
+	std::shared_ptr<const RegisterFile::Layout> registers_layout_;
 };
 
 }}}}}
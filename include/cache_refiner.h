@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "cache_reader.h"
+#include "cache_set.h"
+#include "trace_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! When CacheRefiner adds cache points to a gap between two existing ones.
+struct RefinementPolicy {
+	//! A gap is refined once seeks into it cost at least this much in total, in the unit given to
+	//! CacheRefiner::record_seek.
+	double min_total_cost;
+	//! Cache points added to a gap are spaced so that a seek costs about this much at most.
+	double target_cost;
+	//! A gap is refined only once this many seeks went into it.
+	std::uint64_t min_seeks = 2;
+};
+
+/**
+ * Adds cache points where seeks are slow, to a secondary cache file alongside the original one.
+ *
+ * The caller reports each seek with @ref record_seek: the context it reached, and what replaying from the closest
+ * cache point cost, for example its duration. Gaps between cache points that are sought into often and slowly
+ * according to a RefinementPolicy are then split by @ref refine, which replays them once and appends intermediate
+ * cache points to the secondary file. That file is a valid cache of its own, but its cache points only contain pages
+ * that changed since the closest cache point before them in either file: it is meant to be used along with the
+ * original one in a CacheSet, see @ref caches.
+ *
+ * @ref record_seek and read accessors can be called from several threads at once, and while @ref refine runs.
+ */
+class CacheRefiner
+{
+public:
+	//! Open the secondary cache if `secondary_filename` exists, else it is created on the first refinement.
+	//! @throws std::invalid_argument if the secondary cache doesn't have the same page size as `cache`.
+	CacheRefiner(const TraceFile& trace, std::shared_ptr<const CacheReader> cache, std::string secondary_filename,
+	             const RefinementPolicy& policy);
+
+	//! The original cache along with the secondary one, if it exists.
+	std::shared_ptr<const CacheSet> caches() const;
+
+	//! Report that reaching `context_id` from its closest cache point cost `cost`.
+	void record_seek(std::uint64_t context_id, double cost);
+
+	//! Add cache points to the gaps that need it according to the policy, and forget about their seeks.
+	//! The first refinement writes the secondary cache next to it, then renames it, so that an interrupted refinement
+	//! never leaves an incomplete secondary cache; later ones append to it, see CacheWriter::open_for_append.
+	//! @return the number of cache points added.
+	std::uint64_t refine();
+
+	//! The secondary cache, null until it exists.
+	std::shared_ptr<const CacheReader> secondary() const;
+
+private:
+	struct GapStats {
+		std::uint64_t seeks = 0;
+		double total_cost = 0;
+		std::uint64_t total_events = 0;
+	};
+
+	class Replayer;
+
+	const TraceFile& trace_;
+	std::shared_ptr<const CacheReader> cache_;
+	std::string secondary_filename_;
+	RefinementPolicy policy_;
+	//! The original cache alone.
+	CacheSet cache_set_;
+
+	//! Serializes refinements.
+	std::mutex refine_mutex_;
+	//! Protects the members below.
+	mutable std::mutex mutex_;
+	std::shared_ptr<const CacheReader> secondary_;
+	std::shared_ptr<const CacheSet> caches_;
+	//! Seeks, by context of the cache point they started from.
+	std::map<std::uint64_t, GapStats> gaps_;
+};
+
+}}}}}
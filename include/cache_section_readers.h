@@ -12,5 +12,6 @@ namespace libbintrace {
 
 CacheHeader read_cache_header(binresource::Reader& reader);
 CacheIndex read_cache_index(binresource::Reader& reader);
+CacheAppendCommit read_cache_append_commit(binresource::Reader& reader);
 
 }}}}}
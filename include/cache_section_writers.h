@@ -1,8 +1,15 @@
 #pragma once
 
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
 #include <rvnbinresource/writer.h>
 
 #include "cache_sections.h"
+#include "content_hash.h"
+#include "register_file.h"
+#include "thread_pool.h"
 #include "section_writer.h"
 
 namespace reven {
@@ -13,8 +20,32 @@ namespace libbintrace {
 
 class CacheWriter;
 
+//! Optional encodings of the cache points section, see cache-format.md.
+struct CachePointsOptions {
+	//! Store each distinct page content once, identical pages sharing it. This costs hashing every page, and keeping
+	//! the hash and offset of each distinct page in memory: pages with the same hash are shared without comparing them.
+	bool deduplicate_pages = false;
+
+	//! If not 0, only store registers that changed since the previous cache point, and a full register dump every
+	//! `register_keyframe_interval` cache points. Reading a cache point then costs reading the cache points back to the
+	//! previous full dump.
+	std::uint32_t register_keyframe_interval = 0;
+
+	//! Compress pages, see compress_block. Pages that don't shrink are stored raw.
+	bool compress_pages = false;
+
+	//! If not null, pages of a cache point are hashed and compressed in parallel on this pool, when the cache point is
+	//! finished. Otherwise, this is done on the calling thread. The pool must outlive the writer.
+	ThreadPool* pool = nullptr;
+
+	//! Hash function of pages for deduplication, with a key drawn at random by each writer. Pages of the same hash are
+	//! considered identical, so it must resist collisions crafted by the traced guest, who doesn't know the key.
+	ContentHash (*hash_page)(const std::uint8_t* data, std::size_t size, const ContentHash& key) = hash_content_keyed;
+};
+
 void write_cache_header(binresource::Writer&, const CacheHeader& data);
 void write_cache_index(binresource::Writer&, const CacheIndex& data);
+void write_cache_append_commit(binresource::Writer&, const CacheAppendCommit& data);
 
 class CachePointsSectionWriter : public ExternalSectionTraceWriter
 {
@@ -32,15 +63,20 @@ public:
 	//! cache file will be useless.
 	void start_cache_point(std::uint64_t context_id, std::uint64_t trace_stream_pos);
 
-	//! 2/ Call this as many times as necessary to write all registers.
-	//! @warning Missing a register will render the cache file invalid.
+	//! 2/ Call this once for each register of the machine.
+	//! @throws NonsenseValue if the register is unknown, of another size, or already written in this cache point.
+	//! @note With register delta encoding, all registers must still be written: only those that changed are stored.
 	void write_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size);
 
 	//! 3/ Once all registers have been written, call this as many times as necessary to write all modified pages.
 	//! @note buffer size is implicitly the page size that has been declared while instanciating @ref CacheWriter.
+	//! @note With page deduplication, a page whose content is already stored only gets an index entry pointing to the
+	//! existing copy.
+	//! @note With page compression, pages are copied, then compressed and written in @ref finish_cache_point.
 	void write_memory_page(std::uint64_t address, const std::uint8_t* buffer);
 
 	//! 4/ Call this to finish the declaration of the cache point.
+	//! @throws MissingData if some registers of the machine were not written.
 	void finish_cache_point();
 
 	//! @}
@@ -49,10 +85,43 @@ public:
 	//! this method returns `true` is undefined behavior.
 	bool is_cache_point_started();
 
+	//! Number of cache points stored with all their registers.
+	std::uint64_t register_keyframe_count() const { return keyframe_count_; }
+
+	//! Number of pages written with @ref write_memory_page.
+	std::uint64_t page_count() const { return page_count_; }
+
+	//! Number of pages actually stored, the others being duplicates.
+	std::uint64_t stored_page_count() const { return stored_page_count_; }
+
+	//! Size of the stored pages in the section.
+	std::uint64_t stored_page_bytes() const { return stored_page_bytes_; }
+
 private:
 	friend CacheWriter;
 	CachePointsSectionWriter(binresource::Writer&& writer, std::uint32_t page_size,
-	                  const MachineDescription& machine);
+	                  const MachineDescription& machine, const CachePointsOptions& options);
+	//! Start a section appended to a cache whose cache points are in `existing_index`. Positions in the section start
+	//! at `first_position`, its offset in the cache points.
+	CachePointsSectionWriter(binresource::Writer&& writer, std::uint32_t page_size, const MachineDescription& machine,
+	                         const CachePointsOptions& options, const CacheIndex& existing_index,
+	                         std::uint64_t first_position);
+
+	struct PendingPage {
+		std::uint64_t address;
+		std::vector<std::uint8_t> content;
+		ContentHash hash;
+		std::vector<std::uint8_t> compressed;
+		bool needs_compression;
+	};
+
+	//! Write a page, or point to an existing copy if `hash` is given and a page with the same hash is stored.
+	//! @param buffer the raw page, or its compressed form if `compressed_size` is not 0
+	//! @param compressed_size size of `buffer` if compressed, 0 if `buffer` is a raw page
+	void store_page(std::uint64_t address, const std::uint8_t* buffer, std::uint32_t compressed_size,
+	                const ContentHash* hash);
+	void store_pending_pages();
+	void for_each_pending_page(const std::function<void(PendingPage&)>& function);
 
 	//! It is the responsibility of CacheWriter to write the index to stream.
 	const CacheIndex& index() const { return index_; }
@@ -65,6 +134,31 @@ private:
 	std::uint32_t page_size_;
 	bool cache_point_started_;
 
+	CachePointsOptions options_;
+
+	//! Register values of the previous cache point, if delta encoding.
+	RegisterFile previous_registers_;
+	std::uint64_t previous_cpu_offset_;
+	std::uint32_t cache_points_since_keyframe_;
+	std::uint64_t keyframe_count_;
+	bool current_is_delta_;
+	//! Count of registers passed to write_register, including those not stored.
+	std::uint32_t current_written_reg_count_;
+	//! Whether each register id was passed to write_register.
+	std::vector<bool> current_written_registers_;
+	std::uint64_t current_reg_list_size_pos_;
+	std::uint32_t current_reg_list_size_;
+
+	//! Key of options_.hash_page.
+	ContentHash hash_key_;
+	//! Where each distinct page content is stored, by hash, if deduplicating.
+	std::unordered_map<ContentHash, CacheIndex::PageCacheOffsets, ContentHash::Hasher> stored_pages_;
+	//! Pages of the current cache point waiting for compression.
+	std::vector<PendingPage> pending_pages_;
+	std::uint64_t page_count_;
+	std::uint64_t stored_page_count_;
+	std::uint64_t stored_page_bytes_;
+
 	void do_finalize() override;
 };
 
@@ -23,6 +23,8 @@ public:
 	struct PageCacheOffsets {
 		std::uint64_t page_address;
 		std::uint64_t cache_stream_offset;
+		//! Size of the page in the cache points section if it is compressed, 0 if it is stored raw.
+		std::uint32_t compressed_size = 0;
 	};
 
 	struct CacheOffsets {
@@ -36,7 +38,26 @@ public:
 	};
 
 	using CacheOffsetsType = std::map<std::uint64_t, CacheOffsets, std::greater<std::uint64_t>>;
+
+	//! Set in the page count of cache points whose page entries carry a compressed size, see cache-format.md.
+	static constexpr std::uint32_t compressed_pages_flag = 0x80000000;
+
 	CacheOffsetsType cache_points;
 };
 
+//! Ends a segment of cache points appended to a cache, see cache-format.md. Readers ignore a segment without it.
+class CacheAppendCommit
+{
+public:
+	//! "RVNCAPND" in ASCII.
+	static constexpr std::uint64_t magic = 0x444e5041434e5652;
+	//! Section size of a commit.
+	static constexpr std::uint64_t size = 3 * sizeof(std::uint64_t);
+
+	//! Offset in the cache points of the segment's cache points section, excluding its size.
+	std::uint64_t cache_points_offset;
+	//! Count of cache points in the cache, with those of the segment.
+	std::uint64_t cache_point_count;
+};
+
 }}}}}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cache_reader.h"
+#include "register_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Several caches of the same trace, looked up as one: for example a coarse cache shipped with the trace, along with
+ * finer ones generated for some ranges (see CacheRefiner).
+ *
+ * Cache points of every layer are valid starting points. For the memory, a page's most recent copy is looked for across
+ * all layers: each layer's cache points must contain the pages changed since the closest cache point before them in
+ * any layer.
+ *
+ * Layers must be added before the set is used. Once layers are added, every method can be called from several threads
+ * at once. Copying a set is cheap, layers and their page indexes being shared.
+ */
+class CacheSet
+{
+public:
+	//! A cache point of one of the layers.
+	struct CachePoint {
+		//! The layer, null if there is no cache point: this is then the initial context.
+		std::shared_ptr<const CacheReader> cache;
+		CacheReader::ConstIterator it;
+		std::uint64_t context_id;
+		//! Where to read events following this cache point in the trace.
+		std::uint64_t trace_stream_pos;
+	};
+
+	//! Layers will be validated against `machine`.
+	explicit CacheSet(const MachineDescription& machine);
+
+	//! Open a layer.
+	//! @throws std::invalid_argument if its page size isn't that of the other layers.
+	void add(const std::string& filename);
+	void add(std::unique_ptr<std::istream>&& input_stream);
+
+	//! Add an already open layer.
+	//! @throws std::invalid_argument if it doesn't have the same registers as the machine of this set, or its page size
+	//! isn't that of the other layers.
+	void add(std::shared_ptr<const CacheReader> cache);
+
+	const std::vector<std::shared_ptr<const CacheReader>>& layers() const { return layers_; }
+
+	//! The page size of all layers, 0 if there is none.
+	std::uint32_t page_size() const { return page_size_; }
+
+	//! The closest cache point strictly before context_id in any layer, or the initial context.
+	CachePoint find_closest(std::uint64_t context_id) const;
+
+	//! The context of the first cache point strictly after `context_id` in any layer, or `end` if there is none before.
+	std::uint64_t find_next(std::uint64_t context_id, std::uint64_t end) const;
+
+	//! A comprehensive register dump. Undefined behavior if `cache_point.cache` is null.
+	RegisterFile read_cache_point(const CachePoint& cache_point) const;
+
+	//! Fill `buffer` with the most recent copy of the page at `page_address` as of `context_id`, from any layer.
+	//! `buffer` must be at least as large as @ref page_size().
+	//! @return false if no layer has a copy of that page up to this context, in which case it has its initial content.
+	bool read_memory_page(std::uint64_t page_address, std::uint64_t context_id, std::uint8_t* buffer) const;
+
+private:
+	//! Copies of each page of a layer, by decreasing context.
+	using PageVersions = std::unordered_map<std::uint64_t,
+	                                        std::map<std::uint64_t, CacheIndex::PageCacheOffsets, std::greater<std::uint64_t>>>;
+
+	MachineDescription machine_;
+	std::shared_ptr<const RegisterFile::Layout> registers_layout_;
+	std::uint32_t page_size_;
+
+	std::vector<std::shared_ptr<const CacheReader>> layers_;
+	std::vector<std::shared_ptr<const PageVersions>> layer_pages_;
+};
+
+}}}}}
@@ -25,9 +25,10 @@ namespace libbintrace {
  * to the caller, no specific interval is required.
  *
  * Each cache point must contain a full register dump, along with each page that has changed since the previous cache
- * point was written (or the beginning of the trace if not applicable).
+ * point was written (or the beginning of the trace if not applicable). TraceAndCacheWriter does this tracking for you.
  *
- * See also @ref CachePointsSectionWriter documentation
+ * An existing cache can be opened with @ref open_for_append to add cache points to it, for example finer-grained ones
+ * in a region that is often accessed. See also @ref CachePointsSectionWriter documentation
  */
 class CacheWriter
 {
@@ -36,9 +37,26 @@ public:
 	            const MachineDescription& machine_description,
 	            const char* tool_name, const char* tool_version, const char* tool_info);
 
+	//! Open the existing cache file `filename` to add cache points to it.
+	//! Cache points are written in a new section at the end of the file, and @ref finish_cache_points_section writes
+	//! their index after them, then a commit. Readers ignore whatever follows the last commit, so `filename` remains
+	//! the previous valid cache until the append is finished, even if the process stops before; the next append drops
+	//! such an unfinished one. Nothing is synced to disk though, so this doesn't protect against a power loss.
+	//! Appended cache points can have any context id that doesn't have a cache point yet. Like any cache point, each
+	//! of them must contain every page that changed since the closest cache point before it.
+	//! @throw IncompatibleVersionException if the metadata of `filename` can't be updated to the current version.
+	//! @throw UnexpectedStreamError if `filename` can't be written.
+	static CacheWriter open_for_append(const std::string& filename, const MachineDescription& machine_description);
+
+	//! Rewrite the cache file `filename` with a single index, which is faster to open after many appends. The file is
+	//! written to `filename` followed by ".compact", then renamed over `filename`, which stays valid until then.
+	//! @throw UnexpectedStreamError if the new file can't be written.
+	static void compact(const std::string& filename, const MachineDescription& machine_description);
+
 	//! You should call this once at the start of your trace.
 	//! The returned object is meant to live for most of the trace writing duration.
-	CachePointsSectionWriter start_cache_points_section();
+	//! @param options optional encodings, all disabled by default.
+	CachePointsSectionWriter start_cache_points_section(const CachePointsOptions& options = CachePointsOptions());
 
 	//! You should call this once, when trace writing is done.
 	void finish_cache_points_section(CachePointsSectionWriter&& writer);
@@ -50,8 +68,16 @@ protected:
 	binresource::Writer writer_;
 
 private:
+	CacheWriter(binresource::Writer&& writer, const CacheHeader& header, const MachineDescription& machine_description,
+	            std::shared_ptr<const CacheIndex> existing_index, std::uint64_t first_position);
+
 	CacheHeader header_;
 	MachineDescription machine_;
+
+	//! The cache points already in file, if opened for append.
+	std::shared_ptr<const CacheIndex> existing_index_;
+	//! If opened for append, the offset of the appended cache points section in the cache points.
+	std::uint64_t first_position_;
 };
 
 }}}}}
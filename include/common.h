@@ -1,12 +1,16 @@
 #pragma once
 
+#include <cstdint>
+
 namespace reven {
 namespace backend {
 namespace plugins {
 namespace file {
 namespace libbintrace {
 
-constexpr const char* format_version = "1.0.1";
+constexpr const char* format_version = "1.7.0";
 constexpr const char* writer_version = "1.1.0";
 
+constexpr const char* index_format_version = "1.0.0";
+
 }}}}}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! A 128-bit non-cryptographic hash, strong enough to identify identical buffers such as memory pages.
+struct ContentHash {
+	std::uint64_t low;
+	std::uint64_t high;
+
+	bool operator==(const ContentHash& other) const { return low == other.low and high == other.high; }
+	bool operator!=(const ContentHash& other) const { return not (*this == other); }
+
+	//! For use as key of unordered containers.
+	struct Hasher {
+		std::size_t operator()(const ContentHash& hash) const { return static_cast<std::size_t>(hash.low); }
+	};
+};
+
+//! Hash a buffer. The buffer is processed in 32-byte blocks by four independent 64-bit lanes, which lets the compiler
+//! vectorize or at least pipeline them: a 4kB page is hashed at several bytes per cycle.
+ContentHash hash_content(const std::uint8_t* data, std::size_t size);
+
+//! Hash a buffer with SipHash-2-4, in its 128-bit output variant. As long as `key` is secret, contents that collide
+//! can't be crafted, so that this hash can identify buffers without comparing them, at about half the speed of
+//! @ref hash_content.
+ContentHash hash_content_keyed(const std::uint8_t* data, std::size_t size, const ContentHash& key);
+
+}}}}}
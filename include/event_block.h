@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer_reader.h"
+#include "event_decoder.h"
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! An entry of the table of blocks of a columnar events section.
+struct EventBlockEntry {
+	//! Index of the first event of the block.
+	std::uint64_t first_event_id;
+	//! Position of the block in the events section, which is also a stream position of its first event.
+	std::uint64_t stream_pos;
+};
+
+//! Read the table of blocks at the end of a columnar events section of `section_size` bytes, from an input with the
+//! interface of SectionReader. The input is left at an undefined position.
+//! @throws MalformedSection if the table is inconsistent with the section.
+template <typename Input>
+std::vector<EventBlockEntry> read_event_block_table(Input& input, std::uint64_t section_size);
+
+//! Index in `blocks` of the block `stream_pos` belongs to, or `blocks.size()` if it is before the first block.
+std::size_t find_event_block(const std::vector<EventBlockEntry>& blocks, std::uint64_t stream_pos);
+
+/**
+ * A block of events of the columnar layout, see trace-format.md, read from memory.
+ *
+ * This provides the columns EventDecoder::decode_columns reads events from, and tracks the position of the next event
+ * in each of them. The stream position of an event of the block is that of its header in the headers column, except
+ * for the first event, which can also be designated by the position of the block, and by the end of the headers column
+ * of the previous block.
+ */
+class EventBlock
+{
+public:
+	//! Size of the block size, event count and column sizes, before the first column.
+	static constexpr std::uint64_t header_size = 8 + 4 + 6 * 8;
+
+	//! An empty block at `stream_pos`: it has no event, and ends where it starts.
+	explicit EventBlock(std::uint64_t stream_pos = 0);
+
+	//! Parse the block at `data`, whose stream position is `stream_pos`. `size` is the number of bytes available at
+	//! `data`, which can extend past the block.
+	//! @throws MalformedSection if the block is inconsistent with itself or with the machine description.
+	EventBlock(const EventDecoder& decoder, const std::uint8_t* data, std::uint64_t size, std::uint64_t stream_pos);
+
+	//! @name Columns, see InterleavedColumns.
+	//! @{
+	BufferReader& headers() { return headers_; }
+	BufferReader& register_ids() { return register_ids_; }
+	//! @throws MalformedSection if the block holds no content for `reg_id`.
+	BufferReader& register_payloads(RegisterId reg_id);
+	BufferReader& memory_addresses() { return memory_addresses_; }
+	BufferReader& memory_sizes() { return memory_sizes_; }
+	BufferReader& memory_payloads() { return memory_payloads_; }
+	//! @}
+
+	std::uint32_t event_count() const { return event_count_; }
+
+	//! Whether all events of the block were read.
+	bool finished() const { return headers_.bytes_left() == 0; }
+
+	//! Position of the next event of the block, or the end of the headers column if the block is finished.
+	std::uint64_t stream_pos() const
+	{
+		return event_count_ == 0 ? stream_pos_ : stream_pos_ + header_size + headers_.stream_pos();
+	}
+
+	//! Position of the following block.
+	std::uint64_t end_stream_pos() const { return stream_pos_ + size_; }
+
+	//! Skip events until the one at `stream_pos`, which must be a position of an event of this block.
+	//! @throws std::logic_error if no event of the block is at `stream_pos`.
+	void skip_to(const EventDecoder& decoder, std::uint64_t stream_pos);
+
+private:
+	std::uint64_t stream_pos_;
+	//! Including the block size.
+	std::uint64_t size_;
+	std::uint32_t event_count_;
+
+	BufferReader headers_;
+	BufferReader register_ids_;
+	//! Contents of each register written in the block, by increasing register id.
+	std::vector<std::pair<RegisterId, BufferReader>> register_payloads_;
+	BufferReader memory_addresses_;
+	BufferReader memory_sizes_;
+	BufferReader memory_payloads_;
+};
+
+template <typename Input>
+std::vector<EventBlockEntry> read_event_block_table(Input& input, std::uint64_t section_size)
+{
+	const std::uint64_t entry_size = 2 * sizeof(std::uint64_t);
+	if (section_size < 2 * sizeof(std::uint64_t))
+		throw MalformedSection(input.name(), "Section is too small for a table of blocks");
+
+	input.seek(section_size - sizeof(std::uint64_t));
+	auto block_count = input.template read<std::uint64_t>();
+	auto table_size = section_size - 2 * sizeof(std::uint64_t);
+	if (block_count > table_size / entry_size)
+		throw MalformedSection(input.name(), "Table of blocks is larger than the section");
+
+	auto table_pos = section_size - sizeof(std::uint64_t) - block_count * entry_size;
+	input.seek(table_pos);
+
+	std::vector<EventBlockEntry> blocks(block_count);
+	for (auto& block : blocks) {
+		block.first_event_id = input.template read<std::uint64_t>();
+		block.stream_pos = input.template read<std::uint64_t>();
+	}
+
+	// Blocks start right after the event count, and follow each other
+	std::uint64_t min_pos = sizeof(std::uint64_t);
+	std::uint64_t min_event_id = 0;
+	for (std::size_t i = 0; i < blocks.size(); ++i) {
+		bool is_first_valid = i > 0 or (blocks[i].stream_pos == min_pos and blocks[i].first_event_id == 0);
+		if (not is_first_valid or blocks[i].stream_pos < min_pos or
+		    blocks[i].stream_pos + EventBlock::header_size > table_pos or blocks[i].first_event_id < min_event_id)
+			throw MalformedSection(input.name(), "Block " + std::to_string(i) + " is misplaced in the table");
+		min_pos = blocks[i].stream_pos + EventBlock::header_size;
+		min_event_id = blocks[i].first_event_id + 1;
+	}
+
+	return blocks;
+}
+
+}}}}}
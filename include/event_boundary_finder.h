@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+#include "trace_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! Known event positions in the events section, usable to start reading from the middle of a trace without a cache.
+struct EventOffsetIndex {
+	struct Entry {
+		//! Index of the event, that is the context id before it.
+		std::uint64_t context_id;
+		//! Position of the event in the events section.
+		std::uint64_t stream_pos;
+	};
+
+	//! Sorted by context id. The first entry is always the first event of the trace.
+	std::vector<Entry> entries;
+};
+
+/**
+ * Finds event positions in an events section in parallel, without a cache.
+ *
+ * Event boundaries are implicit, so the events section can normally only be parsed from its start. This cuts the
+ * section into chunks, and parses each chunk on its own from every offset at the beginning of the chunk: most wrong
+ * starting offsets are rejected quickly, because they lead to unknown register ids or event types, forbidden
+ * continuation diffs or writes past the end of the section. Parses starting from different offsets usually fall on the
+ * same boundaries after a few events, and every parse is memoized, so little work is wasted.
+ *
+ * The chunks are then stitched together from the start of the section: the real event position at the start of each
+ * chunk is looked up in the chunk's parses, or parsed again if speculation missed it. The result is thus always exact,
+ * speculation only affects speed.
+ *
+ * In the columnar layout, the positions of blocks of events are known from the table of blocks, and used directly.
+ */
+class EventBoundaryFinder
+{
+public:
+	//! `chunk_size` is the size of the part of the events section parsed by each task, and also the approximate
+	//! spacing between entries of the resulting index. `probe_size` is the number of offsets tried at the start of each
+	//! chunk.
+	explicit EventBoundaryFinder(const TraceFile& trace, std::uint64_t chunk_size = 1 << 20,
+	                             std::uint64_t probe_size = 256);
+
+	//! One entry per chunk: the first event starting in it. In the columnar layout, the first event of the first block
+	//! starting in it.
+	//! @throws MalformedSection if the events section cannot be parsed, or does not contain the announced event count.
+	EventOffsetIndex find(ThreadPool& pool) const;
+
+private:
+	const TraceFile* trace_;
+	std::uint64_t chunk_size_;
+	std::uint64_t probe_size_;
+};
+
+}}}}}
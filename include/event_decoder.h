@@ -0,0 +1,467 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "event_templates.h"
+#include "reader_errors.h"
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! Compute `reg_write = reg_read "operation" value` for a register operation. See MachineDescription::RegisterOperation
+//! @note `reg_read` and `reg_write` can be identical.
+void apply_register_operation(const MachineDescription::RegisterOperation& operation, const std::uint8_t* reg_read,
+                              std::uint8_t* reg_write);
+
+//! Compute the new value `reg_write` of a register of `size` bytes, from its previous value `reg_read` and the
+//! `value_size` bytes of `value` stored with `encoding`, which is not `Full`. See MachineDescription::RegisterEncoding.
+//! @note `reg_read` and `reg_write` can be identical.
+void apply_register_encoding(MachineDescription::RegisterEncoding encoding, const std::uint8_t* reg_read,
+                             const std::uint8_t* value, std::size_t value_size, std::uint8_t* reg_write,
+                             std::size_t size);
+
+/**
+ * The columns of events in the interleaved layout: every field is read from the same input, in event order.
+ *
+ * Columns give the input of each kind of field of events to EventDecoder. In the columnar layout, each returns its own
+ * input, see EventBlock.
+ */
+template <typename Input>
+class InterleavedColumns
+{
+public:
+	explicit InterleavedColumns(Input& input) : input_(input) {}
+
+	//! Event types, descriptions and diff sizes.
+	Input& headers() { return input_; }
+	Input& register_ids() { return input_; }
+	//! Contents of the writes to `reg_id`.
+	Input& register_payloads(RegisterId) { return input_; }
+	Input& memory_addresses() { return input_; }
+	Input& memory_sizes() { return input_; }
+	Input& memory_payloads() { return input_; }
+
+private:
+	Input& input_;
+};
+
+/**
+ * Decodes events of the trace events section, as described in trace-format.md.
+ *
+ * This object only holds quick-access tables built from the machine description, and is immutable once built: it can
+ * be shared between any number of readers, including from several threads.
+ *
+ * The input can be any object with the same reading interface as SectionReader (see also BufferReader). The handler
+ * must provide the `do_*` callbacks documented in TraceReader; it is expected to declare this class as a friend.
+ *
+ * Events in the columnar layout are decoded by the same code, reading each kind of field from its own column: see
+ * InterleavedColumns for the interface of columns, and EventBlock.
+ *
+ * Events stored as a reference to an event template are decoded from the template given at construction, without
+ * parsing register ids and memory sizes.
+ *
+ * The contents of registers with an encoding are applied to the value given by the read buffer of
+ * `do_register_rw_buffers`, which must be the current value of the register, as for register operations.
+ */
+class EventDecoder
+{
+public:
+	EventDecoder();
+	//! `templates` must have been validated against `machine`, see read_event_templates.
+	explicit EventDecoder(const MachineDescription& machine,
+	                      const std::vector<EventTemplate>& templates = std::vector<EventTemplate>());
+
+	//! Read one event from `input`, calling `handler`'s callbacks. `input` is left at the start of the next event.
+	template <typename Input, typename Handler>
+	void decode(Input& input, Handler& handler) const
+	{
+		InterleavedColumns<Input> columns(input);
+		decode_columns(columns, handler);
+	}
+
+	//! Read one event from `input` like @ref decode, but only report its memory writes, as `visit(address, size)`.
+	//! The content of memory and register writes is skipped without being copied, using the sizes from the machine
+	//! description, as well as event descriptions. `input` is left at the start of the next event.
+	template <typename Input, typename Visitor>
+	void scan_memory_writes(Input& input, Visitor&& visit) const
+	{
+		InterleavedColumns<Input> columns(input);
+		scan_memory_writes_columns(columns, visit);
+	}
+
+	//! @ref decode, reading each kind of field from `columns`.
+	template <typename Columns, typename Handler>
+	void decode_columns(Columns& columns, Handler& handler) const;
+
+	//! @ref scan_memory_writes, reading each kind of field from `columns`.
+	template <typename Columns, typename Visitor>
+	void scan_memory_writes_columns(Columns& columns, Visitor&& visit) const;
+
+	bool is_register_operation(RegisterId id) const
+	{
+		return id < register_operations_.size() and register_operations_[id].first;
+	}
+
+	//! Undefined behavior if `is_register_operation(id)` is false.
+	const MachineDescription::RegisterOperation& register_operation(RegisterId id) const
+	{
+		return register_operations_[id].second;
+	}
+
+	bool is_register(RegisterId id) const { return id < registers_.size() and registers_[id].first; }
+
+	//! Undefined behavior if `is_register(id)` is false.
+	std::uint16_t register_size(RegisterId id) const { return registers_[id].second; }
+
+	//! Undefined behavior if `is_register(id)` is false.
+	MachineDescription::RegisterEncoding register_encoding(RegisterId id) const { return register_encodings_[id]; }
+
+	//! Skip the content of a write to `reg_id`, which must be a register, from `input`.
+	template <typename Input>
+	void skip_register_content(Input& input, RegisterId reg_id) const
+	{
+		if (register_encoding(reg_id) == MachineDescription::RegisterEncoding::Full)
+			input.skip(register_size(reg_id));
+		else
+			input.skip(read_encoded_size(input, reg_id));
+	}
+
+	std::uint8_t physical_address_size() const { return physical_address_size_; }
+
+	//! The event templates of the trace, by index.
+	const std::vector<EventTemplate>& templates() const { return templates_; }
+
+private:
+	template <typename Columns, typename Handler>
+	void decode_template(Columns& columns, Handler& handler, const EventTemplate& event_template) const;
+	template <typename Columns, typename Handler>
+	void process_register_write(Columns& columns, Handler& handler, RegisterId reg_id) const;
+	template <typename Handler>
+	void process_register_operation(Handler& handler, RegisterId reg_id) const;
+	template <typename Columns, typename Handler>
+	void process_register_set(Columns& columns, Handler& handler) const;
+	template <typename Input, typename Handler>
+	void process_register_content(Input& input, Handler& handler, RegisterId reg_id) const;
+	template <typename Input, typename Handler>
+	void process_encoded_register_content(Input& input, Handler& handler, RegisterId reg_id) const;
+	//! Read the size of the encoded content of a write to `reg_id`.
+	template <typename Input>
+	std::uint16_t read_encoded_size(Input& input, RegisterId reg_id) const;
+	//! Read the mask of a register set from `input`, and call `function(reg_id)` for each register of the set, by
+	//! increasing slot.
+	template <typename Input, typename Function>
+	void for_each_register_in_set(Input& input, Function&& function) const;
+	template <typename Input, typename Handler>
+	void process_memory_write(Input& input, Handler& handler, std::uint64_t address, std::uint64_t size) const;
+
+	std::uint8_t physical_address_size_;
+
+	//! Quick-access vector for register actions properties stored in machine description.
+	//! If Value.first is false, the Key is not associated with any action.
+	std::vector<std::pair<bool, MachineDescription::RegisterOperation>> register_operations_;
+
+	//! Quick-access vector for register sizes stored in machine description.
+	//! If Value.first is false, the Key is not associated with any register.
+	std::vector<std::pair<bool, std::uint16_t>> registers_;
+
+	//! Register encodings, by register id.
+	std::vector<MachineDescription::RegisterEncoding> register_encodings_;
+
+	//! Register ids by slot in register sets, that is by increasing id.
+	std::vector<RegisterId> register_slots_;
+
+	//! Event templates, validated once so that decoding a templated event parses no register id nor size.
+	std::vector<EventTemplate> templates_;
+};
+
+template <typename Columns, typename Handler>
+void EventDecoder::decode_columns(Columns& columns, Handler& handler) const
+{
+	auto& headers = columns.headers();
+	auto diff_size = headers.template read<std::uint8_t>();
+	std::uint16_t reg_count = 0;
+	std::uint16_t mem_count = 0;
+
+	if (diff_size < 0xff) {
+		handler.do_event_instruction();
+	} else {
+		auto type = headers.template read<std::uint8_t>();
+		if (type < templates_.size()) {
+			handler.do_event_instruction();
+			decode_template(columns, handler, templates_[type]);
+			return;
+		}
+
+		switch (type) {
+			case 0xff:
+				handler.do_event_other(headers.template read_string<std::uint8_t>());
+				break;
+			default:
+				throw MalformedSection(headers.name(), std::to_string(type) + " is an unknown type of event");
+		}
+		diff_size = headers.template read<std::uint8_t>();
+	}
+
+	for(;;) {
+		mem_count = (diff_size >> 0) & 0xf;
+		reg_count = (diff_size >> 4) & 0xf;
+
+		for (std::size_t i = 0; i < mem_count and i < 0xe; ++i) {
+			auto address = columns.memory_addresses().template read<std::uint64_t>(physical_address_size_);
+
+			auto& sizes = columns.memory_sizes();
+			std::uint64_t size = sizes.template read<std::uint8_t>();
+			if (size == 0xff)
+				size = sizes.template read<std::uint64_t>(physical_address_size_);
+
+			process_memory_write(columns.memory_payloads(), handler, address, size);
+		}
+
+		for (std::size_t i = 0; i < reg_count and i < 0xe; ++i) {
+			auto& ids = columns.register_ids();
+			RegisterId reg_id = ids.template read<std::uint8_t>();
+			if (reg_id == 0xff)
+				reg_id = ids.template read<RegisterId>();
+
+			if (reg_id == register_set_id)
+				process_register_set(columns, handler);
+			else
+				process_register_write(columns, handler, reg_id);
+		}
+
+		if (mem_count == 0xf or reg_count == 0xf) {
+			// Read the continuation diff
+			diff_size = headers.template read<std::uint8_t>();
+			if (diff_size == 0xff)
+				throw MalformedSection(headers.name(), "Continuation diff with diff size 0xff is forbidden");
+		} else {
+			break;
+		}
+	}
+}
+
+template <typename Columns, typename Visitor>
+void EventDecoder::scan_memory_writes_columns(Columns& columns, Visitor&& visit) const
+{
+	auto& headers = columns.headers();
+	auto diff_size = headers.template read<std::uint8_t>();
+
+	if (diff_size == 0xff) {
+		auto type = headers.template read<std::uint8_t>();
+		if (type < templates_.size()) {
+			const auto& event_template = templates_[type];
+			for (auto size : event_template.memory_sizes) {
+				visit(columns.memory_addresses().template read<std::uint64_t>(physical_address_size_), size);
+				columns.memory_payloads().skip(size);
+			}
+			for (auto reg_id : event_template.registers) {
+				if (not is_register_operation(reg_id))
+					skip_register_content(columns.register_payloads(reg_id), reg_id);
+			}
+			return;
+		}
+		if (type != 0xff)
+			throw MalformedSection(headers.name(), std::to_string(type) + " is an unknown type of event");
+		headers.skip(headers.template read<std::uint8_t>());
+		diff_size = headers.template read<std::uint8_t>();
+	}
+
+	for(;;) {
+		std::uint16_t mem_count = (diff_size >> 0) & 0xf;
+		std::uint16_t reg_count = (diff_size >> 4) & 0xf;
+
+		for (std::size_t i = 0; i < mem_count and i < 0xe; ++i) {
+			auto address = columns.memory_addresses().template read<std::uint64_t>(physical_address_size_);
+
+			auto& sizes = columns.memory_sizes();
+			std::uint64_t size = sizes.template read<std::uint8_t>();
+			if (size == 0xff)
+				size = sizes.template read<std::uint64_t>(physical_address_size_);
+
+			visit(address, size);
+			columns.memory_payloads().skip(size);
+		}
+
+		for (std::size_t i = 0; i < reg_count and i < 0xe; ++i) {
+			auto& ids = columns.register_ids();
+			RegisterId reg_id = ids.template read<std::uint8_t>();
+			if (reg_id == 0xff)
+				reg_id = ids.template read<RegisterId>();
+
+			if (is_register_operation(reg_id))
+				continue;
+			if (reg_id == register_set_id) {
+				for_each_register_in_set(ids, [this, &columns](RegisterId set_reg_id) {
+					skip_register_content(columns.register_payloads(set_reg_id), set_reg_id);
+				});
+				continue;
+			}
+			if (not is_register(reg_id))
+				throw MalformedSection(ids.name(), std::string("Register or action ") + std::to_string(reg_id) +
+				                                     " is not defined in machine description section");
+			skip_register_content(columns.register_payloads(reg_id), reg_id);
+		}
+
+		if (mem_count == 0xf or reg_count == 0xf) {
+			diff_size = headers.template read<std::uint8_t>();
+			if (diff_size == 0xff)
+				throw MalformedSection(headers.name(), "Continuation diff with diff size 0xff is forbidden");
+		} else {
+			break;
+		}
+	}
+}
+
+template <typename Columns, typename Handler>
+void EventDecoder::decode_template(Columns& columns, Handler& handler, const EventTemplate& event_template) const
+{
+	for (auto size : event_template.memory_sizes) {
+		auto address = columns.memory_addresses().template read<std::uint64_t>(physical_address_size_);
+		process_memory_write(columns.memory_payloads(), handler, address, size);
+	}
+
+	// Register ids were checked with the templates
+	for (auto reg_id : event_template.registers) {
+		if (is_register_operation(reg_id))
+			process_register_operation(handler, reg_id);
+		else
+			process_register_content(columns.register_payloads(reg_id), handler, reg_id);
+	}
+}
+
+template <typename Columns, typename Handler>
+void EventDecoder::process_register_write(Columns& columns, Handler& handler, RegisterId reg_id) const
+{
+	if (is_register_operation(reg_id)) {
+		process_register_operation(handler, reg_id);
+		return;
+	}
+
+	if (not is_register(reg_id))
+		throw MalformedSection(columns.register_ids().name(), std::string("Register or action ") +
+		                                                        std::to_string(reg_id) +
+		                                                        " is not defined in machine description section");
+
+	process_register_content(columns.register_payloads(reg_id), handler, reg_id);
+}
+
+template <typename Handler>
+void EventDecoder::process_register_operation(Handler& handler, RegisterId reg_id) const
+{
+	const auto& reg_operation = register_operation(reg_id);
+
+	const std::uint8_t* reg_read;
+	std::uint8_t* reg_write;
+	std::tie(reg_read, reg_write) = handler.do_register_rw_buffers(reg_operation.register_id);
+	if (reg_write != nullptr)
+		apply_register_operation(reg_operation, reg_read, reg_write);
+}
+
+template <typename Columns, typename Handler>
+void EventDecoder::process_register_set(Columns& columns, Handler& handler) const
+{
+	for_each_register_in_set(columns.register_ids(), [this, &columns, &handler](RegisterId reg_id) {
+		process_register_content(columns.register_payloads(reg_id), handler, reg_id);
+	});
+}
+
+template <typename Input, typename Handler>
+void EventDecoder::process_register_content(Input& input, Handler& handler, RegisterId reg_id) const
+{
+	if (register_encoding(reg_id) != MachineDescription::RegisterEncoding::Full) {
+		process_encoded_register_content(input, handler, reg_id);
+		return;
+	}
+
+	std::uint8_t* reg_write;
+	std::tie(std::ignore, reg_write) = handler.do_register_rw_buffers(reg_id);
+	if (reg_write != nullptr)
+		input.read(reg_write, register_size(reg_id));
+	else
+		input.skip(register_size(reg_id));
+}
+
+template <typename Input, typename Handler>
+void EventDecoder::process_encoded_register_content(Input& input, Handler& handler, RegisterId reg_id) const
+{
+	auto size = read_encoded_size(input, reg_id);
+
+	const std::uint8_t* reg_read;
+	std::uint8_t* reg_write;
+	std::tie(reg_read, reg_write) = handler.do_register_rw_buffers(reg_id);
+	if (reg_write == nullptr) {
+		input.skip(size);
+		return;
+	}
+
+	std::uint8_t value[max_encoded_register_size];
+	input.read(value, size);
+	apply_register_encoding(register_encoding(reg_id), reg_read, value, size, reg_write, register_size(reg_id));
+}
+
+template <typename Input>
+std::uint16_t EventDecoder::read_encoded_size(Input& input, RegisterId reg_id) const
+{
+	std::uint16_t size = input.template read<std::uint8_t>();
+	if (size > register_size(reg_id))
+		throw MalformedSection(input.name(), std::string("Encoded content of register ") + std::to_string(reg_id) +
+		                                       " is larger than the register");
+	return size;
+}
+
+template <typename Input, typename Function>
+void EventDecoder::for_each_register_in_set(Input& input, Function&& function) const
+{
+	const std::size_t slot_count = register_slots_.size();
+	const std::size_t mask_size = (slot_count + 7) / 8;
+
+	// The whole mask is read before the values, which can follow it in the same input. Register ids are 16 bits, so
+	// there are at most 0x10000 slots.
+	std::uint64_t mask[0x10000 / 64];
+	const std::size_t word_count = (slot_count + 63) / 64;
+	for (std::size_t i = 0; i < word_count; ++i)
+		mask[i] = input.template read<std::uint64_t>(std::min<std::size_t>(8, mask_size - i * 8));
+
+	for (std::size_t i = 0; i < word_count; ++i) {
+		const std::size_t first_slot = i * 64;
+		for (auto word = mask[i]; word != 0;) {
+			auto slot = first_slot + __builtin_ctzll(word);
+			word &= word - 1;
+			if (slot >= slot_count)
+				throw MalformedSection(input.name(), "Register set refers to slot " + std::to_string(slot) +
+				                                       " past the last register");
+			function(register_slots_[slot]);
+		}
+	}
+}
+
+template <typename Input, typename Handler>
+void EventDecoder::process_memory_write(Input& input, Handler& handler, std::uint64_t address,
+                                        std::uint64_t size) const
+{
+	for(; size > 0;) {
+		auto buffer = handler.do_memory_before_write(address, size);
+
+		if (buffer.first != nullptr) {
+			input.read(buffer.first, buffer.second);
+			handler.do_memory_after_write(address, buffer.first, buffer.second);
+		} else {
+			input.skip(buffer.second);
+		}
+
+		address += buffer.second;
+		size -= buffer.second;
+	}
+}
+
+}}}}}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "replay_engine.h"
+#include "thread_pool.h"
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! A condition on the writes of a single event, see EventSearch.
+struct EventPredicate {
+	enum class Kind {
+		RegisterWritten,
+		RegisterEquals,
+		MemoryWritten,
+	};
+
+	//! Events writing `reg_id`, directly or through a register operation.
+	static EventPredicate register_written(RegisterId reg_id);
+
+	//! Events after which `reg_id` holds `value`. As traces only record register changes, this finds the events where
+	//! the register changes to `value`.
+	static EventPredicate register_equals(RegisterId reg_id, std::vector<std::uint8_t> value);
+
+	//! Events writing at least one byte of `[address, address + size)`.
+	static EventPredicate memory_written(std::uint64_t address, std::uint64_t size);
+
+	Kind kind;
+	RegisterId reg_id;
+	std::vector<std::uint8_t> value;
+	std::uint64_t address;
+	std::uint64_t size;
+};
+
+struct SearchMatch {
+	std::uint64_t event_id;
+	//! Position of the matching predicate in the search's predicates.
+	std::size_t predicate;
+};
+
+struct SearchStatistics {
+	std::uint64_t events = 0;
+	std::uint64_t matches = 0;
+	double seconds = 0;
+
+	double events_per_second() const { return seconds > 0 ? events / seconds : 0; }
+};
+
+/**
+ * Finds the events matching any of a set of EventPredicate, replaying segments in parallel with a ReplayEngine.
+ *
+ * Only the writes the predicates look at are decoded: the content of other registers and of memory writes is skipped
+ * in the events section, so a search is much faster than a replay keeping the whole machine state.
+ *
+ * RegisterEquals predicates need the register value when it is changed by a register operation: if the register is
+ * the target of any operation, the engine must know register values at the start of each segment, as when it is built
+ * from a cache.
+ */
+class EventSearch
+{
+public:
+	//! Receive a match. Called from the thread calling @ref run, in event order, but in no particular order for the
+	//! predicates matching a single event.
+	using MatchConsumer = std::function<void(const SearchMatch&)>;
+
+	//! `engine` must outlive the search.
+	//! @throws std::invalid_argument if a predicate refers to an unknown register, or has a value of the wrong size,
+	//! or needs register values that `engine` doesn't have: a register equality on a register changed by register
+	//! operations or not stored with MachineDescription::RegisterEncoding::Full.
+	EventSearch(const ReplayEngine& engine, std::vector<EventPredicate> predicates);
+
+	const std::vector<EventPredicate>& predicates() const { return predicates_; }
+
+	//! Search the whole trace on `pool`. Matches are streamed to `consume` as soon as their segment and all the
+	//! previous ones are searched. An event matching several predicates is reported once for each of them.
+	//! @warning Calling this from a task of `pool` can deadlock.
+	SearchStatistics run(ThreadPool& pool, const MatchConsumer& consume) const;
+
+private:
+	class Matcher;
+
+	const ReplayEngine& engine_;
+	std::vector<EventPredicate> predicates_;
+	//! Indices of the register predicates, by register id.
+	std::vector<std::vector<std::size_t>> register_predicates_;
+	//! Indices of the memory predicates.
+	std::vector<std::size_t> memory_predicates_;
+};
+
+}}}}}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#include "buffer_reader.h"
+#include "event_block.h"
+#include "trace_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Reads the events of a TraceFile one after the other from a stream position, whatever the layout of its events
+ * section.
+ *
+ * In the columnar layout, this keeps the current block of events: reading the following events costs nothing more
+ * than in the interleaved layout, but seeking to a position in the middle of a block skips the events before it.
+ */
+class EventStream
+{
+public:
+	//! `trace` must outlive this object.
+	//! @throws std::logic_error if `stream_pos` is not the position of an event.
+	EventStream(const TraceFile& trace, std::uint64_t stream_pos);
+
+	//! The position of the next event.
+	std::uint64_t stream_pos() const { return columnar_ ? block_.stream_pos() : events_.stream_pos(); }
+
+	//! Go to the event at `stream_pos`. Does nothing if it is the current position.
+	//! @throws std::logic_error if `stream_pos` is not the position of an event.
+	void seek(std::uint64_t stream_pos);
+
+	//! Read the next event, see EventDecoder::decode. It must exist.
+	template <typename Handler>
+	void decode(Handler& handler)
+	{
+		if (not columnar_)
+			return trace_->decoder().decode(events_, handler);
+
+		if (block_.finished())
+			load_block(block_.end_stream_pos());
+		trace_->decoder().decode_columns(block_, handler);
+	}
+
+	//! Read the next event, see EventDecoder::scan_memory_writes. It must exist.
+	template <typename Visitor>
+	void scan_memory_writes(Visitor&& visit)
+	{
+		if (not columnar_)
+			return trace_->decoder().scan_memory_writes(events_, visit);
+
+		if (block_.finished())
+			load_block(block_.end_stream_pos());
+		trace_->decoder().scan_memory_writes_columns(block_, visit);
+	}
+
+private:
+	//! Go to the event at `stream_pos` in the columnar layout.
+	void position(std::uint64_t stream_pos);
+	void load_block(std::uint64_t stream_pos);
+
+	const TraceFile* trace_;
+	bool columnar_;
+	//! Interleaved layout
+	BufferReader events_;
+	//! Columnar layout
+	EventBlock block_;
+};
+
+}}}}}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "reader_errors.h"
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! Event types below this are indices of event templates, so a trace has at most this many templates.
+constexpr std::size_t max_event_templates = 0xf0;
+
+/**
+ * The shape of an instruction event: what it writes, but not the values written.
+ *
+ * Events of a recurring shape can be stored as a reference to a template with this shape, followed by the addresses
+ * and contents of their writes only. See trace-format.md.
+ */
+struct EventTemplate {
+	//! Sizes of the memory writes, in order.
+	std::vector<std::uint64_t> memory_sizes;
+	//! Registers and register operations written, in order. Register sets cannot be part of a template.
+	std::vector<RegisterId> registers;
+};
+
+inline bool operator<(const EventTemplate& lhs, const EventTemplate& rhs)
+{
+	return std::tie(lhs.memory_sizes, lhs.registers) < std::tie(rhs.memory_sizes, rhs.registers);
+}
+
+inline bool operator==(const EventTemplate& lhs, const EventTemplate& rhs)
+{
+	return lhs.memory_sizes == rhs.memory_sizes and lhs.registers == rhs.registers;
+}
+
+//! Read the table of event templates at the end of an events section of `section_size` bytes, from an input with the
+//! interface of SectionReader. `table_pos` is set to the position of the table, which is the end of the events and of
+//! the table of blocks, if any. The input is left at an undefined position.
+//! @throws MalformedSection if the table is inconsistent with the section or the machine description.
+template <typename Input>
+std::vector<EventTemplate> read_event_templates(Input& input, std::uint64_t section_size,
+                                                const MachineDescription& machine, std::uint64_t& table_pos)
+{
+	if (section_size < 2 * sizeof(std::uint64_t) + 1)
+		throw MalformedSection(input.name(), "Section is too small for a table of event templates");
+
+	input.seek(section_size - sizeof(std::uint64_t));
+	auto table_size = input.template read<std::uint64_t>();
+	if (table_size < 1 or table_size > section_size - 2 * sizeof(std::uint64_t))
+		throw MalformedSection(input.name(), "Table of event templates is larger than the section");
+
+	table_pos = section_size - sizeof(std::uint64_t) - table_size;
+	input.seek(table_pos);
+
+	std::vector<EventTemplate> templates(input.template read<std::uint8_t>());
+	if (templates.size() > max_event_templates)
+		throw MalformedSection(input.name(), "Too many event templates");
+
+	for (auto& event_template : templates) {
+		event_template.memory_sizes.resize(input.template read<std::uint16_t>());
+		for (auto& size : event_template.memory_sizes) {
+			size = input.template read<std::uint8_t>();
+			if (size == 0xff)
+				size = input.template read<std::uint64_t>(machine.physical_address_size);
+		}
+
+		event_template.registers.resize(input.template read<std::uint16_t>());
+		for (auto& reg_id : event_template.registers) {
+			reg_id = input.template read<std::uint8_t>();
+			if (reg_id == 0xff)
+				reg_id = input.template read<RegisterId>();
+
+			bool is_operation = reg_id < 0xff and
+			                    machine.register_operations.find(static_cast<std::uint8_t>(reg_id)) !=
+			                      machine.register_operations.end();
+			if (not is_operation and machine.registers.find(reg_id) == machine.registers.end())
+				throw MalformedSection(input.name(), std::string("Register or action ") + std::to_string(reg_id) +
+				                                       " of an event template is not defined in machine description section");
+		}
+	}
+
+	if (input.stream_pos() != section_size - sizeof(std::uint64_t))
+		throw MalformedSection(input.name(), "Table of event templates does not match its size");
+
+	return templates;
+}
+
+}}}}}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <rvnbinresource/reader.h>
+#include <rvnbinresource/writer.h>
+
+#include "posting_list.h"
+#include "reader_errors.h"
+#include "section_reader.h"
+#include "section_writer.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! What a trace index sidecar file contains, see index-format.md. Kinds are four-character codes, readable in a dump.
+enum class IndexKind : std::uint32_t
+{
+	MemoryWrites = 0x4d454d49, // "IMEM"
+	RegisterWrites = 0x47455249, // "IREG"
+	SegmentSummaries = 0x47455349, // "ISEG"
+};
+
+class IndexHeader
+{
+public:
+	IndexKind kind;
+	//! Size of the units the index tracks, such as pages for memory indexes.
+	std::uint32_t granularity;
+	//! Event count of the indexed trace.
+	std::uint64_t event_count;
+};
+
+//! Start an index sidecar file, writing its metadata.
+binresource::Writer create_index_writer(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name,
+                                        const char* tool_version, const char* tool_info);
+//! Open an index sidecar file, checking its metadata.
+//! @throws IncompatibleTypeException, IncompatibleVersionException
+binresource::Reader open_index_reader(std::unique_ptr<std::istream>&& input_stream);
+
+void write_index_header(binresource::Writer& writer, const IndexHeader& data);
+//! @throws IncompatibleTypeException if the resource is not an index, or not of kind `expected_kind`.
+IndexHeader read_index_header(binresource::Reader& reader, IndexKind expected_kind);
+
+/**
+ * Posting lists of event ids stored by increasing key, such as a page address or a register id: a keys section giving
+ * the position of each list, followed by a postings section, see index-format.md.
+ *
+ * Indexes store their lists this way and only handle what their keys mean.
+ */
+template <typename Key>
+class KeyedPostingLists
+{
+public:
+	//! A key and the position of its event ids in the postings.
+	struct Entry {
+		Key key;
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	KeyedPostingLists() = default;
+
+	//! Append the events of `key`, which must be greater than the previous one.
+	void add(Key key, const PostingListBuilder& builder);
+
+	//! Read the keys section named `keys_section` then the postings section.
+	//! @throws MalformedSection if keys are not sorted or lists are outside of the postings.
+	void read(binresource::Reader& reader, const char* keys_section);
+	void write(binresource::Writer& writer, const char* keys_section) const;
+
+	//! Sorted by key.
+	const std::vector<Entry>& entries() const { return entries_; }
+	PostingList events(const Entry& entry) const { return PostingList(postings_.data() + entry.offset, entry.size); }
+
+private:
+	std::vector<Entry> entries_;
+	std::vector<std::uint8_t> postings_;
+};
+
+template <typename Key>
+void KeyedPostingLists<Key>::add(Key key, const PostingListBuilder& builder)
+{
+	auto offset = postings_.size();
+	builder.encode(postings_);
+	entries_.push_back({ key, offset, postings_.size() - offset });
+}
+
+template <typename Key>
+void KeyedPostingLists<Key>::read(binresource::Reader& reader, const char* keys_section)
+{
+	{
+		SectionReader section_reader(keys_section, reader);
+		for (auto count = section_reader.read<std::uint64_t>(); count > 0; --count) {
+			Entry entry;
+			entry.key = section_reader.read<Key>();
+			entry.offset = section_reader.read<std::uint64_t>();
+			entry.size = section_reader.read<std::uint64_t>();
+			if (not entries_.empty() and entry.key <= entries_.back().key)
+				throw MalformedSection(keys_section, "keys are not sorted");
+			entries_.push_back(entry);
+		}
+		section_reader.seek_to_end();
+	}
+
+	SectionReader section_reader("index postings", reader);
+	postings_.resize(section_reader.bytes_left());
+	section_reader.read(postings_.data(), postings_.size());
+
+	for (const auto& entry : entries_) {
+		if (entry.offset > postings_.size() or entry.size > postings_.size() - entry.offset)
+			throw MalformedSection(keys_section, "events are outside of the postings section");
+	}
+}
+
+template <typename Key>
+void KeyedPostingLists<Key>::write(binresource::Writer& writer, const char* keys_section) const
+{
+	{
+		SectionWriter section_writer(keys_section, &writer);
+		section_writer.write<std::uint64_t>(entries_.size());
+		for (const auto& entry : entries_) {
+			section_writer.write<Key>(entry.key);
+			section_writer.write<std::uint64_t>(entry.offset);
+			section_writer.write<std::uint64_t>(entry.size);
+		}
+		section_writer.finalize();
+	}
+
+	SectionWriter section_writer("index postings", &writer);
+	section_writer.write_buffer(postings_.data(), postings_.size());
+	section_writer.finalize();
+}
+
+}}}}}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * A whole file mapped read-only in memory.
+ *
+ * The mapping is shared by the operating system's page cache: mapping a file costs no copy, and any number of threads
+ * can read it at once.
+ */
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const std::uint8_t* data() const { return data_; }
+	std::uint64_t size() const { return size_; }
+
+private:
+	const std::uint8_t* data_;
+	std::uint64_t size_;
+};
+
+}}}}}
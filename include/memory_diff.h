@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cache_set.h"
+#include "segment_summaries.h"
+#include "trace_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+struct MemoryRange {
+	std::uint64_t address;
+	std::uint64_t size;
+};
+
+/**
+ * Compares the memory at two contexts of a trace, for example before and after a system call.
+ *
+ * Instead of rebuilding the whole memory at both contexts, only the pages that could have changed in between are
+ * rebuilt: those listed by the cache points in between, or by segment summaries if given. The cost thus depends on the
+ * amount of memory written between the two contexts, not on the size of the memory.
+ *
+ * All objects must outlive this one. Diffs can be computed from several threads at once.
+ */
+class MemoryDiff
+{
+public:
+	//! @param summaries optional, to find candidate pages more precisely, and without scanning events after the last
+	//! cache point. They don't need to cover the whole trace: uncovered events fall back to the caches.
+	//! @throws std::invalid_argument if `caches` has no layer.
+	MemoryDiff(const TraceFile& trace, const CacheSet& caches, const SegmentSummaries* summaries = nullptr);
+
+	//! The pages, of the caches' page size, that may be written by the events between the two contexts, in increasing
+	//! order.
+	std::vector<std::uint64_t> candidate_pages(std::uint64_t first_context, std::uint64_t second_context) const;
+
+	//! The bytes that differ between the two contexts, as disjoint ranges in increasing address order. Contexts can be
+	//! given in any order.
+	//! @throws std::out_of_range if a context is after the end of the trace.
+	std::vector<MemoryRange> diff(std::uint64_t first_context, std::uint64_t second_context) const;
+
+private:
+	class PageCursor;
+
+	//! Add the pages written by the events `[first_context, last_context)` to `pages`, using the cache index.
+	void add_cache_pages(std::uint64_t first_context, std::uint64_t last_context, std::vector<std::uint64_t>& pages) const;
+	//! Add the pages written by the events `[first_context, last_context)` to `pages`, using the summaries. Events no
+	//! summary covers, in gaps between them or past the last one, use the cache index instead.
+	void add_summary_pages(std::uint64_t first_context, std::uint64_t last_context,
+	                       std::vector<std::uint64_t>& pages) const;
+
+	const TraceFile& trace_;
+	const CacheSet& caches_;
+	const SegmentSummaries* summaries_;
+	std::uint32_t page_size_;
+};
+
+}}}}}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "index_sections.h"
+#include "posting_list.h"
+#include "replay_engine.h"
+#include "thread_pool.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * An inverted index of the memory writes of a trace: for each page, the ids of the events that wrote to it.
+ *
+ * Answering "who wrote this buffer?" otherwise means replaying the trace and checking each memory write. The index is
+ * built once by scanning the events in parallel with a ReplayEngine, then stored in a sidecar file next to the trace,
+ * see index-format.md. Each page's event ids are kept as a PostingList, so queries only decode the blocks they need.
+ *
+ * The index is page-granular: an event writing any byte of a page is reported for any range overlapping that page.
+ * Callers needing exact byte ranges must check the reported events, for instance by replaying them.
+ *
+ * Once built or loaded, the index is immutable and can be queried from several threads.
+ */
+class MemoryWriteIndex
+{
+public:
+	//! Returned by @ref last_write_before when no event wrote the range.
+	static constexpr std::uint64_t no_event = std::numeric_limits<std::uint64_t>::max();
+
+	//! Scan every event of `engine`'s trace on `pool`. Segments may have unknown register values, see ReplayEngine.
+	//! @param page_size granularity of the index, a power of two.
+	//! @throws std::invalid_argument if `page_size` is not a power of two.
+	static MemoryWriteIndex build(const ReplayEngine& engine, ThreadPool& pool, std::uint32_t page_size = 0x1000);
+
+	//! Load an index written by @ref write.
+	//! @throws IncompatibleTypeException if the file is not a memory write index.
+	//! @throws MalformedSection if its page size is not a power of two.
+	explicit MemoryWriteIndex(const std::string& filename);
+	explicit MemoryWriteIndex(std::unique_ptr<std::istream>&& input_stream);
+
+	void write(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name, const char* tool_version,
+	           const char* tool_info) const;
+
+	std::uint32_t page_size() const { return page_size_; }
+	//! Event count of the indexed trace.
+	std::uint64_t event_count() const { return event_count_; }
+	//! Number of pages written at least once.
+	std::size_t page_count() const { return pages_.entries().size(); }
+
+	//! Ids of the events in `[first_event, last_event)` that wrote a page overlapping `[address, address + size)`, in
+	//! increasing order.
+	std::vector<std::uint64_t> writes(std::uint64_t address, std::uint64_t size, std::uint64_t first_event,
+	                                  std::uint64_t last_event) const;
+
+	//! The last event before `context_id` that wrote a page overlapping `[address, address + size)`, that is the last
+	//! write already applied at this context, or @ref no_event.
+	std::uint64_t last_write_before(std::uint64_t address, std::uint64_t size, std::uint64_t context_id) const;
+
+private:
+	class Scanner;
+
+	//! A page, keyed by its address, and the position of its event ids.
+	using Page = KeyedPostingLists<std::uint64_t>::Entry;
+
+	MemoryWriteIndex(std::uint32_t page_size, std::uint64_t event_count);
+
+	//! The pages overlapping `[address, address + size)`.
+	std::pair<std::vector<Page>::const_iterator, std::vector<Page>::const_iterator>
+	find_pages(std::uint64_t address, std::uint64_t size) const;
+
+	std::uint32_t page_size_;
+	std::uint64_t event_count_;
+	KeyedPostingLists<std::uint64_t> pages_;
+};
+
+}}}}}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <string>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Reads a resource at arbitrary absolute positions, without any shared cursor.
+ *
+ * Implementations must allow any number of threads to call @ref read_at concurrently.
+ */
+class PositionalReader
+{
+public:
+	virtual ~PositionalReader() = default;
+
+	//! Fill `buffer` with `size` bytes starting at absolute `position`.
+	//! @throws UnexpectedEndOfStream if the resource is too short.
+	virtual void read_at(std::uint64_t position, std::uint8_t* buffer, std::size_t size) const = 0;
+};
+
+//! Reads a file using `pread`: concurrent reads do not block each other.
+class FilePositionalReader : public PositionalReader
+{
+public:
+	explicit FilePositionalReader(const std::string& filename);
+	~FilePositionalReader() override;
+
+	FilePositionalReader(const FilePositionalReader&) = delete;
+	FilePositionalReader& operator=(const FilePositionalReader&) = delete;
+
+	void read_at(std::uint64_t position, std::uint8_t* buffer, std::size_t size) const override;
+
+private:
+	int fd_;
+};
+
+//! Reads any seekable stream. Concurrent reads are serialized, as they share the stream's position.
+class StreamPositionalReader : public PositionalReader
+{
+public:
+	explicit StreamPositionalReader(std::istream& stream) : stream_(stream) {}
+
+	void read_at(std::uint64_t position, std::uint8_t* buffer, std::size_t size) const override;
+
+private:
+	std::istream& stream_;
+	mutable std::mutex mutex_;
+};
+
+}}}}}
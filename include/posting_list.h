@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Builds a compressed list of increasing ids, such as event ids, see PostingList for the encoding.
+ */
+class PostingListBuilder
+{
+public:
+	//! Append `id`, which must not be lower than the previous one. Adding the previous id again does nothing.
+	//! @throws std::logic_error if `id` is lower than the previous one.
+	void add(std::uint64_t id);
+
+	std::uint64_t count() const { return count_; }
+
+	//! Append the encoded list to `output`.
+	void encode(std::vector<std::uint8_t>& output) const;
+
+private:
+	std::uint64_t count_ = 0;
+	std::uint64_t last_ = 0;
+	//! First id and offset in `data_` of each block.
+	std::vector<std::pair<std::uint64_t, std::uint32_t>> skips_;
+	std::vector<std::uint8_t> data_;
+};
+
+/**
+ * A read-only view of a list of increasing ids encoded by PostingListBuilder.
+ *
+ * Ids are stored in blocks of @ref block_size: the first id of a block is stored in a skip table, along with the
+ * position of the block, and the others as LEB128 varints of the difference with the previous id. Queries only decode
+ * the block they need, found by a binary search in the skip table.
+ *
+ * Layout:
+ *   varint: id count
+ *   For each block:
+ *     8B: first id
+ *     4B: offset of the block in the data below
+ *   Data: for each block, varint differences of its ids after the first one
+ */
+class PostingList
+{
+public:
+	static constexpr std::uint32_t block_size = 128;
+
+	//! An empty list.
+	PostingList();
+
+	//! The list encoded at `data`, which must outlive this object.
+	//! @throws MalformedSection if the encoded list does not fit in `size` bytes.
+	PostingList(const std::uint8_t* data, std::uint64_t size);
+
+	std::uint64_t count() const { return count_; }
+
+	//! Append the ids in `[first, last)` to `ids`.
+	void collect(std::uint64_t first, std::uint64_t last, std::vector<std::uint64_t>& ids) const;
+
+	//! The lowest id that is at least `value`, if any.
+	bool next(std::uint64_t value, std::uint64_t& id) const;
+
+	//! The greatest id that is lower than `value`, if any.
+	bool previous(std::uint64_t value, std::uint64_t& id) const;
+
+private:
+	std::uint64_t block_first_id(std::uint64_t block) const;
+	//! Decode the ids of a block into `ids`, which is cleared first.
+	void decode_block(std::uint64_t block, std::vector<std::uint64_t>& ids) const;
+	//! The last block whose first id is lower than or equal to `value`, or the block count if there is none.
+	std::uint64_t find_block(std::uint64_t value) const;
+
+	std::uint64_t count_;
+	std::uint64_t block_count_;
+	const std::uint8_t* skips_;
+	const std::uint8_t* data_;
+	std::uint64_t data_size_;
+};
+
+}}}}}
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <exception>
+#include <stdexcept>
+#include <string>
 
 namespace reven {
 namespace backend {
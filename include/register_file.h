@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * A comprehensive set of register values, stored in one contiguous buffer.
+ *
+ * The placement of each register in the buffer is computed once from a MachineDescription and is shared between all
+ * RegisterFile objects created from the same one (copies included), so copying a RegisterFile is a single allocation
+ * and memcpy, and two register files can be compared with a single memcmp.
+ *
+ * Each register starts on an 8-byte boundary, so register contents up to 8 bytes can be accessed as integers.
+ */
+class RegisterFile
+{
+public:
+	class Layout
+	{
+	public:
+		explicit Layout(const MachineDescription& machine);
+
+		bool contains(RegisterId id) const { return id < slots_.size() and slots_[id].offset != invalid_offset; }
+
+		//! Offset of the register in the buffer. Undefined behavior if `contains(id)` is false.
+		std::uint32_t offset(RegisterId id) const { return slots_[id].offset; }
+
+		//! Size of the register. Undefined behavior if `contains(id)` is false.
+		std::uint16_t size(RegisterId id) const { return slots_[id].size; }
+
+		//! Registers declared in machine description, in ascending order.
+		const std::vector<RegisterId>& register_ids() const { return register_ids_; }
+
+		//! Size of the whole buffer, padding included.
+		std::size_t byte_size() const { return byte_size_; }
+
+		//! Number of slots in the lookup table, that is greatest register id + 1.
+		std::size_t slot_count() const { return slots_.size(); }
+
+		//! Two layouts are equal if they place the same registers at the same offsets.
+		bool operator==(const Layout& other) const;
+		bool operator!=(const Layout& other) const { return not (*this == other); }
+
+	private:
+		static constexpr std::uint32_t invalid_offset = 0xffffffff;
+
+		struct Slot {
+			std::uint32_t offset;
+			std::uint16_t size;
+		};
+
+		std::vector<Slot> slots_;
+		std::vector<RegisterId> register_ids_;
+		std::size_t byte_size_;
+	};
+
+	//! An empty register file, with no register. Only useful as a placeholder to be assigned later.
+	RegisterFile();
+
+	//! A register file containing all registers of `machine`, zero-initialized.
+	explicit RegisterFile(const MachineDescription& machine);
+
+	//! A register file sharing the layout of another, zero-initialized.
+	explicit RegisterFile(std::shared_ptr<const Layout> layout);
+
+	const std::shared_ptr<const Layout>& layout() const { return layout_; }
+
+	bool contains(RegisterId id) const { return layout_->contains(id); }
+
+	//! Size of the register. Undefined behavior if `contains(id)` is false.
+	std::uint16_t register_size(RegisterId id) const { return layout_->size(id); }
+
+	//! Number of registers in this file.
+	std::size_t register_count() const { return layout_->register_ids().size(); }
+
+	//! Registers of this file, in ascending order.
+	const std::vector<RegisterId>& register_ids() const { return layout_->register_ids(); }
+
+	//! Register content. Undefined behavior if `contains(id)` is false.
+	const std::uint8_t* get(RegisterId id) const { return data() + layout_->offset(id); }
+	std::uint8_t* get(RegisterId id) { return data() + layout_->offset(id); }
+
+	//! Overwrite a register content.
+	//! @throws std::out_of_range if the register is unknown or `size` does not match the register size.
+	void set(RegisterId id, const std::uint8_t* buffer, std::size_t size);
+
+	//! The whole buffer, see @ref Layout for register placement.
+	const std::uint8_t* data() const { return reinterpret_cast<const std::uint8_t*>(storage_.data()); }
+	std::uint8_t* data() { return reinterpret_cast<std::uint8_t*>(storage_.data()); }
+	std::size_t byte_size() const { return layout_->byte_size(); }
+
+	//! Bulk copy of all register values.
+	//! @throws std::logic_error if `other` does not have the same layout.
+	void copy_from(const RegisterFile& other);
+
+	//! Register files with different layouts are never equal.
+	bool operator==(const RegisterFile& other) const;
+	bool operator!=(const RegisterFile& other) const { return not (*this == other); }
+
+private:
+	bool same_layout(const RegisterFile& other) const;
+
+	std::shared_ptr<const Layout> layout_;
+	std::vector<std::uint64_t> storage_;
+};
+
+}}}}}
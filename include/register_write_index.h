@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "index_sections.h"
+#include "posting_list.h"
+#include "replay_engine.h"
+#include "thread_pool.h"
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * An index of the register writes of a trace: for each register, the ids of the events that wrote to it.
+ *
+ * Finding the previous event that modified a register otherwise means replaying backward from a cache point. Both
+ * direct writes and register operations targeting a register count as writes, even if the value doesn't change.
+ *
+ * Like MemoryWriteIndex, it is built by scanning the trace in parallel with a ReplayEngine, stores each register's
+ * events as a PostingList and is saved in a sidecar file, see index-format.md. It is immutable once built or loaded.
+ */
+class RegisterWriteIndex
+{
+public:
+	//! Returned by @ref next_write and @ref prev_write when there is no such event.
+	static constexpr std::uint64_t no_event = std::numeric_limits<std::uint64_t>::max();
+
+	//! Scan every event of `engine`'s trace on `pool`. Segments may have unknown register values, see ReplayEngine.
+	static RegisterWriteIndex build(const ReplayEngine& engine, ThreadPool& pool);
+
+	//! Load an index written by @ref write.
+	//! @throws IncompatibleTypeException if the file is not a register write index.
+	explicit RegisterWriteIndex(const std::string& filename);
+	explicit RegisterWriteIndex(std::unique_ptr<std::istream>&& input_stream);
+
+	void write(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name, const char* tool_version,
+	           const char* tool_info) const;
+
+	//! Event count of the indexed trace.
+	std::uint64_t event_count() const { return event_count_; }
+
+	//! Number of events writing `reg_id`.
+	std::uint64_t write_count(RegisterId reg_id) const;
+
+	//! The first event at or after `context_id` writing `reg_id`, that is the next write still to apply at this
+	//! context, or @ref no_event.
+	std::uint64_t next_write(RegisterId reg_id, std::uint64_t context_id) const;
+
+	//! The last event before `context_id` writing `reg_id`, that is the last write already applied at this context, or
+	//! @ref no_event.
+	std::uint64_t prev_write(RegisterId reg_id, std::uint64_t context_id) const;
+
+private:
+	class Scanner;
+
+	explicit RegisterWriteIndex(std::uint64_t event_count);
+
+	//! The events of `reg_id`, empty if it is never written.
+	PostingList events(RegisterId reg_id) const;
+
+	std::uint64_t event_count_;
+	KeyedPostingLists<RegisterId> registers_;
+};
+
+}}}}}
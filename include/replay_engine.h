@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cache_reader.h"
+#include "event_boundary_finder.h"
+#include "register_file.h"
+#include "thread_pool.h"
+#include "trace_cursor.h"
+#include "trace_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! Where the register values at the start of a ReplaySegment come from.
+enum class SegmentSeed {
+	//! The segment starts at context 0, registers are the trace's initial registers.
+	InitialContext,
+	//! The segment starts at a cache point, registers are read from the cache.
+	CachePoint,
+	//! Register values at the start of the segment are not known.
+	Unknown,
+};
+
+//! A range of events `[start_context, end_context)` that can be replayed independently from the others.
+struct ReplaySegment {
+	//! Position of the segment in the trace, starting from 0.
+	std::size_t index;
+	std::uint64_t start_context;
+	std::uint64_t end_context;
+	//! Position of the event `start_context` in the events section.
+	std::uint64_t stream_pos;
+	SegmentSeed seed;
+	//! Only meaningful if `seed` is SegmentSeed::CachePoint.
+	CacheReader::ConstIterator cache_point;
+};
+
+/**
+ * A TraceCursor replaying one ReplaySegment for a ReplayEngine.
+ *
+ * On top of the TraceCursor callbacks, it is notified of the start and end of its segment.
+ */
+class SegmentHandler : public TraceCursor
+{
+public:
+	using TraceCursor::TraceCursor;
+
+protected:
+	//! Called once the cursor is placed at the start of the segment, before its first event.
+	//! `registers` are the register values at `segment.start_context`, or nullptr if `segment.seed` is Unknown.
+	virtual void do_segment_start(const ReplaySegment& segment, const RegisterFile* registers)
+	{
+		static_cast<void>(segment);
+		static_cast<void>(registers);
+	}
+
+	//! Called after the last event of the segment. Not called when only part of it is replayed, see ReplayEngine::query.
+	virtual void do_segment_end(const ReplaySegment& segment) { static_cast<void>(segment); }
+
+private:
+	friend class ReplayEngine;
+};
+
+/**
+ * A SegmentHandler that only looks at the memory writes of its segment. Events are read with
+ * EventDecoder::scan_memory_writes, the whole segment at once to avoid the per-event overhead, instead of the cursor's
+ * callbacks, which are never called. So it can't be stopped at a given event, see ReplayEngine::query.
+ */
+class MemoryWriteScanner : public SegmentHandler
+{
+public:
+	using SegmentHandler::SegmentHandler;
+
+	bool read_next_event() override;
+
+protected:
+	//! Called for each memory write of the segment, in event order.
+	virtual void do_scan_memory_write(std::uint64_t context_id, std::uint64_t address, std::uint64_t size) = 0;
+
+	void do_segment_start(const ReplaySegment& segment, const RegisterFile* registers) override;
+
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId) override
+	{
+		return { nullptr, nullptr };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t, std::uint64_t size) override
+	{
+		return { nullptr, size };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	std::uint64_t end_context_ = 0;
+};
+
+/**
+ * Replays a trace in parallel, cutting it into segments at cache points or known event offsets.
+ *
+ * A cache point gives the full register state at its context and the position of the next event, so the events
+ * between two consecutive cache points can be replayed without reading anything before them. Each segment is replayed
+ * by its own SegmentHandler, on the threads of a ThreadPool.
+ *
+ * The engine itself is immutable once built: it only holds the segment list.
+ */
+class ReplayEngine
+{
+public:
+	//! Create a new handler for a segment. Called from the pool threads.
+	using HandlerFactory = std::function<std::unique_ptr<SegmentHandler>(const ReplaySegment&)>;
+	//! Receive a handler once its segment is replayed. Called from the thread calling @ref replay, in segment order.
+	using HandlerConsumer = std::function<void(const ReplaySegment&, std::unique_ptr<SegmentHandler>&&)>;
+	//! Receive a handler placed at a requested context, see @ref query. Called from the pool threads.
+	using ContextVisitor = std::function<void(std::uint64_t context_id, SegmentHandler& handler)>;
+
+	//! A single segment covering the whole trace, replayed sequentially.
+	explicit ReplayEngine(const TraceFile& trace);
+
+	//! One segment from the start of the trace to the first cache point, then one per cache point.
+	//! Both objects must outlive the engine.
+	ReplayEngine(const TraceFile& trace, const CacheReader& cache);
+
+	//! One segment per entry of `offsets`, see EventBoundaryFinder. Register values are only known for the first
+	//! segment, so this suits handlers that don't need the machine state, such as scanners.
+	ReplayEngine(const TraceFile& trace, const EventOffsetIndex& offsets);
+
+	const std::vector<ReplaySegment>& segments() const { return segments_; }
+
+	const TraceFile& trace() const { return *trace_; }
+
+	/**
+	 * Replay every segment on `pool`, each one with a handler created by `factory`.
+	 *
+	 * If given, `consume` receives the handlers in segment order, as soon as each segment and all the previous ones are
+	 * replayed, while later segments are still running: this is where per-segment results are merged.
+	 *
+	 * Returns once all segments are replayed and consumed. If replaying a segment or consuming it throws, the remaining
+	 * segments are skipped and the first exception is rethrown.
+	 *
+	 * @warning Calling this from a task of `pool` can deadlock.
+	 */
+	void replay(ThreadPool& pool, const HandlerFactory& factory, const HandlerConsumer& consume = nullptr) const;
+
+	/**
+	 * Bring handlers to each context of `context_ids`, replaying each segment at most once.
+	 *
+	 * Contexts are grouped by segment: a handler created by `factory` replays its segment up to the last requested
+	 * context in it, and `visit` is called each time it reaches one, in increasing order. Segments run in parallel on
+	 * `pool`, so `visit` can be called concurrently for contexts of different segments. Duplicate contexts are visited
+	 * once.
+	 *
+	 * Returns once all contexts are visited. If a segment throws, the first exception is rethrown.
+	 * @throws std::out_of_range if a context is after the end of the trace, before replaying anything.
+	 */
+	void query(ThreadPool& pool, std::vector<std::uint64_t> context_ids, const HandlerFactory& factory,
+	           const ContextVisitor& visit) const;
+
+	//! Replay a single segment on the calling thread, and return its handler.
+	std::unique_ptr<SegmentHandler> replay_segment(const ReplaySegment& segment, const HandlerFactory& factory) const;
+
+private:
+	void add_segment(std::uint64_t start_context, std::uint64_t stream_pos, SegmentSeed seed,
+	                 CacheReader::ConstIterator cache_point);
+	//! Create the handler of a segment, placed at its start.
+	std::unique_ptr<SegmentHandler> start_segment(const ReplaySegment& segment, const HandlerFactory& factory) const;
+
+	const TraceFile* trace_;
+	const CacheReader* cache_;
+	std::vector<ReplaySegment> segments_;
+};
+
+}}}}}
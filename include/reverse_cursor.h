@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "trace_cursor.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * A TraceCursor that can also step back, through an undo log of the latest events it read.
+ *
+ * Reading an event records the previous content of the registers and memory it overwrites, in a ring buffer of fixed
+ * size: stepping back costs as much as reading the event, whatever the distance to the closest cache point. The oldest
+ * events are dropped to make room for new ones, so only a bounded window of events can be undone.
+ *
+ * Stepping back restores values through the same callbacks as reading events: do_register_rw_buffers, then
+ * do_memory_before_write and do_memory_after_write, in the reverse order of the event's writes. Event callbacks
+ * (do_event_instruction, do_event_other) are not called.
+ *
+ * Moving the cursor otherwise, such as seeking, invalidates the undo log.
+ */
+class ReverseCursor : public TraceCursor
+{
+public:
+	//! @param undo_log_size size in bytes of the undo log. Events whose writes are larger can't be undone.
+	ReverseCursor(const TraceFile& trace, std::size_t undo_log_size);
+
+	bool read_next_event() override;
+
+	//! Undo the latest event, so that the cursor is placed before it.
+	//! @return false if there is no event to undo in the log.
+	bool step_back();
+
+	//! Number of events that @ref step_back can currently undo.
+	std::size_t undoable_event_count() const { return events_.size(); }
+
+	//! Forget about all events read so far.
+	void clear_undo_log();
+
+private:
+	class Recorder;
+
+	//! An event of the undo log, whose writes are stored at `[offset, offset + size)` of the log.
+	struct Event {
+		std::uint64_t context_id;
+		std::uint64_t stream_pos;
+		std::uint64_t end_stream_pos;
+		std::size_t offset;
+		std::size_t size;
+	};
+
+	//! Copy the current event's writes to the log, dropping the oldest events to make room for it.
+	void commit_event(std::uint64_t context_id, std::uint64_t start_pos);
+
+	static constexpr std::uint8_t register_write = 0;
+	static constexpr std::uint8_t memory_write = 1;
+
+	std::vector<std::uint8_t> log_;
+	//! Where the next event is written in `log_`.
+	std::size_t head_;
+	//! Events of the log, oldest first.
+	std::deque<Event> events_;
+	//! The writes of the event being read, before they are copied to the log.
+	std::vector<std::uint8_t> current_writes_;
+};
+
+}}}}}
@@ -48,6 +48,9 @@ public:
 
 	void read(std::uint8_t* buffer, std::size_t size);
 
+	//! Advance by `size` bytes without reading them.
+	void skip(std::uint64_t size);
+
 	const char* name() const;
 
 private:
@@ -64,4 +67,7 @@ private:
 	std::uint64_t bytes_left_in_stream_buffer_;
 };
 
+//! Whether the resource read by `reader` has a format version of at least `major`.`minor`.
+bool format_version_at_least(binresource::Reader& reader, unsigned major, unsigned minor);
+
 }}}}}
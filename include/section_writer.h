@@ -18,6 +18,9 @@ namespace libbintrace {
 class SectionWriter {
 public:
 	SectionWriter(const char* name, binresource::Writer* writer);
+	//! Start a section whose positions, see @ref bytes_written, start at `first_position` instead of 0, to continue
+	//! the positions of previous sections.
+	SectionWriter(const char* name, binresource::Writer* writer, std::uint64_t first_position);
 
 	std::uint64_t bytes_written() { return bytes_written_; }
 	void finalize();
@@ -76,6 +79,7 @@ private:
 
 	const char* name_;
 	binresource::Writer* writer_;
+	std::uint64_t first_position_;
 	std::uint64_t bytes_written_;
 
 	std::vector<std::uint8_t> stream_buffer_;
@@ -89,6 +93,9 @@ class ExternalSectionTraceWriter
 {
 public:
 	ExternalSectionTraceWriter(binresource::Writer&& writer, const MachineDescription& machine, const char* writer_name);
+	//! Start a section whose positions start at `first_position`, see SectionWriter.
+	ExternalSectionTraceWriter(binresource::Writer&& writer, const MachineDescription& machine, const char* writer_name,
+	                           std::uint64_t first_position);
 	binresource::Writer&& finalize();
 	std::uint64_t stream_pos() { return section_writer_.bytes_written(); }
 
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "replay_engine.h"
+#include "thread_pool.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! What the events of `[start_context, end_context)` wrote, see SegmentSummaries.
+struct SegmentSummary {
+	std::uint64_t start_context;
+	std::uint64_t end_context;
+	//! Every page written, in increasing order.
+	std::vector<std::uint64_t> pages;
+	//! Bloom filter of the cache lines written.
+	std::vector<std::uint64_t> lines_filter;
+};
+
+/**
+ * Summaries of the memory written by each segment of a trace, typically each interval between two cache points.
+ *
+ * Each summary holds the exact set of pages written, and a Bloom filter of the cache lines written. Whether a memory
+ * range may have changed between two contexts is then answered by testing the summaries of the segments in between:
+ * only the candidate segments need to be replayed to know for sure. A write counts as a change, even if it writes the
+ * value the memory already had.
+ *
+ * Summaries are built by scanning a trace with @ref build, or by a writer calling @ref add_segment as it goes. They
+ * are stored in a sidecar file, see index-format.md.
+ */
+class SegmentSummaries
+{
+public:
+	static constexpr std::uint32_t line_size = 64;
+	//! Bits of Bloom filter per cache line written, for about 1% of false positives.
+	static constexpr std::uint32_t filter_bits_per_line = 10;
+	static constexpr std::uint32_t filter_hash_count = 7;
+
+	//! No segments yet, see @ref add_segment.
+	//! @throws std::invalid_argument if `page_size` is not a power of two, or is smaller than a cache line.
+	explicit SegmentSummaries(std::uint32_t page_size);
+
+	//! Summarize each segment of `engine`, scanning them on `pool`. Build `engine` from a cache to get one summary per
+	//! cache point interval.
+	static SegmentSummaries build(const ReplayEngine& engine, ThreadPool& pool, std::uint32_t page_size = 0x1000);
+
+	//! Load summaries written by @ref write.
+	//! @throws IncompatibleTypeException if the file does not contain segment summaries.
+	//! @throws MalformedSection if its page size is invalid, or its segments or pages are not sorted.
+	explicit SegmentSummaries(const std::string& filename);
+	explicit SegmentSummaries(std::unique_ptr<std::istream>&& input_stream);
+
+	void write(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name, const char* tool_version,
+	           const char* tool_info) const;
+
+	//! Summarize the segment `[start_context, end_context)` from its memory writes, as pairs of address and size.
+	//! @throws std::invalid_argument if the segment starts before the end of the previous one.
+	void add_segment(std::uint64_t start_context, std::uint64_t end_context,
+	                 const std::vector<std::pair<std::uint64_t, std::uint64_t>>& writes);
+
+	std::uint32_t page_size() const { return page_size_; }
+	//! In increasing context order.
+	const std::vector<SegmentSummary>& summaries() const { return summaries_; }
+
+	//! Indices of the summaries of the segments whose events may write `[address, address + size)` between
+	//! `first_context` and `last_context`, that is the events `[first_context, last_context)`. Only these segments
+	//! need to be replayed to know what changed.
+	//! @throws std::out_of_range if some events of `[first_context, last_context)` are in no segment, in a gap between
+	//! segments or past the last one.
+	std::vector<std::size_t> candidate_segments(std::uint64_t address, std::uint64_t size, std::uint64_t first_context,
+	                                            std::uint64_t last_context) const;
+
+	//! False if `[address, address + size)` is certainly not written between `first_context` and `last_context`.
+	//! True if some of these events are in no segment, since nothing is known about them.
+	bool may_change(std::uint64_t address, std::uint64_t size, std::uint64_t first_context,
+	                std::uint64_t last_context) const;
+
+	//! Whether `summary` may have written any byte of `[address, address + size)`.
+	bool may_write(const SegmentSummary& summary, std::uint64_t address, std::uint64_t size) const;
+
+private:
+	class Scanner;
+
+	//! Add the candidate segments of @ref candidate_segments to `result`. Returns false if some events are in no
+	//! segment.
+	bool find_candidate_segments(std::uint64_t address, std::uint64_t size, std::uint64_t first_context,
+	                             std::uint64_t last_context, std::vector<std::size_t>& result) const;
+
+	std::uint32_t page_size_;
+	std::vector<SegmentSummary> summaries_;
+};
+
+}}}}}
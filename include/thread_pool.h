@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * A fixed set of worker threads running tasks, with work stealing.
+ *
+ * Each worker has its own task queue. Tasks submitted from a worker go to its own queue and are run last in, first out;
+ * tasks submitted from elsewhere are spread over the queues. An idle worker steals the oldest task of another queue, so
+ * tasks of very different durations still keep every thread busy.
+ */
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+
+	//! Start `thread_count` workers, or one per hardware thread if 0.
+	explicit ThreadPool(std::size_t thread_count = 0);
+
+	//! Finishes all submitted tasks, then stops the workers.
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//! Queue a task. It can be called from any thread, including from a task.
+	void submit(Task task);
+
+	//! Run `task(i)` for every `i` in `[0, count)` on the pool, and block until they are all finished. Unlike @ref wait,
+	//! this only waits for these tasks, so the pool can be shared. If some calls threw, rethrow the first exception.
+	//! @warning Calling this from a task can deadlock.
+	void parallel_for(std::size_t count, const std::function<void(std::size_t)>& task);
+
+	//! Block until every task submitted so far is finished. If some tasks threw, rethrow the first exception.
+	//! @warning Calling this from a task would deadlock.
+	void wait();
+
+	std::size_t thread_count() const { return threads_.size(); }
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void run(std::size_t worker_index);
+	Task take_task(std::size_t worker_index);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::vector<std::thread> threads_;
+	std::atomic<std::size_t> next_worker_;
+
+	std::mutex mutex_;
+	std::condition_variable task_available_;
+	std::condition_variable all_done_;
+	//! Tasks in queues that no worker has claimed yet.
+	std::size_t queued_;
+	//! Tasks submitted and not finished yet.
+	std::size_t pending_;
+	bool stopping_;
+	std::exception_ptr error_;
+};
+
+}}}}}
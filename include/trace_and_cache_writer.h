@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cache_writer.h"
+#include "register_file.h"
+#include "thread_pool.h"
+#include "trace_writer.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+//! What replaying a stretch of events involves.
+struct ReplayWork {
+	std::uint64_t events = 0;
+	//! Size of the events in the trace.
+	std::uint64_t bytes = 0;
+	std::uint64_t memory_writes = 0;
+	//! Register writes, including register operations.
+	std::uint64_t register_writes = 0;
+};
+
+//! Estimate of the time it takes to replay events. The default weights are roughly nanoseconds.
+struct ReplayCostModel {
+	double per_event = 10;
+	double per_byte = 0.5;
+	double per_memory_write = 20;
+	double per_register_write = 5;
+
+	double cost(const ReplayWork& work) const
+	{
+		return per_event * work.events + per_byte * work.bytes + per_memory_write * work.memory_writes +
+		       per_register_write * work.register_writes;
+	}
+};
+
+//! When TraceAndCacheWriter emits cache points. Whichever limit is reached first triggers a cache point.
+struct CachePointInterval {
+	//! Emit a cache point every `events` events, 0 to disable.
+	std::uint64_t events;
+	//! Emit a cache point once `trace_bytes` bytes of events were written since the previous one, 0 to disable.
+	std::uint64_t trace_bytes;
+	//! Emit a cache point once replaying the events since the previous one would cost `max_replay_cost` according to
+	//! `cost_model`, 0 to disable. This bounds the time to reach any context from its closest cache point, whatever
+	//! the events: cache points are denser where events write a lot.
+	double max_replay_cost = 0;
+	ReplayCostModel cost_model;
+};
+
+/**
+ * Writes a trace and its cache together, emitting cache points automatically.
+ *
+ * This object mirrors the machine state as events are written: it keeps a copy of registers and memory regions and
+ * tracks pages changed since the previous cache point in a bitmap, so the caller only has to describe events. Cache
+ * points are emitted after an event, according to a CachePointInterval.
+ *
+ * Copying changed pages to the cache is done by a background thread, while recording continues: a page that is about
+ * to be modified before the background thread copied it is preserved first. Only one cache point is written at a time.
+ *
+ * Memory written outside of the machine's memory regions is traced, but not cached.
+ *
+ * All methods must be called from the same thread.
+ */
+class TraceAndCacheWriter
+{
+public:
+	//! Write the initial sections of the trace right away.
+	//! @param initial_memory the content of each memory region, in machine description order
+	//! @param initial_registers the initial value of all registers of the machine
+	//! @param cache_options encodings of the cache. Its pool, if any, is used from the background thread.
+	//! @param events_options encodings of the events of the trace
+	//! @throws std::logic_error if `initial_registers` does not match the machine's registers.
+	TraceAndCacheWriter(std::unique_ptr<std::ostream>&& trace_stream, std::unique_ptr<std::ostream>&& cache_stream,
+	                    std::uint32_t page_size, const MachineDescription& machine,
+	                    const std::vector<const std::uint8_t*>& initial_memory, const RegisterFile& initial_registers,
+	                    CachePointInterval interval, const CachePointsOptions& cache_options,
+	                    const char* tool_name, const char* tool_version, const char* tool_info,
+	                    const EventsOptions& events_options = EventsOptions());
+
+	//! Waits for the cache point being written, if any. Call @ref finish to get complete files.
+	~TraceAndCacheWriter();
+
+	TraceAndCacheWriter(const TraceAndCacheWriter&) = delete;
+	TraceAndCacheWriter& operator=(const TraceAndCacheWriter&) = delete;
+
+	//! @name Event declaration, see EventsSectionWriter.
+	//! @{
+	void start_event_instruction();
+	void start_event_other(const std::string& description);
+	void write_memory(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size);
+	void write_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size);
+	void write_register_action(RegisterId reg_id);
+	void write_register_set(const std::vector<std::pair<RegisterId, const std::uint8_t*>>& writes);
+	//! Close the event, and emit a cache point if the interval is reached.
+	void finish_event();
+	//! @}
+
+	//! Emit a cache point at the current context, whatever the interval. Does nothing if one was just emitted.
+	void emit_cache_point();
+
+	//! Finish both files. Nothing can be written afterwards.
+	void finish();
+
+	std::uint64_t event_count() const { return events_->event_count(); }
+
+	//! What replaying events since the latest cache point involves.
+	const ReplayWork& replay_work_since_cache_point() const { return replay_work_; }
+
+	//! The current register values.
+	const RegisterFile& registers() const { return registers_; }
+
+private:
+	struct Region {
+		std::uint64_t start;
+		std::vector<std::uint8_t> content;
+		//! Pages fully inside the region are cached. This is the first one's address.
+		std::uint64_t first_page;
+		std::uint64_t page_count;
+		//! Bit of the first page in bitmaps.
+		std::uint64_t first_bit;
+	};
+
+	struct PendingCachePoint {
+		std::uint64_t context_id;
+		std::uint64_t trace_stream_pos;
+		RegisterFile registers;
+		std::vector<std::uint64_t> page_bits;
+		//! Pages modified by the recording thread before the background thread could copy them.
+		std::unordered_map<std::uint64_t, std::vector<std::uint8_t>> preserved_pages;
+	};
+
+	void write_cache_point(PendingCachePoint& cache_point);
+	std::uint64_t page_address(std::uint64_t bit) const;
+
+	TraceWriter trace_writer_;
+	std::unique_ptr<EventsSectionWriter> events_;
+	CacheWriter cache_writer_;
+	std::unique_ptr<CachePointsSectionWriter> cache_points_;
+
+	std::uint32_t page_size_;
+	CachePointInterval interval_;
+	MachineDescription machine_;
+	RegisterFile registers_;
+	std::vector<Region> regions_;
+
+	//! One bit per page, set if it changed since the last cache point.
+	std::vector<std::uint64_t> dirty_pages_;
+
+	std::uint64_t last_cache_point_context_;
+	std::uint64_t last_cache_point_stream_pos_;
+	ReplayWork replay_work_;
+
+	//! Set while the background thread copies pages. When false, the recording thread can skip locking.
+	std::atomic<bool> copying_pages_;
+	//! Protects `pending_pages_` and `pending_`'s preserved pages while copying.
+	std::mutex pages_mutex_;
+	//! One bit per page, set if the page belongs to `pending_` and was not copied yet.
+	std::vector<std::uint64_t> pending_pages_;
+	std::unique_ptr<PendingCachePoint> pending_;
+
+	ThreadPool background_;
+	bool finished_;
+};
+
+}}}}}
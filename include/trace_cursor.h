@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "event_decoder.h"
+#include "event_stream.h"
+#include "trace_file.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * A position in a TraceFile, reading events sequentially from there.
+ *
+ * This works like TraceReader, from which it takes its callbacks, but all the trace-wide data lives in the shared
+ * TraceFile: a cursor only holds a position, so creating or copying one is nearly free. Any number of cursors can read
+ * the same TraceFile, each from its own thread.
+ *
+ * You must inherit from it and implement do_* callbacks, see TraceReader for their documentation.
+ */
+class TraceCursor
+{
+public:
+	//! A cursor placed before the first event, at the initial context.
+	explicit TraceCursor(const TraceFile& trace);
+	virtual ~TraceCursor() = default;
+
+	//! The current position in the events section. Use this information to seek to known locations.
+	std::uint64_t stream_pos() const { return events_.stream_pos(); }
+
+	//! Set the cursor as if context_id was just read, and the events section was now at stream_position.
+	void seek(std::uint64_t context_id, std::uint64_t stream_position);
+
+	//! Will read the next event in the trace. This will cause the user-defined callbacks to be called. Once the
+	//! function returns, the cursor is ready to read the next event.
+	//! Cursors that record events, such as ReverseCursor, override this.
+	virtual bool read_next_event();
+
+	//! Returns the next event to be read, or event being read.
+	std::uint64_t next_event_index() const { return current_event_id_; }
+
+	const TraceFile& trace() const { return *trace_; }
+	const MachineDescription& machine() const { return trace_->machine(); }
+
+	//! The total count of events in the trace.
+	std::uint64_t event_count() const { return trace_->event_count(); }
+
+protected:
+	//! The events read by this cursor, for cursors overriding @ref read_next_event. Once they have read events from
+	//! it, they must @ref seek to its position.
+	EventStream& events() { return events_; }
+
+	//! @name User-defined mandatory callback, see TraceReader
+	//! @{
+	virtual void do_event_instruction() = 0;
+	virtual void do_event_other(const std::string& description) = 0;
+	virtual std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId id) = 0;
+	virtual std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address,
+	                                                                        std::uint64_t size) = 0;
+	virtual void do_memory_after_write(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size) = 0;
+	//! @}
+
+private:
+	friend EventDecoder;
+
+	const TraceFile* trace_;
+	EventStream events_;
+	std::uint64_t current_event_id_;
+};
+
+}}}}}
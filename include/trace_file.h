@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rvnmetadata/metadata-common.h>
+#include <rvnmetadata/metadata-bin.h>
+#include <rvnbinresource/reader.h>
+
+#include "event_block.h"
+#include "event_decoder.h"
+#include "mapped_file.h"
+#include "reader_errors.h"
+#include "register_file.h"
+#include "trace_sections.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * An opened binary trace, shared by any number of TraceCursor objects.
+ * See readme.md for general information, and trace-format.md for a detailed description of the binary format.
+ *
+ * Everything that does not depend on a position in the trace is parsed once here: machine description, decoding tables
+ * and initial registers. The initial memory and events sections are kept in memory, so reading them requires no stream
+ * and no lock.
+ *
+ * Once constructed, this object is immutable and can be used from several threads at once. It must outlive the
+ * cursors created over it.
+ */
+class TraceFile
+{
+public:
+	//! Map the trace file in memory. This costs no copy, whatever the trace size.
+	explicit TraceFile(const std::string& filename);
+
+	//! Load a trace from a stream. The initial memory and events sections are copied in memory, so prefer opening
+	//! large traces from a file name.
+	explicit TraceFile(std::unique_ptr<std::istream>&& input_stream);
+
+	TraceFile(const TraceFile&) = delete;
+	TraceFile& operator=(const TraceFile&) = delete;
+
+	const Header& header() const { return header_; }
+	const MachineDescription& machine() const { return machine_; }
+
+	//! The comprehensive dump of the initial registers values.
+	const RegisterFile& initial_registers() const { return initial_registers_; }
+
+	//! The content of the initial memory region `region_index`, in machine description order. Its size is that of the
+	//! corresponding region.
+	const std::uint8_t* initial_memory_region(std::size_t region_index) const { return memory_regions_.at(region_index); }
+
+	//! The events section, excluding its size and its table of event templates, if any. Offsets in this buffer are the
+	//! stream positions used by cursors and caches.
+	const std::uint8_t* events_section() const { return events_; }
+	std::uint64_t events_section_size() const { return events_size_; }
+
+	//! Stream position of the first event.
+	static constexpr std::uint64_t first_event_stream_pos() { return sizeof(std::uint64_t); }
+
+	//! The blocks of events in the columnar layout, by position. Empty in the interleaved layout.
+	const std::vector<EventBlockEntry>& event_blocks() const { return event_blocks_; }
+
+	//! The total count of events in the trace.
+	std::uint64_t event_count() const { return event_count_; }
+
+	//! Tables used to decode events, built from the machine description and the event templates.
+	const EventDecoder& decoder() const { return decoder_; }
+
+	//! Returns the metadata of the resource
+	metadata::Metadata metadata() const { return metadata::from_raw_metadata(reader_.metadata()); }
+
+private:
+	TraceFile(binresource::Reader&& reader, std::unique_ptr<MappedFile>&& mapping);
+
+	binresource::Reader reader_;
+	std::unique_ptr<MappedFile> mapping_;
+
+	Header header_;
+	MachineDescription machine_;
+	RegisterFile initial_registers_;
+	EventDecoder decoder_;
+
+	//! Section contents when loaded from a stream rather than mapped.
+	std::vector<std::uint8_t> loaded_memory_;
+	std::vector<std::uint8_t> loaded_events_;
+
+	std::vector<const std::uint8_t*> memory_regions_;
+	const std::uint8_t* events_;
+	std::uint64_t events_size_;
+	std::uint64_t event_count_;
+	std::vector<EventBlockEntry> event_blocks_;
+};
+
+}}}}}
@@ -11,8 +11,11 @@
 #include <rvnbinresource/reader.h>
 
 #include "section_reader.h"
+#include "event_block.h"
+#include "event_decoder.h"
 #include "reader_errors.h"
 #include "trace_sections.h"
+#include "register_file.h"
 
 namespace reven {
 namespace backend {
@@ -69,7 +72,7 @@ protected:
 	const std::vector<std::ios::pos_type>& initial_memory_regions_stream_positions() const { return memory_positions_; }
 
 	//! Return the comprehensive dump of the initial registers values.
-	const RegisterContainer& initial_registers() const { return initial_cpu_; }
+	const RegisterFile& initial_registers() const { return initial_cpu_; }
 
 	//! @name User-defined mandatory callback
 	//! @{
@@ -94,12 +97,15 @@ protected:
 	// - first: Valid area, which contains latest known register value. Will be read-only
 	// - second: Valid area where we'll write the new register content. Buffer content will be ignored and overwritten.
 	// Note those two pointers can be identical.
+	// Returning a null write buffer skips the new content, which is faster for handlers ignoring this register.
 	virtual std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId id) = 0;
 
 	//! Must return a buffer to place the new content of physical memory at `address`, of size `size`
-	//! The returned buffer cannot be null, and its size must be <= `size` and > 0.
+	//! The returned size must be <= `size` and > 0.
 	//! If the returned size is less than `size`, we will write what we can into the passed buffer and then call again
 	//! with an updated address, requesting a buffer for what is left.
+	//! If the returned buffer is null, that many bytes of content are skipped instead, and `do_memory_after_write` is
+	//! not called for them.
 	virtual std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address,
 	                                                                            std::uint64_t size) = 0;
 
@@ -118,26 +124,27 @@ protected:
 	//! The trace's stream.
 	binresource::Reader reader_;
 private:
-	void build_quick_access_vectors(const MachineDescription& machine);
-	void process_register_write(SectionReader* reader, RegisterId reg_id);
-	void process_memory_write(SectionReader* reader, std::uint64_t address, std::uint64_t size);
+	friend EventDecoder;
 
 	Header header_;
 	MachineDescription machine_description_;
-	RegisterContainer initial_cpu_;
+	RegisterFile initial_cpu_;
 	std::vector<std::ios::pos_type> memory_positions_;
 
-	//! Quick-access vector for register actions properties stored in machine_description_.
-	//! If Value.first is false, the Key is not associated with any action.
-	std::vector<std::pair<bool, MachineDescription::RegisterOperation>> register_operations_;
-
-	//! Quick-access vector for register properties stored in machine_description_
-	//! If Value.first is false, the Key is not associated with any register.
-	std::vector<std::pair<bool, MachineDescription::Register>> registers_;
+	EventDecoder decoder_;
 
 	std::unique_ptr<SectionReader> events_reader_;
 	std::uint64_t current_event_id_;
 	std::uint64_t event_count_;
+
+	//! @name Columnar layout: the current block is read in memory.
+	//! @{
+	void load_block(std::uint64_t stream_position);
+
+	std::vector<EventBlockEntry> event_blocks_;
+	std::vector<std::uint8_t> block_data_;
+	EventBlock block_;
+	//! @}
 };
 
 }}}}}
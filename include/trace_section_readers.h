@@ -3,6 +3,7 @@
 #include <rvnbinresource/reader.h>
 
 #include "trace_sections.h"
+#include "register_file.h"
 
 namespace reven {
 namespace backend {
@@ -12,6 +13,6 @@ namespace libbintrace {
 
 Header read_trace_header(binresource::Reader& reader);
 MachineDescription read_trace_machine_description(binresource::Reader& reader);
-RegisterContainer read_initial_cpu_context(binresource::Reader& reader, const MachineDescription& machine);
+RegisterFile read_initial_cpu_context(binresource::Reader& reader, const MachineDescription& machine);
 
 }}}}}
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include <rvnbinresource/writer.h>
 
+#include "event_block.h"
+#include "event_templates.h"
 #include "trace_sections.h"
 #include "section_writer.h"
 
@@ -11,6 +20,22 @@ namespace plugins {
 namespace file {
 namespace libbintrace {
 
+//! Encodings of the events section, see trace-format.md.
+struct EventsOptions {
+	//! Write events in the columnar layout: each block of events stores every kind of field in its own column, which
+	//! makes fields of the same kind, such as the successive values of a register, contiguous.
+	bool columnar = false;
+
+	//! Maximum number of events of a block in the columnar layout. Seeking to an event skips the events before it in its
+	//! block, and a block is kept in memory while it is written.
+	std::uint32_t block_event_count = 4096;
+
+	//! Store instruction events of a recurring shape, that is writing the same registers and the same count and sizes
+	//! of memory, as a reference to an event template followed by the values written. A shape becomes a template once
+	//! seen this many times, until the table of templates is full. 0 disables templates.
+	std::uint32_t template_occurrences = 0;
+};
+
 void write_trace_header(binresource::Writer&, const Header& data);
 void write_trace_machine_description(binresource::Writer&, const MachineDescription& data);
 
@@ -41,6 +66,8 @@ private:
 
 	std::ostream::pos_type initial_context_count_stream_pos_;
 	std::uint32_t initial_context_count_;
+	//! Initial values of the registers with an encoding, which the first writes of these registers refer to.
+	std::map<RegisterId, std::vector<std::uint8_t>> encoded_register_values_;
 	void do_finalize() override;
 };
 
@@ -70,13 +97,20 @@ public:
 	//! register twice.
 	//! @note You can interleave these methods with one another.
 	//! @{
-	//! Declare a register write and pass its new value in buffer.
+	//! Declare a register write and pass its new value in buffer. Registers with an encoding in machine description
+	//! are stored relative to their previous value.
 	//! @warning `size` must match the register's size defined in machine description.
 	void write_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size);
 
 	//! Declare a register write by creating a register operation instead of passing the full new value.
 	//! @warning @reg_id must have been defined as a register operation in machine description
 	void write_register_action(RegisterId reg_id);
+
+	//! Declare writes of several registers at once, as pairs of register id and new value, the size of which is that
+	//! of the register. This is stored as a mask of the written registers followed by their values, which is smaller
+	//! and faster to read than separate writes when many registers change, as on context switches.
+	//! @warning Each register can only be written once in a set.
+	void write_register_set(const std::vector<std::pair<RegisterId, const std::uint8_t*>>& writes);
 	//! @}
 
 	//! 4/ Close the opened event.
@@ -90,12 +124,58 @@ public:
 
 	std::uint64_t event_count() const { return event_count_; }
 
+	//! The stream position of the next event, to be given to cache points.
+	std::uint64_t stream_pos();
+
+	EventsSectionWriter(EventsSectionWriter&&);
+	~EventsSectionWriter();
+
 private:
 	friend TraceWriter;
-	EventsSectionWriter(binresource::Writer&& writer, const MachineDescription& machine);
+	//! `initial_values` are the initial values of the registers with an encoding, see InitialRegistersSectionWriter.
+	EventsSectionWriter(binresource::Writer&& writer, const MachineDescription& machine, const EventsOptions& options,
+	                    const std::map<RegisterId, std::vector<std::uint8_t>>& initial_values);
+
+	//! Events of the columnar layout, waiting for their block to be full.
+	struct Block;
 
+	//! Write the placeholder of a diff size.
+	void start_diff();
 	void write_event_diff_size();
 	void continue_on_next_event();
+	//! Count a register write, or a register set, in the current diff.
+	void count_register_write();
+
+	//! @name Write fields of the current diff.
+	//! @{
+	void emit_memory(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size);
+	void emit_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size);
+	void emit_register_action(RegisterId reg_id);
+	//! Write the content of a register write, without its register id.
+	void emit_register_content(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size);
+	//! @}
+
+	//! Apply a register operation to the previous value of its register, if it has an encoding.
+	void apply_register_action(RegisterId reg_id);
+
+	//! An instruction event being declared, while templates are enabled: its shape is only known once finished.
+	struct PendingEvent {
+		EventTemplate shape;
+		std::vector<std::uint64_t> memory_addresses;
+		std::vector<std::uint8_t> memory_contents;
+		std::vector<std::uint8_t> register_contents;
+	};
+
+	//! Write the pending event as a regular one, and go on declaring it as such.
+	void write_pending_event();
+	void write_templated_event(std::size_t template_index);
+	//! Count an occurrence of the shape of the pending event, making it a template if it recurs enough.
+	void learn_template();
+	void write_template_table();
+
+	//! In the columnar layout, write the current block if it is full, and start the next one.
+	void start_block_if_full();
+	void write_block();
 
 	std::uint64_t event_count_;
 	//! Stream position of the total count of events in this trace, to be updated on finish_event()
@@ -107,6 +187,32 @@ private:
 	//! Count of register changes in the current diff.
 	std::uint8_t current_diff_reg_count_;
 
+	//! Slot of each register in register sets.
+	std::map<RegisterId, std::size_t> register_slots_;
+
+	//! A register with an encoding, and its value as last written in events.
+	struct EncodedRegister {
+		MachineDescription::RegisterEncoding encoding;
+		std::vector<std::uint8_t> value;
+	};
+	std::map<RegisterId, EncodedRegister> encoded_registers_;
+
+	EventsOptions options_;
+	//! Null in the interleaved layout.
+	std::unique_ptr<Block> block_;
+	//! Written at the end of the section in the columnar layout.
+	std::vector<EventBlockEntry> block_table_;
+
+	//! Whether the current event is recorded in `pending_` rather than written.
+	bool recording_;
+	PendingEvent pending_;
+	//! Index of each template.
+	std::map<EventTemplate, std::size_t> templates_;
+	//! Written at the end of the section when templates are enabled.
+	std::vector<EventTemplate> template_table_;
+	//! Occurrences of shapes that are not templates yet.
+	std::map<EventTemplate, std::uint32_t> shape_occurrences_;
+
 	void do_finalize() override;
 };
 
@@ -11,14 +11,32 @@ namespace plugins {
 namespace file {
 namespace libbintrace {
 
+//! How the events section is laid out, see trace-format.md.
+enum class EventsLayout : std::uint8_t {
+	//! Each event is written as a whole, one after the other.
+	Interleaved = 0,
+	//! Events are grouped in blocks, each storing every kind of field in its own column.
+	Columnar = 1,
+};
+
 class Header
 {
 public:
 	std::uint8_t compression;
+	EventsLayout events_layout = EventsLayout::Interleaved;
+	//! Whether the events section ends with a table of event templates.
+	bool event_templates = false;
 };
 
 using RegisterId = std::uint16_t;
 
+//! Reserved register id, which introduces a register set instead of a single register write in events. See
+//! trace-format.md.
+constexpr RegisterId register_set_id = 0xffff;
+
+//! Registers stored with an encoding other than MachineDescription::RegisterEncoding::Full cannot be larger than this.
+constexpr std::uint16_t max_encoded_register_size = 64;
+
 class MachineDescription
 {
 public:
@@ -36,6 +54,20 @@ public:
 		RegisterOperatorMax
 	};
 
+	//! How the content of a register write is stored in events. Encodings other than `Full` store the content relative
+	//! to the previous value of the register, as a little-endian integer, without its high bytes when they can be
+	//! deduced.
+	enum class RegisterEncoding {
+		//! The new value.
+		Full = 0,
+		//! The XOR of the new value with the previous one, without its high zero bytes.
+		Xor = 1,
+		//! The new value minus the previous one, without the high bytes which are the sign extension of the lower ones.
+		Delta = 2,
+
+		RegisterEncodingMax
+	};
+
 	struct MemoryRegion {
 		std::uint64_t start;
 		std::uint64_t size;
@@ -65,7 +97,8 @@ public:
 	std::vector<MemoryRegion> memory_regions;
 
 	//! Most recurrent RegisterId should be less than 0xff, because they will be refered to using 1 byte only, reducing
-	//! file size.
+	//! file size. `register_set_id` cannot be used.
+	//! The slot of a register in register sets is its rank in this map.
 	std::map<RegisterId, Register> registers;
 
 	//! Register operations are not mandatory at all, and can apply to any register defined earlier.
@@ -78,6 +111,11 @@ public:
 	//! On X86, those are CPUID values for instance.
 	std::map<std::string, std::vector<std::uint8_t>> static_registers;
 
+	//! Registers which often change in their low bytes only, such as counters and pointers, are smaller stored with an
+	//! encoding relative to their previous value. Registers not listed here are stored in full.
+	//! Encoded registers cannot be larger than `max_encoded_register_size`.
+	std::map<RegisterId, RegisterEncoding> register_encodings;
+
 	std::uint64_t total_physical_size() const {
 		std::uint64_t result = 0;
 		for (const auto& region : memory_regions)
@@ -86,6 +124,4 @@ public:
 	}
 };
 
-using RegisterContainer = std::vector<std::pair<RegisterId, std::vector<std::uint8_t>>>;
-
 }}}}}
@@ -28,8 +28,10 @@ namespace libbintrace {
 class TraceWriter
 {
 public:
+	//! @throws std::invalid_argument if `events_options` asks for empty blocks of events.
 	TraceWriter(std::unique_ptr<std::ostream>&& output_stream, const MachineDescription& machine_description,
-	            const char* tool_name, const char* tool_version, const char* tool_info);
+	            const char* tool_name, const char* tool_version, const char* tool_info,
+	            const EventsOptions& events_options = EventsOptions());
 
 	//! First section to be written: initial memory section.
 	//! Using the created object, you must write the memory content of the regions declared in machine_description.
@@ -57,6 +59,7 @@ protected:
 private:
 	Header header_;
 	MachineDescription machine_;
+	EventsOptions events_options_;
 
 	bool initial_section_written_;
 };
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "event_search.h"
+#include "replay_engine.h"
+#include "thread_pool.h"
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * A set of address ranges, to test memory writes against.
+ *
+ * Ranges are merged into sorted, disjoint ranges. A few of them are compared in turn, more with a binary search.
+ */
+class AddressRanges
+{
+public:
+	//! @param ranges pairs of address and size.
+	explicit AddressRanges(const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges);
+
+	//! Whether `[address, address + size)` overlaps a range of the set.
+	bool overlaps(std::uint64_t address, std::uint64_t size) const;
+
+	//! Disjoint `[start, end)` ranges, in increasing order.
+	const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges() const { return ranges_; }
+
+private:
+	//! Up to this many ranges, comparing each of them is faster than a binary search.
+	static constexpr std::size_t linear_search_size = 8;
+
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges_;
+};
+
+struct WatchpointHit {
+	std::uint64_t event_id;
+	//! The whole memory write overlapping the watched ranges.
+	std::uint64_t address;
+	std::uint64_t size;
+};
+
+/**
+ * Finds all memory writes to a set of address ranges, scanning segments of a ReplayEngine in parallel.
+ *
+ * Only the address and size of memory writes are read from the events section: their content, register contents and
+ * event descriptions are skipped, see EventDecoder::scan_memory_writes. No machine state is kept, so the engine
+ * doesn't need to know register values, and is best built from an EventOffsetIndex.
+ */
+class WatchpointScan
+{
+public:
+	//! Receive a hit. Called from the thread calling @ref run, in event order.
+	using HitConsumer = std::function<void(const WatchpointHit&)>;
+
+	//! `engine` must outlive the scan.
+	//! @param ranges watched ranges, as pairs of address and size.
+	WatchpointScan(const ReplayEngine& engine, const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges);
+
+	//! Scan the whole trace on `pool`. Hits are streamed to `consume` as soon as their segment and all the previous ones
+	//! are scanned.
+	//! @warning Calling this from a task of `pool` can deadlock.
+	SearchStatistics run(ThreadPool& pool, const HitConsumer& consume) const;
+
+private:
+	class Scanner;
+
+	const ReplayEngine& engine_;
+	AddressRanges ranges_;
+};
+
+}}}}}
@@ -0,0 +1,199 @@
+#include <block_codec.h>
+
+#include <cstring>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+// Constraints of the LZ4 block format: the last 5 bytes are always literals, and the last match starts at least 12
+// bytes before the end of the block.
+constexpr std::size_t min_match = 4;
+constexpr std::size_t last_literals = 5;
+constexpr std::size_t match_start_limit = 12;
+constexpr std::size_t max_offset = 0xffff;
+
+constexpr int hash_bits = 12;
+
+std::uint32_t read32(const std::uint8_t* data)
+{
+	std::uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+std::uint32_t hash(std::uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+class BlockOutput
+{
+public:
+	BlockOutput(std::uint8_t* data, std::size_t capacity) : data_(data), capacity_(capacity), size_(0) {}
+
+	bool put(std::uint8_t byte)
+	{
+		if (size_ >= capacity_)
+			return false;
+		data_[size_++] = byte;
+		return true;
+	}
+
+	bool put(const std::uint8_t* buffer, std::size_t size)
+	{
+		if (size > capacity_ - size_)
+			return false;
+		std::memcpy(data_ + size_, buffer, size);
+		size_ += size;
+		return true;
+	}
+
+	//! Write the part of a length that does not fit in the token.
+	bool put_length(std::size_t length)
+	{
+		for (; length >= 0xff; length -= 0xff) {
+			if (not put(0xff))
+				return false;
+		}
+		return put(static_cast<std::uint8_t>(length));
+	}
+
+	std::size_t size() const { return size_; }
+
+private:
+	std::uint8_t* data_;
+	std::size_t capacity_;
+	std::size_t size_;
+};
+
+//! Write literals, followed by a match unless `match_length` is 0.
+bool put_sequence(BlockOutput& output, const std::uint8_t* literals, std::size_t literal_length, std::size_t offset,
+                  std::size_t match_length)
+{
+	auto match_code = match_length == 0 ? 0 : match_length - min_match;
+	auto token = static_cast<std::uint8_t>(((literal_length < 0xf ? literal_length : 0xf) << 4) |
+	                                       (match_code < 0xf ? match_code : 0xf));
+
+	if (not output.put(token))
+		return false;
+	if (literal_length >= 0xf and not output.put_length(literal_length - 0xf))
+		return false;
+	if (not output.put(literals, literal_length))
+		return false;
+	if (match_length == 0)
+		return true;
+
+	if (not output.put(static_cast<std::uint8_t>(offset)) or not output.put(static_cast<std::uint8_t>(offset >> 8)))
+		return false;
+	return match_code < 0xf or output.put_length(match_code - 0xf);
+}
+
+}
+
+std::size_t compress_block(const std::uint8_t* source, std::size_t size, std::uint8_t* destination,
+                           std::size_t capacity)
+{
+	BlockOutput output(destination, capacity);
+	std::size_t anchor = 0;
+
+	if (size > match_start_limit) {
+		// Positions + 1, so that 0 means empty
+		std::uint32_t table[1 << hash_bits] = {};
+		auto match_end_limit = size - last_literals;
+
+		for (std::size_t pos = 0; pos < size - match_start_limit;) {
+			auto value = read32(source + pos);
+			auto& entry = table[hash(value)];
+			std::size_t candidate = entry;
+			entry = static_cast<std::uint32_t>(pos + 1);
+
+			if (candidate == 0 or pos - (candidate - 1) > max_offset or read32(source + candidate - 1) != value) {
+				++pos;
+				continue;
+			}
+
+			auto match = candidate - 1;
+			auto length = min_match;
+			while (pos + length < match_end_limit and source[match + length] == source[pos + length])
+				++length;
+
+			if (not put_sequence(output, source + anchor, pos - anchor, pos - match, length))
+				return 0;
+
+			pos += length;
+			anchor = pos;
+		}
+	}
+
+	if (not put_sequence(output, source + anchor, size - anchor, 0, 0))
+		return 0;
+	return output.size();
+}
+
+bool decompress_block(const std::uint8_t* source, std::size_t compressed_size, std::uint8_t* destination,
+                      std::size_t size)
+{
+	std::size_t in = 0;
+	std::size_t out = 0;
+
+	auto read_length = [&](std::size_t& length) {
+		for (;;) {
+			if (in >= compressed_size)
+				return false;
+			auto byte = source[in++];
+			length += byte;
+			if (byte != 0xff)
+				return true;
+		}
+	};
+
+	while (in < compressed_size) {
+		auto token = source[in++];
+
+		std::size_t literal_length = token >> 4;
+		if (literal_length == 0xf and not read_length(literal_length))
+			return false;
+		if (literal_length > compressed_size - in or literal_length > size - out)
+			return false;
+		std::memcpy(destination + out, source + in, literal_length);
+		in += literal_length;
+		out += literal_length;
+
+		// The last sequence has no match
+		if (in == compressed_size)
+			break;
+
+		if (compressed_size - in < 2)
+			return false;
+		std::size_t offset = source[in] | (source[in + 1] << 8);
+		in += 2;
+		if (offset == 0 or offset > out)
+			return false;
+
+		std::size_t match_length = token & 0xf;
+		if (match_length == 0xf and not read_length(match_length))
+			return false;
+		match_length += min_match;
+		if (match_length > size - out)
+			return false;
+
+		// Matches can overlap the bytes they produce, so copy forward byte by byte in that case.
+		auto match = destination + out - offset;
+		if (offset >= match_length) {
+			std::memcpy(destination + out, match, match_length);
+		} else {
+			for (std::size_t i = 0; i < match_length; ++i)
+				destination[out + i] = match[i];
+		}
+		out += match_length;
+	}
+
+	return out == size;
+}
+
+}}}}}
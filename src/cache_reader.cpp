@@ -1,9 +1,14 @@
 #include <cache_reader.h>
 
-#include <cstdint>
 #include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <vector>
 
 #include <common.h>
+#include <block_codec.h>
+#include <buffer_reader.h>
 #include <cache_section_readers.h>
 #include <reader_errors.h>
 
@@ -13,11 +18,32 @@ namespace plugins {
 namespace file {
 namespace libbintrace {
 
+namespace {
+
+std::unique_ptr<binresource::Reader> open_reader(std::unique_ptr<std::istream>&& input_stream)
+{
+	return std::make_unique<binresource::Reader>(binresource::Reader::open(std::move(input_stream)));
+}
+
+}
+
 CacheReader::CacheReader(std::unique_ptr<std::istream>&& input_stream, const MachineDescription& machine)
-	: reader_(binresource::Reader::open(std::move(input_stream)))
-	, cache_points_reader_(nullptr), machine_(machine)
+	: CacheReader(open_reader(std::move(input_stream)), nullptr, machine)
+{
+}
+
+CacheReader::CacheReader(const std::string& filename, const MachineDescription& machine)
+	: CacheReader(open_reader(std::make_unique<std::ifstream>(filename, std::ios::binary)),
+	              std::make_unique<FilePositionalReader>(filename), machine)
 {
-	if (not reader_.stream())
+}
+
+CacheReader::CacheReader(std::unique_ptr<binresource::Reader>&& reader, std::unique_ptr<PositionalReader>&& input,
+                         const MachineDescription& machine)
+	: reader_(std::move(reader)), input_(std::move(input)), machine_(machine)
+	, registers_layout_(std::make_shared<const RegisterFile::Layout>(machine))
+{
+	if (not reader_->stream())
 		throw UnexpectedEndOfStream("magic");
 
 	if (metadata().type() != metadata::ResourceType::TraceCache) {
@@ -38,56 +64,199 @@ CacheReader::CacheReader(std::unique_ptr<std::istream>&& input_stream, const Mac
 		}
 	}
 
-	header_ = read_cache_header(reader_);
+	header_ = read_cache_header(*reader_);
+
+	SectionReader cache_points_section("cache points", *reader_);
+	cache_points_start_pos_ = cache_points_section.section_stream_pos();
+	cache_points_size_ = cache_points_section.bytes_left();
+	cache_points_sections_.emplace_back(0, cache_points_size_);
+	cache_points_section.seek_to_end();
 
-	auto restore_pos = reader_.stream().tellg();
-	SectionReader skip_cache_points_section("cache points skip", reader_);
-	skip_cache_points_section.seek_to_end();
-	index_ = read_cache_index(reader_);
-	reader_.stream().seekg(restore_pos);
+	auto index = read_cache_index(*reader_);
+	committed_end_pos_ = reader_->stream().tellg();
+	if (format_version_at_least(*reader_, 1, 7))
+		read_appended_sections(index);
+	index_ = std::make_shared<const CacheIndex>(std::move(index));
 
-	cache_points_reader_ = std::make_unique<SectionReader>("cache points", reader_);
+	if (not input_)
+		input_ = std::make_unique<StreamPositionalReader>(reader_->stream());
 }
 
 CacheReader::ConstIterator CacheReader::find_closest(std::uint64_t context_id) const
 {
 	// Do not return the cache point if context_id is an exact match, because the caller does require executing at least
 	// one instruction to get the events right.
-	return index_.cache_points.upper_bound(context_id);
+	return index_->cache_points.upper_bound(context_id);
+}
+
+void CacheReader::read_appended_sections(CacheIndex& index)
+{
+	auto& stream = reader_->stream();
+	stream.seekg(0, std::ios::end);
+	const auto end = static_cast<std::uint64_t>(stream.tellg());
+
+	// Size of the section at `pos`, if it is entirely in the stream.
+	auto complete_section_size = [&stream, end](std::uint64_t pos, std::uint64_t& size) {
+		if (end - pos < sizeof(size))
+			return false;
+		stream.seekg(pos);
+		stream.read(reinterpret_cast<char*>(&size), sizeof(size));
+		return stream and end - pos - sizeof(size) >= size;
+	};
+
+	// An append writes its cache points, then their index, then the commit. Until the commit is complete, the
+	// previous cache is still valid, and whatever follows it is ignored.
+	for (;;) {
+		const auto cache_points_pos = static_cast<std::uint64_t>(committed_end_pos_);
+		std::uint64_t cache_points_size, index_size, commit_size;
+		if (not complete_section_size(cache_points_pos, cache_points_size))
+			break;
+		const auto index_pos = cache_points_pos + sizeof(std::uint64_t) + cache_points_size;
+		if (not complete_section_size(index_pos, index_size))
+			break;
+		const auto commit_pos = index_pos + sizeof(std::uint64_t) + index_size;
+		if (not complete_section_size(commit_pos, commit_size) or commit_size != CacheAppendCommit::size)
+			break;
+
+		stream.seekg(commit_pos);
+		CacheAppendCommit commit;
+		try {
+			commit = read_cache_append_commit(*reader_);
+		} catch (const MalformedSection&) {
+			break;
+		}
+		const auto cache_points_offset =
+			cache_points_pos + sizeof(std::uint64_t) - static_cast<std::uint64_t>(cache_points_start_pos_);
+		if (commit.cache_points_offset != cache_points_offset)
+			break;
+
+		stream.seekg(index_pos);
+		for (auto& cache_point : read_cache_index(*reader_).cache_points) {
+			if (not index.cache_points.insert(std::move(cache_point)).second)
+				throw MalformedSection("cache index", "cache point " + std::to_string(cache_point.first) +
+				                                      " is already in a previous index");
+		}
+		if (index.cache_points.size() != commit.cache_point_count)
+			throw MalformedSection("cache append commit", "cache point count doesn't match the indexes");
+
+		cache_points_size_ = cache_points_offset + cache_points_size;
+		cache_points_sections_.emplace_back(cache_points_offset, cache_points_size_);
+		committed_end_pos_ = commit_pos + sizeof(std::uint64_t) + commit_size;
+	}
+
+	stream.clear();
+	stream.seekg(committed_end_pos_);
 }
 
-RegisterContainer CacheReader::read_cache_point(ConstIterator it)
+void CacheReader::read_cache_points_section(std::uint64_t offset, std::uint8_t* buffer, std::size_t size) const
 {
-	RegisterContainer result;
+	// The last section starting at or before offset, which must contain the whole range.
+	auto section = std::upper_bound(cache_points_sections_.begin(), cache_points_sections_.end(),
+	                                std::make_pair(offset, std::numeric_limits<std::uint64_t>::max()));
+	if (section == cache_points_sections_.begin())
+		throw UnexpectedEndOfSection("cache points");
+	--section;
+	if (offset > section->second or size > section->second - offset)
+		throw UnexpectedEndOfSection("cache points");
+	input_->read_at(static_cast<std::uint64_t>(cache_points_start_pos_) + offset, buffer, size);
+}
+
+RegisterFile CacheReader::read_cache_point(ConstIterator it) const
+{
+	RegisterFile result(registers_layout_);
+
+	// Walk delta cache points back to a full dump, then apply them forward.
+	struct Delta {
+		std::uint64_t offset;
+		std::uint16_t reg_count;
+		std::uint32_t size;
+	};
+	std::vector<Delta> deltas;
+
+	auto offset = it->second.cpu_cache_stream_offset;
+	std::uint16_t reg_count;
+	for (;;) {
+		read_cache_points_section(offset, reinterpret_cast<std::uint8_t*>(&reg_count), sizeof(reg_count));
+		if ((reg_count & delta_cache_point_flag) == 0)
+			break;
 
-	cache_points_reader_->seek(it->second.cpu_cache_stream_offset);
-	auto reg_count = cache_points_reader_->read<std::uint16_t>();
+		std::uint64_t base_offset;
+		std::uint32_t size;
+		read_cache_points_section(offset + sizeof(reg_count), reinterpret_cast<std::uint8_t*>(&base_offset),
+		                          sizeof(base_offset));
+		read_cache_points_section(offset + sizeof(reg_count) + sizeof(base_offset),
+		                          reinterpret_cast<std::uint8_t*>(&size), sizeof(size));
+		// Bases are always written first, which also guarantees the chain ends.
+		if (base_offset >= offset)
+			throw MalformedSection("cache points", "delta cache point with a base stored after it");
 
-	if (machine_.registers.size() != reg_count)
-		throw MalformedSection(cache_points_reader_->name(), "cache point does not contain enough registers");
+		deltas.push_back({ offset + sizeof(reg_count) + sizeof(base_offset) + sizeof(size),
+		                   static_cast<std::uint16_t>(reg_count & ~delta_cache_point_flag), size });
+		offset = base_offset;
+	}
+
+	if (result.register_count() != reg_count)
+		throw MalformedSection("cache points", "cache point does not contain enough registers");
+
+	// A comprehensive dump has a known size, so it can be fetched at once then parsed from memory.
+	std::vector<std::uint8_t> scratch(result.register_count() * 2 * sizeof(std::uint16_t));
+	for (auto reg_id : result.register_ids())
+		scratch.resize(scratch.size() + result.register_size(reg_id));
+	read_cache_points_section(offset + sizeof(reg_count), scratch.data(), scratch.size());
+
+	std::vector<bool> found(registers_layout_->slot_count(), false);
+	read_registers(scratch, reg_count, result, &found);
+
+	for (auto delta = deltas.rbegin(); delta != deltas.rend(); ++delta) {
+		scratch.resize(delta->size);
+		read_cache_points_section(delta->offset, scratch.data(), scratch.size());
+		read_registers(scratch, delta->reg_count, result, nullptr);
+	}
 
+	return result;
+}
+
+void CacheReader::read_registers(const std::vector<std::uint8_t>& buffer, std::uint16_t reg_count,
+                                 RegisterFile& registers, std::vector<bool>* found) const
+{
+	BufferReader cpu_reader("cache points", buffer.data(), buffer.size());
 	for (; reg_count > 0; --reg_count) {
-		auto reg_id = cache_points_reader_->read<std::uint16_t>();
-		auto size = cache_points_reader_->read<std::uint16_t>();
+		auto reg_id = cpu_reader.read<std::uint16_t>();
+		auto size = cpu_reader.read<std::uint16_t>();
 
-		auto found = std::find_if(result.begin(), result.end(),
-		                          [reg_id](const RegisterContainer::value_type& val) { return val.first == reg_id; });
-		if (found != result.end())
-			throw MalformedSection(cache_points_reader_->name(), std::string("Register ") + std::to_string(reg_id) +
+		if (not registers.contains(reg_id))
+			throw MalformedSection(cpu_reader.name(), std::to_string(reg_id) + " is an unknown register id");
+		if (found and (*found)[reg_id])
+			throw MalformedSection(cpu_reader.name(), std::string("Register ") + std::to_string(reg_id) +
 			                                                 " contained twice in cache point");
-		auto reg = machine_.registers.find(reg_id);
-		if (reg == machine_.registers.end())
-			throw MalformedSection(cache_points_reader_->name(), std::to_string(reg_id) + " is an unknown register id");
-		if (reg->second.size != size)
-			throw MalformedSection(cache_points_reader_->name(), std::to_string(reg_id) + "'s size " + std::to_string(size) +
+		if (registers.register_size(reg_id) != size)
+			throw MalformedSection(cpu_reader.name(), std::to_string(reg_id) + "'s size " + std::to_string(size) +
 			                                                 " doesn't match declared " +
-			                                                 std::to_string(reg->second.size));
+			                                                 std::to_string(registers.register_size(reg_id)));
 
-		result.emplace_back(reg_id, size);
-		cache_points_reader_->read(result.back().second.data(), size);
+		if (found)
+			(*found)[reg_id] = true;
+		cpu_reader.read(registers.get(reg_id), size);
 	}
+}
 
-	return result;
+void CacheReader::read_memory_page(const CacheIndex::PageCacheOffsets& page, std::uint8_t* buffer) const
+{
+	if (page.compressed_size == 0) {
+		read_memory_page(page.cache_stream_offset, buffer);
+		return;
+	}
+
+	std::vector<std::uint8_t> compressed(page.compressed_size);
+	read_cache_points_section(page.cache_stream_offset, compressed.data(), compressed.size());
+	if (not decompress_block(compressed.data(), compressed.size(), buffer, header_.page_size))
+		throw MalformedSection("cache points", "page at " + std::to_string(page.page_address) +
+		                                         " cannot be decompressed");
+}
+
+void CacheReader::read_memory_page(std::uint64_t cache_stream_offset, std::uint8_t* buffer) const
+{
+	read_cache_points_section(cache_stream_offset, buffer, header_.page_size);
 }
 
 metadata::Version CacheReader::resource_version()
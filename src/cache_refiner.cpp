@@ -0,0 +1,228 @@
+#include <cache_refiner.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <common.h>
+#include <cache_writer.h>
+#include <trace_cursor.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Replays a gap from its first cache point, keeping only the pages written since then. Their content at the start is
+ * read from the caches, or the initial memory.
+ */
+class CacheRefiner::Replayer : public TraceCursor
+{
+public:
+	Replayer(const TraceFile& trace, const CacheSet& caches, const CacheSet::CachePoint& start)
+	  : TraceCursor(trace), caches_(caches), page_size_(caches.page_size()), start_context_(start.context_id),
+	    scratch_(page_size_)
+	{
+		if (start.cache) {
+			seek(start.context_id, start.trace_stream_pos);
+			registers_ = caches_.read_cache_point(start);
+		} else {
+			registers_ = trace.initial_registers();
+		}
+	}
+
+	//! Write a cache point at the current context, with the pages written since the previous one.
+	void write_cache_point(CachePointsSectionWriter& writer)
+	{
+		writer.start_cache_point(next_event_index(), stream_pos());
+		for (auto reg_id : registers_.register_ids())
+			writer.write_register(reg_id, registers_.get(reg_id), registers_.register_size(reg_id));
+		for (auto page : dirty_pages_)
+			writer.write_memory_page(page, pages_.at(page).data());
+		writer.finish_cache_point();
+		dirty_pages_.clear();
+	}
+
+protected:
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id) override
+	{
+		return { registers_.get(reg_id), registers_.get(reg_id) };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		auto page = address & ~std::uint64_t(page_size_ - 1);
+		size = std::min(size, page + page_size_ - address);
+
+		auto content = load_page(page);
+		if (content == nullptr)
+			return { scratch_.data(), size };
+
+		dirty_pages_.insert(page);
+		return { content + (address - page), size };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	//! The content of a page, loaded as it was at the start if needed. Null if the page isn't cached, because it is
+	//! not fully inside a memory region.
+	std::uint8_t* load_page(std::uint64_t page)
+	{
+		auto it = pages_.find(page);
+		if (it != pages_.end())
+			return it->second.data();
+
+		const auto& regions = machine().memory_regions;
+		auto region = std::find_if(regions.begin(), regions.end(), [this, page](const MemoryRegion& region) {
+			return page >= region.start and page + page_size_ <= region.start + region.size;
+		});
+		if (region == regions.end())
+			return nullptr;
+
+		auto& content = pages_[page];
+		content.resize(page_size_);
+
+		if (not caches_.read_memory_page(page, start_context_, content.data())) {
+			std::memcpy(content.data(),
+			            trace().initial_memory_region(region - regions.begin()) + (page - region->start), page_size_);
+		}
+		return content.data();
+	}
+
+	using MemoryRegion = MachineDescription::MemoryRegion;
+
+	const CacheSet& caches_;
+	std::uint32_t page_size_;
+	std::uint64_t start_context_;
+
+	RegisterFile registers_;
+	std::unordered_map<std::uint64_t, std::vector<std::uint8_t>> pages_;
+	//! Pages written since the previous cache point, in ascending order.
+	std::set<std::uint64_t> dirty_pages_;
+	//! Destination of writes outside of cached pages.
+	std::vector<std::uint8_t> scratch_;
+};
+
+CacheRefiner::CacheRefiner(const TraceFile& trace, std::shared_ptr<const CacheReader> cache,
+                           std::string secondary_filename, const RefinementPolicy& policy)
+  : trace_(trace)
+  , cache_(std::move(cache))
+  , secondary_filename_(std::move(secondary_filename))
+  , policy_(policy)
+  , cache_set_(trace.machine())
+{
+	cache_set_.add(cache_);
+
+	auto caches = std::make_shared<CacheSet>(cache_set_);
+	if (std::ifstream(secondary_filename_, std::ios::binary)) {
+		secondary_ = std::make_shared<const CacheReader>(secondary_filename_, trace_.machine());
+		caches->add(secondary_);
+	}
+	caches_ = std::move(caches);
+}
+
+std::shared_ptr<const CacheSet> CacheRefiner::caches() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return caches_;
+}
+
+void CacheRefiner::record_seek(std::uint64_t context_id, double cost)
+{
+	auto start = caches()->find_closest(context_id + 1).context_id;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto& gap = gaps_[start];
+	++gap.seeks;
+	gap.total_cost += cost;
+	gap.total_events += context_id - start;
+}
+
+std::shared_ptr<const CacheReader> CacheRefiner::secondary() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return secondary_;
+}
+
+std::uint64_t CacheRefiner::refine()
+{
+	std::lock_guard<std::mutex> refine_lock(refine_mutex_);
+
+	// Where to add cache points, by gap start
+	std::map<std::uint64_t, std::uint64_t> spacings;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto& gap : gaps_) {
+			if (gap.second.seeks < policy_.min_seeks or gap.second.total_cost < policy_.min_total_cost or
+			    gap.second.total_events == 0)
+				continue;
+			auto cost_per_event = gap.second.total_cost / gap.second.total_events;
+			spacings[gap.first] =
+			  std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::floor(policy_.target_cost / cost_per_event)));
+		}
+	}
+	if (spacings.empty())
+		return 0;
+
+	auto caches = this->caches();
+	auto secondary = this->secondary();
+	// A new secondary cache is written aside, so that a file at `secondary_filename_` is always complete.
+	auto filename = secondary ? secondary_filename_ : secondary_filename_ + ".new";
+
+	std::uint64_t added = 0;
+	try {
+		auto writer = secondary ? CacheWriter::open_for_append(filename, trace_.machine())
+		                        : CacheWriter(std::make_unique<std::ofstream>(filename, std::ios::binary),
+		                                      cache_->header().page_size, trace_.machine(), "CacheRefiner",
+		                                      writer_version, "refined cache");
+		auto cache_points = writer.start_cache_points_section();
+
+		for (const auto& spacing : spacings) {
+			auto start = caches->find_closest(spacing.first + 1);
+			auto end = caches->find_next(spacing.first, trace_.event_count());
+
+			Replayer replayer(trace_, *caches, start);
+			for (auto context_id = start.context_id + spacing.second; context_id < end;
+			     context_id += spacing.second) {
+				while (replayer.next_event_index() < context_id)
+					replayer.read_next_event();
+				replayer.write_cache_point(cache_points);
+				++added;
+			}
+		}
+
+		writer.finish_cache_points_section(std::move(cache_points));
+	} catch (...) {
+		if (not secondary)
+			std::remove(filename.c_str());
+		throw;
+	}
+	if (not secondary and std::rename(filename.c_str(), secondary_filename_.c_str()) != 0) {
+		std::remove(filename.c_str());
+		throw UnexpectedStreamError("cache index");
+	}
+
+	auto refined = std::make_shared<const CacheReader>(secondary_filename_, trace_.machine());
+	auto refined_caches = std::make_shared<CacheSet>(cache_set_);
+	refined_caches->add(refined);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	secondary_ = std::move(refined);
+	caches_ = std::move(refined_caches);
+	for (const auto& spacing : spacings)
+		gaps_.erase(spacing.first);
+	return added;
+}
+
+}}}}}
@@ -31,10 +31,16 @@ CacheIndex read_cache_index(binresource::Reader& reader)
 		offsets.trace_stream_offset = section_reader.read<std::uint64_t>();
 		offsets.cpu_cache_stream_offset = section_reader.read<std::uint64_t>();
 
-		for (std::size_t count = section_reader.read<std::uint32_t>(); count > 0; --count) {
+		auto page_count = section_reader.read<std::uint32_t>();
+		bool compressed = (page_count & CacheIndex::compressed_pages_flag) != 0;
+		page_count &= ~CacheIndex::compressed_pages_flag;
+
+		for (; page_count > 0; --page_count) {
 			CacheIndex::PageCacheOffsets page;
 			page.page_address = section_reader.read<std::uint64_t>();
 			page.cache_stream_offset = section_reader.read<std::uint64_t>();
+			if (compressed)
+				page.compressed_size = section_reader.read<std::uint32_t>();
 			offsets.page_offsets.push_back(page);
 		}
 
@@ -45,4 +51,18 @@ CacheIndex read_cache_index(binresource::Reader& reader)
 	return data;
 }
 
+CacheAppendCommit read_cache_append_commit(binresource::Reader& reader)
+{
+	SectionReader section_reader("cache append commit", reader);
+	CacheAppendCommit data;
+
+	if (section_reader.read<std::uint64_t>() != CacheAppendCommit::magic)
+		throw MalformedSection(section_reader.name(), "Wrong magic");
+	data.cache_points_offset = section_reader.read<std::uint64_t>();
+	data.cache_point_count = section_reader.read<std::uint64_t>();
+
+	section_reader.seek_to_end();
+	return data;
+}
+
 }}}}}
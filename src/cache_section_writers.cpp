@@ -1,5 +1,14 @@
 #include <cache_section_writers.h>
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <block_codec.h>
+
 #include <writer_errors.h>
 
 namespace reven {
@@ -8,6 +17,17 @@ namespace plugins {
 namespace file {
 namespace libbintrace {
 
+namespace {
+
+ContentHash random_hash_key()
+{
+	std::random_device random;
+	std::uniform_int_distribution<std::uint64_t> distribution;
+	return { distribution(random), distribution(random) };
+}
+
+}
+
 void write_cache_header(binresource::Writer& writer, const CacheHeader& data)
 {
 	SectionWriter section_writer("cache header", &writer);
@@ -26,24 +46,89 @@ void write_cache_index(binresource::Writer& writer, const CacheIndex& data)
 		section_writer.write<std::uint64_t>(cache_point.first);
 		section_writer.write<std::uint64_t>(cache_point.second.trace_stream_offset);
 		section_writer.write<std::uint64_t>(cache_point.second.cpu_cache_stream_offset);
-		section_writer.write<std::uint32_t>(cache_point.second.page_offsets.size());
-		for (const auto& page : cache_point.second.page_offsets) {
+
+		// Compressed sizes are only written for cache points having compressed pages, flagged in the page count.
+		const auto& pages = cache_point.second.page_offsets;
+		bool compressed = std::any_of(pages.begin(), pages.end(), [](const CacheIndex::PageCacheOffsets& page) {
+			return page.compressed_size != 0;
+		});
+		std::uint32_t page_count = pages.size();
+		if (compressed)
+			page_count |= CacheIndex::compressed_pages_flag;
+		section_writer.write<std::uint32_t>(page_count);
+		for (const auto& page : pages) {
 			section_writer.write<std::uint64_t>(page.page_address);
 			section_writer.write<std::uint64_t>(page.cache_stream_offset);
+			if (compressed)
+				section_writer.write<std::uint32_t>(page.compressed_size);
 		}
 	}
 
 	section_writer.finalize();
 }
 
+constexpr std::uint64_t CacheAppendCommit::magic;
+constexpr std::uint64_t CacheAppendCommit::size;
+
+void write_cache_append_commit(binresource::Writer& writer, const CacheAppendCommit& data)
+{
+	SectionWriter section_writer("cache append commit", &writer);
+
+	section_writer.write<std::uint64_t>(CacheAppendCommit::magic);
+	section_writer.write<std::uint64_t>(data.cache_points_offset);
+	section_writer.write<std::uint64_t>(data.cache_point_count);
+
+	section_writer.finalize();
+}
+
 CachePointsSectionWriter::CachePointsSectionWriter(binresource::Writer&& writer, std::uint32_t page_size,
-                                     const MachineDescription& machine)
+                                     const MachineDescription& machine, const CachePointsOptions& options)
   : ExternalSectionTraceWriter(std::move(writer), machine, "cache points")
   , page_size_(page_size)
   , cache_point_started_(false)
+  , options_(options)
+  , previous_registers_(machine)
+  , previous_cpu_offset_(0)
+  , cache_points_since_keyframe_(0)
+  , keyframe_count_(0)
+  , current_is_delta_(false)
+  , current_written_reg_count_(0)
+  , current_written_registers_(machine.registers.empty() ? 0 : machine.registers.rbegin()->first + 1u, false)
+  , current_reg_list_size_pos_(0)
+  , current_reg_list_size_(0)
+  , hash_key_(random_hash_key())
+  , page_count_(0)
+  , stored_page_count_(0)
+  , stored_page_bytes_(0)
 {
 }
 
+CachePointsSectionWriter::CachePointsSectionWriter(binresource::Writer&& writer, std::uint32_t page_size,
+                                     const MachineDescription& machine, const CachePointsOptions& options,
+                                     const CacheIndex& existing_index, std::uint64_t first_position)
+  : ExternalSectionTraceWriter(std::move(writer), machine, "cache points", first_position)
+  , index_(existing_index)
+  , page_size_(page_size)
+  , cache_point_started_(false)
+  , options_(options)
+  , previous_registers_(machine)
+  , previous_cpu_offset_(0)
+  , cache_points_since_keyframe_(0)
+  , keyframe_count_(0)
+  , current_is_delta_(false)
+  , current_written_reg_count_(0)
+  , current_written_registers_(machine.registers.empty() ? 0 : machine.registers.rbegin()->first + 1u, false)
+  , current_reg_list_size_pos_(0)
+  , current_reg_list_size_(0)
+  , hash_key_(random_hash_key())
+  , page_count_(0)
+  , stored_page_count_(0)
+  , stored_page_bytes_(0)
+{
+	// Existing pages are not hashed again: deduplication only applies among appended pages, and the first appended
+	// cache point is a full register dump as keyframe_count_ is 0.
+}
+
 void CachePointsSectionWriter::start_cache_point(std::uint64_t context_id, std::uint64_t trace_stream_pos)
 {
 	if (cache_point_started_)
@@ -56,9 +141,28 @@ void CachePointsSectionWriter::start_cache_point(std::uint64_t context_id, std::
 	    .emplace(std::make_pair(context_id, CacheIndex::CacheOffsets{ trace_stream_pos, stream_pos(), {} }))
 	    .first;
 
+	// The first cache point and every keyframe_interval-th one after a keyframe store all registers.
+	current_is_delta_ = options_.register_keyframe_interval != 0 and keyframe_count_ != 0 and
+	                    cache_points_since_keyframe_ + 1 < options_.register_keyframe_interval;
+	if (current_is_delta_) {
+		++cache_points_since_keyframe_;
+	} else {
+		cache_points_since_keyframe_ = 0;
+		++keyframe_count_;
+	}
+
 	current_reg_count_pos_ = stream_pos();
 	section_writer_.write<std::uint16_t>(0u);
+	if (current_is_delta_) {
+		section_writer_.write<std::uint64_t>(previous_cpu_offset_);
+		current_reg_list_size_pos_ = stream_pos();
+		section_writer_.write<std::uint32_t>(0u);
+	}
+	previous_cpu_offset_ = current_reg_count_pos_;
 	current_reg_count_ = 0;
+	current_written_reg_count_ = 0;
+	current_written_registers_.assign(current_written_registers_.size(), false);
+	current_reg_list_size_ = 0;
 	cache_point_started_= true;
 }
 
@@ -66,7 +170,7 @@ void CachePointsSectionWriter::write_register(RegisterId reg_id, const std::uint
 {
 	if (not cache_point_started_)
 		throw std::logic_error("Called write_register before start_cache_point.");
-	if (current_cache_offsets_->second.page_offsets.size() != 0)
+	if (current_cache_offsets_->second.page_offsets.size() != 0 or not pending_pages_.empty())
 		throw std::logic_error("Called write_register after write_memory.");
 	auto reg = machine_.registers.find(reg_id);
 	if (reg == machine_.registers.end())
@@ -76,9 +180,22 @@ void CachePointsSectionWriter::write_register(RegisterId reg_id, const std::uint
 		                                              std::to_string(reg->second.size) + ", not " +
 		                                              std::to_string(size));
 
+	if (current_written_registers_[reg_id])
+		throw NonsenseValue(section_writer_.name(),
+		                    std::to_string(reg_id) + " is already written in this cache point");
+	current_written_registers_[reg_id] = true;
+	++current_written_reg_count_;
+	if (options_.register_keyframe_interval != 0) {
+		auto previous = previous_registers_.get(reg_id);
+		if (current_is_delta_ and std::memcmp(previous, buffer, size) == 0)
+			return;
+		std::memcpy(previous, buffer, size);
+	}
+
 	section_writer_.write<std::uint16_t>(reg_id);
 	section_writer_.write_sized_buffer<std::uint16_t>(buffer, size);
 	++current_reg_count_;
+	current_reg_list_size_ += 2 * sizeof(std::uint16_t) + size;
 }
 
 void CachePointsSectionWriter::write_memory_page(std::uint64_t address, const std::uint8_t* buffer)
@@ -99,15 +216,105 @@ void CachePointsSectionWriter::write_memory_page(std::uint64_t address, const st
 	if (not found)
 		throw NonsenseValue(section_writer_.name(), std::to_string(address) + " is outside of known memory regions");
 
-	current_cache_offsets_->second.page_offsets.push_back({ address, stream_pos() });
-	section_writer_.write_buffer(buffer, page_size_);
+	++page_count_;
+
+	if (options_.compress_pages) {
+		pending_pages_.push_back({ address, std::vector<std::uint8_t>(buffer, buffer + page_size_), {}, {}, true });
+		return;
+	}
+
+	if (options_.deduplicate_pages) {
+		auto hash = options_.hash_page(buffer, page_size_, hash_key_);
+		store_page(address, buffer, 0, &hash);
+	} else {
+		store_page(address, buffer, 0, nullptr);
+	}
+}
+
+void CachePointsSectionWriter::store_page(std::uint64_t address, const std::uint8_t* buffer,
+                                          std::uint32_t compressed_size, const ContentHash* hash)
+{
+	auto& pages = current_cache_offsets_->second.page_offsets;
+	auto size = compressed_size != 0 ? compressed_size : page_size_;
+
+	if (hash) {
+		auto stored = stored_pages_.emplace(*hash, CacheIndex::PageCacheOffsets{ address, stream_pos(),
+		                                                                         compressed_size });
+		if (not stored.second) {
+			const auto& offsets = stored.first->second;
+			pages.push_back({ address, offsets.cache_stream_offset, offsets.compressed_size });
+			return;
+		}
+	}
+
+	pages.push_back({ address, stream_pos(), compressed_size });
+	section_writer_.write_buffer(buffer, size);
+	++stored_page_count_;
+	stored_page_bytes_ += size;
+}
+
+void CachePointsSectionWriter::for_each_pending_page(const std::function<void(PendingPage&)>& function)
+{
+	if (options_.pool) {
+		options_.pool->parallel_for(pending_pages_.size(), [this, &function](std::size_t i) {
+			function(pending_pages_[i]);
+		});
+	} else {
+		for (auto& page : pending_pages_)
+			function(page);
+	}
+}
+
+void CachePointsSectionWriter::store_pending_pages()
+{
+	if (options_.deduplicate_pages) {
+		for_each_pending_page([this](PendingPage& page) {
+			page.hash = options_.hash_page(page.content.data(), page_size_, hash_key_);
+		});
+
+		// Don't compress pages that will not be stored
+		std::unordered_set<ContentHash, ContentHash::Hasher> batch;
+		for (auto& page : pending_pages_)
+			page.needs_compression = batch.insert(page.hash).second and stored_pages_.count(page.hash) == 0;
+	}
+
+	for_each_pending_page([this](PendingPage& page) {
+		if (not page.needs_compression)
+			return;
+		page.compressed.resize(page_size_);
+		page.compressed.resize(compress_block(page.content.data(), page_size_, page.compressed.data(), page_size_ - 1));
+	});
+
+	for (const auto& page : pending_pages_) {
+		auto hash = options_.deduplicate_pages ? &page.hash : nullptr;
+		if (page.compressed.empty())
+			store_page(page.address, page.content.data(), 0, hash);
+		else
+			store_page(page.address, page.compressed.data(), static_cast<std::uint32_t>(page.compressed.size()), hash);
+	}
+
+	pending_pages_.clear();
 }
 
 void CachePointsSectionWriter::finish_cache_point()
 {
 	if (not cache_point_started_)
 		throw std::logic_error("Called finish_cache_point before start_cache_point.");
-	write_at_position<std::uint16_t>(current_reg_count_, current_reg_count_pos_);
+	// Readers need every register in full dumps, and delta cache points are only correct if every register was
+	// compared.
+	if (current_written_reg_count_ != machine_.registers.size())
+		throw MissingData(section_writer_.name(),
+		                  std::to_string(machine_.registers.size() - current_written_reg_count_) +
+		                    " registers are not written in cache point");
+	if (not pending_pages_.empty())
+		store_pending_pages();
+	if (current_is_delta_) {
+		// The most significant bit of the register count marks delta cache points
+		write_at_position<std::uint16_t>(current_reg_count_ | 0x8000, current_reg_count_pos_);
+		write_at_position<std::uint32_t>(current_reg_list_size_, current_reg_list_size_pos_);
+	} else {
+		write_at_position<std::uint16_t>(current_reg_count_, current_reg_count_pos_);
+	}
 	cache_point_started_ = false;
 	current_cache_offsets_ = index_.cache_points.end();
 }
@@ -0,0 +1,101 @@
+#include <cache_set.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include <trace_file.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+CacheSet::CacheSet(const MachineDescription& machine)
+  : machine_(machine), registers_layout_(std::make_shared<const RegisterFile::Layout>(machine)), page_size_(0)
+{
+}
+
+void CacheSet::add(const std::string& filename)
+{
+	add(std::make_shared<const CacheReader>(filename, machine_));
+}
+
+void CacheSet::add(std::unique_ptr<std::istream>&& input_stream)
+{
+	add(std::make_shared<const CacheReader>(std::move(input_stream), machine_));
+}
+
+void CacheSet::add(std::shared_ptr<const CacheReader> cache)
+{
+	if (RegisterFile::Layout(cache->machine()) != *registers_layout_)
+		throw std::invalid_argument("The cache doesn't have the registers of the cache set's machine");
+	if (not layers_.empty() and cache->header().page_size != page_size_)
+		throw std::invalid_argument("The cache doesn't have the page size of the other caches of the set");
+
+	auto pages = std::make_shared<PageVersions>();
+	for (const auto& cache_point : cache->index().cache_points) {
+		for (const auto& page : cache_point.second.page_offsets)
+			(*pages)[page.page_address].emplace(cache_point.first, page);
+	}
+
+	page_size_ = cache->header().page_size;
+	layers_.push_back(std::move(cache));
+	layer_pages_.push_back(std::move(pages));
+}
+
+CacheSet::CachePoint CacheSet::find_closest(std::uint64_t context_id) const
+{
+	CachePoint closest{ nullptr, {}, 0, TraceFile::first_event_stream_pos() };
+	for (const auto& cache : layers_) {
+		auto it = cache->find_closest(context_id);
+		if (it != cache->none() and (not closest.cache or it->first > closest.context_id))
+			closest = CachePoint{ cache, it, it->first, it->second.trace_stream_offset };
+	}
+	return closest;
+}
+
+std::uint64_t CacheSet::find_next(std::uint64_t context_id, std::uint64_t end) const
+{
+	for (const auto& cache : layers_) {
+		// The index is sorted by decreasing context: the entry before the closest one is the next cache point.
+		const auto& cache_points = cache->index().cache_points;
+		auto it = cache_points.lower_bound(context_id);
+		if (it != cache_points.begin())
+			end = std::min(end, std::prev(it)->first);
+	}
+	return end;
+}
+
+RegisterFile CacheSet::read_cache_point(const CachePoint& cache_point) const
+{
+	return cache_point.cache->read_cache_point(cache_point.it);
+}
+
+bool CacheSet::read_memory_page(std::uint64_t page_address, std::uint64_t context_id, std::uint8_t* buffer) const
+{
+	const CacheReader* latest_cache = nullptr;
+	const CacheIndex::PageCacheOffsets* latest = nullptr;
+	std::uint64_t latest_context = 0;
+
+	for (std::size_t i = 0; i < layers_.size(); ++i) {
+		auto versions = layer_pages_[i]->find(page_address);
+		if (versions == layer_pages_[i]->end())
+			continue;
+		auto version = versions->second.lower_bound(context_id);
+		if (version != versions->second.end() and (latest == nullptr or version->first > latest_context)) {
+			latest_cache = layers_[i].get();
+			latest = &version->second;
+			latest_context = version->first;
+		}
+	}
+
+	if (latest == nullptr)
+		return false;
+
+	latest_cache->read_memory_page(*latest, buffer);
+	return true;
+}
+
+}}}}}
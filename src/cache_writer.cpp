@@ -1,15 +1,24 @@
 #include <cache_writer.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <utility>
 #include <set>
 #include <cassert>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
 
 #include <rvnmetadata/metadata-common.h>
 #include <rvnmetadata/metadata-bin.h>
 
 #include <common.h>
+#include <cache_reader.h>
 #include <cache_section_writers.h>
+#include <section_writer.h>
+#include <reader_errors.h>
 
 namespace reven {
 namespace backend {
@@ -36,22 +45,158 @@ CacheWriter::CacheWriter(std::unique_ptr<std::ostream>&& output_stream, std::uin
     	return binresource::Writer::create(std::move(output_stream), metadata::to_bin_raw_metadata(md));
     }())
   , machine_(machine_description)
+  , first_position_(0)
 {
 	header_.page_size = page_size;
 
 	write_cache_header(writer_, header_);
 }
 
-CachePointsSectionWriter CacheWriter::start_cache_points_section()
+CacheWriter::CacheWriter(binresource::Writer&& writer, const CacheHeader& header,
+                         const MachineDescription& machine_description,
+                         std::shared_ptr<const CacheIndex> existing_index, std::uint64_t first_position)
+  : writer_(std::move(writer))
+  , header_(header)
+  , machine_(machine_description)
+  , existing_index_(std::move(existing_index))
+  , first_position_(first_position)
+{
+}
+
+CacheWriter CacheWriter::open_for_append(const std::string& filename, const MachineDescription& machine_description)
+{
+	// Checks the type and version, and finds the end of the last finished append.
+	const CacheReader cache(filename, machine_description);
+	const auto existing_md = cache.metadata();
+	const auto existing_md_size = [&filename]() {
+		auto reader = binresource::Reader::open(std::make_unique<std::ifstream>(filename, std::ios::binary));
+		return static_cast<std::uint64_t>(reader.stream().tellg());
+	}();
+
+	// Cache points may use encodings of the current version, so the metadata is written again with it. It is
+	// rewritten in place, so it must keep its size.
+	const auto md = metadata::to_bin_raw_metadata(Meta(
+		MetaType::TraceCache,
+		MetaVersion::from_string(format_version),
+		existing_md.tool_name(),
+		existing_md.tool_version(),
+		existing_md.tool_info()
+	));
+	auto md_stream = std::make_unique<std::ostringstream>();
+	auto md_size = static_cast<std::uint64_t>(binresource::Writer::create(std::move(md_stream), md).stream().tellp());
+	if (md_size != existing_md_size)
+		throw IncompatibleVersionException(("Can't append to version " + existing_md.format_version().to_string() +
+		                                    ": metadata can't be updated in place").c_str());
+
+	// Drop an unfinished append, if any
+	const auto end = static_cast<std::uint64_t>(cache.committed_end_pos());
+	if (::truncate(filename.c_str(), static_cast<off_t>(end)) != 0)
+		throw UnexpectedStreamError("cache points");
+
+	auto stream = std::make_unique<std::fstream>(filename, std::ios::binary | std::ios::in | std::ios::out);
+	if (not *stream)
+		throw UnexpectedStreamError("metadata");
+	auto writer = binresource::Writer::create(std::move(stream), md);
+	writer.stream().seekp(end);
+	if (not writer.stream())
+		throw UnexpectedStreamError("cache points");
+
+	// Offsets in every cache points section are relative to the first one.
+	auto first_position =
+	  end + sizeof(std::uint64_t) - static_cast<std::uint64_t>(cache.cache_points_section_start_pos());
+	return CacheWriter(std::move(writer), cache.header(), machine_description, cache.shared_index(), first_position);
+}
+
+void CacheWriter::compact(const std::string& filename, const MachineDescription& machine_description)
 {
-	return CachePointsSectionWriter(std::move(writer_), header().page_size, machine_);
+	const CacheReader cache(filename, machine_description);
+	const auto existing_md = cache.metadata();
+
+	auto compact_filename = filename + ".compact";
+	try {
+		auto stream = std::make_unique<std::ofstream>(compact_filename, std::ios::binary | std::ios::trunc);
+		if (not *stream)
+			throw UnexpectedStreamError("metadata");
+		auto writer = binresource::Writer::create(std::move(stream), metadata::to_bin_raw_metadata(Meta(
+			MetaType::TraceCache,
+			MetaVersion::from_string(format_version),
+			existing_md.tool_name(),
+			existing_md.tool_version(),
+			existing_md.tool_info()
+		)));
+		write_cache_header(writer, cache.header());
+
+		// Cache points refer to each other by offset, so appended sections are copied as is in a single one, with the
+		// indexes and commits between them.
+		std::ifstream original(filename, std::ios::binary);
+		original.seekg(cache.cache_points_section_start_pos());
+		SectionWriter section_writer("cache points", &writer);
+		std::vector<std::uint8_t> buffer(1 << 20);
+		for (auto copy_size = cache.cache_points_section_size(); copy_size > 0;) {
+			auto size = static_cast<std::size_t>(std::min<std::uint64_t>(copy_size, buffer.size()));
+			original.read(reinterpret_cast<char*>(buffer.data()), size);
+			if (not original)
+				throw UnexpectedEndOfStream("cache points");
+			section_writer.write_buffer(buffer.data(), size);
+			copy_size -= size;
+		}
+		section_writer.finalize();
+
+		write_cache_index(writer, cache.index());
+		writer.stream().flush();
+		if (not writer.stream())
+			throw UnexpectedStreamError("cache index");
+	} catch (...) {
+		std::remove(compact_filename.c_str());
+		throw;
+	}
+
+	if (std::rename(compact_filename.c_str(), filename.c_str()) != 0) {
+		std::remove(compact_filename.c_str());
+		throw UnexpectedStreamError("cache index");
+	}
+}
+
+CachePointsSectionWriter CacheWriter::start_cache_points_section(const CachePointsOptions& options)
+{
+	if (existing_index_)
+		return CachePointsSectionWriter(std::move(writer_), header().page_size, machine_, options, *existing_index_,
+		                                first_position_);
+	return CachePointsSectionWriter(std::move(writer_), header().page_size, machine_, options);
 }
 
 void CacheWriter::finish_cache_points_section(CachePointsSectionWriter&& writer)
 {
-	const auto& index = writer.index();
+	if (not existing_index_) {
+		const auto& index = writer.index();
+		writer_ = std::move(writer.finalize());
+		write_cache_index(writer_, index);
+		writer_.stream().flush();
+		if (not writer_.stream())
+			throw UnexpectedStreamError("cache index");
+		return;
+	}
+
+	// The appended index only lists the appended cache points, readers merge it with the previous ones.
+	CacheIndex index;
+	for (const auto& cache_point : writer.index().cache_points) {
+		if (existing_index_->cache_points.find(cache_point.first) == existing_index_->cache_points.end())
+			index.cache_points.insert(cache_point);
+	}
+	CacheAppendCommit commit;
+	commit.cache_points_offset = first_position_;
+	commit.cache_point_count = writer.index().cache_points.size();
+
 	writer_ = std::move(writer.finalize());
 	write_cache_index(writer_, index);
+	// Everything else must be written before the commit, which makes the append visible to readers.
+	writer_.stream().flush();
+	if (not writer_.stream())
+		throw UnexpectedStreamError("cache index");
+	write_cache_append_commit(writer_, commit);
+	writer_.stream().flush();
+	if (not writer_.stream())
+		throw UnexpectedStreamError("cache append commit");
 }
 
 }}}}}
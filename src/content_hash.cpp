@@ -0,0 +1,122 @@
+#include <content_hash.h>
+
+#include <cstring>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+constexpr std::uint64_t prime1 = 0x9e3779b185ebca87ull;
+constexpr std::uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+constexpr std::uint64_t prime3 = 0x165667b19e3779f9ull;
+constexpr std::uint64_t prime4 = 0x85ebca77c2b2ae63ull;
+
+std::uint64_t rotl(std::uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+std::uint64_t accumulate(std::uint64_t accumulator, std::uint64_t input)
+{
+	return rotl(accumulator + input * prime2, 31) * prime1;
+}
+
+std::uint64_t avalanche(std::uint64_t value)
+{
+	value ^= value >> 33;
+	value *= prime2;
+	value ^= value >> 29;
+	value *= prime3;
+	value ^= value >> 32;
+	return value;
+}
+
+void process_block(std::uint64_t (&lanes)[4], const std::uint8_t* block)
+{
+	std::uint64_t input[4];
+	std::memcpy(input, block, sizeof(input));
+	for (int i = 0; i < 4; ++i)
+		lanes[i] = accumulate(lanes[i], input[i]);
+}
+
+struct SipState {
+	std::uint64_t v0, v1, v2, v3;
+
+	void round()
+	{
+		v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+		v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+		v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+		v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+	}
+
+	void compress(std::uint64_t word)
+	{
+		v3 ^= word;
+		round();
+		round();
+		v0 ^= word;
+	}
+
+	std::uint64_t finalize(std::uint8_t marker)
+	{
+		v2 ^= marker;
+		for (int i = 0; i < 4; ++i)
+			round();
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
+};
+
+}
+
+ContentHash hash_content(const std::uint8_t* data, std::size_t size)
+{
+	std::uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+
+	constexpr std::size_t block_size = 4 * sizeof(std::uint64_t);
+	std::size_t offset = 0;
+	for (; offset + block_size <= size; offset += block_size)
+		process_block(lanes, data + offset);
+
+	if (offset < size) {
+		std::uint8_t tail[block_size] = {};
+		std::memcpy(tail, data + offset, size - offset);
+		process_block(lanes, tail);
+	}
+
+	// The two halves combine the lanes in different orders, so that each one depends on the whole state.
+	std::uint64_t low = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+	std::uint64_t high = rotl(lanes[3], 1) ^ rotl(lanes[2] * prime4, 7) ^ rotl(lanes[1], 12) ^ (lanes[0] * prime3);
+
+	return { avalanche(low ^ size), avalanche(high + size * prime4) };
+}
+
+ContentHash hash_content_keyed(const std::uint8_t* data, std::size_t size, const ContentHash& key)
+{
+	SipState state{ key.low ^ 0x736f6d6570736575ull, key.high ^ 0x646f72616e646f6dull ^ 0xee,
+	                key.low ^ 0x6c7967656e657261ull, key.high ^ 0x7465646279746573ull };
+
+	std::size_t offset = 0;
+	for (; offset + sizeof(std::uint64_t) <= size; offset += sizeof(std::uint64_t)) {
+		std::uint64_t word;
+		std::memcpy(&word, data + offset, sizeof(word));
+		state.compress(word);
+	}
+
+	// The last word holds the remaining bytes, and the size in its most significant byte.
+	std::uint64_t last = static_cast<std::uint64_t>(size) << 56;
+	std::memcpy(&last, data + offset, size - offset);
+	state.compress(last);
+
+	ContentHash result;
+	result.low = state.finalize(0xee);
+	state.v1 ^= 0xdd;
+	result.high = state.finalize(0);
+	return result;
+}
+
+}}}}}
@@ -0,0 +1,128 @@
+#include <event_block.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <reader_errors.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+const char* const section_name = "trace events";
+
+}
+
+std::size_t find_event_block(const std::vector<EventBlockEntry>& blocks, std::uint64_t stream_pos)
+{
+	auto it = std::upper_bound(blocks.begin(), blocks.end(), stream_pos,
+	                           [](std::uint64_t pos, const EventBlockEntry& block) { return pos < block.stream_pos; });
+	return it == blocks.begin() ? blocks.size() : it - blocks.begin() - 1;
+}
+
+constexpr std::uint64_t EventBlock::header_size;
+
+EventBlock::EventBlock(std::uint64_t stream_pos)
+  : stream_pos_(stream_pos), size_(0), event_count_(0), headers_(section_name, nullptr, 0),
+    register_ids_(section_name, nullptr, 0), memory_addresses_(section_name, nullptr, 0),
+    memory_sizes_(section_name, nullptr, 0), memory_payloads_(section_name, nullptr, 0)
+{
+}
+
+EventBlock::EventBlock(const EventDecoder& decoder, const std::uint8_t* data, std::uint64_t size,
+                       std::uint64_t stream_pos)
+  : EventBlock(stream_pos)
+{
+	BufferReader header(section_name, data, size);
+	auto block_size = header.read<std::uint64_t>();
+	if (block_size > header.bytes_left() or block_size < header_size - sizeof(std::uint64_t))
+		throw MalformedSection(section_name, "Block at " + std::to_string(stream_pos) + " has an invalid size");
+	size_ = sizeof(std::uint64_t) + block_size;
+
+	event_count_ = header.read<std::uint32_t>();
+	if (event_count_ == 0)
+		throw MalformedSection(section_name, "Block at " + std::to_string(stream_pos) + " has no event");
+
+	std::uint64_t column_sizes[6];
+	auto columns_size = size_ - header_size;
+	for (auto& column_size : column_sizes) {
+		column_size = header.read<std::uint64_t>();
+		if (column_size > columns_size)
+			throw MalformedSection(section_name, "Columns of block at " + std::to_string(stream_pos) +
+			                                       " are larger than the block");
+		columns_size -= column_size;
+	}
+	if (columns_size != 0)
+		throw MalformedSection(section_name, "Columns of block at " + std::to_string(stream_pos) +
+		                                       " are smaller than the block");
+
+	auto column = data + header_size;
+	auto next_column = [&column, &column_sizes](std::size_t index) {
+		BufferReader reader(section_name, column, column_sizes[index]);
+		column += column_sizes[index];
+		return reader;
+	};
+
+	headers_ = next_column(0);
+	register_ids_ = next_column(1);
+	auto payloads = next_column(2);
+	memory_addresses_ = next_column(3);
+	memory_sizes_ = next_column(4);
+	memory_payloads_ = next_column(5);
+
+	// Register contents are grouped by register, after the list of registers and their write counts
+	std::vector<std::pair<RegisterId, std::uint32_t>> groups(payloads.read<std::uint16_t>());
+	for (std::size_t i = 0; i < groups.size(); ++i) {
+		groups[i].first = payloads.read<RegisterId>();
+		groups[i].second = payloads.read<std::uint32_t>();
+		if (not decoder.is_register(groups[i].first))
+			throw MalformedSection(section_name, std::string("Register ") + std::to_string(groups[i].first) +
+			                                       " is not defined in machine description section");
+		if (i > 0 and groups[i - 1].first >= groups[i].first)
+			throw MalformedSection(section_name, "Register contents are not sorted by register id");
+	}
+
+	register_payloads_.reserve(groups.size());
+	for (const auto& group : groups) {
+		// The contents of registers with an encoding vary in size, so their groups give a size rather than a count
+		std::uint64_t group_size = group.second;
+		if (decoder.register_encoding(group.first) == MachineDescription::RegisterEncoding::Full)
+			group_size *= decoder.register_size(group.first);
+		register_payloads_.emplace_back(group.first, BufferReader(section_name, payloads.skip(group_size), group_size));
+	}
+	if (payloads.bytes_left() != 0)
+		throw MalformedSection(section_name, "Register contents of block at " + std::to_string(stream_pos) +
+		                                       " are smaller than their column");
+}
+
+BufferReader& EventBlock::register_payloads(RegisterId reg_id)
+{
+	auto it = std::lower_bound(register_payloads_.begin(), register_payloads_.end(), reg_id,
+	                           [](const std::pair<RegisterId, BufferReader>& group, RegisterId id) {
+		                           return group.first < id;
+	                           });
+	if (it == register_payloads_.end() or it->first != reg_id)
+		throw MalformedSection(section_name, "Block at " + std::to_string(stream_pos_) + " has no content for register " +
+		                                       std::to_string(reg_id));
+	return it->second;
+}
+
+void EventBlock::skip_to(const EventDecoder& decoder, std::uint64_t stream_pos)
+{
+	if (stream_pos == stream_pos_)
+		return;
+
+	auto ignore = [](std::uint64_t, std::uint64_t) {};
+	while (this->stream_pos() < stream_pos and not finished())
+		decoder.scan_memory_writes_columns(*this, ignore);
+
+	if (this->stream_pos() != stream_pos)
+		throw std::logic_error("Trying to seek between events");
+}
+
+}}}}}
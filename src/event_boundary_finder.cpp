@@ -0,0 +1,177 @@
+#include <event_boundary_finder.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+#include <buffer_reader.h>
+#include <event_decoder.h>
+#include <reader_errors.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+//! Decodes single events without keeping any state, only to tell whether they are well-formed.
+class EventValidator
+{
+public:
+	explicit EventValidator(const TraceFile& trace)
+	  : trace_(&trace), input_(nullptr), scratch_(0x1000)
+	{
+		for (const auto& reg : trace.machine().registers)
+			scratch_.resize(std::max<std::size_t>(scratch_.size(), reg.second.size));
+	}
+
+	//! Position of the event following the one starting at `stream_pos`, or 0 if no event can start there.
+	std::uint64_t next_event(std::uint64_t stream_pos)
+	{
+		BufferReader input("trace events", trace_->events_section(), trace_->events_section_size(), stream_pos);
+		input_ = &input;
+		try {
+			trace_->decoder().decode(input, *this);
+		} catch (const std::runtime_error&) {
+			return 0;
+		}
+		return input.stream_pos();
+	}
+
+private:
+	friend EventDecoder;
+
+	void do_event_instruction() {}
+	void do_event_other(const std::string&) {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId)
+	{
+		return { scratch_.data(), scratch_.data() };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t, std::uint64_t size)
+	{
+		// Reject huge sizes read from a wrong offset right away, instead of copying the rest of the section.
+		if (size > input_->bytes_left())
+			throw MalformedSection(input_->name(), "Memory write past the end of the section");
+		return { scratch_.data(), std::min<std::uint64_t>(size, scratch_.size()) };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) {}
+
+	const TraceFile* trace_;
+	BufferReader* input_;
+	std::vector<std::uint8_t> scratch_;
+};
+
+//! Where reading events from a position inside a chunk leads.
+struct Jump {
+	//! First event boundary at or after the end of the chunk, or 0 if no event can start at the position.
+	std::uint64_t end;
+	//! Number of events read to get there.
+	std::uint64_t event_count;
+};
+
+struct Chunk {
+	std::uint64_t begin;
+	std::uint64_t end;
+	//! Memoized parses, by starting position.
+	std::unordered_map<std::uint64_t, Jump> jumps;
+
+	Jump resolve(EventValidator& validator, std::uint64_t stream_pos)
+	{
+		// Walk events until the end of the chunk or a known position, then fill in the path backwards.
+		std::vector<std::uint64_t> path;
+		Jump jump{ stream_pos, 0 };
+		for (;;) {
+			if (jump.end >= end)
+				break;
+
+			auto known = jumps.find(jump.end);
+			if (known != jumps.end()) {
+				jump = known->second;
+				break;
+			}
+
+			path.push_back(jump.end);
+			jump.end = validator.next_event(jump.end);
+			if (jump.end == 0)
+				break;
+		}
+
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			if (jump.end != 0)
+				++jump.event_count;
+			jumps[*it] = jump;
+		}
+
+		return jump;
+	}
+};
+
+}
+
+EventBoundaryFinder::EventBoundaryFinder(const TraceFile& trace, std::uint64_t chunk_size, std::uint64_t probe_size)
+  : trace_(&trace), chunk_size_(std::max<std::uint64_t>(chunk_size, 1)), probe_size_(probe_size)
+{
+}
+
+EventOffsetIndex EventBoundaryFinder::find(ThreadPool& pool) const
+{
+	// In the columnar layout, blocks are listed along with their first event
+	if (trace_->header().events_layout == EventsLayout::Columnar) {
+		EventOffsetIndex index;
+		for (const auto& block : trace_->event_blocks()) {
+			if (index.entries.empty() or block.stream_pos >= index.entries.back().stream_pos + chunk_size_)
+				index.entries.push_back({ block.first_event_id, block.stream_pos });
+		}
+		if (index.entries.empty())
+			index.entries.push_back({ 0, TraceFile::first_event_stream_pos() });
+		return index;
+	}
+
+	std::vector<Chunk> chunks;
+	for (auto begin = TraceFile::first_event_stream_pos(); begin < trace_->events_section_size(); begin += chunk_size_)
+		chunks.push_back({ begin, std::min(begin + chunk_size_, trace_->events_section_size()), {} });
+
+	pool.parallel_for(chunks.size(), [this, &chunks](std::size_t i) {
+		EventValidator validator(*trace_);
+		auto& chunk = chunks[i];
+
+		// The first chunk starts on a boundary, no need to guess
+		auto probe_end = i == 0 ? chunk.begin + 1 : std::min(chunk.begin + probe_size_, chunk.end);
+		for (auto pos = chunk.begin; pos < probe_end; ++pos)
+			chunk.resolve(validator, pos);
+	});
+
+	// Stitch chunks from the start of the section. Positions reached this way are real event boundaries.
+	EventValidator validator(*trace_);
+	EventOffsetIndex index;
+	Jump position{ TraceFile::first_event_stream_pos(), 0 };
+
+	for (auto& chunk : chunks) {
+		if (position.end >= chunk.end)
+			continue;
+
+		index.entries.push_back({ position.event_count, position.end });
+
+		auto jump = chunk.resolve(validator, position.end);
+		if (jump.end == 0)
+			throw MalformedSection("trace events", "Invalid event at position " + std::to_string(position.end));
+		position.end = jump.end;
+		position.event_count += jump.event_count;
+	}
+
+	if (index.entries.empty())
+		index.entries.push_back({ 0, TraceFile::first_event_stream_pos() });
+
+	if (position.event_count != trace_->event_count())
+		throw MalformedSection("trace events", "Found " + std::to_string(position.event_count) + " events instead of " +
+		                                         std::to_string(trace_->event_count()));
+
+	return index;
+}
+
+}}}}}
@@ -0,0 +1,185 @@
+#include <event_decoder.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+void apply_register_operation(const MachineDescription::RegisterOperation& reg_operation, const std::uint8_t* reg_read,
+                              std::uint8_t* reg_write)
+{
+	const auto& content = reg_operation.value;
+
+	switch (reg_operation.operation) {
+		case MachineDescription::RegisterOperator::Set:
+			std::memcpy(reg_write, content.data(), content.size());
+			break;
+
+		case MachineDescription::RegisterOperator::Add:
+			switch (content.size()) {
+				case 1:
+					*reg_write = *reg_read + *content.data();
+					break;
+				case 2:
+					*reinterpret_cast<std::uint16_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint16_t*>(reg_read) +
+					  *reinterpret_cast<const std::uint16_t*>(content.data());
+					break;
+				case 4:
+					*reinterpret_cast<std::uint32_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint32_t*>(reg_read) +
+					  *reinterpret_cast<const std::uint32_t*>(content.data());
+					break;
+				case 8:
+					*reinterpret_cast<std::uint64_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint64_t*>(reg_read) +
+					  *reinterpret_cast<const std::uint64_t*>(content.data());
+					break;
+				default: {
+					std::uint8_t carry = 0;
+					for (std::size_t i = 0; i < content.size(); ++i) {
+						auto result =
+						  static_cast<std::uint16_t>(reg_read[i]) + static_cast<std::uint8_t>(content[i]) + carry;
+						carry = result >> 8;
+						reg_write[i] = result & 0xff;
+					}
+				}
+			}
+			break;
+
+		case MachineDescription::RegisterOperator::And:
+			switch (content.size()) {
+				case 1:
+					*reg_write = *reg_read & *content.data();
+					break;
+				case 2:
+					*reinterpret_cast<std::uint16_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint16_t*>(reg_read) &
+					  *reinterpret_cast<const std::uint16_t*>(content.data());
+					break;
+				case 4:
+					*reinterpret_cast<std::uint32_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint32_t*>(reg_read) &
+					  *reinterpret_cast<const std::uint32_t*>(content.data());
+					break;
+				case 8:
+					*reinterpret_cast<std::uint64_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint64_t*>(reg_read) &
+					  *reinterpret_cast<const std::uint64_t*>(content.data());
+					break;
+				default:
+					for (std::size_t i = 0; i < content.size(); ++i)
+						reg_write[i] = reg_read[i] & content[i];
+			}
+			break;
+
+		case MachineDescription::RegisterOperator::Or:
+			switch (content.size()) {
+				case 1:
+					*reg_write = *reg_read | *content.data();
+					break;
+				case 2:
+					*reinterpret_cast<std::uint16_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint16_t*>(reg_read) |
+					  *reinterpret_cast<const std::uint16_t*>(content.data());
+					break;
+				case 4:
+					*reinterpret_cast<std::uint32_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint32_t*>(reg_read) |
+					  *reinterpret_cast<const std::uint32_t*>(content.data());
+					break;
+				case 8:
+					*reinterpret_cast<std::uint64_t*>(reg_write) =
+					  *reinterpret_cast<const std::uint64_t*>(reg_read) |
+					  *reinterpret_cast<const std::uint64_t*>(content.data());
+					break;
+				default:
+					for (std::size_t i = 0; i < content.size(); ++i)
+						reg_write[i] = reg_read[i] | content[i];
+			}
+			break;
+		default:
+			throw MalformedSection(
+			  "trace events", std::string("Operation ") +
+			                    std::to_string(static_cast<std::uint8_t>(reg_operation.operation)) + " is unknown");
+	}
+}
+
+void apply_register_encoding(MachineDescription::RegisterEncoding encoding, const std::uint8_t* reg_read,
+                             const std::uint8_t* value, std::size_t value_size, std::uint8_t* reg_write,
+                             std::size_t size)
+{
+	if (encoding == MachineDescription::RegisterEncoding::Xor) {
+		for (std::size_t i = 0; i < value_size; ++i)
+			reg_write[i] = reg_read[i] ^ value[i];
+		if (reg_write != reg_read)
+			std::memcpy(reg_write + value_size, reg_read + value_size, size - value_size);
+		return;
+	}
+
+	if (encoding != MachineDescription::RegisterEncoding::Delta)
+		throw MalformedSection("trace events", std::string("Register encoding ") +
+		                                         std::to_string(static_cast<std::uint8_t>(encoding)) + " is unknown");
+
+	// The omitted high bytes of the delta are the sign extension of the stored ones
+	std::uint8_t extension = value_size > 0 and (value[value_size - 1] & 0x80) ? 0xff : 0;
+
+	if (size <= sizeof(std::uint64_t)) {
+		std::uint64_t previous = 0;
+		std::uint64_t delta = 0;
+		std::memcpy(&previous, reg_read, size);
+		std::memcpy(&delta, value, value_size);
+		if (extension != 0 and value_size < sizeof(std::uint64_t))
+			delta |= ~std::uint64_t(0) << (value_size * 8);
+		previous += delta;
+		std::memcpy(reg_write, &previous, size);
+		return;
+	}
+
+	std::uint8_t carry = 0;
+	for (std::size_t i = 0; i < size; ++i) {
+		auto result = static_cast<std::uint16_t>(reg_read[i]) + (i < value_size ? value[i] : extension) + carry;
+		carry = result >> 8;
+		reg_write[i] = result & 0xff;
+	}
+}
+
+EventDecoder::EventDecoder()
+  : physical_address_size_(0)
+{
+}
+
+EventDecoder::EventDecoder(const MachineDescription& machine, const std::vector<EventTemplate>& templates)
+  : physical_address_size_(machine.physical_address_size), templates_(templates)
+{
+	auto max_reg_action = std::max_element(machine.register_operations.begin(), machine.register_operations.end(),
+	                                       machine.register_operations.value_comp());
+	if (max_reg_action != machine.register_operations.end()) {
+		register_operations_.resize(max_reg_action->first + 1,
+		                            std::make_pair(false, MachineDescription::RegisterOperation()));
+		for (const auto& action : machine.register_operations) {
+			register_operations_[action.first].first = true;
+			register_operations_[action.first].second = action.second;
+		}
+	}
+
+	auto max_register =
+	  std::max_element(machine.registers.begin(), machine.registers.end(), machine.registers.value_comp());
+	if (max_register != machine.registers.end()) {
+		registers_.resize(max_register->first + 1, std::make_pair(false, 0));
+		register_encodings_.resize(max_register->first + 1, MachineDescription::RegisterEncoding::Full);
+		for (const auto& reg : machine.registers) {
+			registers_[reg.first].first = true;
+			registers_[reg.first].second = reg.second.size;
+			register_slots_.push_back(reg.first);
+		}
+		for (const auto& encoding : machine.register_encodings)
+			register_encodings_[encoding.first] = encoding.second;
+	}
+}
+
+}}}}}
@@ -0,0 +1,191 @@
+#include <event_search.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <register_file.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Evaluates the predicates of a search over a segment.
+ *
+ * Registers with predicates are kept up to date, others and memory writes are skipped. Register predicates are
+ * evaluated once the event is fully read, that is when the next event starts or at the end of the segment.
+ */
+class EventSearch::Matcher : public SegmentHandler
+{
+public:
+	Matcher(const TraceFile& trace, const EventSearch& search)
+	  : SegmentHandler(trace), search_(search), registers_(trace.machine()),
+	    last_matches_(search.predicates_.size(), no_event), current_event_(no_event)
+	{
+	}
+
+	const std::vector<SearchMatch>& matches() const { return matches_; }
+
+protected:
+	void do_segment_start(const ReplaySegment&, const RegisterFile* registers) override
+	{
+		if (registers != nullptr)
+			registers_ = *registers;
+	}
+
+	void do_segment_end(const ReplaySegment&) override { finish_event(); }
+
+	void do_event_instruction() override { start_event(); }
+	void do_event_other(const std::string&) override { start_event(); }
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id) override
+	{
+		const auto& predicates = search_.register_predicates_;
+		if (reg_id >= predicates.size() or predicates[reg_id].empty())
+			return { nullptr, nullptr };
+
+		written_registers_.push_back(reg_id);
+		return { registers_.get(reg_id), registers_.get(reg_id) };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		for (auto index : search_.memory_predicates_) {
+			const auto& predicate = search_.predicates_[index];
+			if (address < predicate.address + predicate.size and predicate.address < address + size)
+				match(index);
+		}
+		return { nullptr, size };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	static constexpr std::uint64_t no_event = std::uint64_t(-1);
+
+	void start_event()
+	{
+		finish_event();
+		current_event_ = next_event_index();
+	}
+
+	void finish_event()
+	{
+		for (auto reg_id : written_registers_) {
+			for (auto index : search_.register_predicates_[reg_id]) {
+				const auto& predicate = search_.predicates_[index];
+				if (predicate.kind == EventPredicate::Kind::RegisterWritten or
+				    std::memcmp(registers_.get(reg_id), predicate.value.data(), predicate.value.size()) == 0)
+					match(index);
+			}
+		}
+		written_registers_.clear();
+	}
+
+	void match(std::size_t index)
+	{
+		if (last_matches_[index] == current_event_)
+			return;
+		last_matches_[index] = current_event_;
+		matches_.push_back({ current_event_, index });
+	}
+
+	const EventSearch& search_;
+	RegisterFile registers_;
+	//! Last event matching each predicate, to report events once per predicate.
+	std::vector<std::uint64_t> last_matches_;
+	std::uint64_t current_event_;
+	std::vector<RegisterId> written_registers_;
+	std::vector<SearchMatch> matches_;
+};
+
+constexpr std::uint64_t EventSearch::Matcher::no_event;
+
+EventPredicate EventPredicate::register_written(RegisterId reg_id)
+{
+	return { Kind::RegisterWritten, reg_id, {}, 0, 0 };
+}
+
+EventPredicate EventPredicate::register_equals(RegisterId reg_id, std::vector<std::uint8_t> value)
+{
+	return { Kind::RegisterEquals, reg_id, std::move(value), 0, 0 };
+}
+
+EventPredicate EventPredicate::memory_written(std::uint64_t address, std::uint64_t size)
+{
+	return { Kind::MemoryWritten, 0, {}, address, size };
+}
+
+EventSearch::EventSearch(const ReplayEngine& engine, std::vector<EventPredicate> predicates)
+  : engine_(engine), predicates_(std::move(predicates))
+{
+	const auto& machine = engine.trace().machine();
+	const auto& segments = engine.segments();
+	bool known_registers = std::none_of(segments.begin(), segments.end(), [](const ReplaySegment& segment) {
+		return segment.seed == SegmentSeed::Unknown;
+	});
+
+	for (std::size_t i = 0; i < predicates_.size(); ++i) {
+		const auto& predicate = predicates_[i];
+		if (predicate.kind == EventPredicate::Kind::MemoryWritten) {
+			memory_predicates_.push_back(i);
+			continue;
+		}
+
+		auto reg = machine.registers.find(predicate.reg_id);
+		if (reg == machine.registers.end())
+			throw std::invalid_argument("Unknown register " + std::to_string(predicate.reg_id));
+
+		if (predicate.kind == EventPredicate::Kind::RegisterEquals) {
+			if (predicate.value.size() != reg->second.size)
+				throw std::invalid_argument("Value of size " + std::to_string(predicate.value.size()) +
+				                            " for register " + reg->second.name);
+
+			bool operations = false;
+			for (const auto& operation : machine.register_operations)
+				operations = operations or operation.second.register_id == predicate.reg_id;
+			if (operations and not known_registers)
+				throw std::invalid_argument("Register " + reg->second.name +
+				                            " is changed by register operations, the search needs register values");
+
+			// Writes of encoded registers are relative to their previous value
+			auto encoding = machine.register_encodings.find(predicate.reg_id);
+			if (encoding != machine.register_encodings.end() and
+			    encoding->second != MachineDescription::RegisterEncoding::Full and not known_registers)
+				throw std::invalid_argument("Register " + reg->second.name +
+				                            " is not stored in full, the search needs register values");
+		}
+
+		if (predicate.reg_id >= register_predicates_.size())
+			register_predicates_.resize(predicate.reg_id + 1);
+		register_predicates_[predicate.reg_id].push_back(i);
+	}
+}
+
+SearchStatistics EventSearch::run(ThreadPool& pool, const MatchConsumer& consume) const
+{
+	SearchStatistics statistics;
+	const auto& trace = engine_.trace();
+	auto start = std::chrono::steady_clock::now();
+
+	engine_.replay(
+	  pool,
+	  [this, &trace](const ReplaySegment&) { return std::make_unique<Matcher>(trace, *this); },
+	  [&statistics, &consume](const ReplaySegment& segment, std::unique_ptr<SegmentHandler>&& handler) {
+		  statistics.events += segment.end_context - segment.start_context;
+		  for (const auto& match : static_cast<const Matcher&>(*handler).matches()) {
+			  ++statistics.matches;
+			  consume(match);
+		  }
+	  });
+
+	statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return statistics;
+}
+
+}}}}}
@@ -0,0 +1,59 @@
+#include <event_stream.h>
+
+#include <stdexcept>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+EventStream::EventStream(const TraceFile& trace, std::uint64_t stream_pos)
+  : trace_(&trace), columnar_(trace.header().events_layout == EventsLayout::Columnar),
+    events_("trace events", trace.events_section(), trace.events_section_size()), block_(stream_pos)
+{
+	if (columnar_)
+		position(stream_pos);
+	else
+		events_.seek(stream_pos);
+}
+
+void EventStream::seek(std::uint64_t stream_pos)
+{
+	if (not columnar_)
+		events_.seek(stream_pos);
+	else if (stream_pos != this->stream_pos())
+		position(stream_pos);
+}
+
+void EventStream::position(std::uint64_t stream_pos)
+{
+	const auto& blocks = trace_->event_blocks();
+	auto index = find_event_block(blocks, stream_pos);
+	if (index == blocks.size()) {
+		// Only the end of an empty trace is before the first block
+		if (not blocks.empty() or stream_pos != TraceFile::first_event_stream_pos())
+			throw std::logic_error("Trying to seek outside section");
+		block_ = EventBlock(stream_pos);
+		return;
+	}
+
+	if (blocks[index].stream_pos == stream_pos) {
+		// The block is loaded by the first read
+		block_ = EventBlock(stream_pos);
+		return;
+	}
+
+	load_block(blocks[index].stream_pos);
+	block_.skip_to(trace_->decoder(), stream_pos);
+}
+
+void EventStream::load_block(std::uint64_t stream_pos)
+{
+	if (stream_pos > trace_->events_section_size())
+		throw UnexpectedEndOfSection("trace events");
+	block_ = EventBlock(trace_->decoder(), trace_->events_section() + stream_pos,
+	                    trace_->events_section_size() - stream_pos, stream_pos);
+}
+
+}}}}}
@@ -0,0 +1,95 @@
+#include <index_sections.h>
+
+#include <string>
+
+#include <rvnmetadata/metadata-common.h>
+#include <rvnmetadata/metadata-bin.h>
+
+#include <common.h>
+#include <reader_errors.h>
+#include <section_reader.h>
+#include <section_writer.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+using Meta = ::reven::metadata::Metadata;
+using MetaType = ::reven::metadata::ResourceType;
+using MetaVersion = ::reven::metadata::Version;
+
+binresource::Writer create_index_writer(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name,
+                                        const char* tool_version, const char* tool_info)
+{
+	const auto md = Meta(
+		MetaType::Other,
+		MetaVersion::from_string(index_format_version),
+		tool_name,
+		MetaVersion::from_string(tool_version),
+		tool_info + std::string(" - using rvnbintrace ") + writer_version
+	);
+
+	return binresource::Writer::create(std::move(output_stream), metadata::to_bin_raw_metadata(md));
+}
+
+binresource::Reader open_index_reader(std::unique_ptr<std::istream>&& input_stream)
+{
+	auto reader = binresource::Reader::open(std::move(input_stream));
+	if (not reader.stream())
+		throw UnexpectedEndOfStream("magic");
+
+	const auto md = metadata::from_raw_metadata(reader.metadata());
+	if (md.type() != MetaType::Other)
+		throw IncompatibleTypeException("Can't open a resource of type different from Other");
+
+	const auto cmp = md.format_version().compare(MetaVersion::from_string(index_format_version));
+	if (!cmp.is_compatible()) {
+		throw IncompatibleVersionException(
+			("Incompatible version " + md.format_version().to_string() +
+			 (cmp.detail < MetaVersion::Comparison::Current ? ": Past version" : ": Future version"))
+		);
+	}
+
+	return reader;
+}
+
+void write_index_header(binresource::Writer& writer, const IndexHeader& data)
+{
+	SectionWriter section_writer("index header", &writer);
+
+	section_writer.write<std::uint32_t>(static_cast<std::uint32_t>(data.kind));
+	section_writer.write<std::uint32_t>(data.granularity);
+	section_writer.write<std::uint64_t>(data.event_count);
+
+	section_writer.finalize();
+}
+
+IndexHeader read_index_header(binresource::Reader& reader, IndexKind expected_kind)
+{
+	SectionReader section_reader("index header", reader);
+	IndexHeader data;
+
+	data.kind = static_cast<IndexKind>(section_reader.read<std::uint32_t>());
+	switch (data.kind) {
+		case IndexKind::MemoryWrites:
+		case IndexKind::RegisterWrites:
+		case IndexKind::SegmentSummaries:
+			break;
+		default:
+			// Another resource of the same type
+			throw IncompatibleTypeException("Can't open a resource that is not a trace index");
+	}
+	if (data.kind != expected_kind)
+		throw IncompatibleTypeException("Unexpected index kind " +
+		                                std::to_string(static_cast<std::uint32_t>(data.kind)));
+
+	data.granularity = section_reader.read<std::uint32_t>();
+	data.event_count = section_reader.read<std::uint64_t>();
+
+	section_reader.seek_to_end();
+	return data;
+}
+
+}}}}}
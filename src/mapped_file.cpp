@@ -0,0 +1,53 @@
+#include <mapped_file.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+MappedFile::MappedFile(const std::string& filename)
+  : data_(nullptr), size_(0)
+{
+	int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open " + filename + ": " + std::strerror(errno));
+
+	struct stat file_stat;
+	if (::fstat(fd, &file_stat) != 0) {
+		auto error = errno;
+		::close(fd);
+		throw std::runtime_error("Cannot stat " + filename + ": " + std::strerror(error));
+	}
+	size_ = static_cast<std::uint64_t>(file_stat.st_size);
+
+	if (size_ > 0) {
+		void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+		if (mapping == MAP_FAILED) {
+			auto error = errno;
+			::close(fd);
+			throw std::runtime_error("Cannot map " + filename + ": " + std::strerror(error));
+		}
+		data_ = static_cast<const std::uint8_t*>(mapping);
+	}
+
+	// The mapping stays valid once the descriptor is closed.
+	::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data_)
+		::munmap(const_cast<std::uint8_t*>(data_), size_);
+}
+
+}}}}}
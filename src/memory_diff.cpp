@@ -0,0 +1,249 @@
+#include <memory_diff.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <event_stream.h>
+#include <trace_cursor.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+//! Append `[address, address + size)` to `ranges`, merging it with the last range if they are contiguous.
+void append_range(std::vector<MemoryRange>& ranges, std::uint64_t address, std::uint64_t size)
+{
+	if (not ranges.empty() and ranges.back().address + ranges.back().size == address)
+		ranges.back().size += size;
+	else
+		ranges.push_back({ address, size });
+}
+
+//! Append the bytes that differ between `lhs` and `rhs`, the content of `size` bytes at `address`, to `ranges`.
+void diff_buffers(std::uint64_t address, const std::uint8_t* lhs, const std::uint8_t* rhs, std::size_t size,
+                  std::vector<MemoryRange>& ranges)
+{
+	if (std::memcmp(lhs, rhs, size) == 0)
+		return;
+
+	// Compare 8 bytes at once, then find the differing bytes in differing words.
+	std::size_t i = 0;
+	for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+		std::uint64_t lhs_word;
+		std::uint64_t rhs_word;
+		std::memcpy(&lhs_word, lhs + i, sizeof(lhs_word));
+		std::memcpy(&rhs_word, rhs + i, sizeof(rhs_word));
+		if (lhs_word == rhs_word)
+			continue;
+		for (std::size_t j = i; j < i + sizeof(std::uint64_t); ++j) {
+			if (lhs[j] != rhs[j])
+				append_range(ranges, address + j, 1);
+		}
+	}
+	for (; i < size; ++i) {
+		if (lhs[i] != rhs[i])
+			append_range(ranges, address + i, 1);
+	}
+}
+
+}
+
+/**
+ * Replays events from a cache point, only keeping some pages of memory: writes to other pages and to registers are
+ * skipped.
+ */
+class MemoryDiff::PageCursor : public TraceCursor
+{
+public:
+	PageCursor(const TraceFile& trace, const CacheSet& caches, const std::vector<std::uint64_t>& pages)
+	  : TraceCursor(trace), caches_(caches), page_size_(caches.page_size()), pages_(pages),
+	    content_(pages.size() * page_size_)
+	{
+	}
+
+	//! Place the cursor at `context_id`, from the closest cache point.
+	void start_at(std::uint64_t context_id)
+	{
+		auto cache_point = caches_.find_closest(context_id + 1);
+		seek(cache_point.context_id, cache_point.trace_stream_pos);
+		for (std::size_t i = 0; i < pages_.size(); ++i)
+			load_page(pages_[i], cache_point.context_id, content_.data() + i * page_size_);
+		run_to(context_id);
+	}
+
+	//! Read events up to `context_id`.
+	void run_to(std::uint64_t context_id)
+	{
+		while (next_event_index() < context_id and read_next_event()) {
+		}
+	}
+
+	//! The content of the pages, in order.
+	const std::vector<std::uint8_t>& content() const { return content_; }
+
+protected:
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId) override
+	{
+		return { nullptr, nullptr };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		auto page = address & ~std::uint64_t(page_size_ - 1);
+		size = std::min(size, page + page_size_ - address);
+
+		auto it = std::lower_bound(pages_.begin(), pages_.end(), page);
+		if (it == pages_.end() or *it != page)
+			return { nullptr, size };
+		return { content_.data() + (it - pages_.begin()) * page_size_ + (address - page), size };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	//! The page as of `context_id`, from the caches or the initial memory. Bytes outside of memory regions are zero.
+	void load_page(std::uint64_t page, std::uint64_t context_id, std::uint8_t* buffer) const
+	{
+		if (caches_.read_memory_page(page, context_id, buffer))
+			return;
+
+		std::memset(buffer, 0, page_size_);
+		const auto& regions = machine().memory_regions;
+		for (std::size_t i = 0; i < regions.size(); ++i) {
+			auto start = std::max(page, regions[i].start);
+			auto end = std::min(page + page_size_, regions[i].start + regions[i].size);
+			if (start < end)
+				std::memcpy(buffer + (start - page), trace().initial_memory_region(i) + (start - regions[i].start),
+				            end - start);
+		}
+	}
+
+	const CacheSet& caches_;
+	std::uint32_t page_size_;
+	const std::vector<std::uint64_t>& pages_;
+	std::vector<std::uint8_t> content_;
+};
+
+MemoryDiff::MemoryDiff(const TraceFile& trace, const CacheSet& caches, const SegmentSummaries* summaries)
+  : trace_(trace), caches_(caches), summaries_(summaries), page_size_(caches.page_size())
+{
+	if (caches.layers().empty())
+		throw std::invalid_argument("Memory diffs need at least one cache");
+}
+
+void MemoryDiff::add_cache_pages(std::uint64_t first_context, std::uint64_t last_context,
+                                 std::vector<std::uint64_t>& pages) const
+{
+	// A cache point lists the pages changed since the closest cache point before it, so the events of the range are
+	// covered by the cache points after its start, up to the first one at or after its end.
+	auto end = caches_.find_next(last_context - 1, trace_.event_count() + 1);
+	for (const auto& cache : caches_.layers()) {
+		const auto& cache_points = cache->index().cache_points;
+		for (auto it = cache_points.lower_bound(end); it != cache_points.end() and it->first > first_context; ++it) {
+			for (const auto& page : it->second.page_offsets)
+				pages.push_back(page.page_address);
+		}
+	}
+
+	if (end <= trace_.event_count())
+		return;
+
+	// Past the last cache point, the events are scanned for their memory writes.
+	auto start = caches_.find_closest(last_context);
+	EventStream events(trace_, start.trace_stream_pos);
+	for (auto context_id = start.context_id; context_id < last_context; ++context_id) {
+		events.scan_memory_writes([&](std::uint64_t address, std::uint64_t size) {
+			if (context_id < first_context or size == 0)
+				return;
+			auto last_page = (address + size - 1) & ~std::uint64_t(page_size_ - 1);
+			for (auto page = address & ~std::uint64_t(page_size_ - 1); page <= last_page; page += page_size_)
+				pages.push_back(page);
+		});
+	}
+}
+
+void MemoryDiff::add_summary_pages(std::uint64_t first_context, std::uint64_t last_context,
+                                   std::vector<std::uint64_t>& pages) const
+{
+	const auto& summaries = summaries_->summaries();
+	auto summary_page_size = summaries_->page_size();
+	// Events before this one are covered, by summaries or by the cache index
+	auto covered = first_context;
+	for (const auto& summary : summaries) {
+		if (summary.end_context <= first_context or summary.start_context >= last_context)
+			continue;
+		if (summary.start_context > covered)
+			add_cache_pages(covered, summary.start_context, pages);
+		covered = std::max(covered, summary.end_context);
+
+		for (auto summary_page : summary.pages) {
+			// Summary pages may not have the size of cache pages
+			auto first_page = summary_page & ~std::uint64_t(page_size_ - 1);
+			for (auto page = first_page; page < summary_page + summary_page_size; page += page_size_)
+				pages.push_back(page);
+		}
+	}
+	if (covered < last_context)
+		add_cache_pages(covered, last_context, pages);
+}
+
+std::vector<std::uint64_t> MemoryDiff::candidate_pages(std::uint64_t first_context,
+                                                       std::uint64_t second_context) const
+{
+	if (first_context > second_context)
+		std::swap(first_context, second_context);
+
+	std::vector<std::uint64_t> pages;
+	if (first_context == second_context)
+		return pages;
+
+	if (summaries_ != nullptr)
+		add_summary_pages(first_context, second_context, pages);
+	else
+		add_cache_pages(first_context, second_context, pages);
+
+	std::sort(pages.begin(), pages.end());
+	pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+	return pages;
+}
+
+std::vector<MemoryRange> MemoryDiff::diff(std::uint64_t first_context, std::uint64_t second_context) const
+{
+	if (first_context > second_context)
+		std::swap(first_context, second_context);
+	if (second_context > trace_.event_count())
+		throw std::out_of_range("Context " + std::to_string(second_context) + " is after the end of the trace");
+
+	std::vector<MemoryRange> result;
+	auto pages = candidate_pages(first_context, second_context);
+	if (pages.empty())
+		return result;
+
+	PageCursor cursor(trace_, caches_, pages);
+	cursor.start_at(first_context);
+	auto first_content = cursor.content();
+
+	// Replay from the closest cache point if it is after the first context, otherwise go on from there.
+	if (caches_.find_closest(second_context + 1).context_id > first_context)
+		cursor.start_at(second_context);
+	else
+		cursor.run_to(second_context);
+
+	const auto& second_content = cursor.content();
+	for (std::size_t i = 0; i < pages.size(); ++i) {
+		diff_buffers(pages[i], first_content.data() + i * page_size_, second_content.data() + i * page_size_,
+		             page_size_, result);
+	}
+	return result;
+}
+
+}}}}}
@@ -0,0 +1,175 @@
+#include <memory_write_index.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <index_sections.h>
+#include <reader_errors.h>
+#include <index_sections.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Records the pages written by each event of a segment. Written values are discarded, so register values don't need to
+ * be known.
+ */
+class MemoryWriteIndex::Scanner : public SegmentHandler
+{
+public:
+	Scanner(const TraceFile& trace, std::uint32_t page_size)
+	  : SegmentHandler(trace), page_size_(page_size), scratch_(page_size)
+	{
+		for (const auto& reg : trace.machine().registers)
+			scratch_.resize(std::max<std::size_t>(scratch_.size(), reg.second.size));
+	}
+
+	//! Written pages and the event writing them, in event order.
+	const std::vector<std::pair<std::uint64_t, std::uint64_t>>& writes() const { return writes_; }
+
+protected:
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId) override
+	{
+		return { scratch_.data(), scratch_.data() };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		// Writes are split at page boundaries, so each call covers a single page.
+		auto page = address & ~std::uint64_t(page_size_ - 1);
+		writes_.emplace_back(page, next_event_index());
+		return { scratch_.data(), std::min(size, page + page_size_ - address) };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	std::uint32_t page_size_;
+	std::vector<std::uint8_t> scratch_;
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> writes_;
+};
+
+constexpr std::uint64_t MemoryWriteIndex::no_event;
+
+MemoryWriteIndex::MemoryWriteIndex(std::uint32_t page_size, std::uint64_t event_count)
+  : page_size_(page_size), event_count_(event_count)
+{
+}
+
+MemoryWriteIndex MemoryWriteIndex::build(const ReplayEngine& engine, ThreadPool& pool, std::uint32_t page_size)
+{
+	if (page_size == 0 or (page_size & (page_size - 1)) != 0)
+		throw std::invalid_argument("Index page size must be a power of two, not " + std::to_string(page_size));
+
+	const auto& trace = engine.trace();
+	std::unordered_map<std::uint64_t, PostingListBuilder> builders;
+
+	// Segments are consumed in order, so each page's events are added in increasing order.
+	engine.replay(
+	  pool,
+	  [&trace, page_size](const ReplaySegment&) { return std::make_unique<Scanner>(trace, page_size); },
+	  [&builders](const ReplaySegment&, std::unique_ptr<SegmentHandler>&& handler) {
+		  for (const auto& write : static_cast<const Scanner&>(*handler).writes())
+			  builders[write.first].add(write.second);
+	  });
+
+	std::vector<std::uint64_t> addresses;
+	addresses.reserve(builders.size());
+	for (const auto& builder : builders)
+		addresses.push_back(builder.first);
+	std::sort(addresses.begin(), addresses.end());
+
+	MemoryWriteIndex index(page_size, trace.event_count());
+	for (auto address : addresses)
+		index.pages_.add(address, builders.at(address));
+
+	return index;
+}
+
+MemoryWriteIndex::MemoryWriteIndex(const std::string& filename)
+  : MemoryWriteIndex(std::make_unique<std::ifstream>(filename, std::ios::binary))
+{
+}
+
+MemoryWriteIndex::MemoryWriteIndex(std::unique_ptr<std::istream>&& input_stream)
+{
+	auto reader = open_index_reader(std::move(input_stream));
+
+	auto header = read_index_header(reader, IndexKind::MemoryWrites);
+	if (header.granularity == 0 or (header.granularity & (header.granularity - 1)) != 0)
+		throw MalformedSection("index header", "page size " + std::to_string(header.granularity) +
+		                                       " is not a power of two");
+	page_size_ = header.granularity;
+	event_count_ = header.event_count;
+	pages_.read(reader, "index pages");
+}
+
+void MemoryWriteIndex::write(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name,
+                             const char* tool_version, const char* tool_info) const
+{
+	auto writer = create_index_writer(std::move(output_stream), tool_name, tool_version, tool_info);
+
+	write_index_header(writer, { IndexKind::MemoryWrites, page_size_, event_count_ });
+	pages_.write(writer, "index pages");
+}
+
+std::pair<std::vector<MemoryWriteIndex::Page>::const_iterator, std::vector<MemoryWriteIndex::Page>::const_iterator>
+MemoryWriteIndex::find_pages(std::uint64_t address, std::uint64_t size) const
+{
+	const auto& pages = pages_.entries();
+	if (size == 0)
+		return { pages.end(), pages.end() };
+
+	auto last_address = size - 1 > std::numeric_limits<std::uint64_t>::max() - address
+	                    ? std::numeric_limits<std::uint64_t>::max()
+	                    : address + (size - 1);
+	auto first_page = address & ~std::uint64_t(page_size_ - 1);
+	auto last_page = last_address & ~std::uint64_t(page_size_ - 1);
+
+	auto begin = std::lower_bound(pages.begin(), pages.end(), first_page,
+	                              [](const Page& page, std::uint64_t value) { return page.key < value; });
+	auto end = std::upper_bound(begin, pages.end(), last_page,
+	                            [](std::uint64_t value, const Page& page) { return value < page.key; });
+	return { begin, end };
+}
+
+std::vector<std::uint64_t> MemoryWriteIndex::writes(std::uint64_t address, std::uint64_t size,
+                                                    std::uint64_t first_event, std::uint64_t last_event) const
+{
+	std::vector<std::uint64_t> result;
+	auto pages = find_pages(address, size);
+	for (auto page = pages.first; page != pages.second; ++page)
+		pages_.events(*page).collect(first_event, last_event, result);
+
+	if (std::distance(pages.first, pages.second) > 1) {
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+	}
+	return result;
+}
+
+std::uint64_t MemoryWriteIndex::last_write_before(std::uint64_t address, std::uint64_t size,
+                                                  std::uint64_t context_id) const
+{
+	auto result = no_event;
+	auto pages = find_pages(address, size);
+	for (auto page = pages.first; page != pages.second; ++page) {
+		std::uint64_t event_id;
+		if (pages_.events(*page).previous(context_id, event_id) and (result == no_event or event_id > result))
+			result = event_id;
+	}
+	return result;
+}
+
+}}}}}
@@ -0,0 +1,58 @@
+#include <positional_reader.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <reader_errors.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+FilePositionalReader::FilePositionalReader(const std::string& filename)
+  : fd_(::open(filename.c_str(), O_RDONLY | O_CLOEXEC))
+{
+	if (fd_ < 0)
+		throw std::runtime_error("Cannot open " + filename + ": " + std::strerror(errno));
+}
+
+FilePositionalReader::~FilePositionalReader()
+{
+	::close(fd_);
+}
+
+void FilePositionalReader::read_at(std::uint64_t position, std::uint8_t* buffer, std::size_t size) const
+{
+	while (size > 0) {
+		auto result = ::pread(fd_, buffer, size, static_cast<off_t>(position));
+		if (result < 0 and errno == EINTR)
+			continue;
+		if (result <= 0)
+			throw UnexpectedEndOfStream();
+
+		buffer += result;
+		position += result;
+		size -= result;
+	}
+}
+
+void StreamPositionalReader::read_at(std::uint64_t position, std::uint8_t* buffer, std::size_t size) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	stream_.clear();
+	stream_.seekg(static_cast<std::istream::off_type>(position));
+	stream_.read(reinterpret_cast<char*>(buffer), size);
+	if (static_cast<std::size_t>(stream_.gcount()) != size) {
+		stream_.clear();
+		throw UnexpectedEndOfStream();
+	}
+}
+
+}}}}}
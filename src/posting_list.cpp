@@ -0,0 +1,189 @@
+#include <posting_list.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include <reader_errors.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+constexpr std::uint64_t skip_entry_size = sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+void write_varint(std::vector<std::uint8_t>& output, std::uint64_t value)
+{
+	while (value >= 0x80) {
+		output.push_back(static_cast<std::uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+	output.push_back(static_cast<std::uint8_t>(value));
+}
+
+//! Read a varint from `[data + pos, data + size)`, advancing `pos`.
+std::uint64_t read_varint(const std::uint8_t* data, std::uint64_t size, std::uint64_t& pos)
+{
+	std::uint64_t value = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		if (pos >= size)
+			throw MalformedSection("posting list", "truncated varint");
+		auto byte = data[pos++];
+		value |= std::uint64_t(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+	throw MalformedSection("posting list", "varint too long");
+}
+
+template <typename T>
+T read_at(const std::uint8_t* data)
+{
+	T value;
+	std::memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+}
+
+constexpr std::uint32_t PostingList::block_size;
+
+void PostingListBuilder::add(std::uint64_t id)
+{
+	if (count_ != 0) {
+		if (id == last_)
+			return;
+		if (id < last_)
+			throw std::logic_error("Posting list ids must increase: " + std::to_string(id) + " after " +
+			                       std::to_string(last_));
+	}
+
+	if (count_ % PostingList::block_size == 0)
+		skips_.emplace_back(id, static_cast<std::uint32_t>(data_.size()));
+	else
+		write_varint(data_, id - last_);
+
+	last_ = id;
+	++count_;
+}
+
+void PostingListBuilder::encode(std::vector<std::uint8_t>& output) const
+{
+	write_varint(output, count_);
+	for (const auto& skip : skips_) {
+		auto pos = output.size();
+		output.resize(pos + skip_entry_size);
+		std::memcpy(output.data() + pos, &skip.first, sizeof(skip.first));
+		std::memcpy(output.data() + pos + sizeof(skip.first), &skip.second, sizeof(skip.second));
+	}
+	output.insert(output.end(), data_.begin(), data_.end());
+}
+
+PostingList::PostingList()
+  : count_(0), block_count_(0), skips_(nullptr), data_(nullptr), data_size_(0)
+{
+}
+
+PostingList::PostingList(const std::uint8_t* data, std::uint64_t size)
+{
+	std::uint64_t pos = 0;
+	count_ = read_varint(data, size, pos);
+	block_count_ = (count_ + block_size - 1) / block_size;
+	if (block_count_ > (size - pos) / skip_entry_size)
+		throw MalformedSection("posting list", "skip table is larger than the list");
+
+	skips_ = data + pos;
+	data_ = skips_ + block_count_ * skip_entry_size;
+	data_size_ = size - pos - block_count_ * skip_entry_size;
+}
+
+std::uint64_t PostingList::block_first_id(std::uint64_t block) const
+{
+	return read_at<std::uint64_t>(skips_ + block * skip_entry_size);
+}
+
+void PostingList::decode_block(std::uint64_t block, std::vector<std::uint64_t>& ids) const
+{
+	auto pos = std::uint64_t(read_at<std::uint32_t>(skips_ + block * skip_entry_size + sizeof(std::uint64_t)));
+	auto id_count = std::min<std::uint64_t>(block_size, count_ - block * block_size);
+
+	ids.clear();
+	ids.push_back(block_first_id(block));
+	for (std::uint64_t i = 1; i < id_count; ++i)
+		ids.push_back(ids.back() + read_varint(data_, data_size_, pos));
+}
+
+std::uint64_t PostingList::find_block(std::uint64_t value) const
+{
+	// Binary search for the first block starting after `value`
+	std::uint64_t begin = 0;
+	std::uint64_t end = block_count_;
+	while (begin < end) {
+		auto middle = begin + (end - begin) / 2;
+		if (block_first_id(middle) <= value)
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+	return begin == 0 ? block_count_ : begin - 1;
+}
+
+void PostingList::collect(std::uint64_t first, std::uint64_t last, std::vector<std::uint64_t>& ids) const
+{
+	auto block = find_block(first);
+	if (block == block_count_)
+		block = 0;
+
+	std::vector<std::uint64_t> block_ids;
+	for (; block < block_count_ and block_first_id(block) < last; ++block) {
+		decode_block(block, block_ids);
+		for (auto id : block_ids) {
+			if (id >= first and id < last)
+				ids.push_back(id);
+		}
+	}
+}
+
+bool PostingList::next(std::uint64_t value, std::uint64_t& id) const
+{
+	auto block = find_block(value);
+	if (block != block_count_) {
+		std::vector<std::uint64_t> block_ids;
+		decode_block(block, block_ids);
+		auto it = std::lower_bound(block_ids.begin(), block_ids.end(), value);
+		if (it != block_ids.end()) {
+			id = *it;
+			return true;
+		}
+		++block;
+	} else {
+		block = 0;
+	}
+
+	if (block >= block_count_)
+		return false;
+	id = block_first_id(block);
+	return true;
+}
+
+bool PostingList::previous(std::uint64_t value, std::uint64_t& id) const
+{
+	if (value == 0)
+		return false;
+	auto block = find_block(value - 1);
+	if (block == block_count_)
+		return false;
+
+	std::vector<std::uint64_t> block_ids;
+	decode_block(block, block_ids);
+	id = *std::prev(std::lower_bound(block_ids.begin(), block_ids.end(), value));
+	return true;
+}
+
+}}}}}
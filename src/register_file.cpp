@@ -0,0 +1,96 @@
+#include <register_file.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+constexpr std::size_t register_alignment = 8;
+
+std::size_t align(std::size_t value)
+{
+	return (value + register_alignment - 1) & ~(register_alignment - 1);
+}
+
+}
+
+constexpr std::uint32_t RegisterFile::Layout::invalid_offset;
+
+RegisterFile::Layout::Layout(const MachineDescription& machine)
+  : byte_size_(0)
+{
+	if (not machine.registers.empty())
+		slots_.resize(machine.registers.rbegin()->first + 1, Slot{ invalid_offset, 0 });
+
+	register_ids_.reserve(machine.registers.size());
+	for (const auto& reg : machine.registers) {
+		slots_[reg.first] = Slot{ static_cast<std::uint32_t>(byte_size_), reg.second.size };
+		register_ids_.push_back(reg.first);
+		byte_size_ = align(byte_size_ + reg.second.size);
+	}
+}
+
+bool RegisterFile::Layout::operator==(const Layout& other) const
+{
+	if (this == &other)
+		return true;
+	if (byte_size_ != other.byte_size_ or register_ids_ != other.register_ids_)
+		return false;
+	for (auto id : register_ids_) {
+		if (slots_[id].offset != other.slots_[id].offset or slots_[id].size != other.slots_[id].size)
+			return false;
+	}
+	return true;
+}
+
+RegisterFile::RegisterFile()
+  : RegisterFile(MachineDescription())
+{
+}
+
+RegisterFile::RegisterFile(const MachineDescription& machine)
+  : RegisterFile(std::make_shared<const Layout>(machine))
+{
+}
+
+RegisterFile::RegisterFile(std::shared_ptr<const Layout> layout)
+  : layout_(std::move(layout))
+  , storage_(layout_->byte_size() / sizeof(std::uint64_t), 0)
+{
+}
+
+void RegisterFile::set(RegisterId id, const std::uint8_t* buffer, std::size_t size)
+{
+	if (not contains(id))
+		throw std::out_of_range(std::string("Register ") + std::to_string(id) + " is not in register file");
+	if (register_size(id) != size)
+		throw std::out_of_range(std::string("Register ") + std::to_string(id) + "'s size is " +
+		                        std::to_string(register_size(id)) + ", not " + std::to_string(size));
+	std::memcpy(get(id), buffer, size);
+}
+
+bool RegisterFile::same_layout(const RegisterFile& other) const
+{
+	return layout_ == other.layout_ or *layout_ == *other.layout_;
+}
+
+void RegisterFile::copy_from(const RegisterFile& other)
+{
+	if (not same_layout(other))
+		throw std::logic_error("Cannot copy register files with different layouts");
+	std::memcpy(data(), other.data(), byte_size());
+}
+
+bool RegisterFile::operator==(const RegisterFile& other) const
+{
+	return same_layout(other) and std::memcmp(data(), other.data(), byte_size()) == 0;
+}
+
+}}}}}
@@ -0,0 +1,133 @@
+#include <register_write_index.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <utility>
+
+#include <index_sections.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Records the registers written by each event of a segment. Register operations are applied to a scratch buffer, so
+ * register values don't need to be known.
+ */
+class RegisterWriteIndex::Scanner : public SegmentHandler
+{
+public:
+	explicit Scanner(const TraceFile& trace)
+	  : SegmentHandler(trace), scratch_(0x1000)
+	{
+		for (const auto& reg : trace.machine().registers)
+			scratch_.resize(std::max<std::size_t>(scratch_.size(), reg.second.size));
+	}
+
+	//! Written registers and the event writing them, in event order.
+	const std::vector<std::pair<RegisterId, std::uint64_t>>& writes() const { return writes_; }
+
+protected:
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id) override
+	{
+		writes_.emplace_back(reg_id, next_event_index());
+		return { scratch_.data(), scratch_.data() };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t, std::uint64_t size) override
+	{
+		return { scratch_.data(), std::min<std::uint64_t>(size, scratch_.size()) };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	std::vector<std::uint8_t> scratch_;
+	std::vector<std::pair<RegisterId, std::uint64_t>> writes_;
+};
+
+constexpr std::uint64_t RegisterWriteIndex::no_event;
+
+RegisterWriteIndex::RegisterWriteIndex(std::uint64_t event_count)
+  : event_count_(event_count)
+{
+}
+
+RegisterWriteIndex RegisterWriteIndex::build(const ReplayEngine& engine, ThreadPool& pool)
+{
+	const auto& trace = engine.trace();
+	std::map<RegisterId, PostingListBuilder> builders;
+
+	// Segments are consumed in order, so each register's events are added in increasing order.
+	engine.replay(
+	  pool,
+	  [&trace](const ReplaySegment&) { return std::make_unique<Scanner>(trace); },
+	  [&builders](const ReplaySegment&, std::unique_ptr<SegmentHandler>&& handler) {
+		  for (const auto& write : static_cast<const Scanner&>(*handler).writes())
+			  builders[write.first].add(write.second);
+	  });
+
+	RegisterWriteIndex index(trace.event_count());
+	for (const auto& builder : builders)
+		index.registers_.add(builder.first, builder.second);
+
+	return index;
+}
+
+RegisterWriteIndex::RegisterWriteIndex(const std::string& filename)
+  : RegisterWriteIndex(std::make_unique<std::ifstream>(filename, std::ios::binary))
+{
+}
+
+RegisterWriteIndex::RegisterWriteIndex(std::unique_ptr<std::istream>&& input_stream)
+{
+	auto reader = open_index_reader(std::move(input_stream));
+
+	event_count_ = read_index_header(reader, IndexKind::RegisterWrites).event_count;
+	registers_.read(reader, "index registers");
+}
+
+void RegisterWriteIndex::write(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name,
+                               const char* tool_version, const char* tool_info) const
+{
+	auto writer = create_index_writer(std::move(output_stream), tool_name, tool_version, tool_info);
+
+	write_index_header(writer, { IndexKind::RegisterWrites, 0, event_count_ });
+	registers_.write(writer, "index registers");
+}
+
+PostingList RegisterWriteIndex::events(RegisterId reg_id) const
+{
+	using Register = KeyedPostingLists<RegisterId>::Entry;
+	const auto& registers = registers_.entries();
+	auto it = std::lower_bound(registers.begin(), registers.end(), reg_id,
+	                           [](const Register& reg, RegisterId value) { return reg.key < value; });
+	if (it == registers.end() or it->key != reg_id)
+		return PostingList();
+	return registers_.events(*it);
+}
+
+std::uint64_t RegisterWriteIndex::write_count(RegisterId reg_id) const
+{
+	return events(reg_id).count();
+}
+
+std::uint64_t RegisterWriteIndex::next_write(RegisterId reg_id, std::uint64_t context_id) const
+{
+	std::uint64_t event_id;
+	return events(reg_id).next(context_id, event_id) ? event_id : no_event;
+}
+
+std::uint64_t RegisterWriteIndex::prev_write(RegisterId reg_id, std::uint64_t context_id) const
+{
+	std::uint64_t event_id;
+	return events(reg_id).previous(context_id, event_id) ? event_id : no_event;
+}
+
+}}}}}
@@ -0,0 +1,227 @@
+#include <replay_engine.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+bool MemoryWriteScanner::read_next_event()
+{
+	auto event_id = next_event_index();
+	if (event_id >= end_context_)
+		return false;
+
+	auto& events = this->events();
+	auto visit = [this, &event_id](std::uint64_t address, std::uint64_t size) {
+		do_scan_memory_write(event_id, address, size);
+	};
+	for (; event_id < end_context_; ++event_id)
+		events.scan_memory_writes(visit);
+
+	seek(event_id, events.stream_pos());
+	return true;
+}
+
+void MemoryWriteScanner::do_segment_start(const ReplaySegment& segment, const RegisterFile*)
+{
+	end_context_ = segment.end_context;
+}
+
+ReplayEngine::ReplayEngine(const TraceFile& trace)
+  : trace_(&trace), cache_(nullptr)
+{
+	add_segment(0, TraceFile::first_event_stream_pos(), SegmentSeed::InitialContext, {});
+	segments_.back().end_context = trace_->event_count();
+}
+
+ReplayEngine::ReplayEngine(const TraceFile& trace, const CacheReader& cache)
+  : trace_(&trace), cache_(&cache)
+{
+	add_segment(0, TraceFile::first_event_stream_pos(), SegmentSeed::InitialContext, {});
+
+	// The index is sorted by decreasing context
+	const auto& cache_points = cache_->index().cache_points;
+	for (auto it = cache_points.rbegin(); it != cache_points.rend(); ++it) {
+		if (it->first >= trace_->event_count())
+			break;
+		if (it->first == segments_.back().start_context)
+			continue;
+
+		segments_.back().end_context = it->first;
+		add_segment(it->first, it->second.trace_stream_offset, SegmentSeed::CachePoint, std::next(it).base());
+	}
+
+	segments_.back().end_context = trace_->event_count();
+}
+
+ReplayEngine::ReplayEngine(const TraceFile& trace, const EventOffsetIndex& offsets)
+  : trace_(&trace), cache_(nullptr)
+{
+	add_segment(0, TraceFile::first_event_stream_pos(), SegmentSeed::InitialContext, {});
+
+	for (const auto& entry : offsets.entries) {
+		if (entry.context_id >= trace_->event_count())
+			break;
+		if (entry.context_id <= segments_.back().start_context)
+			continue;
+
+		segments_.back().end_context = entry.context_id;
+		add_segment(entry.context_id, entry.stream_pos, SegmentSeed::Unknown, {});
+	}
+
+	segments_.back().end_context = trace_->event_count();
+}
+
+void ReplayEngine::add_segment(std::uint64_t start_context, std::uint64_t stream_pos, SegmentSeed seed,
+                               CacheReader::ConstIterator cache_point)
+{
+	segments_.push_back({ segments_.size(), start_context, start_context, stream_pos, seed, cache_point });
+}
+
+std::unique_ptr<SegmentHandler> ReplayEngine::start_segment(const ReplaySegment& segment,
+                                                            const HandlerFactory& factory) const
+{
+	auto handler = factory(segment);
+	handler->seek(segment.start_context, segment.stream_pos);
+
+	switch (segment.seed) {
+		case SegmentSeed::InitialContext:
+			handler->do_segment_start(segment, &trace_->initial_registers());
+			break;
+		case SegmentSeed::CachePoint: {
+			auto registers = cache_->read_cache_point(segment.cache_point);
+			handler->do_segment_start(segment, &registers);
+			break;
+		}
+		case SegmentSeed::Unknown:
+			handler->do_segment_start(segment, nullptr);
+			break;
+	}
+	return handler;
+}
+
+std::unique_ptr<SegmentHandler> ReplayEngine::replay_segment(const ReplaySegment& segment,
+                                                             const HandlerFactory& factory) const
+{
+	auto handler = start_segment(segment, factory);
+	while (handler->next_event_index() < segment.end_context and handler->read_next_event()) {
+	}
+
+	handler->do_segment_end(segment);
+	return handler;
+}
+
+void ReplayEngine::query(ThreadPool& pool, std::vector<std::uint64_t> context_ids, const HandlerFactory& factory,
+                         const ContextVisitor& visit) const
+{
+	std::sort(context_ids.begin(), context_ids.end());
+	context_ids.erase(std::unique(context_ids.begin(), context_ids.end()), context_ids.end());
+	if (not context_ids.empty() and context_ids.back() > trace_->event_count())
+		throw std::out_of_range("Context " + std::to_string(context_ids.back()) + " is after the end of the trace");
+
+	// The contexts of each segment, as [begin, end) ranges of `context_ids`. A context starting a segment is in it,
+	// and the last context of the trace is in the last segment.
+	struct Group {
+		const ReplaySegment* segment;
+		std::size_t begin;
+		std::size_t end;
+	};
+	std::vector<Group> groups;
+	for (std::size_t i = 0; i < context_ids.size(); ++i) {
+		auto segment = std::upper_bound(segments_.begin(), segments_.end(), context_ids[i],
+		                                [](std::uint64_t context_id, const ReplaySegment& segment) {
+			                                return context_id < segment.start_context;
+		                                });
+		const auto* segment_ptr = &*std::prev(segment);
+		if (groups.empty() or groups.back().segment != segment_ptr)
+			groups.push_back({ segment_ptr, i, i });
+		++groups.back().end;
+	}
+
+	pool.parallel_for(groups.size(), [&](std::size_t group_index) {
+		const auto& group = groups[group_index];
+		auto handler = start_segment(*group.segment, factory);
+		for (auto i = group.begin; i < group.end; ++i) {
+			while (handler->next_event_index() < context_ids[i] and handler->read_next_event()) {
+			}
+			visit(context_ids[i], *handler);
+		}
+	});
+}
+
+void ReplayEngine::replay(ThreadPool& pool, const HandlerFactory& factory, const HandlerConsumer& consume) const
+{
+	struct Result {
+		bool done = false;
+		std::unique_ptr<SegmentHandler> handler;
+		std::exception_ptr error;
+	};
+
+	std::vector<Result> results(segments_.size());
+	std::mutex mutex;
+	std::condition_variable segment_done;
+	std::atomic<bool> failed(false);
+
+	for (const auto& segment : segments_) {
+		pool.submit([&, segment_ptr = &segment]() {
+			std::unique_ptr<SegmentHandler> handler;
+			std::exception_ptr error;
+			if (not failed) {
+				try {
+					handler = replay_segment(*segment_ptr, factory);
+				} catch (...) {
+					error = std::current_exception();
+					failed = true;
+				}
+			}
+
+			// Notify while holding the lock: the caller's stack, and the condition variable with it, can go away as
+			// soon as the lock is released.
+			std::lock_guard<std::mutex> lock(mutex);
+			auto& result = results[segment_ptr->index];
+			result.handler = std::move(handler);
+			result.error = error;
+			result.done = true;
+			segment_done.notify_all();
+		});
+	}
+
+	// Every task must be finished before leaving, as they all reference this stack frame.
+	std::exception_ptr error;
+	for (const auto& segment : segments_) {
+		std::unique_ptr<SegmentHandler> handler;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			auto& result = results[segment.index];
+			segment_done.wait(lock, [&result]() { return result.done; });
+			if (result.error and not error)
+				error = result.error;
+			handler = std::move(result.handler);
+		}
+
+		if (error or not consume or not handler)
+			continue;
+
+		try {
+			consume(segment, std::move(handler));
+		} catch (...) {
+			error = std::current_exception();
+			failed = true;
+		}
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+}}}}}
@@ -0,0 +1,172 @@
+#include <reverse_cursor.h>
+
+#include <cstring>
+
+#include <buffer_reader.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Forwards the decoder's callbacks to the cursor, saving the content of each buffer before it is overwritten.
+ *
+ * A register write is saved as its type, id and previous content, a memory write as its type, address, size and
+ * previous content.
+ */
+class ReverseCursor::Recorder
+{
+public:
+	explicit Recorder(ReverseCursor& cursor) : cursor_(cursor) {}
+
+	void do_event_instruction() { cursor_.do_event_instruction(); }
+	void do_event_other(const std::string& description) { cursor_.do_event_other(description); }
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id)
+	{
+		auto buffers = cursor_.do_register_rw_buffers(reg_id);
+		save(register_write);
+		save(reg_id);
+		save(buffers.second, cursor_.trace().decoder().register_size(reg_id));
+		return buffers;
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size)
+	{
+		auto buffer = cursor_.do_memory_before_write(address, size);
+		save(memory_write);
+		save(address);
+		save(buffer.second);
+		save(buffer.first, buffer.second);
+		return buffer;
+	}
+
+	void do_memory_after_write(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size)
+	{
+		cursor_.do_memory_after_write(address, buffer, size);
+	}
+
+private:
+	template <typename T>
+	void save(const T& value)
+	{
+		save(reinterpret_cast<const std::uint8_t*>(&value), sizeof(T));
+	}
+
+	void save(const std::uint8_t* buffer, std::size_t size)
+	{
+		auto& writes = cursor_.current_writes_;
+		writes.insert(writes.end(), buffer, buffer + size);
+	}
+
+	ReverseCursor& cursor_;
+};
+
+constexpr std::uint8_t ReverseCursor::register_write;
+constexpr std::uint8_t ReverseCursor::memory_write;
+
+ReverseCursor::ReverseCursor(const TraceFile& trace, std::size_t undo_log_size)
+  : TraceCursor(trace), log_(undo_log_size), head_(0)
+{
+}
+
+bool ReverseCursor::read_next_event()
+{
+	auto context_id = next_event_index();
+	auto start_pos = stream_pos();
+	if (context_id >= event_count())
+		return false;
+
+	current_writes_.clear();
+	Recorder recorder(*this);
+	events().decode(recorder);
+
+	seek(context_id + 1, events().stream_pos());
+	commit_event(context_id, start_pos);
+	return true;
+}
+
+void ReverseCursor::commit_event(std::uint64_t context_id, std::uint64_t start_pos)
+{
+	auto size = current_writes_.size();
+	if (size > log_.size()) {
+		clear_undo_log();
+		return;
+	}
+
+	// The space ahead of the head holds the oldest events. Events are stored contiguously: an event that doesn't fit
+	// before the end of the log starts back at its beginning, and the events left after the head are dropped.
+	auto offset = head_;
+	if (head_ + size > log_.size()) {
+		offset = 0;
+		while (not events_.empty() and events_.front().offset >= head_)
+			events_.pop_front();
+	}
+
+	while (not events_.empty() and events_.front().offset < offset + size and
+	       events_.front().offset + events_.front().size > offset)
+		events_.pop_front();
+
+	std::memcpy(log_.data() + offset, current_writes_.data(), size);
+	events_.push_back({ context_id, start_pos, stream_pos(), offset, size });
+	head_ = offset + size;
+}
+
+bool ReverseCursor::step_back()
+{
+	if (events_.empty())
+		return false;
+
+	const auto event = events_.back();
+	if (event.context_id + 1 != next_event_index() or event.end_stream_pos != stream_pos()) {
+		// The cursor was moved since this event was read
+		clear_undo_log();
+		return false;
+	}
+
+	// Writes must be undone in reverse order, as an event can write the same location twice.
+	BufferReader writes("undo log", log_.data() + event.offset, event.size);
+	std::vector<std::uint64_t> write_offsets;
+	while (writes.bytes_left() > 0) {
+		write_offsets.push_back(writes.stream_pos());
+		if (writes.read<std::uint8_t>() == register_write) {
+			writes.skip(trace().decoder().register_size(writes.read<RegisterId>()));
+		} else {
+			writes.read<std::uint64_t>();
+			writes.skip(writes.read<std::uint64_t>());
+		}
+	}
+
+	for (auto it = write_offsets.rbegin(); it != write_offsets.rend(); ++it) {
+		writes.seek(*it);
+		if (writes.read<std::uint8_t>() == register_write) {
+			auto reg_id = writes.read<RegisterId>();
+			writes.read(do_register_rw_buffers(reg_id).second, trace().decoder().register_size(reg_id));
+		} else {
+			auto address = writes.read<std::uint64_t>();
+			auto size = writes.read<std::uint64_t>();
+			while (size > 0) {
+				auto buffer = do_memory_before_write(address, size);
+				writes.read(buffer.first, buffer.second);
+				do_memory_after_write(address, buffer.first, buffer.second);
+				address += buffer.second;
+				size -= buffer.second;
+			}
+		}
+	}
+
+	seek(event.context_id, event.stream_pos);
+	events_.pop_back();
+	head_ = event.offset;
+	return true;
+}
+
+void ReverseCursor::clear_undo_log()
+{
+	events_.clear();
+	head_ = 0;
+}
+
+}}}}}
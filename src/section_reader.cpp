@@ -1,6 +1,10 @@
 #include <section_reader.h>
 
 #include <cstring>
+#include <sstream>
+
+#include <rvnmetadata/metadata-common.h>
+#include <rvnmetadata/metadata-bin.h>
 
 #include <reader_errors.h>
 
@@ -81,6 +85,20 @@ void SectionReader::read(std::uint8_t* buffer, std::size_t size)
 	}
 }
 
+void SectionReader::skip(std::uint64_t size)
+{
+	if (size > bytes_lefts_)
+		throw UnexpectedEndOfSection(name());
+
+	if (size <= bytes_left_in_stream_buffer_) {
+		bytes_read_in_buffer_ += size;
+		bytes_left_in_stream_buffer_ -= size;
+		bytes_lefts_ -= size;
+	} else {
+		seek(stream_pos() + size);
+	}
+}
+
 void SectionReader::fill_stream_buffer()
 {
 	auto size = std::min<std::size_t>(bytes_lefts_, stream_buffer_.size());
@@ -93,4 +111,14 @@ void SectionReader::fill_stream_buffer()
 	bytes_left_in_stream_buffer_ = size;
 }
 
+bool format_version_at_least(binresource::Reader& reader, unsigned major, unsigned minor)
+{
+	std::istringstream version(metadata::from_raw_metadata(reader.metadata()).format_version().to_string());
+	unsigned version_major = 0;
+	unsigned version_minor = 0;
+	char dot = 0;
+	version >> version_major >> dot >> version_minor;
+	return version_major > major or (version_major == major and version_minor >= minor);
+}
+
 }}}}}
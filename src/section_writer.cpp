@@ -11,9 +11,16 @@ namespace file {
 namespace libbintrace {
 
 SectionWriter::SectionWriter(const char* name, binresource::Writer* writer)
-  : name_(name), writer_(writer), bytes_written_(0), total_bytes_flushed_(0), bytes_not_flushed_(0)
+  : SectionWriter(name, writer, 0)
 {
-	writer_->stream().write(reinterpret_cast<const char*>(&bytes_written_), sizeof(bytes_written_));
+}
+
+SectionWriter::SectionWriter(const char* name, binresource::Writer* writer, std::uint64_t first_position)
+  : name_(name), writer_(writer), first_position_(first_position), bytes_written_(first_position),
+    total_bytes_flushed_(first_position), bytes_not_flushed_(0)
+{
+	std::uint64_t size = 0;
+	writer_->stream().write(reinterpret_cast<const char*>(&size), sizeof(size));
 	stream_buffer_.resize(1024*1024*4);
 	ensure_stream_status();
 }
@@ -21,9 +28,10 @@ SectionWriter::SectionWriter(const char* name, binresource::Writer* writer)
 void SectionWriter::finalize()
 {
 	flush_stream_buffer();
-	writer_->stream().seekp(0 - bytes_written_ - sizeof(std::uint64_t), std::ios::cur);
-	writer_->stream().write(reinterpret_cast<const char*>(&bytes_written_), sizeof(bytes_written_));
-	writer_->stream().seekp(bytes_written_, std::ios::cur);
+	std::uint64_t size = bytes_written_ - first_position_;
+	writer_->stream().seekp(0 - size - sizeof(std::uint64_t), std::ios::cur);
+	writer_->stream().write(reinterpret_cast<const char*>(&size), sizeof(size));
+	writer_->stream().seekp(size, std::ios::cur);
 	ensure_stream_status();
 }
 
@@ -89,6 +97,16 @@ ExternalSectionTraceWriter::ExternalSectionTraceWriter(binresource::Writer&& wri
 		throw std::logic_error("Creating ExternalSectionTraceWriter with bad writer");
 }
 
+ExternalSectionTraceWriter::ExternalSectionTraceWriter(binresource::Writer&& writer, const MachineDescription& machine,
+                             const char* writer_name, std::uint64_t first_position)
+  : writer_(std::move(writer))
+  , machine_(machine)
+  , section_writer_(writer_name, &writer_, first_position)
+{
+	if (not writer_.stream())
+		throw std::logic_error("Creating ExternalSectionTraceWriter with bad writer");
+}
+
 ExternalSectionTraceWriter::ExternalSectionTraceWriter(ExternalSectionTraceWriter&& rhs)
   : writer_(std::move(rhs.writer_))
   , machine_(std::move(rhs.machine_))
@@ -0,0 +1,280 @@
+#include <segment_summaries.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <index_sections.h>
+#include <reader_errors.h>
+#include <section_reader.h>
+#include <section_writer.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+//! End of `[address, address + size)`, cut one byte short at the end of the address space.
+std::uint64_t range_end(std::uint64_t address, std::uint64_t size)
+{
+	return size > std::numeric_limits<std::uint64_t>::max() - address ? std::numeric_limits<std::uint64_t>::max()
+	                                                                  : address + size;
+}
+
+//! The positions of the bits of `line` in a filter of `bit_count` bits, a power of two, by double hashing.
+template <typename Visitor>
+void visit_filter_bits(std::uint64_t line, std::uint64_t bit_count, Visitor&& visit)
+{
+	// splitmix64 finalizer
+	auto hash = line + 0x9e3779b97f4a7c15ull;
+	hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+	hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+	hash ^= hash >> 31;
+
+	auto step = (hash >> 32) | 1;
+	for (std::uint32_t i = 0; i < SegmentSummaries::filter_hash_count; ++i) {
+		if (not visit((hash + i * step) & (bit_count - 1)))
+			return;
+	}
+}
+
+}
+
+/**
+ * Collects the memory writes of a segment, to summarize it.
+ */
+class SegmentSummaries::Scanner : public MemoryWriteScanner
+{
+public:
+	using MemoryWriteScanner::MemoryWriteScanner;
+
+	const std::vector<std::pair<std::uint64_t, std::uint64_t>>& writes() const { return writes_; }
+
+protected:
+	void do_scan_memory_write(std::uint64_t, std::uint64_t address, std::uint64_t size) override
+	{
+		writes_.emplace_back(address, size);
+	}
+
+private:
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> writes_;
+};
+
+constexpr std::uint32_t SegmentSummaries::line_size;
+constexpr std::uint32_t SegmentSummaries::filter_bits_per_line;
+constexpr std::uint32_t SegmentSummaries::filter_hash_count;
+
+SegmentSummaries::SegmentSummaries(std::uint32_t page_size)
+  : page_size_(page_size)
+{
+	if (page_size < line_size or (page_size & (page_size - 1)) != 0)
+		throw std::invalid_argument("Summary page size must be a power of two, at least a cache line, not " +
+		                            std::to_string(page_size));
+}
+
+SegmentSummaries SegmentSummaries::build(const ReplayEngine& engine, ThreadPool& pool, std::uint32_t page_size)
+{
+	SegmentSummaries result(page_size);
+	const auto& trace = engine.trace();
+
+	engine.replay(
+	  pool,
+	  [&trace](const ReplaySegment&) { return std::make_unique<Scanner>(trace); },
+	  [&result](const ReplaySegment& segment, std::unique_ptr<SegmentHandler>&& handler) {
+		  result.add_segment(segment.start_context, segment.end_context,
+		                     static_cast<const Scanner&>(*handler).writes());
+	  });
+
+	return result;
+}
+
+SegmentSummaries::SegmentSummaries(const std::string& filename)
+  : SegmentSummaries(std::make_unique<std::ifstream>(filename, std::ios::binary))
+{
+}
+
+SegmentSummaries::SegmentSummaries(std::unique_ptr<std::istream>&& input_stream)
+{
+	auto reader = open_index_reader(std::move(input_stream));
+
+	page_size_ = read_index_header(reader, IndexKind::SegmentSummaries).granularity;
+	if (page_size_ < line_size or (page_size_ & (page_size_ - 1)) != 0)
+		throw MalformedSection("index header", "page size " + std::to_string(page_size_) +
+		                                       " is not a power of two of at least a cache line");
+
+	SectionReader section_reader("index segments", reader);
+	if (section_reader.read<std::uint32_t>() != line_size or section_reader.read<std::uint32_t>() != filter_hash_count)
+		throw MalformedSection("index segments", "unsupported cache line size or hash count");
+
+	for (auto count = section_reader.read<std::uint64_t>(); count > 0; --count) {
+		SegmentSummary summary;
+		summary.start_context = section_reader.read<std::uint64_t>();
+		summary.end_context = section_reader.read<std::uint64_t>();
+		if (not summaries_.empty() and summary.start_context < summaries_.back().end_context)
+			throw MalformedSection("index segments", "segments are not sorted");
+
+		summary.pages.resize(section_reader.read<std::uint64_t>());
+		for (auto& page : summary.pages)
+			page = section_reader.read<std::uint64_t>();
+		if (std::adjacent_find(summary.pages.begin(), summary.pages.end(), std::greater_equal<std::uint64_t>()) !=
+		    summary.pages.end())
+			throw MalformedSection("index segments", "pages are not sorted");
+
+		summary.lines_filter.resize(section_reader.read<std::uint64_t>());
+		auto filter_size = summary.lines_filter.size();
+		if ((filter_size & (filter_size - 1)) != 0)
+			throw MalformedSection("index segments", "filter size is not a power of two");
+		for (auto& word : summary.lines_filter)
+			word = section_reader.read<std::uint64_t>();
+
+		summaries_.push_back(std::move(summary));
+	}
+	section_reader.seek_to_end();
+}
+
+void SegmentSummaries::write(std::unique_ptr<std::ostream>&& output_stream, const char* tool_name,
+                             const char* tool_version, const char* tool_info) const
+{
+	auto writer = create_index_writer(std::move(output_stream), tool_name, tool_version, tool_info);
+
+	std::uint64_t event_count = summaries_.empty() ? 0 : summaries_.back().end_context;
+	write_index_header(writer, { IndexKind::SegmentSummaries, page_size_, event_count });
+
+	SectionWriter section_writer("index segments", &writer);
+	section_writer.write<std::uint32_t>(line_size);
+	section_writer.write<std::uint32_t>(filter_hash_count);
+	section_writer.write<std::uint64_t>(summaries_.size());
+	for (const auto& summary : summaries_) {
+		section_writer.write<std::uint64_t>(summary.start_context);
+		section_writer.write<std::uint64_t>(summary.end_context);
+		section_writer.write<std::uint64_t>(summary.pages.size());
+		for (auto page : summary.pages)
+			section_writer.write<std::uint64_t>(page);
+		section_writer.write<std::uint64_t>(summary.lines_filter.size());
+		for (auto word : summary.lines_filter)
+			section_writer.write<std::uint64_t>(word);
+	}
+	section_writer.finalize();
+}
+
+void SegmentSummaries::add_segment(std::uint64_t start_context, std::uint64_t end_context,
+                                   const std::vector<std::pair<std::uint64_t, std::uint64_t>>& writes)
+{
+	if (end_context < start_context or (not summaries_.empty() and start_context < summaries_.back().end_context))
+		throw std::invalid_argument("Segment [" + std::to_string(start_context) + ", " + std::to_string(end_context) +
+		                            ") is not after the previous one");
+
+	std::vector<std::uint64_t> lines;
+	for (const auto& write : writes) {
+		if (write.second == 0)
+			continue;
+		auto last_line = (range_end(write.first, write.second) - 1) / line_size;
+		for (auto line = write.first / line_size; line <= last_line; ++line)
+			lines.push_back(line);
+	}
+	std::sort(lines.begin(), lines.end());
+	lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+	SegmentSummary summary;
+	summary.start_context = start_context;
+	summary.end_context = end_context;
+
+	const auto lines_per_page = page_size_ / line_size;
+	for (auto line : lines) {
+		auto page = line / lines_per_page * page_size_;
+		if (summary.pages.empty() or summary.pages.back() != page)
+			summary.pages.push_back(page);
+	}
+
+	if (not lines.empty()) {
+		std::uint64_t word_count = 1;
+		while (word_count * 64 < lines.size() * filter_bits_per_line)
+			word_count *= 2;
+		summary.lines_filter.resize(word_count);
+		for (auto line : lines) {
+			visit_filter_bits(line, word_count * 64, [&summary](std::uint64_t bit) {
+				summary.lines_filter[bit / 64] |= std::uint64_t(1) << (bit % 64);
+				return true;
+			});
+		}
+	}
+
+	summaries_.push_back(std::move(summary));
+}
+
+bool SegmentSummaries::may_write(const SegmentSummary& summary, std::uint64_t address, std::uint64_t size) const
+{
+	if (size == 0 or summary.lines_filter.empty())
+		return false;
+
+	auto end = range_end(address, size);
+	auto first_page = address & ~std::uint64_t(page_size_ - 1);
+	auto bit_count = summary.lines_filter.size() * 64;
+
+	// Only the lines of written pages can be in the filter
+	for (auto page = std::lower_bound(summary.pages.begin(), summary.pages.end(), first_page);
+	     page != summary.pages.end() and *page < end; ++page) {
+		auto first_line = std::max(address, *page) / line_size;
+		auto last_line = (std::min(end, *page + page_size_) - 1) / line_size;
+		for (auto line = first_line; line <= last_line; ++line) {
+			bool found = true;
+			visit_filter_bits(line, bit_count, [&summary, &found](std::uint64_t bit) {
+				found = (summary.lines_filter[bit / 64] >> (bit % 64)) & 1;
+				return found;
+			});
+			if (found)
+				return true;
+		}
+	}
+	return false;
+}
+
+bool SegmentSummaries::find_candidate_segments(std::uint64_t address, std::uint64_t size, std::uint64_t first_context,
+                                               std::uint64_t last_context, std::vector<std::size_t>& result) const
+{
+	if (first_context >= last_context)
+		return true;
+
+	// Segments are sorted and disjoint, so their ends are sorted too.
+	auto it = std::upper_bound(summaries_.begin(), summaries_.end(), first_context,
+	                           [](std::uint64_t value, const SegmentSummary& summary) {
+		                           return value < summary.end_context;
+	                           });
+	// Events before this one are in a segment
+	auto covered = first_context;
+	for (; it != summaries_.end() and it->start_context < last_context; ++it) {
+		if (it->start_context > covered)
+			return false;
+		covered = it->end_context;
+		if (may_write(*it, address, size))
+			result.push_back(it - summaries_.begin());
+	}
+	return covered >= last_context;
+}
+
+std::vector<std::size_t> SegmentSummaries::candidate_segments(std::uint64_t address, std::uint64_t size,
+                                                              std::uint64_t first_context,
+                                                              std::uint64_t last_context) const
+{
+	std::vector<std::size_t> result;
+	if (not find_candidate_segments(address, size, first_context, last_context, result))
+		throw std::out_of_range("Events [" + std::to_string(first_context) + ", " + std::to_string(last_context) +
+		                        ") are not all summarized");
+	return result;
+}
+
+bool SegmentSummaries::may_change(std::uint64_t address, std::uint64_t size, std::uint64_t first_context,
+                                  std::uint64_t last_context) const
+{
+	std::vector<std::size_t> candidates;
+	return not find_candidate_segments(address, size, first_context, last_context, candidates) or
+	       not candidates.empty();
+}
+
+}}}}}
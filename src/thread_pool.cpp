@@ -0,0 +1,159 @@
+#include <thread_pool.h>
+
+#include <algorithm>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+//! The pool and worker index the current thread belongs to, if any.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_worker = 0;
+
+}
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+  : next_worker_(0), queued_(0), pending_(0), stopping_(false)
+{
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	for (std::size_t i = 0; i < thread_count; ++i)
+		workers_.push_back(std::make_unique<Worker>());
+	for (std::size_t i = 0; i < thread_count; ++i)
+		threads_.emplace_back([this, i]() { run(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		all_done_.wait(lock, [this]() { return pending_ == 0; });
+		stopping_ = true;
+	}
+	task_available_.notify_all();
+
+	for (auto& thread : threads_)
+		thread.join();
+}
+
+void ThreadPool::submit(Task task)
+{
+	auto worker_index = current_pool == this ? current_worker : next_worker_++ % workers_.size();
+	{
+		std::lock_guard<std::mutex> lock(workers_[worker_index]->mutex);
+		workers_[worker_index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++queued_;
+		++pending_;
+	}
+	task_available_.notify_one();
+}
+
+void ThreadPool::parallel_for(std::size_t count, const std::function<void(std::size_t)>& task)
+{
+	std::mutex mutex;
+	std::condition_variable done;
+	std::size_t remaining = count;
+	std::exception_ptr error;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		submit([&, i]() {
+			std::exception_ptr task_error;
+			try {
+				task(i);
+			} catch (...) {
+				task_error = std::current_exception();
+			}
+
+			// Notify while holding the lock: the caller's stack can go away as soon as it is released.
+			std::lock_guard<std::mutex> lock(mutex);
+			if (task_error and not error)
+				error = task_error;
+			if (--remaining == 0)
+				done.notify_all();
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&remaining]() { return remaining == 0; });
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	all_done_.wait(lock, [this]() { return pending_ == 0; });
+
+	if (error_) {
+		auto error = error_;
+		error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+ThreadPool::Task ThreadPool::take_task(std::size_t worker_index)
+{
+	// A task was claimed, so one is guaranteed to be in some queue: own queue first, newest task first, then steal
+	// the oldest task of the others.
+	for (;;) {
+		{
+			auto& worker = *workers_[worker_index];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if (not worker.tasks.empty()) {
+				auto task = std::move(worker.tasks.back());
+				worker.tasks.pop_back();
+				return task;
+			}
+		}
+
+		for (std::size_t i = 1; i < workers_.size(); ++i) {
+			auto& victim = *workers_[(worker_index + i) % workers_.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (not victim.tasks.empty()) {
+				auto task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return task;
+			}
+		}
+	}
+}
+
+void ThreadPool::run(std::size_t worker_index)
+{
+	current_pool = this;
+	current_worker = worker_index;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			task_available_.wait(lock, [this]() { return queued_ > 0 or stopping_; });
+			if (queued_ == 0)
+				return;
+			--queued_;
+		}
+
+		auto task = take_task(worker_index);
+		std::exception_ptr error;
+		try {
+			task();
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (error and not error_)
+			error_ = error;
+		if (--pending_ == 0)
+			all_done_.notify_all();
+	}
+}
+
+}}}}}
@@ -0,0 +1,259 @@
+#include <trace_and_cache_writer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <event_decoder.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+namespace {
+
+void set_bit(std::vector<std::uint64_t>& bitmap, std::uint64_t bit)
+{
+	bitmap[bit / 64] |= std::uint64_t(1) << (bit % 64);
+}
+
+bool test_and_clear_bit(std::vector<std::uint64_t>& bitmap, std::uint64_t bit)
+{
+	auto mask = std::uint64_t(1) << (bit % 64);
+	bool was_set = (bitmap[bit / 64] & mask) != 0;
+	bitmap[bit / 64] &= ~mask;
+	return was_set;
+}
+
+}
+
+TraceAndCacheWriter::TraceAndCacheWriter(std::unique_ptr<std::ostream>&& trace_stream,
+                                         std::unique_ptr<std::ostream>&& cache_stream, std::uint32_t page_size,
+                                         const MachineDescription& machine,
+                                         const std::vector<const std::uint8_t*>& initial_memory,
+                                         const RegisterFile& initial_registers, CachePointInterval interval,
+                                         const CachePointsOptions& cache_options,
+                                         const char* tool_name, const char* tool_version, const char* tool_info,
+                                         const EventsOptions& events_options)
+  : trace_writer_(std::move(trace_stream), machine, tool_name, tool_version, tool_info, events_options)
+  , cache_writer_(std::move(cache_stream), page_size, machine, tool_name, tool_version, tool_info)
+  , page_size_(page_size)
+  , interval_(interval)
+  , machine_(machine)
+  , registers_(machine)
+  , last_cache_point_context_(0)
+  , copying_pages_(false)
+  , background_(1)
+  , finished_(false)
+{
+	if (page_size_ == 0 or (page_size_ & (page_size_ - 1)) != 0)
+		throw std::invalid_argument("Page size must be a power of two");
+	if (initial_memory.size() != machine_.memory_regions.size())
+		throw std::invalid_argument("Initial memory must be given for each memory region");
+
+	registers_.copy_from(initial_registers);
+
+	std::uint64_t page_bits = 0;
+	for (std::size_t i = 0; i < machine_.memory_regions.size(); ++i) {
+		const auto& region = machine_.memory_regions[i];
+		auto first_page = (region.start + page_size_ - 1) & ~std::uint64_t(page_size_ - 1);
+		auto end_page = (region.start + region.size) & ~std::uint64_t(page_size_ - 1);
+		auto page_count = end_page > first_page ? (end_page - first_page) / page_size_ : 0;
+
+		regions_.push_back({ region.start, std::vector<std::uint8_t>(initial_memory[i], initial_memory[i] + region.size),
+		                     first_page, page_count, page_bits });
+		page_bits += page_count;
+	}
+	dirty_pages_.resize((page_bits + 63) / 64, 0);
+	pending_pages_.resize(dirty_pages_.size(), 0);
+
+	auto memory_writer = trace_writer_.start_initial_memory_section();
+	for (const auto& region : regions_)
+		memory_writer.write(region.content.data(), region.content.size());
+
+	auto registers_writer = trace_writer_.start_initial_registers_section(std::move(memory_writer));
+	for (auto reg_id : registers_.register_ids())
+		registers_writer.write(reg_id, registers_.get(reg_id), registers_.register_size(reg_id));
+
+	events_ = std::make_unique<EventsSectionWriter>(trace_writer_.start_events_section(std::move(registers_writer)));
+	cache_points_ = std::make_unique<CachePointsSectionWriter>(cache_writer_.start_cache_points_section(cache_options));
+	last_cache_point_stream_pos_ = events_->stream_pos();
+}
+
+TraceAndCacheWriter::~TraceAndCacheWriter()
+{
+	try {
+		background_.wait();
+	} catch (...) {
+	}
+}
+
+void TraceAndCacheWriter::start_event_instruction()
+{
+	events_->start_event_instruction();
+}
+
+void TraceAndCacheWriter::start_event_other(const std::string& description)
+{
+	events_->start_event_other(description);
+}
+
+void TraceAndCacheWriter::write_memory(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size)
+{
+	events_->write_memory(address, buffer, size);
+	++replay_work_.memory_writes;
+
+	std::unique_lock<std::mutex> lock(pages_mutex_, std::defer_lock);
+	if (copying_pages_)
+		lock.lock();
+
+	for (auto& region : regions_) {
+		auto begin = std::max(address, region.start);
+		auto end = std::min(address + size, region.start + region.content.size());
+		if (begin >= end)
+			continue;
+
+		if (region.page_count != 0) {
+			auto first_page = std::max(begin, region.first_page);
+			auto end_page = std::min(end, region.first_page + region.page_count * page_size_);
+			for (auto page = first_page & ~std::uint64_t(page_size_ - 1); page < end_page; page += page_size_) {
+				auto bit = region.first_bit + (page - region.first_page) / page_size_;
+				if (lock.owns_lock() and test_and_clear_bit(pending_pages_, bit)) {
+					auto content = region.content.data() + (page - region.start);
+					pending_->preserved_pages.emplace(bit, std::vector<std::uint8_t>(content, content + page_size_));
+				}
+				set_bit(dirty_pages_, bit);
+			}
+		}
+
+		std::memcpy(region.content.data() + (begin - region.start), buffer + (begin - address), end - begin);
+	}
+}
+
+void TraceAndCacheWriter::write_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size)
+{
+	events_->write_register(reg_id, buffer, size);
+	++replay_work_.register_writes;
+	registers_.set(reg_id, buffer, size);
+}
+
+void TraceAndCacheWriter::write_register_action(RegisterId reg_id)
+{
+	events_->write_register_action(reg_id);
+	++replay_work_.register_writes;
+
+	const auto& operation = machine_.register_operations.at(static_cast<std::uint8_t>(reg_id));
+	auto reg = registers_.get(operation.register_id);
+	apply_register_operation(operation, reg, reg);
+}
+
+void TraceAndCacheWriter::write_register_set(const std::vector<std::pair<RegisterId, const std::uint8_t*>>& writes)
+{
+	events_->write_register_set(writes);
+	replay_work_.register_writes += writes.size();
+	for (const auto& write : writes)
+		registers_.set(write.first, write.second, registers_.register_size(write.first));
+}
+
+void TraceAndCacheWriter::finish_event()
+{
+	events_->finish_event();
+
+	replay_work_.events = event_count() - last_cache_point_context_;
+	replay_work_.bytes = events_->stream_pos() - last_cache_point_stream_pos_;
+	if ((interval_.events != 0 and replay_work_.events >= interval_.events) or
+	    (interval_.trace_bytes != 0 and replay_work_.bytes >= interval_.trace_bytes) or
+	    (interval_.max_replay_cost != 0 and interval_.cost_model.cost(replay_work_) >= interval_.max_replay_cost))
+		emit_cache_point();
+}
+
+void TraceAndCacheWriter::emit_cache_point()
+{
+	if (event_count() == last_cache_point_context_)
+		return;
+
+	// Only one cache point at a time: the previous one must be complete before its pending pages are replaced.
+	background_.wait();
+
+	auto cache_point = std::make_unique<PendingCachePoint>();
+	cache_point->context_id = event_count();
+	cache_point->trace_stream_pos = events_->stream_pos();
+	cache_point->registers = registers_;
+
+	for (std::size_t word = 0; word < dirty_pages_.size(); ++word) {
+		for (auto bits = dirty_pages_[word]; bits != 0; bits &= bits - 1)
+			cache_point->page_bits.push_back(word * 64 + __builtin_ctzll(bits));
+	}
+
+	pending_ = std::move(cache_point);
+	pending_pages_.swap(dirty_pages_);
+	std::fill(dirty_pages_.begin(), dirty_pages_.end(), 0);
+	copying_pages_ = true;
+
+	last_cache_point_context_ = pending_->context_id;
+	last_cache_point_stream_pos_ = pending_->trace_stream_pos;
+	replay_work_ = ReplayWork();
+
+	background_.submit([this]() {
+		try {
+			write_cache_point(*pending_);
+		} catch (...) {
+			copying_pages_ = false;
+			throw;
+		}
+		copying_pages_ = false;
+	});
+}
+
+void TraceAndCacheWriter::write_cache_point(PendingCachePoint& cache_point)
+{
+	cache_points_->start_cache_point(cache_point.context_id, cache_point.trace_stream_pos);
+	for (auto reg_id : cache_point.registers.register_ids())
+		cache_points_->write_register(reg_id, cache_point.registers.get(reg_id),
+		                              cache_point.registers.register_size(reg_id));
+
+	std::vector<std::uint8_t> page(page_size_);
+	for (auto bit : cache_point.page_bits) {
+		auto address = page_address(bit);
+		{
+			std::lock_guard<std::mutex> lock(pages_mutex_);
+			if (test_and_clear_bit(pending_pages_, bit)) {
+				for (const auto& region : regions_) {
+					if (bit >= region.first_bit and bit < region.first_bit + region.page_count) {
+						std::memcpy(page.data(), region.content.data() + (address - region.start), page_size_);
+						break;
+					}
+				}
+			} else {
+				page = cache_point.preserved_pages.at(bit);
+			}
+		}
+		cache_points_->write_memory_page(address, page.data());
+	}
+
+	cache_points_->finish_cache_point();
+}
+
+std::uint64_t TraceAndCacheWriter::page_address(std::uint64_t bit) const
+{
+	for (const auto& region : regions_) {
+		if (bit >= region.first_bit and bit < region.first_bit + region.page_count)
+			return region.first_page + (bit - region.first_bit) * page_size_;
+	}
+	throw std::logic_error("Page bit outside of memory regions");
+}
+
+void TraceAndCacheWriter::finish()
+{
+	if (finished_)
+		throw std::logic_error("Called finish twice");
+	finished_ = true;
+
+	background_.wait();
+	trace_writer_.finish_events_section(std::move(*events_));
+	cache_writer_.finish_cache_points_section(std::move(*cache_points_));
+}
+
+}}}}}
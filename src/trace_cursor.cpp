@@ -0,0 +1,31 @@
+#include <trace_cursor.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+TraceCursor::TraceCursor(const TraceFile& trace)
+  : trace_(&trace), events_(trace, TraceFile::first_event_stream_pos()), current_event_id_(0)
+{
+}
+
+void TraceCursor::seek(std::uint64_t context_id, std::uint64_t stream_position)
+{
+	events_.seek(stream_position);
+	current_event_id_ = context_id;
+}
+
+bool TraceCursor::read_next_event()
+{
+	if (current_event_id_ >= trace_->event_count())
+		return false;
+
+	events_.decode(*this);
+	current_event_id_++;
+
+	return true;
+}
+
+}}}}}
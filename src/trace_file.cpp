@@ -0,0 +1,117 @@
+#include <trace_file.h>
+
+#include <fstream>
+
+#include <common.h>
+#include <buffer_reader.h>
+#include <section_reader.h>
+#include <trace_section_readers.h>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+TraceFile::TraceFile(const std::string& filename)
+  : TraceFile(binresource::Reader::open(std::make_unique<std::ifstream>(filename, std::ios::binary)),
+              std::make_unique<MappedFile>(filename))
+{
+}
+
+TraceFile::TraceFile(std::unique_ptr<std::istream>&& input_stream)
+  : TraceFile(binresource::Reader::open(std::move(input_stream)), nullptr)
+{
+}
+
+TraceFile::TraceFile(binresource::Reader&& reader, std::unique_ptr<MappedFile>&& mapping)
+  : reader_(std::move(reader)), mapping_(std::move(mapping)), events_(nullptr), events_size_(0), event_count_(0)
+{
+	if (not reader_.stream())
+		throw UnexpectedEndOfStream("trace magic");
+
+	if (metadata().type() != metadata::ResourceType::TraceBin) {
+		throw IncompatibleTypeException("Can't open a resource of type different from TraceBin");
+	}
+
+	const auto cmp = metadata().format_version().compare(metadata::Version::from_string(format_version));
+
+	if (!cmp.is_compatible()) {
+		if (cmp.detail < metadata::Version::Comparison::Current) {
+			throw IncompatibleVersionException(
+				("Incompatible version " + metadata().format_version().to_string() + ": Past version").c_str()
+			);
+		} else {
+			throw IncompatibleVersionException(
+				("Incompatible version " + metadata().format_version().to_string() + ": Future version").c_str()
+			);
+		}
+	}
+
+	header_ = read_trace_header(reader_);
+
+	machine_ = read_trace_machine_description(reader_);
+
+	decoder_ = EventDecoder(machine_);
+
+	SectionReader regions_reader("trace memory", reader_);
+	if (regions_reader.bytes_left() != machine_.total_physical_size())
+		throw MalformedSection(regions_reader.name(),
+		                       std::string("Section size does not fit initial memory regions size: " +
+		                                   std::to_string(regions_reader.bytes_left()) + " != " +
+		                                   std::to_string(machine_.total_physical_size())));
+
+	if (mapping_) {
+		for (const auto& region : machine_.memory_regions) {
+			std::uint64_t position = reader_.stream().tellg();
+			reader_.stream().seekg(region.size, std::ios_base::cur);
+			if (not reader_.stream() or position + region.size > mapping_->size())
+				throw UnexpectedEndOfStream(regions_reader.name());
+			memory_regions_.push_back(mapping_->data() + position);
+		}
+	} else {
+		loaded_memory_.resize(machine_.total_physical_size());
+		std::uint64_t position = 0;
+		for (const auto& region : machine_.memory_regions) {
+			regions_reader.read(loaded_memory_.data() + position, region.size);
+			memory_regions_.push_back(loaded_memory_.data() + position);
+			position += region.size;
+		}
+	}
+
+	initial_registers_ = read_initial_cpu_context(reader_, machine_);
+
+	SectionReader events_reader("trace events", reader_);
+	if (events_reader.bytes_left() == 0)
+		throw MalformedSection(events_reader.name(), "Section cannot be of size 0");
+	events_size_ = events_reader.bytes_left();
+
+	if (mapping_) {
+		std::uint64_t position = events_reader.section_stream_pos();
+		if (position + events_size_ > mapping_->size())
+			throw UnexpectedEndOfStream(events_reader.name());
+		events_ = mapping_->data() + position;
+	} else {
+		loaded_events_.resize(events_size_);
+		events_reader.read(loaded_events_.data(), events_size_);
+		events_ = loaded_events_.data();
+	}
+
+	BufferReader events(events_reader.name(), events_, events_size_);
+	event_count_ = events.read<std::uint64_t>();
+
+	if (header_.event_templates) {
+		// The table of templates is not part of the events, as far as readers are concerned
+		auto templates = read_event_templates(events, events_size_, machine_, events_size_);
+		decoder_ = EventDecoder(machine_, templates);
+	}
+
+	if (header_.events_layout == EventsLayout::Columnar) {
+		event_blocks_ = read_event_block_table(events, events_size_);
+		if (event_blocks_.empty() != (event_count_ == 0) or
+		    (not event_blocks_.empty() and event_blocks_.back().first_event_id >= event_count_))
+			throw MalformedSection(events.name(), "Table of blocks does not match the event count");
+	}
+}
+
+}}}}}
@@ -1,6 +1,7 @@
 #include <trace_section_readers.h>
 
 #include <algorithm>
+#include <string>
 
 #include <reader_errors.h>
 #include <section_reader.h>
@@ -22,6 +23,22 @@ Header read_trace_header(binresource::Reader& reader)
 	if (result.compression)
 		throw UnsupportedFeature("compression");
 
+	// Traces older than 1.3 have no events layout
+	if (format_version_at_least(reader, 1, 3)) {
+		auto layout = section_reader.read<std::uint8_t>();
+		if (layout > static_cast<std::uint8_t>(EventsLayout::Columnar))
+			throw UnsupportedFeature("events layout " + std::to_string(layout));
+		result.events_layout = static_cast<EventsLayout>(layout);
+	}
+
+	// Traces older than 1.5 have no event templates
+	if (format_version_at_least(reader, 1, 5)) {
+		auto templates = section_reader.read<std::uint8_t>();
+		if (templates > 1)
+			throw UnsupportedFeature("event templates " + std::to_string(templates));
+		result.event_templates = templates != 0;
+	}
+
 	section_reader.seek_to_end();
 	return result;
 }
@@ -61,6 +78,8 @@ MachineDescription read_trace_machine_description(binresource::Reader& reader)
 		auto id = section_reader.read<RegisterId>();
 		if (result.registers.find(id) != result.registers.end())
 			throw MalformedSection(section_reader.name(), std::string("register id ") + std::to_string(id) + " is defined twice");
+		if (id == register_set_id)
+			throw MalformedSection(section_reader.name(), std::string("register id ") + std::to_string(id) + " is reserved");
 
 		MachineDescription::Register reg;
 		reg.size = section_reader.read<std::uint16_t>();
@@ -117,34 +136,58 @@ MachineDescription read_trace_machine_description(binresource::Reader& reader)
 		result.static_registers.emplace(name, value);
 	}
 
+	// Traces older than 1.6 have no register encodings, and their section may have trailing bytes
+	if (format_version_at_least(reader, 1, 6)) {
+		for (std::size_t count = section_reader.read<std::uint32_t>(); count > 0; --count) {
+			auto id = section_reader.read<RegisterId>();
+			auto reg = result.registers.find(id);
+			if (reg == result.registers.end())
+				throw MalformedSection(section_reader.name(), std::string("register encoding refered to unknown register id ") +
+				                                        std::to_string(id));
+			if (result.register_encodings.find(id) != result.register_encodings.end())
+				throw MalformedSection(section_reader.name(), std::string("register encoding of ") + reg->second.name +
+				                                        " is defined twice");
+
+			auto encoding = section_reader.read<std::uint8_t>();
+			if (encoding >= static_cast<std::uint8_t>(MachineDescription::RegisterEncoding::RegisterEncodingMax))
+				throw MalformedSection(section_reader.name(),
+				                       std::string("register encoding unknown ") + std::to_string(encoding));
+			if (encoding != 0 and reg->second.size > max_encoded_register_size)
+				throw MalformedSection(section_reader.name(), std::string("register ") + reg->second.name +
+				                                        " is too large to be encoded");
+
+			result.register_encodings.emplace(id, static_cast<MachineDescription::RegisterEncoding>(encoding));
+		}
+	}
+
 	section_reader.seek_to_end();
 	return result;
 }
 
-RegisterContainer read_initial_cpu_context(binresource::Reader& reader, const MachineDescription& machine)
+RegisterFile read_initial_cpu_context(binresource::Reader& reader, const MachineDescription& machine)
 {
 	SectionReader section_reader("trace initial context", reader);
 
-	RegisterContainer result;
+	RegisterFile result(machine);
+	std::vector<bool> found(result.layout()->slot_count(), false);
+	std::size_t found_count = 0;
 
 	for (std::size_t count = section_reader.read<std::uint32_t>(); count > 0; --count) {
 		auto reg_id = section_reader.read<RegisterId>();
-		auto found = std::find_if(result.begin(), result.end(),
-		                          [reg_id](const RegisterContainer::value_type& val) { return val.first == reg_id; });
-		if (found != result.end())
-			throw MalformedSection(section_reader.name(), std::string("Register ") + std::to_string(reg_id) +
-			                                                    " contained twice in initial context");
-		auto reg = machine.registers.find(reg_id);
-		if (reg == machine.registers.end())
+		if (not result.contains(reg_id))
 			throw MalformedSection(section_reader.name(), std::string("Register ") + std::to_string(reg_id) +
 			                                        " is not defined in machine description section");
-		result.emplace_back(reg_id, reg->second.size);
-		section_reader.read(result.back().second.data(), reg->second.size);
+		if (found[reg_id])
+			throw MalformedSection(section_reader.name(), std::string("Register ") + std::to_string(reg_id) +
+			                                                    " contained twice in initial context");
+		found[reg_id] = true;
+		++found_count;
+		section_reader.read(result.get(reg_id), result.register_size(reg_id));
 	}
 
-	if (machine.registers.size() != result.size())
+	if (result.register_count() != found_count)
 		throw MalformedSection(section_reader.name(), std::string("Missing ") +
-		                                        std::to_string(machine.registers.size() - result.size()) +
+		                                        std::to_string(result.register_count() - found_count) +
 		                                        " register(s) in initial context");
 
 	section_reader.seek_to_end();
@@ -1,6 +1,11 @@
 #include <trace_section_writers.h>
 
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <writer_errors.h>
 #include <section_writer.h>
@@ -16,6 +21,8 @@ void write_trace_header(binresource::Writer& writer, const Header& data)
 	SectionWriter section_writer("trace header", &writer);
 
 	section_writer.write<std::uint8_t>(data.compression);
+	section_writer.write<std::uint8_t>(static_cast<std::uint8_t>(data.events_layout));
+	section_writer.write<std::uint8_t>(data.event_templates ? 1u : 0u);
 
 	section_writer.finalize();
 }
@@ -48,6 +55,9 @@ void write_trace_machine_description(binresource::Writer& writer, const MachineD
 
 	section_writer.write<std::uint32_t>(data.registers.size());
 	for (const auto& reg : data.registers) {
+		if (reg.first == register_set_id)
+			throw NonsenseValue(section_writer.name(), std::string("register id ") + std::to_string(reg.first) +
+			                                     " is reserved for register sets");
 		section_writer.write<RegisterId>(reg.first);
 		section_writer.write<std::uint16_t>(reg.second.size);
 		section_writer.write_string<std::uint8_t>(reg.second.name);
@@ -81,6 +91,23 @@ void write_trace_machine_description(binresource::Writer& writer, const MachineD
 		section_writer.write_sized_buffer<std::uint8_t>(static_reg.second.data(), static_reg.second.size());
 	}
 
+	section_writer.write<std::uint32_t>(data.register_encodings.size());
+	for (const auto& encoding : data.register_encodings) {
+		auto reg = data.registers.find(encoding.first);
+		if (reg == data.registers.end())
+			throw NonsenseValue(section_writer.name(), std::string("register encoding refered to unknown register id ") +
+			                                     std::to_string(encoding.first));
+		if (encoding.second >= MachineDescription::RegisterEncoding::RegisterEncodingMax)
+			throw NonsenseValue(section_writer.name(), std::string("register encoding unknown ") +
+			                                     std::to_string(static_cast<std::uint8_t>(encoding.second)));
+		if (encoding.second != MachineDescription::RegisterEncoding::Full and reg->second.size > max_encoded_register_size)
+			throw NonsenseValue(section_writer.name(), std::string("register ") + reg->second.name +
+			                                     " is too large to be encoded");
+
+		section_writer.write<RegisterId>(encoding.first);
+		section_writer.write<std::uint8_t>(static_cast<std::uint8_t>(encoding.second));
+	}
+
 	section_writer.finalize();
 }
 
@@ -120,6 +147,10 @@ void InitialRegistersSectionWriter::write(RegisterId reg_id, const std::uint8_t*
 	section_writer_.write<RegisterId>(reg_id);
 	section_writer_.write_buffer(buffer, size);
 	initial_context_count_++;
+
+	auto encoding = machine_.register_encodings.find(reg_id);
+	if (encoding != machine_.register_encodings.end() and encoding->second != MachineDescription::RegisterEncoding::Full)
+		encoded_register_values_[reg_id].assign(buffer, buffer + size);
 }
 
 void InitialRegistersSectionWriter::do_finalize()
@@ -127,26 +158,189 @@ void InitialRegistersSectionWriter::do_finalize()
 	write_at_position(initial_context_count_, initial_context_count_stream_pos_);
 }
 
-EventsSectionWriter::EventsSectionWriter(binresource::Writer&& writer, const MachineDescription& machine)
+namespace {
+
+//! Number of shapes counted before they become templates, after which counts are reset.
+const std::size_t max_candidate_shapes = 0x1000;
+
+bool is_register_operation(const MachineDescription& machine, RegisterId reg_id)
+{
+	return reg_id < 0xff and
+	       machine.register_operations.find(static_cast<std::uint8_t>(reg_id)) != machine.register_operations.end();
+}
+
+//! Store the new value `next` of a register of `size` bytes relative to its `previous` one with `encoding`, which is not
+//! `Full`, to `value`. Return the size of the stored value. See apply_register_encoding.
+std::size_t encode_register_value(MachineDescription::RegisterEncoding encoding, const std::uint8_t* previous,
+                                  const std::uint8_t* next, std::size_t size, std::uint8_t* value)
+{
+	std::size_t value_size = 0;
+
+	if (encoding == MachineDescription::RegisterEncoding::Xor) {
+		for (std::size_t i = 0; i < size; ++i) {
+			value[i] = previous[i] ^ next[i];
+			if (value[i] != 0)
+				value_size = i + 1;
+		}
+		return value_size;
+	}
+
+	std::uint8_t borrow = 0;
+	for (std::size_t i = 0; i < size; ++i) {
+		auto result = static_cast<int>(next[i]) - previous[i] - borrow;
+		borrow = result < 0;
+		value[i] = result & 0xff;
+	}
+
+	// Drop the high bytes which are the sign extension of the lower ones. A single 0xff byte is still needed for -1.
+	auto sign_extension = [value](std::size_t byte_count) -> std::uint8_t {
+		return byte_count > 0 and (value[byte_count - 1] & 0x80) ? 0xff : 0;
+	};
+	value_size = size;
+	while (value_size > 0 and value[value_size - 1] == sign_extension(value_size) and
+	       sign_extension(value_size - 1) == sign_extension(value_size))
+		--value_size;
+	return value_size;
+}
+
+/**
+ * A column of a block of events, with the writing interface of SectionWriter, so that fields are written the same way
+ * in both layouts.
+ */
+class ColumnBuffer
+{
+public:
+	template <typename WriteType, typename InputType>
+	void write(const InputType& value)
+	{
+		WriteType converted = static_cast<WriteType>(value);
+		if (converted != value)
+			throw ValueTooBig("trace events");
+		write_buffer(reinterpret_cast<const std::uint8_t*>(&converted), sizeof(WriteType));
+	}
+
+	template <typename InputType>
+	void write(const InputType& value, std::size_t max)
+	{
+		if (max > sizeof(InputType))
+			throw ValueTooBig("trace events");
+
+		InputType mask = 0;
+		mask = (~mask);
+		mask >>= (sizeof(InputType) - max)*8;
+		if ((value & mask) != value)
+			throw ValueTooBig("trace events");
+
+		write_buffer(reinterpret_cast<const std::uint8_t*>(&value), max);
+	}
+
+	template <typename T>
+	void write_string(const std::string& str)
+	{
+		if (str.size() != static_cast<T>(str.size()))
+			throw ValueTooBig("trace events");
+
+		write<T>(str.size());
+		write_buffer(reinterpret_cast<const std::uint8_t*>(str.data()), str.size());
+	}
+
+	void write_buffer(const std::uint8_t* buffer, std::size_t size) { data.insert(data.end(), buffer, buffer + size); }
+
+	std::vector<std::uint8_t> data;
+};
+
+}
+
+struct EventsSectionWriter::Block {
+	Block(std::uint64_t block_stream_pos, std::uint64_t block_first_event_id)
+	  : stream_pos(block_stream_pos), first_event_id(block_first_event_id)
+	{
+	}
+
+	std::uint64_t stream_pos;
+	std::uint64_t first_event_id;
+	std::uint32_t event_count = 0;
+
+	ColumnBuffer headers;
+	ColumnBuffer register_ids;
+	//! Write count and contents of each register.
+	std::map<RegisterId, std::pair<std::uint32_t, ColumnBuffer>> register_payloads;
+	ColumnBuffer memory_addresses;
+	ColumnBuffer memory_sizes;
+	ColumnBuffer memory_payloads;
+};
+
+EventsSectionWriter::EventsSectionWriter(binresource::Writer&& writer, const MachineDescription& machine,
+                                         const EventsOptions& options,
+                                         const std::map<RegisterId, std::vector<std::uint8_t>>& initial_values)
 	: ExternalSectionTraceWriter(std::move(writer), machine, "trace events")
 	, event_count_(0)
 	, diff_element_count_stream_pos_(-1)
 	, current_diff_mem_count_(0)
 	, current_diff_reg_count_(0)
+	, options_(options)
+	, recording_(false)
 {
-	event_count_stream_pos_ = stream_pos();
+	event_count_stream_pos_ = ExternalSectionTraceWriter::stream_pos();
 	section_writer_.write<std::uint64_t>(0u);
 	event_count_ = 0;
+
+	for (const auto& reg : machine_.registers)
+		register_slots_.emplace(reg.first, register_slots_.size());
+
+	for (const auto& encoding : machine_.register_encodings) {
+		if (encoding.second == MachineDescription::RegisterEncoding::Full)
+			continue;
+
+		auto& encoded_register = encoded_registers_[encoding.first];
+		encoded_register.encoding = encoding.second;
+		auto initial_value = initial_values.find(encoding.first);
+		if (initial_value != initial_values.end())
+			encoded_register.value = initial_value->second;
+		else
+			encoded_register.value.resize(find_register(encoding.first).size);
+	}
+
+	if (options_.columnar)
+		block_ = std::make_unique<Block>(ExternalSectionTraceWriter::stream_pos(), 0);
 }
 
+EventsSectionWriter::EventsSectionWriter(EventsSectionWriter&&) = default;
+EventsSectionWriter::~EventsSectionWriter() = default;
+
 void EventsSectionWriter::do_finalize()
 {
+	if (block_) {
+		if (block_->event_count > 0)
+			write_block();
+		for (const auto& block : block_table_) {
+			section_writer_.write<std::uint64_t>(block.first_event_id);
+			section_writer_.write<std::uint64_t>(block.stream_pos);
+		}
+		section_writer_.write<std::uint64_t>(block_table_.size());
+	}
+
+	if (options_.template_occurrences != 0)
+		write_template_table();
+
 	write_at_position(event_count_, event_count_stream_pos_);
 }
 
+std::uint64_t EventsSectionWriter::stream_pos()
+{
+	if (not block_)
+		return ExternalSectionTraceWriter::stream_pos();
+
+	// The headers column is the first one of a block, so the position of an event's header is known before the block
+	// is written.
+	if (block_->headers.data.empty())
+		return block_->stream_pos;
+	return block_->stream_pos + EventBlock::header_size + block_->headers.data.size();
+}
+
 bool EventsSectionWriter::is_event_started()
 {
-	return diff_element_count_stream_pos_ != -1;
+	return diff_element_count_stream_pos_ != -1 or recording_;
 }
 
 void EventsSectionWriter::start_event_instruction()
@@ -154,10 +348,19 @@ void EventsSectionWriter::start_event_instruction()
 	if (is_event_started())
 		throw std::logic_error("Called start_event_instruction before finish_event");
 
-	current_diff_mem_count_ = 0;
-	current_diff_reg_count_ = 0;
-	diff_element_count_stream_pos_ = stream_pos();
-	section_writer_.write<std::uint8_t>(0u);
+	start_block_if_full();
+
+	if (options_.template_occurrences == 0) {
+		start_diff();
+		return;
+	}
+
+	recording_ = true;
+	pending_.shape.memory_sizes.clear();
+	pending_.shape.registers.clear();
+	pending_.memory_addresses.clear();
+	pending_.memory_contents.clear();
+	pending_.register_contents.clear();
 }
 
 void EventsSectionWriter::start_event_other(const std::string& description)
@@ -165,10 +368,34 @@ void EventsSectionWriter::start_event_other(const std::string& description)
 	if (is_event_started())
 		throw std::logic_error("Called start_event_other before finish_event");
 
-	section_writer_.write<std::uint8_t>(0xff); // not instruction diff
-	section_writer_.write<std::uint8_t>(0xff); // "other" type
-	section_writer_.write_string<std::uint8_t>(description);
-	start_event_instruction();
+	start_block_if_full();
+
+	auto write_type = [&description](auto& headers) {
+		headers.template write<std::uint8_t>(0xff); // not instruction diff
+		headers.template write<std::uint8_t>(0xff); // "other" type
+		headers.template write_string<std::uint8_t>(description);
+	};
+	if (block_)
+		write_type(block_->headers);
+	else
+		write_type(section_writer_);
+
+	start_diff();
+}
+
+void EventsSectionWriter::start_diff()
+{
+	current_diff_mem_count_ = 0;
+	current_diff_reg_count_ = 0;
+
+	// In the columnar layout, this is the position in the headers column
+	if (block_) {
+		diff_element_count_stream_pos_ = block_->headers.data.size();
+		block_->headers.write<std::uint8_t>(0u);
+	} else {
+		diff_element_count_stream_pos_ = stream_pos();
+		section_writer_.write<std::uint8_t>(0u);
+	}
 }
 
 void EventsSectionWriter::finish_event()
@@ -176,8 +403,25 @@ void EventsSectionWriter::finish_event()
 	if (not is_event_started())
 		throw std::logic_error("Called finish_event before start_event_instruction or other starting function");
 
+	if (recording_) {
+		auto event_template = templates_.find(pending_.shape);
+		if (event_template != templates_.end()) {
+			write_templated_event(event_template->second);
+			recording_ = false;
+			event_count_++;
+			if (block_)
+				block_->event_count++;
+			return;
+		}
+
+		learn_template();
+		write_pending_event();
+	}
+
 	write_event_diff_size();
 	event_count_++;
+	if (block_)
+		block_->event_count++;
 	diff_element_count_stream_pos_ = -1;
 }
 
@@ -191,14 +435,82 @@ void EventsSectionWriter::write_event_diff_size()
 		throw std::logic_error("Cannot write diff size if both mem and ref == 0xf");
 
 	std::uint8_t diff_size = current_diff_mem_count_ | (current_diff_reg_count_ << 4);
-	write_at_position(diff_size, diff_element_count_stream_pos_);
+	if (block_)
+		block_->headers.data[static_cast<std::size_t>(diff_element_count_stream_pos_)] = diff_size;
+	else
+		write_at_position(diff_size, diff_element_count_stream_pos_);
 }
 
 void EventsSectionWriter::continue_on_next_event()
 {
 	write_event_diff_size();
-	diff_element_count_stream_pos_ = -1;
-	start_event_instruction();
+	start_diff();
+}
+
+void EventsSectionWriter::count_register_write()
+{
+	current_diff_reg_count_++;
+	if (current_diff_reg_count_ == 0xf) {
+		continue_on_next_event();
+		current_diff_reg_count_ = 1;
+	}
+}
+
+void EventsSectionWriter::start_block_if_full()
+{
+	if (not block_ or block_->event_count < options_.block_event_count)
+		return;
+
+	write_block();
+	block_ = std::make_unique<Block>(ExternalSectionTraceWriter::stream_pos(), event_count_);
+}
+
+void EventsSectionWriter::write_block()
+{
+	const auto& block = *block_;
+
+	std::uint64_t register_payloads_size = sizeof(std::uint16_t);
+	for (const auto& reg : block.register_payloads)
+		register_payloads_size += sizeof(RegisterId) + sizeof(std::uint32_t) + reg.second.second.data.size();
+
+	const std::uint64_t column_sizes[] = {
+		block.headers.data.size(),          block.register_ids.data.size(), register_payloads_size,
+		block.memory_addresses.data.size(), block.memory_sizes.data.size(), block.memory_payloads.data.size(),
+	};
+
+	std::uint64_t block_size = EventBlock::header_size - sizeof(std::uint64_t);
+	for (auto column_size : column_sizes)
+		block_size += column_size;
+
+	section_writer_.write<std::uint64_t>(block_size);
+	section_writer_.write<std::uint32_t>(block.event_count);
+	for (auto column_size : column_sizes)
+		section_writer_.write<std::uint64_t>(column_size);
+
+	auto write_column = [this](const ColumnBuffer& column) {
+		section_writer_.write_buffer(column.data.data(), column.data.size());
+	};
+
+	write_column(block.headers);
+	write_column(block.register_ids);
+
+	section_writer_.write<std::uint16_t>(block.register_payloads.size());
+	for (const auto& reg : block.register_payloads) {
+		section_writer_.write<RegisterId>(reg.first);
+		// Contents of registers with an encoding vary in size
+		if (encoded_registers_.find(reg.first) == encoded_registers_.end())
+			section_writer_.write<std::uint32_t>(reg.second.first);
+		else
+			section_writer_.write<std::uint32_t>(reg.second.second.data.size());
+	}
+	for (const auto& reg : block.register_payloads)
+		write_column(reg.second.second);
+
+	write_column(block.memory_addresses);
+	write_column(block.memory_sizes);
+	write_column(block.memory_payloads);
+
+	block_table_.push_back({ block.first_event_id, block.stream_pos });
 }
 
 void EventsSectionWriter::write_memory(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size)
@@ -206,23 +518,41 @@ void EventsSectionWriter::write_memory(std::uint64_t address, const std::uint8_t
 	if (not is_event_started())
 		throw std::logic_error("Called write_memory before start_event_instruction or other starting function");
 
-	if (current_diff_reg_count_ > 0)
+	if (recording_ ? not pending_.shape.registers.empty() : current_diff_reg_count_ > 0)
 		throw std::logic_error("Called write_memory after write_packet_register");
 
+	if (recording_) {
+		pending_.shape.memory_sizes.push_back(size);
+		pending_.memory_addresses.push_back(address);
+		pending_.memory_contents.insert(pending_.memory_contents.end(), buffer, buffer + size);
+		return;
+	}
+
+	emit_memory(address, buffer, size);
+}
+
+void EventsSectionWriter::emit_memory(std::uint64_t address, const std::uint8_t* buffer, std::uint64_t size)
+{
 	current_diff_mem_count_++;
 	if (current_diff_mem_count_ == 0xf) {
 		continue_on_next_event();
 		current_diff_mem_count_ = 1;
 	}
 
-	section_writer_.write(address, machine_.physical_address_size);
-	if (size < 0xff) {
-		section_writer_.write<std::uint8_t>(size);
-	} else {
-		section_writer_.write<std::uint8_t>(0xff);
-		section_writer_.write(size, machine_.physical_address_size);
-	}
-	section_writer_.write_buffer(buffer, size);
+	auto write_fields = [this, address, buffer, size](auto& addresses, auto& sizes, auto& payloads) {
+		addresses.write(address, machine_.physical_address_size);
+		if (size < 0xff) {
+			sizes.template write<std::uint8_t>(size);
+		} else {
+			sizes.template write<std::uint8_t>(0xff);
+			sizes.write(size, machine_.physical_address_size);
+		}
+		payloads.write_buffer(buffer, size);
+	};
+	if (block_)
+		write_fields(block_->memory_addresses, block_->memory_sizes, block_->memory_payloads);
+	else
+		write_fields(section_writer_, section_writer_, section_writer_);
 }
 
 void EventsSectionWriter::write_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size)
@@ -234,19 +564,59 @@ void EventsSectionWriter::write_register(RegisterId reg_id, const std::uint8_t*
 	if (reg_size != size)
 		throw NonsenseValue(section_writer_.name(), "Register size doesn't match definition");
 
-	current_diff_reg_count_++;
-	if (current_diff_reg_count_ == 0xf) {
-		continue_on_next_event();
-		current_diff_reg_count_ = 1;
+	if (recording_) {
+		pending_.shape.registers.push_back(reg_id);
+		pending_.register_contents.insert(pending_.register_contents.end(), buffer, buffer + size);
+		return;
 	}
 
-	if (reg_id < 0xff) {
-		section_writer_.write<std::uint8_t>(reg_id);
+	emit_register(reg_id, buffer, size);
+}
+
+void EventsSectionWriter::emit_register(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size)
+{
+	count_register_write();
+
+	auto write_id = [reg_id](auto& ids) {
+		if (reg_id < 0xff) {
+			ids.template write<std::uint8_t>(reg_id);
+		} else {
+			ids.template write<std::uint8_t>(0xff);
+			ids.template write<RegisterId>(reg_id);
+		}
+	};
+	if (block_)
+		write_id(block_->register_ids);
+	else
+		write_id(section_writer_);
+
+	emit_register_content(reg_id, buffer, size);
+}
+
+void EventsSectionWriter::emit_register_content(RegisterId reg_id, const std::uint8_t* buffer, std::uint64_t size)
+{
+	auto encoded_register = encoded_registers_.find(reg_id);
+
+	auto write_content = [this, encoded_register, buffer, size](auto& payloads) {
+		if (encoded_register == encoded_registers_.end()) {
+			payloads.write_buffer(buffer, size);
+			return;
+		}
+
+		auto& previous = encoded_register->second.value;
+		std::uint8_t value[max_encoded_register_size];
+		auto value_size = encode_register_value(encoded_register->second.encoding, previous.data(), buffer, size, value);
+		payloads.template write<std::uint8_t>(value_size);
+		payloads.write_buffer(value, value_size);
+		std::copy(buffer, buffer + size, previous.begin());
+	};
+	if (block_) {
+		auto& payloads = block_->register_payloads[reg_id];
+		payloads.first++;
+		write_content(payloads.second);
 	} else {
-		section_writer_.write<std::uint8_t>(0xff);
-		section_writer_.write<RegisterId>(reg_id);
+		write_content(section_writer_);
 	}
-	section_writer_.write_buffer(buffer, size);
 }
 
 void EventsSectionWriter::write_register_action(RegisterId reg_id)
@@ -258,13 +628,189 @@ void EventsSectionWriter::write_register_action(RegisterId reg_id)
 	if (reg == machine_.register_operations.end())
 		throw NonsenseValue(section_writer_.name(), std::to_string(reg_id) + "in an invalid register operation id");
 
-	current_diff_reg_count_++;
-	if (current_diff_reg_count_ == 0xf) {
-		continue_on_next_event();
-		current_diff_reg_count_ = 1;
+	if (recording_)
+		pending_.shape.registers.push_back(reg_id);
+	else
+		emit_register_action(reg_id);
+}
+
+void EventsSectionWriter::emit_register_action(RegisterId reg_id)
+{
+	count_register_write();
+	apply_register_action(reg_id);
+
+	if (block_)
+		block_->register_ids.write<std::uint8_t>(reg_id);
+	else
+		section_writer_.write<std::uint8_t>(reg_id);
+}
+
+void EventsSectionWriter::apply_register_action(RegisterId reg_id)
+{
+	if (encoded_registers_.empty())
+		return;
+
+	const auto& operation = machine_.register_operations.at(static_cast<std::uint8_t>(reg_id));
+	auto encoded_register = encoded_registers_.find(operation.register_id);
+	if (encoded_register != encoded_registers_.end()) {
+		auto value = encoded_register->second.value.data();
+		apply_register_operation(operation, value, value);
+	}
+}
+
+void EventsSectionWriter::write_register_set(const std::vector<std::pair<RegisterId, const std::uint8_t*>>& writes)
+{
+	if (not is_event_started())
+		throw std::logic_error("Called write_register_set before start_event_instruction or other starting function");
+
+	std::vector<std::uint64_t> mask((register_slots_.size() + 63) / 64, 0);
+	std::vector<const std::uint8_t*> values(register_slots_.size(), nullptr);
+	for (const auto& write : writes) {
+		auto slot = register_slots_.find(write.first);
+		if (slot == register_slots_.end())
+			throw NonsenseValue(section_writer_.name(), std::to_string(write.first) + " is an invalid register id");
+		if (values[slot->second] != nullptr)
+			throw NonsenseValue(section_writer_.name(), std::string("Register ") + std::to_string(write.first) +
+			                                              " is written twice in a register set");
+		mask[slot->second / 64] |= std::uint64_t(1) << (slot->second % 64);
+		values[slot->second] = write.second;
+	}
+
+	// Register sets are not part of templates
+	if (recording_)
+		write_pending_event();
+
+	count_register_write();
+
+	auto write_mask = [&mask, this](auto& ids) {
+		ids.template write<std::uint8_t>(0xff);
+		ids.template write<RegisterId>(register_set_id);
+
+		std::size_t mask_size = (register_slots_.size() + 7) / 8;
+		for (std::size_t i = 0; i < mask.size(); ++i)
+			ids.write(mask[i], std::min<std::size_t>(8, mask_size - i * 8));
+	};
+	if (block_)
+		write_mask(block_->register_ids);
+	else
+		write_mask(section_writer_);
+
+	for (const auto& slot : register_slots_) {
+		auto value = values[slot.second];
+		if (value == nullptr)
+			continue;
+
+		emit_register_content(slot.first, value, find_register(slot.first).size);
+	}
+}
+
+void EventsSectionWriter::write_pending_event()
+{
+	recording_ = false;
+	start_diff();
+
+	auto memory_contents = pending_.memory_contents.data();
+	for (std::size_t i = 0; i < pending_.memory_addresses.size(); ++i) {
+		emit_memory(pending_.memory_addresses[i], memory_contents, pending_.shape.memory_sizes[i]);
+		memory_contents += pending_.shape.memory_sizes[i];
+	}
+
+	auto register_contents = pending_.register_contents.data();
+	for (auto reg_id : pending_.shape.registers) {
+		if (is_register_operation(machine_, reg_id)) {
+			emit_register_action(reg_id);
+		} else {
+			auto size = find_register(reg_id).size;
+			emit_register(reg_id, register_contents, size);
+			register_contents += size;
+		}
+	}
+}
+
+void EventsSectionWriter::write_templated_event(std::size_t template_index)
+{
+	auto write_memory_fields = [this, template_index](auto& headers, auto& addresses, auto& payloads) {
+		headers.template write<std::uint8_t>(0xff); // not instruction diff
+		headers.template write<std::uint8_t>(template_index);
+
+		auto memory_contents = pending_.memory_contents.data();
+		for (std::size_t i = 0; i < pending_.memory_addresses.size(); ++i) {
+			addresses.write(pending_.memory_addresses[i], machine_.physical_address_size);
+			payloads.write_buffer(memory_contents, pending_.shape.memory_sizes[i]);
+			memory_contents += pending_.shape.memory_sizes[i];
+		}
+	};
+	if (block_)
+		write_memory_fields(block_->headers, block_->memory_addresses, block_->memory_payloads);
+	else
+		write_memory_fields(section_writer_, section_writer_, section_writer_);
+
+	auto register_contents = pending_.register_contents.data();
+	for (auto reg_id : pending_.shape.registers) {
+		if (is_register_operation(machine_, reg_id)) {
+			apply_register_action(reg_id);
+			continue;
+		}
+
+		auto size = find_register(reg_id).size;
+		emit_register_content(reg_id, register_contents, size);
+		register_contents += size;
+	}
+}
+
+void EventsSectionWriter::learn_template()
+{
+	const auto& shape = pending_.shape;
+
+	// A templated event has a 2 bytes header, which must be smaller than the diff size, register ids and memory sizes
+	// it replaces. Counts of the table are on 2 bytes.
+	if (template_table_.size() >= max_event_templates or shape.memory_sizes.size() + shape.registers.size() < 2 or
+	    shape.memory_sizes.size() > 0xffff or shape.registers.size() > 0xffff)
+		return;
+
+	// Bound the memory used by shapes that do not recur
+	if (shape_occurrences_.size() >= max_candidate_shapes and shape_occurrences_.find(shape) == shape_occurrences_.end())
+		shape_occurrences_.clear();
+
+	auto occurrences = ++shape_occurrences_[shape];
+	if (occurrences < options_.template_occurrences)
+		return;
+
+	shape_occurrences_.erase(shape);
+	templates_.emplace(shape, template_table_.size());
+	template_table_.push_back(shape);
+	if (template_table_.size() == max_event_templates)
+		shape_occurrences_.clear();
+}
+
+void EventsSectionWriter::write_template_table()
+{
+	ColumnBuffer table;
+	table.write<std::uint8_t>(template_table_.size());
+	for (const auto& event_template : template_table_) {
+		table.write<std::uint16_t>(event_template.memory_sizes.size());
+		for (auto size : event_template.memory_sizes) {
+			if (size < 0xff) {
+				table.write<std::uint8_t>(size);
+			} else {
+				table.write<std::uint8_t>(0xff);
+				table.write(size, machine_.physical_address_size);
+			}
+		}
+
+		table.write<std::uint16_t>(event_template.registers.size());
+		for (auto reg_id : event_template.registers) {
+			if (reg_id < 0xff) {
+				table.write<std::uint8_t>(reg_id);
+			} else {
+				table.write<std::uint8_t>(0xff);
+				table.write<RegisterId>(reg_id);
+			}
+		}
 	}
 
-	section_writer_.write<std::uint8_t>(reg_id);
+	section_writer_.write_buffer(table.data.data(), table.data.size());
+	section_writer_.write<std::uint64_t>(table.data.size());
 }
 
 }}}}}
@@ -1,6 +1,7 @@
 #include <trace_writer.h>
 
 #include <cstdint>
+#include <stdexcept>
 #include <utility>
 #include <set>
 
@@ -23,7 +24,8 @@ using MetaType = ::reven::metadata::ResourceType;
 using MetaVersion = ::reven::metadata::Version;
 
 TraceWriter::TraceWriter(std::unique_ptr<std::ostream>&& output_stream, const MachineDescription& machine_description,
-                         const char* tool_name, const char* tool_version, const char* tool_info)
+                         const char* tool_name, const char* tool_version, const char* tool_info,
+                         const EventsOptions& events_options)
   : writer_([&output_stream, tool_name, tool_version, tool_info]() {
     	const auto md = Meta(
     		MetaType::TraceBin,
@@ -36,9 +38,15 @@ TraceWriter::TraceWriter(std::unique_ptr<std::ostream>&& output_stream, const Ma
     	return binresource::Writer::create(std::move(output_stream), metadata::to_bin_raw_metadata(md));
     }())
   , machine_(machine_description)
+  , events_options_(events_options)
   , initial_section_written_(false)
 {
+	if (events_options_.columnar and events_options_.block_event_count == 0)
+		throw std::invalid_argument("Blocks of events must hold at least one event");
+
 	header_.compression = 0u; // no compression
+	header_.events_layout = events_options_.columnar ? EventsLayout::Columnar : EventsLayout::Interleaved;
+	header_.event_templates = events_options_.template_occurrences != 0;
 
 	write_trace_header(writer_, header_);
 	write_trace_machine_description(writer_, machine_);
@@ -60,7 +68,8 @@ InitialRegistersSectionWriter TraceWriter::start_initial_registers_section(Initi
 
 EventsSectionWriter TraceWriter::start_events_section(InitialRegistersSectionWriter&& writer)
 {
-	return EventsSectionWriter(std::move(writer.finalize()), machine());
+	auto initial_values = std::move(writer.encoded_register_values_);
+	return EventsSectionWriter(std::move(writer.finalize()), machine(), events_options_, initial_values);
 }
 
 void TraceWriter::finish_events_section(EventsSectionWriter&& writer)
@@ -0,0 +1,110 @@
+#include <watchpoint_scan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <string>
+
+namespace reven {
+namespace backend {
+namespace plugins {
+namespace file {
+namespace libbintrace {
+
+/**
+ * Collects the memory writes of a segment that overlap the watched ranges.
+ */
+class WatchpointScan::Scanner : public MemoryWriteScanner
+{
+public:
+	Scanner(const TraceFile& trace, const AddressRanges& ranges)
+	  : MemoryWriteScanner(trace), ranges_(ranges)
+	{
+	}
+
+	const std::vector<WatchpointHit>& hits() const { return hits_; }
+
+protected:
+	void do_scan_memory_write(std::uint64_t context_id, std::uint64_t address, std::uint64_t size) override
+	{
+		if (ranges_.overlaps(address, size))
+			hits_.push_back({ context_id, address, size });
+	}
+
+private:
+	const AddressRanges& ranges_;
+	std::vector<WatchpointHit> hits_;
+};
+
+constexpr std::size_t AddressRanges::linear_search_size;
+
+AddressRanges::AddressRanges(const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges)
+{
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> sorted;
+	for (const auto& range : ranges) {
+		if (range.second == 0)
+			continue;
+		// Ranges reaching the end of the address space are cut one byte short, so that `end` doesn't overflow.
+		auto end = range.second > std::numeric_limits<std::uint64_t>::max() - range.first
+		           ? std::numeric_limits<std::uint64_t>::max()
+		           : range.first + range.second;
+		sorted.emplace_back(range.first, end);
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	for (const auto& range : sorted) {
+		if (not ranges_.empty() and range.first <= ranges_.back().second)
+			ranges_.back().second = std::max(ranges_.back().second, range.second);
+		else
+			ranges_.push_back(range);
+	}
+}
+
+bool AddressRanges::overlaps(std::uint64_t address, std::uint64_t size) const
+{
+	auto end = size > std::numeric_limits<std::uint64_t>::max() - address ? std::numeric_limits<std::uint64_t>::max()
+	                                                                        : address + size;
+
+	if (ranges_.size() <= linear_search_size) {
+		bool result = false;
+		for (const auto& range : ranges_)
+			result |= address < range.second and range.first < end;
+		return result;
+	}
+
+	// Ranges are disjoint, so their ends are sorted too: check the first one ending after `address`.
+	auto it = std::upper_bound(ranges_.begin(), ranges_.end(), address,
+	                           [](std::uint64_t value, const std::pair<std::uint64_t, std::uint64_t>& range) {
+		                           return value < range.second;
+	                           });
+	return it != ranges_.end() and it->first < end;
+}
+
+WatchpointScan::WatchpointScan(const ReplayEngine& engine,
+                               const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges)
+  : engine_(engine), ranges_(ranges)
+{
+}
+
+SearchStatistics WatchpointScan::run(ThreadPool& pool, const HitConsumer& consume) const
+{
+	SearchStatistics statistics;
+	const auto& trace = engine_.trace();
+	auto start = std::chrono::steady_clock::now();
+
+	engine_.replay(
+	  pool,
+	  [this, &trace](const ReplaySegment&) { return std::make_unique<Scanner>(trace, ranges_); },
+	  [&statistics, &consume](const ReplaySegment& segment, std::unique_ptr<SegmentHandler>&& handler) {
+		  statistics.events += segment.end_context - segment.start_context;
+		  for (const auto& hit : static_cast<const Scanner&>(*handler).hits()) {
+			  ++statistics.matches;
+			  consume(hit);
+		  }
+	  });
+
+	statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return statistics;
+}
+
+}}}}}
@@ -1,9 +1,18 @@
 #include <boost/test/unit_test.hpp>
 
 #include "helpers.h"
+#include "sample_trace.h"
 
 constexpr const char* TestMDWriter::format_version;
 constexpr const char* TestMDWriter::tool_name;
 constexpr const char* TestMDWriter::tool_version;
 constexpr const char* TestMDWriter::tool_info;
 constexpr std::uint64_t TestMDWriter::generation_date;
+
+constexpr std::uint32_t SampleTrace::page_size;
+constexpr std::uint64_t SampleTrace::memory_size;
+constexpr libbintrace::RegisterId SampleTrace::rax;
+constexpr libbintrace::RegisterId SampleTrace::rbx;
+constexpr libbintrace::RegisterId SampleTrace::rip;
+constexpr libbintrace::RegisterId SampleTrace::zmm0;
+constexpr std::uint8_t SampleTrace::add_rbx;
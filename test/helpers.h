@@ -2,8 +2,12 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <vector>
 
+#include <cstdlib>
+#include <unistd.h>
+
 #include <rvnmetadata/metadata-common.h>
 #include <rvnbinresource/writer.h>
 #include <rvnbinresource/reader.h>
@@ -177,3 +181,27 @@ struct WriterWrapper {
 
 	std::unique_ptr<reven::binresource::Writer> writer;
 };
+
+struct TemporaryFile {
+	TemporaryFile()
+	{
+		char name[] = "/tmp/rvnbintrace_test_XXXXXX";
+		int fd = mkstemp(name);
+		BOOST_REQUIRE(fd >= 0);
+		close(fd);
+		filename = name;
+	}
+
+	~TemporaryFile()
+	{
+		unlink(filename.c_str());
+	}
+
+	TemporaryFile& write(const std::string& content)
+	{
+		std::ofstream(filename, std::ios::binary | std::ios::trunc) << content;
+		return *this;
+	}
+
+	std::string filename;
+};
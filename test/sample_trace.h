@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cache_writer.h>
+#include <register_file.h>
+#include <trace_cursor.h>
+#include <trace_writer.h>
+
+#include "helpers.h"
+
+namespace libbintrace = reven::backend::plugins::file::libbintrace;
+
+//! A small but complete trace, along with its cache, written with TraceWriter and CacheWriter.
+//! Event `i` always sets rip to `i`, and writes other registers and memory depending on `i`, so that tests can check
+//! the state at any context with @ref expected_rip.
+//! The trace is written with `register_encodings` in its machine description, unlike the cache.
+struct SampleTrace {
+	static constexpr std::uint32_t page_size = 0x1000;
+	static constexpr std::uint64_t memory_size = 4 * page_size;
+
+	static constexpr libbintrace::RegisterId rax = 0;
+	static constexpr libbintrace::RegisterId rbx = 1;
+	static constexpr libbintrace::RegisterId rip = 2;
+	static constexpr libbintrace::RegisterId zmm0 = 0x100;
+	static constexpr std::uint8_t add_rbx = 0xfe;
+
+	static libbintrace::MachineDescription machine()
+	{
+		using namespace libbintrace;
+		std::vector<std::uint8_t> one(8, 0);
+		one[0] = 1;
+		return MachineDescription{
+			MachineDescription::Archi::x64_1,
+			4,
+			{ { 0, memory_size } },
+			{ { rax, { 8, "rax" } }, { rbx, { 8, "rbx" } }, { rip, { 8, "rip" } }, { zmm0, { 64, "zmm0" } } },
+			{ { add_rbx, { rbx, MachineDescription::RegisterOperator::Add, one } } },
+			{},
+		};
+	}
+
+	static std::uint64_t expected_rip(std::uint64_t context_id)
+	{
+		return context_id == 0 ? 0xffff : context_id - 1;
+	}
+
+	//! Address written by event `i`, if @ref writes_memory is true.
+	static std::uint64_t memory_address(std::uint64_t i) { return (i * 0x1d8) % (memory_size - 0x20); }
+	static bool writes_memory(std::uint64_t i) { return i % 3 == 0; }
+	static bool writes_large_memory(std::uint64_t i) { return i % 97 == 5; }
+	static bool is_other_event(std::uint64_t i) { return i % 11 == 7; }
+
+	SampleTrace(std::uint64_t event_count, std::uint64_t cache_interval,
+	            const libbintrace::CachePointsOptions& cache_options = libbintrace::CachePointsOptions(),
+	            const libbintrace::EventsOptions& events_options = libbintrace::EventsOptions(),
+	            const std::map<libbintrace::RegisterId, libbintrace::MachineDescription::RegisterEncoding>&
+	              register_encodings = {})
+	  : registers(machine()), memory(memory_size, 0)
+	{
+		using namespace libbintrace;
+
+		for (std::uint64_t i = 0; i < memory_size; ++i)
+			memory[i] = static_cast<std::uint8_t>(i * 7);
+		initial_memory = memory;
+
+		std::uint64_t initial_rip = expected_rip(0);
+		registers.set(rip, reinterpret_cast<const std::uint8_t*>(&initial_rip), 8);
+		*registers.get(rax) = 0x42;
+		initial_registers = registers;
+
+		auto trace_stream = std::make_unique<std::stringstream>();
+		auto trace_stream_ptr = trace_stream.get();
+		auto trace_machine = machine();
+		trace_machine.register_encodings = register_encodings;
+		TraceWriter trace_writer(std::move(trace_stream), trace_machine, "SampleTrace", "1.0.0", "sample trace",
+		                         events_options);
+
+		auto cache_stream = std::make_unique<std::stringstream>();
+		auto cache_stream_ptr = cache_stream.get();
+		CacheWriter cache_writer(std::move(cache_stream), page_size, machine(), "SampleTrace", "1.0.0", "sample cache");
+
+		auto memory_writer = trace_writer.start_initial_memory_section();
+		memory_writer.write(memory.data(), memory.size());
+		auto registers_writer = trace_writer.start_initial_registers_section(std::move(memory_writer));
+		for (auto reg_id : registers.register_ids())
+			registers_writer.write(reg_id, registers.get(reg_id), registers.register_size(reg_id));
+		auto events = trace_writer.start_events_section(std::move(registers_writer));
+		auto cache_points = cache_writer.start_cache_points_section(cache_options);
+
+		std::set<std::uint64_t> dirty_pages;
+
+		for (std::uint64_t i = 0; i < event_count; ++i) {
+			if (is_other_event(i))
+				events.start_event_other("event " + std::to_string(i));
+			else
+				events.start_event_instruction();
+
+			if (writes_memory(i)) {
+				std::uint64_t value = i * 0x0101010101010101ull;
+				write_memory(events, dirty_pages, memory_address(i), reinterpret_cast<const std::uint8_t*>(&value), 8);
+			}
+			if (writes_large_memory(i)) {
+				std::vector<std::uint8_t> buffer(0x1800, static_cast<std::uint8_t>(i));
+				write_memory(events, dirty_pages, (i * 0x100) % (memory_size - buffer.size()), buffer.data(),
+				             buffer.size());
+			}
+
+			std::uint64_t new_rip = i;
+			write_register(events, rip, reinterpret_cast<const std::uint8_t*>(&new_rip));
+			if (i % 5 == 0) {
+				std::uint64_t value = i * 3;
+				write_register(events, rax, reinterpret_cast<const std::uint8_t*>(&value));
+			}
+			if (i % 2 == 0) {
+				events.write_register_action(add_rbx);
+				++*reinterpret_cast<std::uint64_t*>(registers.get(rbx));
+			}
+			if (i % 13 == 0) {
+				std::vector<std::uint8_t> value(64, static_cast<std::uint8_t>(i));
+				write_register(events, zmm0, value.data());
+			}
+			events.finish_event();
+
+			auto context_id = i + 1;
+			if (cache_interval and context_id % cache_interval == 0) {
+				cache_points.start_cache_point(context_id, events.stream_pos());
+				for (auto reg_id : registers.register_ids())
+					cache_points.write_register(reg_id, registers.get(reg_id), registers.register_size(reg_id));
+				for (auto page : dirty_pages)
+					cache_points.write_memory_page(page, memory.data() + page);
+				cache_points.finish_cache_point();
+				dirty_pages.clear();
+				cache_point_contexts.push_back(context_id);
+			}
+		}
+
+		trace_writer.finish_events_section(std::move(events));
+		cache_writer.finish_cache_points_section(std::move(cache_points));
+
+		trace = trace_stream_ptr->str();
+		cache = cache_stream_ptr->str();
+		final_registers = registers;
+		final_memory = memory;
+	}
+
+	std::unique_ptr<std::stringstream> trace_stream() const { return std::make_unique<std::stringstream>(trace); }
+	std::unique_ptr<std::stringstream> cache_stream() const { return std::make_unique<std::stringstream>(cache); }
+
+	std::string trace;
+	std::string cache;
+	std::vector<std::uint64_t> cache_point_contexts;
+
+	libbintrace::RegisterFile initial_registers;
+	std::vector<std::uint8_t> initial_memory;
+	libbintrace::RegisterFile final_registers;
+	std::vector<std::uint8_t> final_memory;
+
+private:
+	void write_memory(libbintrace::EventsSectionWriter& events,
+	                  std::set<std::uint64_t>& dirty_pages, std::uint64_t address, const std::uint8_t* buffer,
+	                  std::uint64_t size)
+	{
+		events.write_memory(address, buffer, size);
+		std::memcpy(memory.data() + address, buffer, size);
+		for (auto page = address & ~std::uint64_t(page_size - 1); page < address + size; page += page_size)
+			dirty_pages.insert(page);
+	}
+
+	void write_register(libbintrace::EventsSectionWriter& events,
+	                    libbintrace::RegisterId reg_id, const std::uint8_t* buffer)
+	{
+		events.write_register(reg_id, buffer, registers.register_size(reg_id));
+		registers.set(reg_id, buffer, registers.register_size(reg_id));
+	}
+
+	libbintrace::RegisterFile registers;
+	std::vector<std::uint8_t> memory;
+};
+
+//! A cursor keeping track of the full machine state while reading events.
+class StateCursor : public libbintrace::TraceCursor
+{
+public:
+	StateCursor(const libbintrace::TraceFile& trace)
+	  : TraceCursor(trace), registers(trace.initial_registers()), memory(SampleTrace::memory_size)
+	{
+		std::memcpy(memory.data(), trace.initial_memory_region(0), memory.size());
+	}
+
+	std::uint64_t rip() const { return *reinterpret_cast<const std::uint64_t*>(registers.get(SampleTrace::rip)); }
+
+	libbintrace::RegisterFile registers;
+	std::vector<std::uint8_t> memory;
+	std::uint64_t other_events = 0;
+
+protected:
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override { ++other_events; }
+
+	std::pair<const std::uint8_t*, std::uint8_t*>
+	do_register_rw_buffers(libbintrace::RegisterId reg_id) override
+	{
+		return { registers.get(reg_id), registers.get(reg_id) };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		return { memory.data() + address, size };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+};
@@ -1,11 +1,21 @@
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
 
 #include <cache_reader.h>
 #include <cache_section_readers.h>
+#include <cache_set.h>
+#include <cache_writer.h>
+#include <common.h>
 
 #include "helpers.h"
+#include "sample_trace.h"
 
 using namespace std;
 using namespace reven::backend::plugins::file::libbintrace;
@@ -56,25 +66,29 @@ BOOST_AUTO_TEST_CASE(test_cache_read_index)
 	BOOST_CHECK_EQUAL(cache.cache_points[30].page_offsets.size(), 0);
 }
 
-BOOST_AUTO_TEST_CASE(test_cache_reader)
+namespace {
+
+const MachineDescription test_desc{
+	MachineDescription::Archi::x64_1,
+	5,
+	{ { 0, 0xff0000 }, { 0xf00000000, 10 } },
+	{ { 0, { 4, "eax" } }, { 0xf00, { 8, "rax" } } },
+	{},
+	{},
+};
+
+std::vector<std::uint8_t> test_page()
 {
 	std::vector<std::uint8_t> buffer;
-	std::string buffer_string;
 	for (int i=0; i < 4*1024; ++i) {
 		buffer.push_back('a' + (i % 27));
-		buffer_string.push_back('a' + (i % 27));
 	}
+	return buffer;
+}
 
-	MachineDescription desc{
-		MachineDescription::Archi::x64_1,
-		5,
-		{ { 0, 0xff0000 }, { 0xf00000000, 10 } },
-		{ { 0, { 4, "eax" } }, { 0xf00, { 8, "rax" } } },
-		{},
-		{},
-	};
-
-	StreamWrapper s;
+void write_test_cache(StreamWrapper& s)
+{
+	auto buffer = test_page();
 
 	s.write<uint64_t>(4).write<uint32_t>(4*1024);
 
@@ -118,9 +132,21 @@ BOOST_AUTO_TEST_CASE(test_cache_reader)
 		.write<std::uint64_t>(22 + 2 * 4 * 1024) // index in cache points stream
 		.write<std::uint32_t>(0) // memory count
 	;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_reader)
+{
+	auto buffer = test_page();
+	std::string buffer_string(buffer.begin(), buffer.end());
+	const auto& desc = test_desc;
+
+	StreamWrapper s;
+	write_test_cache(s);
 
 	auto reader = CacheReader(s.to_stream_with_cache_metadata(), desc);
-	RegisterContainer cpu;
+	RegisterFile cpu;
 
 	BOOST_CHECK(reader.find_closest(0) == reader.none());
 	BOOST_CHECK(reader.find_closest(20) == reader.none());
@@ -128,23 +154,27 @@ BOOST_AUTO_TEST_CASE(test_cache_reader)
 	BOOST_CHECK(cache_point != reader.none());
 	BOOST_CHECK(cache_point->first == 20);
 	cpu = reader.read_cache_point(cache_point);
-	BOOST_CHECK_EQUAL(cpu.size(), 2);
-	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint32_t*>(cpu.at(0).second.data()), 0xf0f0f0f0);
+	BOOST_CHECK_EQUAL(cpu.register_count(), 2);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint32_t*>(cpu.get(0)), 0xf0f0f0f0);
 	BOOST_CHECK_EQUAL(s.s.str().substr(16 + 4 + cache_point->second.page_offsets[0].cache_stream_offset, 4 * 1024),
 	                  buffer_string);
+	std::vector<std::uint8_t> page(4 * 1024);
+	reader.read_memory_page(cache_point->second.page_offsets[1].cache_stream_offset, page.data());
+	BOOST_CHECK(page == buffer);
+	BOOST_CHECK_THROW(reader.read_memory_page(22 + 2 * 4 * 1024, page.data()), UnexpectedEndOfSection);
 
 	cache_point = reader.find_closest(60);
 	BOOST_CHECK(cache_point->first == 30);
 	cpu = reader.read_cache_point(cache_point);
-	BOOST_CHECK_EQUAL(cpu.size(), 2);
-	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint32_t*>(cpu.at(0).second.data()), 0xfaf0f0fa);
-	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint64_t*>(cpu.at(1).second.data()), 0x0f0f0f0ff0f0f0fa);
+	BOOST_CHECK_EQUAL(cpu.register_count(), 2);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint32_t*>(cpu.get(0)), 0xfaf0f0fa);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint64_t*>(cpu.get(0xf00)), 0x0f0f0f0ff0f0f0fa);
 
 	cache_point = reader.find_closest(30);
 	BOOST_CHECK(cache_point->first == 20);
 	cpu = reader.read_cache_point(cache_point);
-	BOOST_CHECK_EQUAL(cpu.size(), 2);
-	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint32_t*>(cpu.at(0).second.data()), 0xf0f0f0f0);
+	BOOST_CHECK_EQUAL(cpu.register_count(), 2);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<std::uint32_t*>(cpu.get(0)), 0xf0f0f0f0);
 
 	auto md = reader.metadata();
 
@@ -156,6 +186,355 @@ BOOST_AUTO_TEST_CASE(test_cache_reader)
 	BOOST_CHECK(md.generation_date() == std::chrono::system_clock::time_point(std::chrono::seconds(TestMDWriter::generation_date)));
 }
 
+BOOST_AUTO_TEST_CASE(test_cache_reader_concurrent)
+{
+	StreamWrapper s;
+	write_test_cache(s);
+	TemporaryFile file;
+	file.write(s.to_stream_with_cache_metadata()->str());
+
+	const auto expected_page = test_page();
+
+	for (bool from_file : { true, false }) {
+		auto reader = from_file ? CacheReader(file.filename, test_desc)
+		                        : CacheReader(s.reset().to_stream_with_cache_metadata(), test_desc);
+
+		std::atomic<int> errors(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&reader, &errors, &expected_page, t]() {
+				std::vector<std::uint8_t> page(4 * 1024);
+				for (int i = 0; i < 200; ++i) {
+					auto cache_point = reader.find_closest((i + t) % 2 ? 25 : 35);
+					auto cpu = reader.read_cache_point(cache_point);
+					auto eax = *reinterpret_cast<const std::uint32_t*>(cpu.get(0));
+					if (eax != (cache_point->first == 20 ? 0xf0f0f0f0 : 0xfaf0f0fa))
+						++errors;
+					if (cache_point->first == 20) {
+						reader.read_memory_page(cache_point->second.page_offsets[i % 2].cache_stream_offset, page.data());
+						if (page != expected_page)
+							++errors;
+					}
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		BOOST_CHECK_EQUAL(errors, 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_reader_delta_cache_points)
+{
+	SampleTrace full(2000, 10);
+	for (std::uint32_t keyframe_interval : { 1u, 2u, 7u, 1000u }) {
+		SampleTrace delta(2000, 10, { false, keyframe_interval });
+		if (keyframe_interval > 1)
+			BOOST_CHECK_LT(delta.cache.size(), full.cache.size());
+
+		CacheReader full_cache(full.cache_stream(), SampleTrace::machine());
+		CacheReader delta_cache(delta.cache_stream(), SampleTrace::machine());
+		BOOST_REQUIRE_EQUAL(delta_cache.index().cache_points.size(), 200);
+
+		for (auto context_id : full.cache_point_contexts) {
+			auto expected = full_cache.read_cache_point(full_cache.find_closest(context_id + 1));
+			auto actual = delta_cache.read_cache_point(delta_cache.find_closest(context_id + 1));
+			BOOST_CHECK(expected == actual);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_reader_compressed_pages)
+{
+	SampleTrace raw(2000, 10);
+	ThreadPool pool(2);
+	for (auto pool_ptr : { static_cast<ThreadPool*>(nullptr), &pool }) {
+		SampleTrace compressed(2000, 10, { true, 0, true, pool_ptr });
+		BOOST_CHECK_LT(compressed.cache.size(), raw.cache.size());
+
+		CacheReader raw_cache(raw.cache_stream(), SampleTrace::machine());
+		CacheReader compressed_cache(compressed.cache_stream(), SampleTrace::machine());
+
+		std::vector<std::uint8_t> expected(SampleTrace::page_size);
+		std::vector<std::uint8_t> actual(SampleTrace::page_size);
+		std::size_t compressed_pages = 0;
+		for (auto context_id : raw.cache_point_contexts) {
+			const auto& raw_pages = raw_cache.index().cache_points.at(context_id).page_offsets;
+			const auto& pages = compressed_cache.index().cache_points.at(context_id).page_offsets;
+			BOOST_REQUIRE_EQUAL(pages.size(), raw_pages.size());
+
+			for (std::size_t i = 0; i < pages.size(); ++i) {
+				BOOST_CHECK_EQUAL(pages[i].page_address, raw_pages[i].page_address);
+				raw_cache.read_memory_page(raw_pages[i], expected.data());
+				compressed_cache.read_memory_page(pages[i], actual.data());
+				BOOST_CHECK(expected == actual);
+				compressed_pages += pages[i].compressed_size != 0;
+			}
+		}
+		BOOST_CHECK_GT(compressed_pages, 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_reader_deduplicated_pages)
+{
+	SampleTrace raw(2000, 10);
+	CacheReader raw_cache(raw.cache_stream(), SampleTrace::machine());
+
+	// Shared pages read as the pages they replace
+	for (bool compress : { false, true }) {
+		SampleTrace deduplicated(2000, 10, { true, 0, compress });
+		CacheReader cache(deduplicated.cache_stream(), SampleTrace::machine());
+
+		std::vector<std::uint8_t> expected(SampleTrace::page_size);
+		std::vector<std::uint8_t> actual(SampleTrace::page_size);
+		for (auto context_id : raw.cache_point_contexts) {
+			const auto& raw_pages = raw_cache.index().cache_points.at(context_id).page_offsets;
+			const auto& pages = cache.index().cache_points.at(context_id).page_offsets;
+			BOOST_REQUIRE_EQUAL(pages.size(), raw_pages.size());
+
+			for (std::size_t i = 0; i < pages.size(); ++i) {
+				raw_cache.read_memory_page(raw_pages[i], expected.data());
+				cache.read_memory_page(pages[i], actual.data());
+				BOOST_REQUIRE(expected == actual);
+			}
+		}
+	}
+}
+
+namespace {
+
+//! Write the cache points of `from` whose context matches `filter`, as a CacheWriter would when replaying a trace.
+template <typename Filter>
+void write_cache_points(CachePointsSectionWriter& cache_points, const CacheReader& from, Filter filter)
+{
+	std::vector<std::uint8_t> page(SampleTrace::page_size);
+	for (auto it = from.index().cache_points.begin(); it != from.index().cache_points.end(); ++it) {
+		if (not filter(it->first))
+			continue;
+		cache_points.start_cache_point(it->first, it->second.trace_stream_offset);
+		auto registers = from.read_cache_point(it);
+		for (auto reg_id : registers.register_ids())
+			cache_points.write_register(reg_id, registers.get(reg_id), registers.register_size(reg_id));
+		for (const auto& offsets : it->second.page_offsets) {
+			from.read_memory_page(offsets, page.data());
+			cache_points.write_memory_page(offsets.page_address, page.data());
+		}
+		cache_points.finish_cache_point();
+	}
+}
+
+//! Check that `cache` has the cache points of `fine`, with the pages of `fine` for those that are not in a coarse
+//! cache with an interval of 20.
+void check_appended_cache(const CacheReader& cache, const CacheReader& fine)
+{
+	BOOST_CHECK_EQUAL(cache.metadata().format_version().to_string(), format_version);
+	BOOST_REQUIRE_EQUAL(cache.index().cache_points.size(), fine.index().cache_points.size());
+
+	std::vector<std::uint8_t> expected(SampleTrace::page_size);
+	std::vector<std::uint8_t> page(SampleTrace::page_size);
+	for (const auto& cache_point : fine.index().cache_points) {
+		auto it = cache.index().cache_points.find(cache_point.first);
+		BOOST_REQUIRE(it != cache.none());
+		BOOST_CHECK_EQUAL(it->second.trace_stream_offset, cache_point.second.trace_stream_offset);
+		BOOST_CHECK(cache.read_cache_point(it) ==
+		            fine.read_cache_point(fine.index().cache_points.find(cache_point.first)));
+
+		// Existing cache points have the pages changed since the previous coarse cache point instead
+		if (cache_point.first % 20 == 0)
+			continue;
+		const auto& pages = it->second.page_offsets;
+		BOOST_REQUIRE_EQUAL(pages.size(), cache_point.second.page_offsets.size());
+		for (std::size_t i = 0; i < pages.size(); ++i) {
+			BOOST_CHECK_EQUAL(pages[i].page_address, cache_point.second.page_offsets[i].page_address);
+			fine.read_memory_page(cache_point.second.page_offsets[i], expected.data());
+			cache.read_memory_page(pages[i], page.data());
+			BOOST_CHECK(expected == page);
+		}
+	}
+}
+
+std::string file_content(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_writer_append)
+{
+	SampleTrace coarse(2000, 20);
+	SampleTrace fine(2000, 10);
+	CacheReader fine_cache(fine.cache_stream(), SampleTrace::machine());
+
+	for (std::uint32_t keyframe_interval : { 0u, 3u }) {
+		TemporaryFile file;
+		file.write(coarse.cache);
+
+		// Add the cache points of the fine cache that are missing in the coarse one, in two appends
+		{
+			auto writer = CacheWriter::open_for_append(file.filename, SampleTrace::machine());
+			auto cache_points = writer.start_cache_points_section({ false, keyframe_interval });
+			BOOST_CHECK_THROW(cache_points.start_cache_point(20, 0), NonsenseValue);
+			write_cache_points(cache_points, fine_cache,
+			                   [](std::uint64_t id) { return id % 20 != 0 and id >= 1000; });
+			writer.finish_cache_points_section(std::move(cache_points));
+		}
+		// Existing cache points are left in place
+		BOOST_CHECK(file_content(file.filename).substr(0, coarse.cache.size()) == coarse.cache);
+		{
+			auto writer = CacheWriter::open_for_append(file.filename, SampleTrace::machine());
+			auto cache_points = writer.start_cache_points_section({ false, keyframe_interval });
+			BOOST_CHECK_THROW(cache_points.start_cache_point(1010, 0), NonsenseValue);
+			write_cache_points(cache_points, fine_cache,
+			                   [](std::uint64_t id) { return id % 20 != 0 and id < 1000; });
+			writer.finish_cache_points_section(std::move(cache_points));
+		}
+
+		CacheReader appended(file.filename, SampleTrace::machine());
+		check_appended_cache(appended, fine_cache);
+		BOOST_CHECK_EQUAL(static_cast<std::uint64_t>(appended.committed_end_pos()),
+		                  file_content(file.filename).size());
+
+		// Compaction keeps the same cache points, in a single section with a single index
+		CacheWriter::compact(file.filename, SampleTrace::machine());
+		BOOST_CHECK(not std::ifstream(file.filename + ".compact"));
+		CacheReader compacted(file.filename, SampleTrace::machine());
+		check_appended_cache(compacted, fine_cache);
+		BOOST_CHECK_EQUAL(compacted.cache_points_section_size(), appended.cache_points_section_size());
+		BOOST_CHECK_EQUAL(static_cast<std::uint64_t>(compacted.committed_end_pos()),
+		                  file_content(file.filename).size());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_writer_abandoned_append)
+{
+	SampleTrace coarse(2000, 20);
+	SampleTrace fine(2000, 10);
+	CacheReader fine_cache(fine.cache_stream(), SampleTrace::machine());
+
+	TemporaryFile file;
+	file.write(coarse.cache);
+
+	{
+		auto writer = CacheWriter::open_for_append(file.filename, SampleTrace::machine());
+		auto cache_points = writer.start_cache_points_section({ false, 0 });
+		write_cache_points(cache_points, fine_cache, [](std::uint64_t id) { return id % 20 != 0; });
+
+		// Until finished, readers only see the existing cache points
+		CacheReader cache(file.filename, SampleTrace::machine());
+		BOOST_CHECK_EQUAL(cache.index().cache_points.size(), coarse.cache_point_contexts.size());
+	}
+
+	// The writer is destroyed without finishing: the appended cache points are ignored
+	BOOST_CHECK_GT(file_content(file.filename).size(), coarse.cache.size());
+	{
+		CacheReader cache(file.filename, SampleTrace::machine());
+		BOOST_CHECK_EQUAL(cache.index().cache_points.size(), coarse.cache_point_contexts.size());
+		BOOST_CHECK_EQUAL(static_cast<std::uint64_t>(cache.committed_end_pos()), coarse.cache.size());
+	}
+
+	// And overwritten by the next append
+	{
+		auto writer = CacheWriter::open_for_append(file.filename, SampleTrace::machine());
+		auto cache_points = writer.start_cache_points_section({ false, 0 });
+		write_cache_points(cache_points, fine_cache, [](std::uint64_t id) { return id % 20 != 0; });
+		writer.finish_cache_points_section(std::move(cache_points));
+	}
+	check_appended_cache(CacheReader(file.filename, SampleTrace::machine()), fine_cache);
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_writer_torn_append)
+{
+	SampleTrace coarse(2000, 20);
+	SampleTrace fine(2000, 10);
+	CacheReader fine_cache(fine.cache_stream(), SampleTrace::machine());
+
+	TemporaryFile file;
+	file.write(coarse.cache);
+	{
+		auto writer = CacheWriter::open_for_append(file.filename, SampleTrace::machine());
+		auto cache_points = writer.start_cache_points_section({ false, 0 });
+		write_cache_points(cache_points, fine_cache, [](std::uint64_t id) { return id % 20 != 0; });
+		writer.finish_cache_points_section(std::move(cache_points));
+	}
+	const auto appended = file_content(file.filename);
+
+	// An append stopped at any point leaves the previous cache
+	for (std::size_t cut : { std::size_t(1), std::size_t(8), std::size_t(32), std::size_t(100),
+	                         appended.size() - coarse.cache.size() - 1 }) {
+		file.write(appended.substr(0, appended.size() - cut));
+		CacheReader cache(file.filename, SampleTrace::machine());
+		BOOST_CHECK_EQUAL(cache.index().cache_points.size(), coarse.cache_point_contexts.size());
+		BOOST_CHECK_EQUAL(static_cast<std::uint64_t>(cache.committed_end_pos()), coarse.cache.size());
+	}
+
+	// Whatever follows the last commit is ignored
+	file.write(appended + std::string(100, '\xff'));
+	check_appended_cache(CacheReader(file.filename, SampleTrace::machine()), fine_cache);
+
+	// But a committed append can't add a cache point twice
+	auto duplicated = appended + appended.substr(coarse.cache.size());
+	std::uint64_t offset;
+	duplicated.copy(reinterpret_cast<char*>(&offset), sizeof(offset), appended.size() - 2 * sizeof(offset));
+	offset += appended.size() - coarse.cache.size();
+	duplicated.replace(duplicated.size() - 2 * sizeof(offset), sizeof(offset), reinterpret_cast<char*>(&offset),
+	                   sizeof(offset));
+	file.write(duplicated);
+	BOOST_CHECK_THROW(CacheReader(file.filename, SampleTrace::machine()), MalformedSection);
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_set)
+{
+	SampleTrace coarse(2000, 200);
+	SampleTrace fine(2000, 50);
+	TraceFile trace(coarse.trace_stream());
+
+	CacheSet caches(SampleTrace::machine());
+	BOOST_CHECK(not caches.find_closest(100).cache);
+	caches.add(coarse.cache_stream());
+	auto fine_cache = std::make_shared<const CacheReader>(fine.cache_stream(), SampleTrace::machine());
+	caches.add(fine_cache);
+	BOOST_CHECK_EQUAL(caches.layers().size(), 2);
+	BOOST_CHECK_EQUAL(caches.page_size(), SampleTrace::page_size);
+
+	BOOST_CHECK_THROW(caches.add(std::make_shared<const CacheReader>(coarse.cache_stream(), test_desc)),
+	                  std::invalid_argument);
+
+	auto other_page_size = std::make_unique<std::stringstream>();
+	auto other_page_size_ptr = other_page_size.get();
+	CacheWriter writer(std::move(other_page_size), 2 * SampleTrace::page_size, SampleTrace::machine(), "test",
+	                   "1.0.0", "test");
+	writer.finish_cache_points_section(writer.start_cache_points_section());
+	BOOST_CHECK_THROW(caches.add(std::make_unique<std::stringstream>(other_page_size_ptr->str())),
+	                  std::invalid_argument);
+
+	BOOST_CHECK_EQUAL(caches.find_closest(260).context_id, 250);
+	BOOST_CHECK(caches.find_closest(260).cache == fine_cache);
+	BOOST_CHECK_EQUAL(caches.find_closest(20).trace_stream_pos, TraceFile::first_event_stream_pos());
+	BOOST_CHECK_EQUAL(caches.find_next(250, trace.event_count()), 300);
+	BOOST_CHECK_EQUAL(caches.find_next(2000, trace.event_count()), trace.event_count());
+
+	// The state at each cache point is rebuilt from the most recent pages of any layer
+	StateCursor cursor(trace);
+	std::vector<std::uint8_t> memory(SampleTrace::memory_size);
+	for (auto context_id : fine.cache_point_contexts) {
+		while (cursor.next_event_index() < context_id)
+			cursor.read_next_event();
+
+		auto cache_point = caches.find_closest(context_id + 1);
+		BOOST_REQUIRE_EQUAL(cache_point.context_id, context_id);
+		BOOST_CHECK(caches.read_cache_point(cache_point) == cursor.registers);
+
+		for (std::uint64_t page = 0; page < SampleTrace::memory_size; page += SampleTrace::page_size) {
+			if (not caches.read_memory_page(page, context_id, memory.data() + page))
+				std::memcpy(memory.data() + page, coarse.initial_memory.data() + page, SampleTrace::page_size);
+		}
+		BOOST_CHECK(memory == cursor.memory);
+	}
+}
+
 BOOST_AUTO_TEST_CASE(test_incompatible_type_cache)
 {
 	StreamWrapper s;
@@ -0,0 +1,97 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cache_refiner.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+//! Check each cache point of both caches against the trace. The memory at a cache point is rebuilt from the initial
+//! memory and every page version up to it, in either cache.
+void check_caches(const SampleTrace& sample, const TraceFile& trace, const CacheReader& cache,
+                  const CacheReader& secondary)
+{
+	std::map<std::uint64_t, const CacheReader*> cache_points;
+	for (auto reader : { &cache, &secondary }) {
+		for (const auto& cache_point : reader->index().cache_points)
+			BOOST_CHECK(cache_points.emplace(cache_point.first, reader).second);
+	}
+
+	StateCursor cursor(trace);
+	std::vector<std::uint8_t> memory = sample.initial_memory;
+	for (const auto& cache_point : cache_points) {
+		while (cursor.next_event_index() < cache_point.first)
+			cursor.read_next_event();
+
+		auto it = cache_point.second->index().cache_points.find(cache_point.first);
+		BOOST_CHECK_EQUAL(it->second.trace_stream_offset, cursor.stream_pos());
+		BOOST_CHECK(cache_point.second->read_cache_point(it) == cursor.registers);
+
+		for (const auto& page : it->second.page_offsets)
+			cache_point.second->read_memory_page(page, memory.data() + page.page_address);
+		BOOST_CHECK(memory == cursor.memory);
+	}
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_refiner)
+{
+	SampleTrace sample(2000, 500);
+	TraceFile trace(sample.trace_stream());
+	auto cache = std::make_shared<const CacheReader>(sample.cache_stream(), SampleTrace::machine());
+
+	TemporaryFile secondary_file;
+	unlink(secondary_file.filename.c_str());
+	// Left by an interrupted refinement
+	std::ofstream(secondary_file.filename + ".new", std::ios::binary) << "truncated";
+
+	{
+		CacheRefiner refiner(trace, cache, secondary_file.filename, { 300, 50 });
+		BOOST_CHECK(not refiner.secondary());
+		BOOST_CHECK_EQUAL(refiner.refine(), 0);
+
+		// Costing 1 per event: cache points every 50 events are added to the gap after 500 only
+		refiner.record_seek(700, 200);
+		refiner.record_seek(650, 150);
+		refiner.record_seek(1100, 1000);
+		BOOST_CHECK_EQUAL(refiner.refine(), 9);
+		BOOST_REQUIRE(refiner.secondary());
+		BOOST_CHECK_EQUAL(refiner.secondary()->index().cache_points.size(), 9);
+		BOOST_CHECK(not std::ifstream(secondary_file.filename + ".new"));
+
+		auto closest = refiner.caches()->find_closest(701);
+		BOOST_CHECK_EQUAL(closest.context_id, 700);
+		BOOST_CHECK(closest.cache == refiner.secondary());
+		BOOST_CHECK_EQUAL(refiner.caches()->find_closest(1100).context_id, 1000);
+		BOOST_CHECK(refiner.caches()->find_closest(1100).cache == cache);
+		BOOST_CHECK(not refiner.caches()->find_closest(10).cache);
+
+		// Seeks were forgotten
+		BOOST_CHECK_EQUAL(refiner.refine(), 0);
+	}
+
+	// The secondary cache is opened again, and cache points are appended to it, including in a refined gap
+	CacheRefiner refiner(trace, cache, secondary_file.filename, { 50, 40, 1 });
+	BOOST_REQUIRE(refiner.secondary());
+	refiner.record_seek(1200, 80);
+	refiner.record_seek(740, 60);
+	BOOST_CHECK_EQUAL(refiner.refine(), 4 + 1);
+	BOOST_CHECK_EQUAL(refiner.secondary()->index().cache_points.size(), 14);
+	BOOST_CHECK_EQUAL(refiner.caches()->find_closest(740).context_id, 726);
+	BOOST_CHECK_EQUAL(refiner.caches()->find_closest(1301).context_id, 1300);
+
+	check_caches(sample, trace, *cache, *refiner.secondary());
+}
@@ -1,8 +1,13 @@
 #include <boost/test/unit_test.hpp>
 
 #include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
 
+#include <block_codec.h>
 #include <cache_writer.h>
+#include <content_hash.h>
 
 #include "helpers.h"
 
@@ -90,6 +95,9 @@ BOOST_AUTO_TEST_CASE(test_cache_writer)
 
 	cache_points_writer.start_cache_point(27, 1061);
 	cache_points_writer.write_register(0, buffer, 4);
+	BOOST_CHECK_THROW(cache_points_writer.write_register(0, buffer, 4), NonsenseValue);
+	cache_points_writer.write_register(1, buffer, 4);
+	cache_points_writer.write_register(0xf00, buffer, 8);
 	cache_points_writer.write_memory_page(0, buffer);
 	BOOST_CHECK_THROW(cache_points_writer.write_memory_page(1, buffer), NonsenseValue);
 	BOOST_CHECK_THROW(cache_points_writer.write_register(0xf00, buffer, 0), std::logic_error);
@@ -114,8 +122,8 @@ BOOST_AUTO_TEST_CASE(test_cache_writer)
 	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 8);
 	BOOST_CHECK_EQUAL(s.read_data(8), data.substr(0, 8));
 
-	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 1);
-	s.read_data(2+2+4); // ignore register
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 3);
+	s.read_data(2 * (2+2+4) + 2+2+8); // ignore registers
 	BOOST_CHECK_EQUAL(s.read_data(4*1024), data.substr(0, 4*1024));
 
 	s.read<uint64_t>(); // section index, already tested but still
@@ -125,7 +133,256 @@ BOOST_AUTO_TEST_CASE(test_cache_writer)
 	auto cpu_offset = s.read<uint64_t>(); // cpu stream offset, irrelevant
 	BOOST_CHECK_EQUAL(s.read<uint32_t>(), 1); // page count
 	BOOST_CHECK_EQUAL(s.read<uint64_t>(), 0);  // page 1 address
-	BOOST_CHECK_EQUAL(s.read<uint64_t>(), cpu_offset + 2 + 8); // page 1 offset
+	BOOST_CHECK_EQUAL(s.read<uint64_t>(), cpu_offset + 2 + 28); // page 1 offset
 	BOOST_CHECK_EQUAL(s.read<uint64_t>(), 10);
 	BOOST_CHECK_EQUAL(s.read<uint64_t>(), 165);
 }
+
+BOOST_AUTO_TEST_CASE(test_cache_writer_missing_register)
+{
+	MachineDescription desc {
+		MachineDescription::Archi::x64_1,
+		5,
+		{ {0, 0x10000} },
+		{ {0, {4, "eax"}}, {1, {4, "ebx"}} },
+		{},
+		{},
+	};
+	std::uint32_t value = 0;
+
+	// Delta cache points must be given every register too
+	for (std::uint32_t keyframe_interval : { 0u, 2u }) {
+		CacheWriterTester cache(desc);
+		auto cache_points_writer = cache.start_cache_points_section({ false, keyframe_interval });
+		cache_points_writer.start_cache_point(10, 165);
+		cache_points_writer.write_register(0, reinterpret_cast<const std::uint8_t*>(&value), 4);
+		cache_points_writer.write_register(1, reinterpret_cast<const std::uint8_t*>(&value), 4);
+		cache_points_writer.finish_cache_point();
+
+		cache_points_writer.start_cache_point(20, 300);
+		cache_points_writer.write_register(1, reinterpret_cast<const std::uint8_t*>(&value), 4);
+		BOOST_CHECK_THROW(cache_points_writer.finish_cache_point(), MissingData);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_content_hash)
+{
+	std::vector<std::uint8_t> page(4096, 0);
+	auto zero = hash_content(page.data(), page.size());
+	BOOST_CHECK(zero == hash_content(std::vector<std::uint8_t>(4096, 0).data(), 4096));
+
+	// Any single bit flip changes both halves
+	for (std::size_t byte : { 0, 1, 31, 32, 1000, 4095 }) {
+		page[byte] = 0x10;
+		auto flipped = hash_content(page.data(), page.size());
+		BOOST_CHECK(flipped.low != zero.low);
+		BOOST_CHECK(flipped.high != zero.high);
+		page[byte] = 0;
+	}
+
+	// Size is part of the hash, as well as tail bytes
+	BOOST_CHECK(hash_content(page.data(), 4095) != zero);
+	page[4094] = 1;
+	BOOST_CHECK(hash_content(page.data(), 4095) != hash_content(std::vector<std::uint8_t>(4096, 0).data(), 4095));
+}
+
+BOOST_AUTO_TEST_CASE(test_content_hash_keyed)
+{
+	// Reference vector of SipHash-2-4 with a 128-bit output, for key 00 01 .. 0f and an empty message, as little
+	// endian 64-bit halves
+	const ContentHash key{ 0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull };
+	std::uint8_t empty = 0;
+	auto reference = hash_content_keyed(&empty, 0, key);
+	BOOST_CHECK_EQUAL(reference.low, 0xe6a825ba047f81a3ull);
+	BOOST_CHECK_EQUAL(reference.high, 0x930255c71472f66dull);
+
+	// The key changes both halves
+	std::vector<std::uint8_t> page(4096, 0);
+	auto zero = hash_content_keyed(page.data(), page.size(), key);
+	auto other_key = hash_content_keyed(page.data(), page.size(), ContentHash{ key.low, key.high + 1 });
+	BOOST_CHECK(zero.low != other_key.low);
+	BOOST_CHECK(zero.high != other_key.high);
+
+	// Any single bit flip too
+	for (std::size_t byte : { 0, 7, 8, 1000, 4095 }) {
+		page[byte] = 0x10;
+		auto flipped = hash_content_keyed(page.data(), page.size(), key);
+		BOOST_CHECK(flipped.low != zero.low);
+		BOOST_CHECK(flipped.high != zero.high);
+		page[byte] = 0;
+	}
+	BOOST_CHECK(hash_content_keyed(page.data(), 4095, key) != zero);
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_writer_page_deduplication)
+{
+	MachineDescription desc {
+		MachineDescription::Archi::x64_1,
+		5,
+		{ {0, 0x10000} },
+		{ {0, {4, "eax"}} },
+		{},
+		{},
+	};
+
+	std::vector<std::uint8_t> zero(4096, 0);
+	std::vector<std::uint8_t> other(4096, 0x42);
+	std::uint32_t eax = 0;
+
+	for (auto options : { CachePointsOptions{ false, 0 }, CachePointsOptions{ true, 0 } }) {
+		bool deduplicate = options.deduplicate_pages;
+		CacheWriterTester cache(desc);
+		auto cache_points_writer = cache.start_cache_points_section(options);
+
+		cache_points_writer.start_cache_point(10, 165);
+		cache_points_writer.write_register(0, reinterpret_cast<const std::uint8_t*>(&eax), 4);
+		cache_points_writer.write_memory_page(0x0000, zero.data());
+		cache_points_writer.write_memory_page(0x1000, zero.data());
+		cache_points_writer.write_memory_page(0x2000, other.data());
+		cache_points_writer.finish_cache_point();
+
+		cache_points_writer.start_cache_point(20, 300);
+		cache_points_writer.write_register(0, reinterpret_cast<const std::uint8_t*>(&eax), 4);
+		cache_points_writer.write_memory_page(0x1000, other.data());
+		cache_points_writer.write_memory_page(0x3000, zero.data());
+		cache_points_writer.finish_cache_point();
+
+		BOOST_CHECK_EQUAL(cache_points_writer.page_count(), 5);
+		BOOST_CHECK_EQUAL(cache_points_writer.stored_page_count(), deduplicate ? 2 : 5);
+
+		cache.finish_cache_points_section(std::move(cache_points_writer));
+		auto s = cache.stream();
+
+		s.skip_section(); // header
+		auto section_size = s.read<uint64_t>();
+		BOOST_CHECK_EQUAL(section_size, 2 * (2 + 2 + 2 + 4) + (deduplicate ? 2 : 5) * 4096);
+		s.read_data(section_size);
+
+		// Index is sorted by decreasing context id
+		s.read<uint64_t>();
+		BOOST_CHECK_EQUAL(s.read<uint64_t>(), 2);
+		std::map<std::uint64_t, std::vector<std::uint64_t>> page_offsets;
+		for (int i = 0; i < 2; ++i) {
+			auto context_id = s.read<uint64_t>();
+			s.read<uint64_t>();
+			s.read<uint64_t>();
+			auto page_count = s.read<uint32_t>();
+			for (std::uint32_t page = 0; page < page_count; ++page) {
+				s.read<uint64_t>();
+				page_offsets[context_id].push_back(s.read<uint64_t>());
+			}
+		}
+
+		const auto& first = page_offsets[10];
+		const auto& second = page_offsets[20];
+		BOOST_CHECK_EQUAL(first[0] == first[1], deduplicate);
+		BOOST_CHECK_NE(first[0], first[2]);
+		BOOST_CHECK_EQUAL(second[0] == first[2], deduplicate);
+		BOOST_CHECK_EQUAL(second[1] == first[0], deduplicate);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_writer_register_delta)
+{
+	MachineDescription desc {
+		MachineDescription::Archi::x64_1,
+		5,
+		{ {0, 0x10000} },
+		{ {0, {4, "eax"}}, {1, {4, "ebx"}} },
+		{},
+		{},
+	};
+
+	CacheWriterTester cache(desc);
+	auto cache_points_writer = cache.start_cache_points_section({ false, 3 });
+
+	std::uint32_t eax = 1;
+	std::uint32_t ebx = 2;
+	for (std::uint64_t i = 1; i <= 4; ++i) {
+		eax += (i % 2 == 0) ? 1 : 0;
+		cache_points_writer.start_cache_point(i * 10, i * 100);
+		cache_points_writer.write_register(0, reinterpret_cast<const std::uint8_t*>(&eax), 4);
+		cache_points_writer.write_register(1, reinterpret_cast<const std::uint8_t*>(&ebx), 4);
+		cache_points_writer.finish_cache_point();
+	}
+	BOOST_CHECK_EQUAL(cache_points_writer.register_keyframe_count(), 2);
+
+	cache.finish_cache_points_section(std::move(cache_points_writer));
+	auto s = cache.stream();
+	s.skip_section(); // header
+	s.read<uint64_t>();
+
+	// Keyframe
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 2);
+	s.read_data(2 * (2 + 2 + 4));
+
+	// eax changed
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 0x8001);
+	BOOST_CHECK_EQUAL(s.read<uint64_t>(), 0);
+	BOOST_CHECK_EQUAL(s.read<uint32_t>(), 2 + 2 + 4);
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 0);
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 4);
+	BOOST_CHECK_EQUAL(s.read<uint32_t>(), 2);
+
+	// Nothing changed
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 0x8000);
+	BOOST_CHECK_EQUAL(s.read<uint64_t>(), 2 + 2 * (2 + 2 + 4));
+	BOOST_CHECK_EQUAL(s.read<uint32_t>(), 0);
+
+	// Keyframe again
+	BOOST_CHECK_EQUAL(s.read<uint16_t>(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_block_codec)
+{
+	std::vector<std::vector<std::uint8_t>> inputs;
+	inputs.emplace_back(4096, 0);
+	inputs.emplace_back();
+	inputs.emplace_back(1, 42);
+	inputs.emplace_back(13, 7);
+	std::string text("Memory pages full of text compress well, because text repeats itself. ");
+	inputs.emplace_back();
+	while (inputs.back().size() < 4096)
+		inputs.back().insert(inputs.back().end(), text.begin(), text.end());
+	inputs.emplace_back(4096);
+	std::uint32_t state = 1;
+	for (auto& byte : inputs.back()) {
+		state = state * 1103515245 + 12345;
+		byte = static_cast<std::uint8_t>(state >> 16);
+	}
+	inputs.emplace_back(70000, 0);
+
+	for (const auto& input : inputs) {
+		std::vector<std::uint8_t> compressed(input.size() + input.size() / 255 + 16);
+		auto size = compress_block(input.data(), input.size(), compressed.data(), compressed.size());
+		BOOST_REQUIRE_NE(size, 0);
+
+		std::vector<std::uint8_t> output(input.size());
+		BOOST_CHECK(decompress_block(compressed.data(), size, output.data(), output.size()));
+		BOOST_CHECK(output == input);
+
+		// Truncated or oversized outputs are errors
+		if (input.size() > 0) {
+			BOOST_CHECK(not decompress_block(compressed.data(), size, output.data(), output.size() - 1));
+			BOOST_CHECK(not decompress_block(compressed.data(), size - 1, output.data(), output.size()));
+		}
+
+		// A capacity too small is reported
+		if (size > 1)
+			BOOST_CHECK_EQUAL(compress_block(input.data(), input.size(), compressed.data(), size - 1), 0);
+	}
+
+	std::vector<std::uint8_t> compressed(4096);
+	BOOST_CHECK_LT(compress_block(inputs[0].data(), 4096, compressed.data(), compressed.size()), 32);
+	BOOST_CHECK_LT(compress_block(inputs[4].data(), 4096, compressed.data(), compressed.size()), 256);
+
+	// Garbage never reads or writes out of bounds
+	std::vector<std::uint8_t> output(4096);
+	for (std::size_t i = 0; i < 1000; ++i) {
+		for (auto& byte : compressed) {
+			state = state * 1103515245 + 12345;
+			byte = static_cast<std::uint8_t>(state >> 16);
+		}
+		decompress_block(compressed.data(), 1 + i % 64, output.data(), output.size());
+	}
+}
@@ -0,0 +1,154 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <map>
+
+#include <event_boundary_finder.h>
+#include <replay_engine.h>
+#include <thread_pool.h>
+#include <trace_file.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+class CountingHandler : public SegmentHandler
+{
+public:
+	using SegmentHandler::SegmentHandler;
+
+	std::uint64_t events = 0;
+	std::uint64_t other_events = 0;
+
+protected:
+	void do_event_instruction() override { ++events; }
+	void do_event_other(const std::string&) override { ++events; ++other_events; }
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId) override
+	{
+		return { scratch_, scratch_ };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t, std::uint64_t size) override
+	{
+		return { scratch_, std::min<std::uint64_t>(size, sizeof(scratch_)) };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	std::uint8_t scratch_[256];
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_event_boundary_finder)
+{
+	SampleTrace sample(3000, 0);
+	TraceFile trace(sample.trace_stream());
+	ThreadPool pool(4);
+
+	// Real event positions, by context id
+	std::map<std::uint64_t, std::uint64_t> boundaries;
+	StateCursor cursor(trace);
+	do {
+		boundaries[cursor.stream_pos()] = cursor.next_event_index();
+	} while (cursor.read_next_event());
+
+	for (std::uint64_t chunk_size : { 1ull, 64ull, 1000ull, 0x1000ull, 1ull << 30 }) {
+		auto index = EventBoundaryFinder(trace, chunk_size, 64).find(pool);
+
+		BOOST_REQUIRE(not index.entries.empty());
+		BOOST_CHECK_EQUAL(index.entries[0].context_id, 0);
+		BOOST_CHECK_EQUAL(index.entries[0].stream_pos, TraceFile::first_event_stream_pos());
+		for (std::size_t i = 0; i < index.entries.size(); ++i) {
+			const auto& entry = index.entries[i];
+			auto boundary = boundaries.find(entry.stream_pos);
+			BOOST_REQUIRE(boundary != boundaries.end());
+			BOOST_CHECK_EQUAL(boundary->second, entry.context_id);
+			if (i > 0)
+				BOOST_CHECK_GT(entry.context_id, index.entries[i - 1].context_id);
+		}
+
+		if (chunk_size == 1)
+			BOOST_CHECK_EQUAL(index.entries.size(), 3000);
+		if (chunk_size == 1ull << 30)
+			BOOST_CHECK_EQUAL(index.entries.size(), 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_replay_engine_from_offsets)
+{
+	SampleTrace sample(3000, 0);
+	TraceFile trace(sample.trace_stream());
+	ThreadPool pool(4);
+
+	auto index = EventBoundaryFinder(trace, 0x1000).find(pool);
+	ReplayEngine engine(trace, index);
+	BOOST_CHECK_EQUAL(engine.segments().size(), index.entries.size());
+	BOOST_CHECK(engine.segments()[0].seed == SegmentSeed::InitialContext);
+	BOOST_CHECK(engine.segments()[1].seed == SegmentSeed::Unknown);
+
+	std::uint64_t events = 0;
+	std::uint64_t other_events = 0;
+	engine.replay(
+	  pool,
+	  [&trace](const ReplaySegment&) { return std::make_unique<CountingHandler>(trace); },
+	  [&](const ReplaySegment&, std::unique_ptr<SegmentHandler>&& handler) {
+		  events += static_cast<CountingHandler&>(*handler).events;
+		  other_events += static_cast<CountingHandler&>(*handler).other_events;
+	  });
+	BOOST_CHECK_EQUAL(events, 3000);
+	BOOST_CHECK_EQUAL(other_events, 273);
+}
+
+BOOST_AUTO_TEST_CASE(test_event_boundary_finder_empty)
+{
+	SampleTrace sample(0, 0);
+	TraceFile trace(sample.trace_stream());
+	ThreadPool pool(2);
+
+	auto index = EventBoundaryFinder(trace).find(pool);
+	BOOST_REQUIRE_EQUAL(index.entries.size(), 1);
+	BOOST_CHECK_EQUAL(index.entries[0].stream_pos, TraceFile::first_event_stream_pos());
+}
+
+BOOST_AUTO_TEST_CASE(test_event_boundary_finder_columnar)
+{
+	EventsOptions columnar;
+	columnar.columnar = true;
+	columnar.block_event_count = 64;
+	SampleTrace sample(3000, 0, CachePointsOptions(), columnar);
+	TraceFile trace(sample.trace_stream());
+	ThreadPool pool(4);
+
+	// Entries are the starts of blocks
+	auto index = EventBoundaryFinder(trace, 1).find(pool);
+	BOOST_REQUIRE_EQUAL(index.entries.size(), trace.event_blocks().size());
+	for (std::size_t i = 0; i < index.entries.size(); ++i) {
+		BOOST_CHECK_EQUAL(index.entries[i].context_id, i * 64);
+		BOOST_CHECK_EQUAL(index.entries[i].stream_pos, trace.event_blocks()[i].stream_pos);
+	}
+	BOOST_CHECK_EQUAL(index.entries[0].stream_pos, TraceFile::first_event_stream_pos());
+	BOOST_CHECK_EQUAL(EventBoundaryFinder(trace, 1ull << 30).find(pool).entries.size(), 1);
+
+	ReplayEngine engine(trace, EventBoundaryFinder(trace, 0x1000).find(pool));
+	std::uint64_t events = 0;
+	engine.replay(
+	  pool,
+	  [&trace](const ReplaySegment&) { return std::make_unique<CountingHandler>(trace); },
+	  [&](const ReplaySegment&, std::unique_ptr<SegmentHandler>&& handler) {
+		  events += static_cast<CountingHandler&>(*handler).events;
+	  });
+	BOOST_CHECK_EQUAL(events, 3000);
+
+	SampleTrace empty(0, 0, CachePointsOptions(), columnar);
+	TraceFile empty_trace(empty.trace_stream());
+	auto empty_index = EventBoundaryFinder(empty_trace).find(pool);
+	BOOST_REQUIRE_EQUAL(empty_index.entries.size(), 1);
+	BOOST_CHECK_EQUAL(empty_index.entries[0].stream_pos, TraceFile::first_event_stream_pos());
+}
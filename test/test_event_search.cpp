@@ -0,0 +1,128 @@
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <cache_reader.h>
+#include <event_boundary_finder.h>
+#include <event_search.h>
+#include <replay_engine.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+std::vector<std::uint8_t> value64(std::uint64_t value)
+{
+	return std::vector<std::uint8_t>(reinterpret_cast<const std::uint8_t*>(&value),
+	                                 reinterpret_cast<const std::uint8_t*>(&value) + sizeof(value));
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_event_search)
+{
+	SampleTrace sample(2000, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+
+	const std::uint64_t address = 0x1234;
+	std::vector<SearchMatch> expected;
+	for (std::uint64_t i = 0; i < 2000; ++i) {
+		if (i == 1234)
+			expected.push_back({ i, 0 });
+		// rbx is incremented by each even event, and starts at 0
+		if (i == 18)
+			expected.push_back({ i, 1 });
+		if (i % 13 == 0)
+			expected.push_back({ i, 2 });
+		auto written = (SampleTrace::writes_memory(i) and SampleTrace::memory_address(i) <= address and
+		                address < SampleTrace::memory_address(i) + 8) or
+		               (SampleTrace::writes_large_memory(i) and (i * 0x100) % (SampleTrace::memory_size - 0x1800) <= address and
+		                address < (i * 0x100) % (SampleTrace::memory_size - 0x1800) + 0x1800);
+		if (written)
+			expected.push_back({ i, 3 });
+	}
+
+	ReplayEngine engine(trace, cache);
+	EventSearch search(engine, {
+		EventPredicate::register_equals(SampleTrace::rip, value64(1234)),
+		EventPredicate::register_equals(SampleTrace::rbx, value64(10)),
+		EventPredicate::register_written(SampleTrace::zmm0),
+		EventPredicate::memory_written(address, 1),
+	});
+
+	std::vector<SearchMatch> matches;
+	auto statistics = search.run(pool, [&matches](const SearchMatch& match) { matches.push_back(match); });
+	BOOST_CHECK_EQUAL(statistics.events, 2000);
+	BOOST_CHECK_EQUAL(statistics.matches, expected.size());
+	BOOST_CHECK(statistics.events_per_second() > 0);
+
+	// Matches come in event order, but not in predicate order for a given event
+	auto by_event = [](const SearchMatch& lhs, const SearchMatch& rhs) {
+		return lhs.event_id < rhs.event_id or (lhs.event_id == rhs.event_id and lhs.predicate < rhs.predicate);
+	};
+	BOOST_CHECK(std::is_sorted(matches.begin(), matches.end(), [](const SearchMatch& lhs, const SearchMatch& rhs) {
+		return lhs.event_id < rhs.event_id;
+	}));
+	std::sort(matches.begin(), matches.end(), by_event);
+
+	BOOST_REQUIRE_EQUAL(matches.size(), expected.size());
+	for (std::size_t i = 0; i < matches.size(); ++i) {
+		BOOST_CHECK_EQUAL(matches[i].event_id, expected[i].event_id);
+		BOOST_CHECK_EQUAL(matches[i].predicate, expected[i].predicate);
+	}
+
+	// Without register values, only predicates not depending on register operations can be evaluated
+	auto offsets = EventBoundaryFinder(trace, 0x1000).find(pool);
+	ReplayEngine scanner(trace, offsets);
+	BOOST_CHECK_THROW(EventSearch(scanner, { EventPredicate::register_equals(SampleTrace::rbx, value64(10)) }),
+	                  std::invalid_argument);
+
+	EventSearch rip_search(scanner, { EventPredicate::register_equals(SampleTrace::rip, value64(1999)),
+	                                  EventPredicate::register_written(SampleTrace::rbx) });
+	matches.clear();
+	statistics = rip_search.run(pool, [&matches](const SearchMatch& match) { matches.push_back(match); });
+	BOOST_CHECK_EQUAL(statistics.events, 2000);
+	BOOST_CHECK_EQUAL(statistics.matches, 1001);
+	BOOST_REQUIRE(not matches.empty());
+	BOOST_CHECK_EQUAL(matches.back().event_id, 1999);
+	BOOST_CHECK_EQUAL(matches.back().predicate, 0);
+
+	BOOST_CHECK_THROW(EventSearch(engine, { EventPredicate::register_written(0x42) }), std::invalid_argument);
+	BOOST_CHECK_THROW(EventSearch(engine, { EventPredicate::register_equals(SampleTrace::rip, { 1, 2 }) }),
+	                  std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_event_search_register_encodings)
+{
+	SampleTrace sample(2000, 100, CachePointsOptions(), EventsOptions(),
+	                   { { SampleTrace::rip, MachineDescription::RegisterEncoding::Delta } });
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+
+	std::vector<SearchMatch> matches;
+	auto collect = [&matches](const SearchMatch& match) { matches.push_back(match); };
+
+	// Cache points give the values the encoded writes apply to
+	ReplayEngine engine(trace, cache);
+	EventSearch(engine, { EventPredicate::register_equals(SampleTrace::rip, value64(1234)) }).run(pool, collect);
+	BOOST_REQUIRE_EQUAL(matches.size(), 1);
+	BOOST_CHECK_EQUAL(matches[0].event_id, 1234);
+
+	// Without them, encoded registers can only be searched for writes
+	auto offsets = EventBoundaryFinder(trace, 0x1000).find(pool);
+	ReplayEngine scanner(trace, offsets);
+	BOOST_CHECK_THROW(EventSearch(scanner, { EventPredicate::register_equals(SampleTrace::rip, value64(1234)) }),
+	                  std::invalid_argument);
+	BOOST_CHECK_NO_THROW(EventSearch(scanner, { EventPredicate::register_written(SampleTrace::rip) }));
+	BOOST_CHECK_NO_THROW(EventSearch(scanner, { EventPredicate::register_equals(SampleTrace::rax, value64(0)) }));
+}
@@ -0,0 +1,129 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <cache_set.h>
+#include <event_stream.h>
+#include <memory_diff.h>
+#include <replay_engine.h>
+#include <segment_summaries.h>
+
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+//! The memory of `trace` at `context_id`, replaying from the start.
+std::vector<std::uint8_t> memory_at(const TraceFile& trace, std::uint64_t context_id)
+{
+	StateCursor cursor(trace);
+	while (cursor.next_event_index() < context_id and cursor.read_next_event()) {
+	}
+	return cursor.memory;
+}
+
+//! The ranges of bytes that differ between `lhs` and `rhs`, as pairs of address and size.
+std::vector<std::pair<std::uint64_t, std::uint64_t>> expected_diff(const std::vector<std::uint8_t>& lhs,
+                                                                   const std::vector<std::uint8_t>& rhs)
+{
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+	for (std::uint64_t i = 0; i < lhs.size(); ++i) {
+		if (lhs[i] == rhs[i])
+			continue;
+		if (not ranges.empty() and ranges.back().first + ranges.back().second == i)
+			++ranges.back().second;
+		else
+			ranges.emplace_back(i, 1);
+	}
+	return ranges;
+}
+
+std::vector<std::pair<std::uint64_t, std::uint64_t>> as_pairs(const std::vector<MemoryRange>& ranges)
+{
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> result;
+	for (const auto& range : ranges)
+		result.emplace_back(range.address, range.size);
+	return result;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_diff)
+{
+	// Events after the last cache point, at 2000, are scanned to find candidate pages
+	SampleTrace sample(2050, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheSet caches(SampleTrace::machine());
+	caches.add(sample.cache_stream());
+	ThreadPool pool(4);
+
+	ReplayEngine engine(trace, *caches.layers().front());
+	auto summaries = SegmentSummaries::build(engine, pool, 0x400);
+
+	MemoryDiff diff(trace, caches);
+	MemoryDiff summarized_diff(trace, caches, &summaries);
+
+	const std::vector<std::pair<std::uint64_t, std::uint64_t>> context_pairs = {
+		{ 0, 1 },       { 0, 3 },       { 5, 7 },       { 97, 103 },    { 150, 450 }, { 990, 1000 },
+		{ 1000, 1001 }, { 1234, 1235 }, { 1999, 2050 }, { 2010, 2040 }, { 0, 2050 },  { 600, 400 },
+	};
+
+
+	for (const auto& contexts : context_pairs) {
+		auto expected = expected_diff(memory_at(trace, contexts.first), memory_at(trace, contexts.second));
+		BOOST_TEST_CONTEXT("contexts " << contexts.first << " and " << contexts.second)
+		{
+			BOOST_CHECK(as_pairs(diff.diff(contexts.first, contexts.second)) == expected);
+			BOOST_CHECK(as_pairs(summarized_diff.diff(contexts.first, contexts.second)) == expected);
+			BOOST_CHECK(as_pairs(diff.diff(contexts.second, contexts.first)) == expected);
+		}
+	}
+
+	// Past the last cache point, candidates are the pages of the events in between
+	BOOST_CHECK(diff.candidate_pages(2011, 2012).empty());
+	BOOST_CHECK(diff.candidate_pages(2010, 2011) ==
+	            std::vector<std::uint64_t>{ SampleTrace::memory_address(2010) & ~std::uint64_t(0xfff) });
+	BOOST_CHECK_EQUAL(diff.candidate_pages(1233, 1234).size(), diff.candidate_pages(1200, 1300).size());
+
+	BOOST_CHECK(diff.diff(300, 300).empty());
+	BOOST_CHECK(diff.candidate_pages(300, 300).empty());
+	BOOST_CHECK_THROW(diff.diff(0, 2051), std::out_of_range);
+
+	// Summaries with gaps between them, and none past 1500: uncovered events use the caches
+	SegmentSummaries gapped(0x400);
+	for (const auto& segment : engine.segments()) {
+		if (segment.index % 3 == 1 or segment.start_context >= 1500)
+			continue;
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> writes;
+		EventStream events(trace, segment.stream_pos);
+		for (auto context_id = segment.start_context; context_id < segment.end_context; ++context_id)
+			events.scan_memory_writes([&writes](std::uint64_t address, std::uint64_t size) {
+				writes.emplace_back(address, size);
+			});
+		gapped.add_segment(segment.start_context, segment.end_context, writes);
+	}
+
+	MemoryDiff gapped_diff(trace, caches, &gapped);
+	for (const auto& segment : engine.segments()) {
+		if (segment.index % 3 != 1)
+			continue;
+		auto pages = diff.candidate_pages(segment.start_context, segment.end_context);
+		BOOST_CHECK(not pages.empty());
+		BOOST_CHECK(gapped_diff.candidate_pages(segment.start_context, segment.end_context) == pages);
+	}
+	for (const auto& contexts : context_pairs) {
+		auto expected = expected_diff(memory_at(trace, contexts.first), memory_at(trace, contexts.second));
+		BOOST_TEST_CONTEXT("gapped summaries, contexts " << contexts.first << " and " << contexts.second)
+		{
+			BOOST_CHECK(as_pairs(gapped_diff.diff(contexts.first, contexts.second)) == expected);
+		}
+	}
+
+	CacheSet no_caches(SampleTrace::machine());
+	BOOST_CHECK_THROW(MemoryDiff(trace, no_caches), std::invalid_argument);
+}
@@ -0,0 +1,159 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <cache_reader.h>
+#include <event_boundary_finder.h>
+#include <memory_write_index.h>
+#include <posting_list.h>
+#include <reader_errors.h>
+#include <replay_engine.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+//! Events writing each page of a SampleTrace, computed from its definition.
+std::map<std::uint64_t, std::set<std::uint64_t>> sample_page_writes(std::uint64_t event_count, std::uint32_t page_size)
+{
+	std::map<std::uint64_t, std::set<std::uint64_t>> pages;
+	auto add = [&pages, page_size](std::uint64_t event, std::uint64_t address, std::uint64_t size) {
+		for (auto page = address & ~std::uint64_t(page_size - 1); page < address + size; page += page_size)
+			pages[page].insert(event);
+	};
+
+	for (std::uint64_t i = 0; i < event_count; ++i) {
+		if (SampleTrace::writes_memory(i))
+			add(i, SampleTrace::memory_address(i), 8);
+		if (SampleTrace::writes_large_memory(i))
+			add(i, (i * 0x100) % (SampleTrace::memory_size - 0x1800), 0x1800);
+	}
+	return pages;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_posting_list)
+{
+	PostingListBuilder builder;
+	std::vector<std::uint64_t> ids;
+	for (std::uint64_t i = 0; i < 1000; ++i) {
+		ids.push_back(5 + i * 3 + (i > 500 ? 1000000 : 0));
+		builder.add(ids.back());
+		builder.add(ids.back());
+	}
+	BOOST_CHECK_EQUAL(builder.count(), 1000);
+	BOOST_CHECK_THROW(builder.add(4), std::logic_error);
+
+	std::vector<std::uint8_t> data;
+	builder.encode(data);
+	PostingList list(data.data(), data.size());
+	BOOST_CHECK_EQUAL(list.count(), 1000);
+
+	std::vector<std::uint64_t> all;
+	list.collect(0, std::uint64_t(-1), all);
+	BOOST_CHECK(all == ids);
+
+	std::vector<std::uint64_t> some;
+	list.collect(ids[200], ids[700] + 1, some);
+	BOOST_CHECK(some == std::vector<std::uint64_t>(ids.begin() + 200, ids.begin() + 701));
+
+	std::uint64_t id;
+	BOOST_CHECK(list.next(0, id) and id == ids[0]);
+	BOOST_CHECK(list.next(ids[127] + 1, id) and id == ids[128]);
+	BOOST_CHECK(list.next(ids[501] - 1, id) and id == ids[501]);
+	BOOST_CHECK(not list.next(ids.back() + 1, id));
+	BOOST_CHECK(not list.previous(ids[0], id));
+	BOOST_CHECK(list.previous(ids[128], id) and id == ids[127]);
+	BOOST_CHECK(list.previous(ids[501], id) and id == ids[500]);
+	BOOST_CHECK(list.previous(std::uint64_t(-1), id) and id == ids.back());
+
+	PostingList empty;
+	BOOST_CHECK(not empty.next(0, id));
+	BOOST_CHECK(not empty.previous(10, id));
+
+	BOOST_CHECK_THROW(PostingList(data.data(), 5), MalformedSection);
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_write_index)
+{
+	SampleTrace sample(2000, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+
+	const std::uint32_t page_size = 0x400;
+	auto expected = sample_page_writes(2000, page_size);
+
+	auto offsets = EventBoundaryFinder(trace, 0x1000).find(pool);
+	ReplayEngine scanner(trace, offsets);
+	auto index = MemoryWriteIndex::build(scanner, pool, page_size);
+	BOOST_CHECK_EQUAL(index.event_count(), 2000);
+	BOOST_CHECK_EQUAL(index.page_count(), expected.size());
+
+	TemporaryFile file;
+	index.write(std::make_unique<std::ofstream>(file.filename, std::ios::binary), "test", "1.0.0", "test");
+	MemoryWriteIndex loaded(file.filename);
+	BOOST_CHECK_EQUAL(loaded.page_size(), page_size);
+	BOOST_CHECK_EQUAL(loaded.page_count(), expected.size());
+	BOOST_CHECK_THROW(CacheReader(file.filename, trace.machine()), IncompatibleTypeException);
+
+	// The same index built from cache points
+	ReplayEngine engine(trace, cache);
+	auto from_cache = MemoryWriteIndex::build(engine, pool, page_size);
+
+	for (const auto* checked : { &index, &loaded, &from_cache }) {
+		for (const auto& page : expected) {
+			auto writes = checked->writes(page.first + 0x10, 0x20, 0, 2000);
+			BOOST_CHECK(writes == std::vector<std::uint64_t>(page.second.begin(), page.second.end()));
+
+			for (std::uint64_t context_id : { 0, 1, 150, 999, 1000, 2000 }) {
+				auto it = page.second.lower_bound(context_id);
+				auto last = it == page.second.begin() ? MemoryWriteIndex::no_event : *std::prev(it);
+				BOOST_CHECK_EQUAL(checked->last_write_before(page.first, page_size, context_id), last);
+			}
+		}
+	}
+
+	// A range over two pages, in a window of events
+	std::set<std::uint64_t> both(expected[0].begin(), expected[0].end());
+	both.insert(expected[page_size].begin(), expected[page_size].end());
+	std::vector<std::uint64_t> window;
+	for (auto event : both) {
+		if (event >= 300 and event < 900)
+			window.push_back(event);
+	}
+	BOOST_CHECK(index.writes(page_size - 1, 2, 300, 900) == window);
+	BOOST_CHECK(index.writes(0, 0, 0, 2000).empty());
+	BOOST_CHECK(index.writes(SampleTrace::memory_size, 0x1000, 0, 2000).empty());
+	BOOST_CHECK_EQUAL(index.last_write_before(SampleTrace::memory_size, 1, 2000), MemoryWriteIndex::no_event);
+	BOOST_CHECK_EQUAL(index.last_write_before(std::uint64_t(-8), 0x100, 2000), MemoryWriteIndex::no_event);
+
+	BOOST_CHECK_THROW(MemoryWriteIndex::build(scanner, pool, 0x300), std::invalid_argument);
+	BOOST_CHECK_THROW(MemoryWriteIndex(sample.trace_stream()), IncompatibleTypeException);
+	BOOST_CHECK_THROW(MemoryWriteIndex(sample.cache_stream()), IncompatibleTypeException);
+
+	// The page size is checked on load too
+	std::ifstream written(file.filename, std::ios::binary);
+	const std::string content(std::istreambuf_iterator<char>(written), {});
+	const auto granularity_pos = static_cast<std::size_t>(
+		reven::binresource::Reader::open(std::make_unique<std::ifstream>(file.filename, std::ios::binary))
+		.stream().tellg()) + sizeof(std::uint64_t) + sizeof(std::uint32_t);
+	for (std::uint32_t granularity : { 0u, 0x300u }) {
+		auto patched = content;
+		patched.replace(granularity_pos, sizeof(granularity), reinterpret_cast<const char*>(&granularity),
+		                sizeof(granularity));
+		BOOST_CHECK_THROW(MemoryWriteIndex(std::make_unique<std::stringstream>(patched)), MalformedSection);
+	}
+}
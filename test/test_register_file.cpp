@@ -0,0 +1,59 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+
+#include <register_file.h>
+
+#include "helpers.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+BOOST_AUTO_TEST_CASE(test_register_file)
+{
+	MachineDescription desc{
+		MachineDescription::Archi::x64_1,
+		5,
+		{},
+		{ { 0, { 4, "eax" } }, { 2, { 2, "ax" } }, { 0xf00, { 64, "zmm0" } } },
+		{},
+		{},
+	};
+
+	RegisterFile regs(desc);
+	BOOST_CHECK_EQUAL(regs.register_count(), 3);
+	BOOST_CHECK(regs.contains(0));
+	BOOST_CHECK(not regs.contains(1));
+	BOOST_CHECK(regs.contains(2));
+	BOOST_CHECK(not regs.contains(0xf01));
+	BOOST_CHECK_EQUAL(regs.register_size(0xf00), 64);
+	BOOST_CHECK_EQUAL(regs.layout()->offset(0), 0);
+	BOOST_CHECK_EQUAL(regs.layout()->offset(2), 8);
+	BOOST_CHECK_EQUAL(regs.layout()->offset(0xf00), 16);
+	BOOST_CHECK_EQUAL(regs.byte_size(), 80);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint64_t*>(regs.get(0xf00)), 0);
+
+	std::uint32_t value = 0xdeadbeef;
+	regs.set(0, reinterpret_cast<const std::uint8_t*>(&value), 4);
+	BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint32_t*>(regs.get(0)), 0xdeadbeef);
+	BOOST_CHECK_THROW(regs.set(0, reinterpret_cast<const std::uint8_t*>(&value), 2), std::out_of_range);
+	BOOST_CHECK_THROW(regs.set(1, reinterpret_cast<const std::uint8_t*>(&value), 4), std::out_of_range);
+
+	auto copy = regs;
+	BOOST_CHECK(copy == regs);
+	*copy.get(2) = 1;
+	BOOST_CHECK(copy != regs);
+	copy.copy_from(regs);
+	BOOST_CHECK(copy == regs);
+
+	// Same machine described twice gives compatible register files
+	RegisterFile other(desc);
+	BOOST_CHECK(other != regs);
+	other.copy_from(regs);
+	BOOST_CHECK(other == regs);
+
+	desc.registers.erase(2);
+	RegisterFile smaller(desc);
+	BOOST_CHECK(smaller != regs);
+	BOOST_CHECK_THROW(smaller.copy_from(regs), std::logic_error);
+}
@@ -0,0 +1,73 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+
+#include <event_boundary_finder.h>
+#include <memory_write_index.h>
+#include <reader_errors.h>
+#include <register_write_index.h>
+#include <replay_engine.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+BOOST_AUTO_TEST_CASE(test_register_write_index)
+{
+	SampleTrace sample(2000, 100);
+	TraceFile trace(sample.trace_stream());
+	ThreadPool pool(4);
+
+	auto offsets = EventBoundaryFinder(trace, 0x1000).find(pool);
+	auto index = RegisterWriteIndex::build(ReplayEngine(trace, offsets), pool);
+	BOOST_CHECK_EQUAL(index.event_count(), 2000);
+
+	TemporaryFile file;
+	index.write(std::make_unique<std::ofstream>(file.filename, std::ios::binary), "test", "1.0.0", "test");
+	RegisterWriteIndex loaded(file.filename);
+
+	// rbx is only written by register operations
+	const std::map<RegisterId, std::function<bool(std::uint64_t)>> written = {
+		{ SampleTrace::rip, [](std::uint64_t) { return true; } },
+		{ SampleTrace::rax, [](std::uint64_t i) { return i % 5 == 0; } },
+		{ SampleTrace::rbx, [](std::uint64_t i) { return i % 2 == 0; } },
+		{ SampleTrace::zmm0, [](std::uint64_t i) { return i % 13 == 0; } },
+	};
+
+	for (const auto* checked : { &index, &loaded }) {
+		for (const auto& reg : written) {
+			std::uint64_t count = 0;
+			for (std::uint64_t i = 0; i < 2000; ++i)
+				count += reg.second(i);
+			BOOST_CHECK_EQUAL(checked->write_count(reg.first), count);
+
+			for (std::uint64_t context_id : { 0, 1, 2, 13, 14, 999, 1000, 1999, 2000 }) {
+				auto next = context_id;
+				while (next < 2000 and not reg.second(next))
+					++next;
+				BOOST_CHECK_EQUAL(checked->next_write(reg.first, context_id),
+				                  next == 2000 ? RegisterWriteIndex::no_event : next);
+
+				auto prev = context_id;
+				while (prev > 0 and not reg.second(prev - 1))
+					--prev;
+				BOOST_CHECK_EQUAL(checked->prev_write(reg.first, context_id),
+				                  prev == 0 ? RegisterWriteIndex::no_event : prev - 1);
+			}
+		}
+
+		BOOST_CHECK_EQUAL(checked->write_count(0x42), 0);
+		BOOST_CHECK_EQUAL(checked->next_write(0x42, 0), RegisterWriteIndex::no_event);
+		BOOST_CHECK_EQUAL(checked->prev_write(0x42, 2000), RegisterWriteIndex::no_event);
+	}
+
+	TemporaryFile memory_file;
+	MemoryWriteIndex::build(ReplayEngine(trace, offsets), pool)
+	  .write(std::make_unique<std::ofstream>(memory_file.filename, std::ios::binary), "test", "1.0.0", "test");
+	BOOST_CHECK_THROW(RegisterWriteIndex{ memory_file.filename }, IncompatibleTypeException);
+}
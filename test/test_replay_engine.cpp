@@ -0,0 +1,232 @@
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+#include <cache_reader.h>
+#include <replay_engine.h>
+#include <thread_pool.h>
+#include <trace_file.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+//! Tracks registers from the segment's seed, and counts events.
+class CheckingHandler : public SegmentHandler
+{
+public:
+	using SegmentHandler::SegmentHandler;
+
+	RegisterFile registers;
+	std::uint64_t events = 0;
+	std::uint64_t other_events = 0;
+	bool ended = false;
+
+protected:
+	void do_segment_start(const ReplaySegment&, const RegisterFile* seed) override
+	{
+		registers = *seed;
+	}
+
+	void do_segment_end(const ReplaySegment&) override { ended = true; }
+
+	void do_event_instruction() override { ++events; }
+	void do_event_other(const std::string&) override { ++events; ++other_events; }
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id) override
+	{
+		return { registers.get(reg_id), registers.get(reg_id) };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t, std::uint64_t size) override
+	{
+		return { scratch_, std::min<std::uint64_t>(size, sizeof(scratch_)) };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+
+private:
+	std::uint8_t scratch_[256];
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_thread_pool)
+{
+	ThreadPool pool(4);
+	BOOST_CHECK_EQUAL(pool.thread_count(), 4);
+
+	std::atomic<int> count(0);
+	for (int i = 0; i < 100; ++i) {
+		pool.submit([&pool, &count]() {
+			// Tasks submitted from a worker go to its own queue, and can be stolen by the others
+			for (int j = 0; j < 10; ++j)
+				pool.submit([&count]() { ++count; });
+		});
+	}
+	pool.wait();
+	BOOST_CHECK_EQUAL(count, 1000);
+
+	pool.submit([]() { throw std::runtime_error("task error"); });
+	pool.submit([&count]() { ++count; });
+	BOOST_CHECK_THROW(pool.wait(), std::runtime_error);
+	BOOST_CHECK_EQUAL(count, 1001);
+
+	// The error is only reported once
+	pool.wait();
+
+	std::vector<int> values(1000, 0);
+	pool.parallel_for(values.size(), [&values](std::size_t i) { values[i] = static_cast<int>(i); });
+	for (std::size_t i = 0; i < values.size(); ++i)
+		BOOST_CHECK_EQUAL(values[i], i);
+	BOOST_CHECK_THROW(pool.parallel_for(10, [](std::size_t i) { if (i == 3) throw std::runtime_error("error"); }),
+	                  std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_replay_engine_segments)
+{
+	SampleTrace sample(1050, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+
+	ReplayEngine sequential(trace);
+	BOOST_REQUIRE_EQUAL(sequential.segments().size(), 1);
+	BOOST_CHECK_EQUAL(sequential.segments()[0].end_context, 1050);
+
+	ReplayEngine engine(trace, cache);
+	const auto& segments = engine.segments();
+	BOOST_REQUIRE_EQUAL(segments.size(), 11);
+	BOOST_CHECK(segments[0].seed == SegmentSeed::InitialContext);
+	BOOST_CHECK_EQUAL(segments[0].stream_pos, TraceFile::first_event_stream_pos());
+	for (std::size_t i = 1; i < segments.size(); ++i) {
+		BOOST_CHECK_EQUAL(segments[i].index, i);
+		BOOST_CHECK(segments[i].seed == SegmentSeed::CachePoint);
+		BOOST_CHECK_EQUAL(segments[i].start_context, i * 100);
+		BOOST_CHECK_EQUAL(segments[i].cache_point->first, i * 100);
+		BOOST_CHECK_EQUAL(segments[i - 1].end_context, segments[i].start_context);
+	}
+	BOOST_CHECK_EQUAL(segments.back().end_context, 1050);
+}
+
+BOOST_AUTO_TEST_CASE(test_replay_engine)
+{
+	SampleTrace sample(2000, 100);
+	TemporaryFile file;
+	file.write(sample.trace);
+
+	TraceFile trace(file.filename);
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+
+	for (bool with_cache : { true, false }) {
+		auto engine = with_cache ? std::make_unique<ReplayEngine>(trace, cache) : std::make_unique<ReplayEngine>(trace);
+
+		std::size_t next_segment = 0;
+		std::uint64_t events = 0;
+		std::uint64_t other_events = 0;
+		RegisterFile last_registers;
+
+		engine->replay(
+		  pool,
+		  [&trace](const ReplaySegment&) { return std::make_unique<CheckingHandler>(trace); },
+		  [&](const ReplaySegment& segment, std::unique_ptr<SegmentHandler>&& handler) {
+			  BOOST_CHECK_EQUAL(segment.index, next_segment++);
+
+			  auto& result = static_cast<CheckingHandler&>(*handler);
+			  BOOST_CHECK(result.ended);
+			  BOOST_CHECK_EQUAL(result.events, segment.end_context - segment.start_context);
+			  BOOST_CHECK_EQUAL(result.next_event_index(), segment.end_context);
+			  std::uint64_t rip = *reinterpret_cast<const std::uint64_t*>(result.registers.get(SampleTrace::rip));
+			  BOOST_CHECK_EQUAL(rip, SampleTrace::expected_rip(segment.end_context));
+
+			  events += result.events;
+			  other_events += result.other_events;
+			  last_registers = result.registers;
+		  });
+
+		BOOST_CHECK_EQUAL(next_segment, engine->segments().size());
+		BOOST_CHECK_EQUAL(events, 2000);
+		BOOST_CHECK_EQUAL(other_events, 182);
+		BOOST_CHECK(last_registers == sample.final_registers);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_replay_engine_query)
+{
+	SampleTrace sample(2000, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+	ReplayEngine engine(trace, cache);
+
+	// Unordered, with duplicates, cache point contexts, and both ends of the trace
+	std::vector<std::uint64_t> contexts{ 1500, 0, 2000, 17, 300, 301, 17, 399, 250, 1999, 1500, 1 };
+	std::set<std::uint64_t> expected(contexts.begin(), contexts.end());
+
+	std::mutex mutex;
+	std::map<std::uint64_t, std::uint64_t> rips;
+	std::atomic<int> handlers(0);
+	std::atomic<std::uint64_t> events(0);
+	engine.query(pool, contexts,
+	             [&trace, &handlers](const ReplaySegment&) {
+		             ++handlers;
+		             return std::make_unique<CheckingHandler>(trace);
+	             },
+	             [&](std::uint64_t context_id, SegmentHandler& handler) {
+		             auto& state = static_cast<CheckingHandler&>(handler);
+		             BOOST_CHECK_EQUAL(state.next_event_index(), context_id);
+		             BOOST_CHECK(not state.ended);
+		             std::lock_guard<std::mutex> lock(mutex);
+		             BOOST_CHECK(rips.emplace(context_id, *reinterpret_cast<const std::uint64_t*>(
+		                                                    state.registers.get(SampleTrace::rip))).second);
+		             events = std::max<std::uint64_t>(events, state.events);
+	             });
+
+	BOOST_REQUIRE_EQUAL(rips.size(), expected.size());
+	for (const auto& rip : rips)
+		BOOST_CHECK_EQUAL(rip.second, SampleTrace::expected_rip(rip.first));
+
+	// Segments 0, 2, 3, 14 and 19, each only replayed up to their last requested context
+	BOOST_CHECK_EQUAL(handlers, 5);
+	BOOST_CHECK_EQUAL(events, 100);
+
+	BOOST_CHECK_THROW(engine.query(pool, { 10, 2001 }, nullptr, nullptr), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(test_replay_engine_error)
+{
+	SampleTrace sample(1000, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+	ReplayEngine engine(trace, cache);
+
+	std::size_t consumed = 0;
+	BOOST_CHECK_THROW(
+	  engine.replay(pool,
+	                [&trace](const ReplaySegment& segment) -> std::unique_ptr<SegmentHandler> {
+		                if (segment.index == 5)
+			                throw std::runtime_error("factory error");
+		                return std::make_unique<CheckingHandler>(trace);
+	                },
+	                [&consumed](const ReplaySegment&, std::unique_ptr<SegmentHandler>&&) { ++consumed; }),
+	  std::runtime_error);
+	// Segments still waiting in the pool when the error happens are skipped
+	BOOST_CHECK_LE(consumed, 5);
+
+	// The pool is still usable
+	std::atomic<int> count(0);
+	pool.submit([&count]() { ++count; });
+	pool.wait();
+	BOOST_CHECK_EQUAL(count, 1);
+}
@@ -0,0 +1,158 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <cache_reader.h>
+#include <reader_errors.h>
+#include <replay_engine.h>
+#include <segment_summaries.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+//! Memory writes of event `i` of a SampleTrace, as pairs of address and size.
+std::vector<std::pair<std::uint64_t, std::uint64_t>> sample_writes(std::uint64_t i)
+{
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> writes;
+	if (SampleTrace::writes_memory(i))
+		writes.emplace_back(SampleTrace::memory_address(i), 8);
+	if (SampleTrace::writes_large_memory(i))
+		writes.emplace_back((i * 0x100) % (SampleTrace::memory_size - 0x1800), 0x1800);
+	return writes;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_segment_summaries)
+{
+	SampleTrace sample(2000, 100);
+	TraceFile trace(sample.trace_stream());
+	CacheReader cache(sample.cache_stream(), trace.machine());
+	ThreadPool pool(4);
+
+	const std::uint32_t page_size = 0x400;
+	ReplayEngine engine(trace, cache);
+	auto summaries = SegmentSummaries::build(engine, pool, page_size);
+
+	TemporaryFile file;
+	summaries.write(std::make_unique<std::ofstream>(file.filename, std::ios::binary), "test", "1.0.0", "test");
+	SegmentSummaries loaded(file.filename);
+	BOOST_CHECK_EQUAL(loaded.page_size(), page_size);
+
+	for (const auto* checked : { &summaries, &loaded }) {
+		BOOST_REQUIRE_EQUAL(checked->summaries().size(), 20);
+
+		for (std::size_t segment = 0; segment < 20; ++segment) {
+			const auto& summary = checked->summaries()[segment];
+			BOOST_CHECK_EQUAL(summary.start_context, segment * 100);
+			BOOST_CHECK_EQUAL(summary.end_context, segment * 100 + 100);
+
+			std::set<std::uint64_t> pages;
+			for (auto i = summary.start_context; i < summary.end_context; ++i) {
+				for (const auto& write : sample_writes(i)) {
+					for (auto page = write.first & ~std::uint64_t(page_size - 1); page < write.first + write.second;
+					     page += page_size)
+						pages.insert(page);
+
+					// No false negatives, for the whole write or any byte of it
+					BOOST_CHECK(checked->may_write(summary, write.first, write.second));
+					BOOST_CHECK(checked->may_write(summary, write.first + write.second - 1, 1));
+					auto candidates = checked->candidate_segments(write.first + 3, 1, i, i + 1);
+					BOOST_CHECK(candidates == std::vector<std::size_t>{ segment });
+				}
+			}
+			BOOST_CHECK(std::vector<std::uint64_t>(pages.begin(), pages.end()) == summary.pages);
+
+			// Pages that are not written are never candidates
+			for (std::uint64_t page = 0; page < SampleTrace::memory_size; page += page_size) {
+				if (pages.count(page) == 0)
+					BOOST_CHECK(not checked->may_write(summary, page, page_size));
+			}
+		}
+	}
+
+	// Few false positives among the cache lines that are not written
+	std::uint64_t false_positives = 0;
+	std::uint64_t tested = 0;
+	for (const auto& summary : summaries.summaries()) {
+		std::set<std::uint64_t> lines;
+		for (auto i = summary.start_context; i < summary.end_context; ++i) {
+			for (const auto& write : sample_writes(i)) {
+				for (auto line = write.first / 64; line <= (write.first + write.second - 1) / 64; ++line)
+					lines.insert(line);
+			}
+		}
+		for (std::uint64_t line = 0; line < SampleTrace::memory_size / 64; ++line) {
+			if (lines.count(line) == 0) {
+				++tested;
+				false_positives += summaries.may_write(summary, line * 64, 64);
+			}
+		}
+	}
+	BOOST_CHECK(false_positives * 20 < tested);
+
+	BOOST_CHECK(not summaries.may_change(SampleTrace::memory_size, 0x1000, 0, 2000));
+	BOOST_CHECK(summaries.candidate_segments(0, SampleTrace::memory_size, 250, 250).empty());
+	BOOST_CHECK_EQUAL(summaries.candidate_segments(0, SampleTrace::memory_size, 250, 451).size(), 3);
+
+	// Nothing is known of the events in no segment
+	SegmentSummaries partial(0x1000);
+	partial.add_segment(0, 100, {});
+	partial.add_segment(200, 300, {});
+	BOOST_CHECK(not partial.may_change(0, SampleTrace::memory_size, 0, 100));
+	BOOST_CHECK(not partial.may_change(0, SampleTrace::memory_size, 210, 300));
+	BOOST_CHECK(partial.may_change(0, SampleTrace::memory_size, 50, 250));
+	BOOST_CHECK(partial.may_change(0, SampleTrace::memory_size, 250, 301));
+	BOOST_CHECK(partial.may_change(0, SampleTrace::memory_size, 400, 500));
+	BOOST_CHECK(partial.candidate_segments(0, SampleTrace::memory_size, 0, 100).empty());
+	BOOST_CHECK_THROW(partial.candidate_segments(0, SampleTrace::memory_size, 50, 250), std::out_of_range);
+	BOOST_CHECK_THROW(partial.candidate_segments(0, SampleTrace::memory_size, 250, 301), std::out_of_range);
+
+	BOOST_CHECK_THROW(summaries.add_segment(1500, 3000, {}), std::invalid_argument);
+	BOOST_CHECK_THROW(SegmentSummaries(0x30), std::invalid_argument);
+	BOOST_CHECK_THROW(SegmentSummaries(sample.trace_stream()), IncompatibleTypeException);
+}
+
+BOOST_AUTO_TEST_CASE(test_segment_summaries_malformed)
+{
+	SegmentSummaries summaries(0x1000);
+	summaries.add_segment(0, 10, { { 0x1000, 8 }, { 0x3000, 8 } });
+	TemporaryFile file;
+	summaries.write(std::make_unique<std::ofstream>(file.filename, std::ios::binary), "test", "1.0.0", "test");
+
+	std::ifstream written(file.filename, std::ios::binary);
+	const std::string content(std::istreambuf_iterator<char>(written), {});
+	const auto header_pos = static_cast<std::size_t>(
+		reven::binresource::Reader::open(std::make_unique<std::ifstream>(file.filename, std::ios::binary))
+		.stream().tellg());
+	auto patched = [&content](std::size_t pos, std::uint64_t value, std::size_t size) {
+		auto result = content;
+		result.replace(pos, size, reinterpret_cast<const char*>(&value), size);
+		return std::make_unique<std::stringstream>(result);
+	};
+
+	// Page size, after the header's size and the index kind
+	const auto granularity_pos = header_pos + 8 + 4;
+	BOOST_CHECK_EQUAL(SegmentSummaries(patched(granularity_pos, 0x2000, 4)).summaries().size(), 1);
+	for (std::uint32_t granularity : { 0u, 0x300u, SegmentSummaries::line_size / 2 })
+		BOOST_CHECK_THROW(SegmentSummaries(patched(granularity_pos, granularity, 4)), MalformedSection);
+
+	// The second page, after the header, the line size, hash count, segment count, segment bounds and page count
+	const auto second_page_pos = header_pos + 8 + 16 + 8 + 4 + 4 + 8 + 16 + 8 + 8;
+	BOOST_CHECK(SegmentSummaries(patched(second_page_pos, 0x5000, 8)).summaries()[0].pages ==
+	            std::vector<std::uint64_t>({ 0x1000, 0x5000 }));
+	BOOST_CHECK_THROW(SegmentSummaries(patched(second_page_pos, 0x1000, 8)), MalformedSection);
+	BOOST_CHECK_THROW(SegmentSummaries(patched(second_page_pos, 0, 8)), MalformedSection);
+}
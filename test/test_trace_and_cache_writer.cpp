@@ -0,0 +1,188 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <cache_reader.h>
+#include <trace_and_cache_writer.h>
+#include <trace_file.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+struct RecordedTrace {
+	std::string trace;
+	std::string cache;
+};
+
+RecordedTrace record(std::uint64_t event_count, CachePointInterval interval,
+                     const CachePointsOptions& options = CachePointsOptions())
+{
+	auto trace_stream = std::make_unique<std::stringstream>();
+	auto trace_stream_ptr = trace_stream.get();
+	auto cache_stream = std::make_unique<std::stringstream>();
+	auto cache_stream_ptr = cache_stream.get();
+
+	std::vector<std::uint8_t> memory(SampleTrace::memory_size, 0xaa);
+	RegisterFile registers(SampleTrace::machine());
+
+	TraceAndCacheWriter writer(std::move(trace_stream), std::move(cache_stream), SampleTrace::page_size,
+	                           SampleTrace::machine(), { memory.data() }, registers, interval, options,
+	                           "TestTraceAndCacheWriter", "1.0.0", "test");
+
+	std::mt19937 random(42);
+	std::vector<std::uint8_t> buffer(0x2000);
+	for (std::uint64_t i = 0; i < event_count; ++i) {
+		writer.start_event_instruction();
+
+		for (auto writes = random() % 4; writes > 0; --writes) {
+			std::uint64_t size = random() % 16 == 0 ? buffer.size() : 1 + random() % 300;
+			std::uint64_t address = random() % (SampleTrace::memory_size - size);
+			for (std::uint64_t j = 0; j < size; ++j)
+				buffer[j] = static_cast<std::uint8_t>(random() % 4);
+			writer.write_memory(address, buffer.data(), size);
+		}
+
+		writer.write_register(SampleTrace::rip, reinterpret_cast<const std::uint8_t*>(&i), 8);
+		if (i % 2 == 0)
+			writer.write_register_action(SampleTrace::add_rbx);
+		if (i % 7 == 3)
+			writer.write_register_set({ { SampleTrace::rax, reinterpret_cast<const std::uint8_t*>(&i) },
+			                            { SampleTrace::zmm0, buffer.data() } });
+
+		writer.finish_event();
+	}
+
+	BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint64_t*>(writer.registers().get(SampleTrace::rbx)),
+	                  (event_count + 1) / 2);
+	writer.finish();
+
+	return { trace_stream_ptr->str(), cache_stream_ptr->str() };
+}
+
+//! Replay the trace, and check the state at each cache point against the registers and pages found in the cache.
+std::vector<std::uint64_t> check_cache(const RecordedTrace& recorded)
+{
+	TraceFile trace(std::make_unique<std::stringstream>(recorded.trace));
+	CacheReader cache(std::make_unique<std::stringstream>(recorded.cache), trace.machine());
+
+	StateCursor cursor(trace);
+	std::vector<std::uint8_t> cached_memory = cursor.memory;
+	std::vector<std::uint64_t> contexts;
+
+	const auto& cache_points = cache.index().cache_points;
+	for (auto it = cache_points.rbegin(); it != cache_points.rend(); ++it) {
+		while (cursor.next_event_index() < it->first)
+			cursor.read_next_event();
+
+		contexts.push_back(it->first);
+		BOOST_CHECK_EQUAL(it->second.trace_stream_offset, cursor.stream_pos());
+		BOOST_CHECK(cache.read_cache_point(std::next(it).base()) == cursor.registers);
+
+		for (const auto& page : it->second.page_offsets)
+			cache.read_memory_page(page, cached_memory.data() + page.page_address);
+		BOOST_CHECK(cached_memory == cursor.memory);
+	}
+
+	return contexts;
+}
+
+//! A cursor measuring the replay work of the events it reads.
+class WorkCursor : public StateCursor
+{
+public:
+	using StateCursor::StateCursor;
+
+	ReplayWork work;
+
+protected:
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id) override
+	{
+		++work.register_writes;
+		return StateCursor::do_register_rw_buffers(reg_id);
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		++work.memory_writes;
+		return StateCursor::do_memory_before_write(address, size);
+	}
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_and_cache_writer_events_interval)
+{
+	auto recorded = record(1000, { 100, 0 });
+	auto contexts = check_cache(recorded);
+
+	BOOST_REQUIRE_EQUAL(contexts.size(), 10);
+	for (std::size_t i = 0; i < contexts.size(); ++i)
+		BOOST_CHECK_EQUAL(contexts[i], (i + 1) * 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_and_cache_writer_bytes_interval)
+{
+	auto recorded = record(1000, { 0, 0x4000 });
+	auto contexts = check_cache(recorded);
+
+	BOOST_CHECK_GT(contexts.size(), 10);
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_and_cache_writer_dense)
+{
+	// A cache point after each event, so that the background thread is still copying pages while the next event
+	// modifies them.
+	auto recorded = record(500, { 1, 0 });
+	auto contexts = check_cache(recorded);
+
+	BOOST_CHECK_EQUAL(contexts.size(), 500);
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_and_cache_writer_options)
+{
+	ThreadPool pool(4);
+	auto raw = record(1000, { 50, 0 });
+	auto encoded = record(1000, { 50, 0 }, { true, 4, true, &pool });
+
+	auto contexts = check_cache(encoded);
+	BOOST_CHECK(contexts == check_cache(raw));
+	BOOST_CHECK_LT(encoded.cache.size(), raw.cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_and_cache_writer_replay_cost)
+{
+	CachePointInterval interval{ 0, 0 };
+	interval.max_replay_cost = 20000;
+	auto recorded = record(1000, interval);
+	auto contexts = check_cache(recorded);
+	BOOST_REQUIRE_GT(contexts.size(), 10);
+
+	// Replaying up to the event before each cache point stays under the bound, whatever the number of events.
+	TraceFile trace(std::make_unique<std::stringstream>(recorded.trace));
+	WorkCursor cursor(trace);
+	std::set<std::uint64_t> gaps;
+	std::uint64_t previous = 0;
+	for (auto context_id : contexts) {
+		cursor.work = ReplayWork();
+		auto start_pos = cursor.stream_pos();
+		while (cursor.next_event_index() + 1 < context_id)
+			cursor.read_next_event();
+		cursor.work.events = context_id - 1 - previous;
+		cursor.work.bytes = cursor.stream_pos() - start_pos;
+		BOOST_CHECK_LT(interval.cost_model.cost(cursor.work), interval.max_replay_cost);
+
+		cursor.read_next_event();
+		gaps.insert(context_id - previous);
+		previous = context_id;
+	}
+	BOOST_CHECK_GT(gaps.size(), 1);
+}
@@ -0,0 +1,470 @@
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <cache_reader.h>
+#include <reverse_cursor.h>
+#include <trace_cursor.h>
+#include <trace_file.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+//! Same as StateCursor, stepping back too.
+class ReverseStateCursor : public ReverseCursor
+{
+public:
+	ReverseStateCursor(const TraceFile& trace, std::size_t undo_log_size)
+	  : ReverseCursor(trace, undo_log_size), registers(trace.initial_registers()), memory(SampleTrace::memory_size)
+	{
+		std::memcpy(memory.data(), trace.initial_memory_region(0), memory.size());
+	}
+
+	RegisterFile registers;
+	std::vector<std::uint8_t> memory;
+
+protected:
+	void do_event_instruction() override {}
+	void do_event_other(const std::string&) override {}
+
+	std::pair<const std::uint8_t*, std::uint8_t*> do_register_rw_buffers(RegisterId reg_id) override
+	{
+		return { registers.get(reg_id), registers.get(reg_id) };
+	}
+
+	std::pair<std::uint8_t*, std::uint64_t> do_memory_before_write(std::uint64_t address, std::uint64_t size) override
+	{
+		// Split writes, as callers may do
+		return { memory.data() + address, std::min<std::uint64_t>(size, 0x100) };
+	}
+
+	void do_memory_after_write(std::uint64_t, const std::uint8_t*, std::uint64_t) override {}
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_file)
+{
+	SampleTrace sample(500, 0);
+	TemporaryFile file;
+	file.write(sample.trace);
+
+	for (bool from_file : { true, false }) {
+		auto trace = from_file ? std::make_unique<TraceFile>(file.filename)
+		                       : std::make_unique<TraceFile>(sample.trace_stream());
+
+		BOOST_CHECK_EQUAL(trace->event_count(), 500);
+		BOOST_CHECK_EQUAL(trace->machine().registers.size(), 4);
+		BOOST_CHECK(trace->initial_registers() == sample.initial_registers);
+		BOOST_CHECK(std::equal(sample.initial_memory.begin(), sample.initial_memory.end(),
+		                       trace->initial_memory_region(0)));
+		BOOST_CHECK_THROW(trace->initial_memory_region(1), std::out_of_range);
+		BOOST_CHECK(trace->metadata().type() == reven::metadata::ResourceType::TraceBin);
+
+		StateCursor cursor(*trace);
+		BOOST_CHECK_EQUAL(cursor.stream_pos(), TraceFile::first_event_stream_pos());
+		std::uint64_t count = 0;
+		while (cursor.read_next_event()) {
+			++count;
+			BOOST_CHECK_EQUAL(cursor.rip(), SampleTrace::expected_rip(count));
+		}
+		BOOST_CHECK_EQUAL(count, 500);
+		BOOST_CHECK_EQUAL(cursor.next_event_index(), 500);
+		BOOST_CHECK_EQUAL(cursor.stream_pos(), trace->events_section_size());
+		BOOST_CHECK(cursor.registers == sample.final_registers);
+		BOOST_CHECK(cursor.memory == sample.final_memory);
+		BOOST_CHECK_EQUAL(cursor.other_events, 45);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_trace_cursors_concurrent)
+{
+	SampleTrace sample(2000, 100);
+	TemporaryFile file;
+	file.write(sample.trace);
+
+	TraceFile trace(file.filename);
+	CacheReader cache(sample.cache_stream(), trace.machine());
+
+	std::atomic<int> errors(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 8; ++t) {
+		threads.emplace_back([&trace, &cache, &sample, &errors, t]() {
+			// Each thread starts from a different cache point, and reads up to the end of the trace.
+			auto cache_point = cache.find_closest(sample.cache_point_contexts[t * 2] + 1);
+			StateCursor cursor(trace);
+			cursor.registers = cache.read_cache_point(cache_point);
+			cursor.seek(cache_point->first, cache_point->second.trace_stream_offset);
+
+			while (cursor.read_next_event()) {
+				if (cursor.rip() != SampleTrace::expected_rip(cursor.next_event_index()))
+					++errors;
+			}
+			if (cursor.registers != sample.final_registers)
+				++errors;
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_reverse_cursor)
+{
+	SampleTrace sample(600, 0);
+	TraceFile trace(sample.trace_stream());
+
+	// The states at each context, as read forward
+	std::vector<RegisterFile> registers;
+	std::vector<std::vector<std::uint8_t>> memory;
+	StateCursor forward(trace);
+	do {
+		registers.push_back(forward.registers);
+		memory.push_back(forward.memory);
+	} while (forward.read_next_event());
+
+	for (std::size_t log_size : { std::size_t(1) << 20, std::size_t(0x3000) }) {
+		ReverseStateCursor cursor(trace, log_size);
+		BOOST_CHECK(not cursor.step_back());
+
+		// Going back and forth
+		for (std::uint64_t i = 0; i < 300; ++i)
+			cursor.read_next_event();
+		for (std::uint64_t i = 0; i < 10; ++i)
+			BOOST_REQUIRE(cursor.step_back());
+		while (cursor.read_next_event()) {
+		}
+		BOOST_CHECK(cursor.registers == sample.final_registers);
+
+		std::uint64_t undone = 0;
+		while (cursor.step_back()) {
+			++undone;
+			auto context_id = cursor.next_event_index();
+			BOOST_REQUIRE(cursor.registers == registers[context_id]);
+			BOOST_REQUIRE(cursor.memory == memory[context_id]);
+		}
+		BOOST_CHECK_EQUAL(cursor.undoable_event_count(), 0);
+		if (log_size == 0x3000) {
+			// Only the latest events fit in the log
+			BOOST_CHECK_GT(undone, 10);
+			BOOST_CHECK_LT(undone, 600);
+		} else {
+			BOOST_CHECK_EQUAL(undone, 600);
+		}
+	}
+
+	// Seeking invalidates the log
+	ReverseStateCursor cursor(trace, 1 << 20);
+	cursor.read_next_event();
+	cursor.read_next_event();
+	cursor.seek(0, TraceFile::first_event_stream_pos());
+	BOOST_CHECK(not cursor.step_back());
+	BOOST_CHECK_EQUAL(cursor.undoable_event_count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_columnar_events)
+{
+	EventsOptions columnar;
+	columnar.columnar = true;
+	columnar.block_event_count = 7;
+	SampleTrace interleaved_sample(600, 50);
+	SampleTrace columnar_sample(600, 50, CachePointsOptions(), columnar);
+	TemporaryFile file;
+	file.write(columnar_sample.trace);
+
+	TraceFile interleaved(interleaved_sample.trace_stream());
+	TraceFile trace(file.filename);
+	BOOST_CHECK(trace.header().events_layout == EventsLayout::Columnar);
+	BOOST_CHECK_EQUAL(trace.event_count(), 600);
+	BOOST_CHECK_EQUAL(trace.event_blocks().size(), 86);
+	BOOST_CHECK_EQUAL(trace.event_blocks().back().first_event_id, 595);
+
+	// Same states at every context, noting the position of each event
+	std::vector<std::uint64_t> positions;
+	StateCursor expected(interleaved);
+	StateCursor cursor(trace);
+	do {
+		positions.push_back(cursor.stream_pos());
+		BOOST_REQUIRE(cursor.registers == expected.registers);
+		BOOST_REQUIRE(cursor.memory == expected.memory);
+		BOOST_REQUIRE_EQUAL(cursor.next_event_index(), expected.next_event_index());
+	} while (cursor.read_next_event() and expected.read_next_event());
+	BOOST_CHECK(not expected.read_next_event());
+	BOOST_CHECK_EQUAL(cursor.next_event_index(), 600);
+	BOOST_CHECK(cursor.registers == columnar_sample.final_registers);
+	BOOST_CHECK(cursor.memory == columnar_sample.final_memory);
+	BOOST_CHECK_EQUAL(cursor.other_events, 54);
+
+	// Seeking from cache points, in the middle of blocks
+	CacheReader cache(columnar_sample.cache_stream(), trace.machine());
+	for (auto context_id : columnar_sample.cache_point_contexts) {
+		auto cache_point = cache.find_closest(context_id + 1);
+		StateCursor from_cache(trace);
+		from_cache.registers = cache.read_cache_point(cache_point);
+		from_cache.seek(cache_point->first, cache_point->second.trace_stream_offset);
+		while (from_cache.read_next_event())
+			BOOST_REQUIRE_EQUAL(from_cache.rip(), SampleTrace::expected_rip(from_cache.next_event_index()));
+		BOOST_CHECK(from_cache.registers == columnar_sample.final_registers);
+	}
+
+	// Seeking to any event, backward and forward
+	for (std::uint64_t context_id : { 599, 0, 13, 14, 12, 300, 301, 7, 6 }) {
+		cursor.seek(context_id, positions[context_id]);
+		BOOST_CHECK_EQUAL(cursor.stream_pos(), positions[context_id]);
+		BOOST_REQUIRE(cursor.read_next_event());
+		BOOST_CHECK_EQUAL(cursor.rip(), SampleTrace::expected_rip(context_id + 1));
+		BOOST_CHECK_EQUAL(cursor.stream_pos(), positions[context_id + 1]);
+	}
+	// Instruction headers are a single byte, "other" events have a description
+	BOOST_CHECK_THROW(cursor.seek(18, positions[18] + 1), std::logic_error);
+
+	// Stepping back replays blocks from their start
+	ReverseStateCursor reverse(trace, 1 << 20);
+	while (reverse.read_next_event()) {
+	}
+	for (std::uint64_t i = 0; i < 20; ++i)
+		BOOST_REQUIRE(reverse.step_back());
+	BOOST_CHECK_EQUAL(reverse.next_event_index(), 580);
+	while (reverse.read_next_event()) {
+	}
+	BOOST_CHECK(reverse.registers == columnar_sample.final_registers);
+}
+
+BOOST_AUTO_TEST_CASE(test_columnar_continued_diffs)
+{
+	// Events with more writes than a diff size holds, and register ids past a single byte
+	EventsOptions columnar;
+	columnar.columnar = true;
+	columnar.block_event_count = 2;
+
+	auto machine = SampleTrace::machine();
+	const RegisterId far_register = 0x1234;
+	machine.registers[far_register] = { 2, "far" };
+
+	auto trace_stream = std::make_unique<std::stringstream>();
+	auto trace_stream_ptr = trace_stream.get();
+	TraceWriter writer(std::move(trace_stream), machine, "test", "1.0.0", "test", columnar);
+	std::vector<std::uint8_t> memory(SampleTrace::memory_size, 0);
+	RegisterFile registers(machine);
+
+	auto memory_writer = writer.start_initial_memory_section();
+	memory_writer.write(memory.data(), memory.size());
+	auto registers_writer = writer.start_initial_registers_section(std::move(memory_writer));
+	for (auto reg_id : registers.register_ids())
+		registers_writer.write(reg_id, registers.get(reg_id), registers.register_size(reg_id));
+	auto events = writer.start_events_section(std::move(registers_writer));
+
+	for (std::uint64_t i = 0; i < 5; ++i) {
+		events.start_event_instruction();
+		for (std::uint64_t j = 0; j < 20; ++j) {
+			std::uint8_t value = static_cast<std::uint8_t>(i * 20 + j);
+			std::vector<std::uint8_t> large(0x100, value);
+			events.write_memory(j * 8, &value, 1);
+			events.write_memory(0x1000 + j * 0x100, large.data(), large.size());
+		}
+		for (std::uint64_t j = 0; j < 20; ++j) {
+			std::uint64_t value = i * 100 + j;
+			std::uint16_t far_value = static_cast<std::uint16_t>(value + 1);
+			events.write_register(SampleTrace::rax, reinterpret_cast<const std::uint8_t*>(&value), 8);
+			events.write_register(far_register, reinterpret_cast<const std::uint8_t*>(&far_value), 2);
+			events.write_register_action(SampleTrace::add_rbx);
+		}
+		events.finish_event();
+	}
+	writer.finish_events_section(std::move(events));
+
+	TraceFile trace(std::make_unique<std::stringstream>(trace_stream_ptr->str()));
+	BOOST_CHECK_EQUAL(trace.event_count(), 5);
+	BOOST_CHECK_EQUAL(trace.event_blocks().size(), 3);
+
+	StateCursor cursor(trace);
+	std::uint64_t count = 0;
+	while (cursor.read_next_event()) {
+		++count;
+		auto last = (count - 1) * 100 + 19;
+		BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint64_t*>(cursor.registers.get(SampleTrace::rax)), last);
+		BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint16_t*>(cursor.registers.get(far_register)), last + 1);
+		BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint64_t*>(cursor.registers.get(SampleTrace::rbx)), count * 20);
+		BOOST_CHECK_EQUAL(cursor.memory[19 * 8], (count - 1) * 20 + 19);
+		BOOST_CHECK_EQUAL(cursor.memory[0x1000 + 19 * 0x100 + 0xff], (count - 1) * 20 + 19);
+	}
+	BOOST_CHECK_EQUAL(count, 5);
+}
+
+BOOST_AUTO_TEST_CASE(test_register_sets)
+{
+	// A machine with more registers than a 64 bits mask, written all at once
+	MachineDescription machine = SampleTrace::machine();
+	for (RegisterId reg_id = 0x10; reg_id < 0x10 + 80; ++reg_id)
+		machine.registers[reg_id] = { 4, "r" + std::to_string(reg_id) };
+
+	for (bool columnar : { false, true }) {
+		EventsOptions options;
+		options.columnar = columnar;
+		options.block_event_count = 3;
+
+		auto trace_stream = std::make_unique<std::stringstream>();
+		auto trace_stream_ptr = trace_stream.get();
+		TraceWriter writer(std::move(trace_stream), machine, "test", "1.0.0", "test", options);
+		std::vector<std::uint8_t> memory(SampleTrace::memory_size, 0);
+		RegisterFile registers(machine);
+
+		auto memory_writer = writer.start_initial_memory_section();
+		memory_writer.write(memory.data(), memory.size());
+		auto registers_writer = writer.start_initial_registers_section(std::move(memory_writer));
+		for (auto reg_id : registers.register_ids())
+			registers_writer.write(reg_id, registers.get(reg_id), registers.register_size(reg_id));
+		auto events = writer.start_events_section(std::move(registers_writer));
+
+		std::vector<std::vector<std::uint32_t>> values;
+		for (std::uint32_t i = 0; i < 10; ++i) {
+			events.start_event_instruction();
+			std::uint8_t byte = static_cast<std::uint8_t>(i);
+			events.write_memory(i, &byte, 1);
+
+			// Every other register, then the last one alone, among separate writes
+			values.emplace_back(80);
+			std::vector<std::pair<RegisterId, const std::uint8_t*>> writes;
+			for (std::uint32_t j = i % 2; j < 80; j += 2) {
+				values.back()[j] = i * 1000 + j;
+				writes.emplace_back(0x10 + j, reinterpret_cast<const std::uint8_t*>(&values.back()[j]));
+			}
+			std::uint64_t rip = i;
+			events.write_register(SampleTrace::rip, reinterpret_cast<const std::uint8_t*>(&rip), 8);
+			events.write_register_set(writes);
+			events.write_register_action(SampleTrace::add_rbx);
+			events.write_register_set({ { 0x10 + 79, reinterpret_cast<const std::uint8_t*>(&i) } });
+			events.finish_event();
+		}
+		writer.finish_events_section(std::move(events));
+
+		TraceFile trace(std::make_unique<std::stringstream>(trace_stream_ptr->str()));
+		StateCursor cursor(trace);
+		std::vector<std::uint32_t> expected(80, 0);
+		for (std::uint32_t i = 0; i < 10; ++i) {
+			BOOST_REQUIRE(cursor.read_next_event());
+			for (std::uint32_t j = i % 2; j < 80; j += 2)
+				expected[j] = values[i][j];
+			expected[79] = i;
+
+			BOOST_TEST_CONTEXT("columnar " << columnar << ", event " << i)
+			{
+				BOOST_CHECK_EQUAL(cursor.rip(), i);
+				BOOST_CHECK_EQUAL(*reinterpret_cast<const std::uint64_t*>(cursor.registers.get(SampleTrace::rbx)), i + 1);
+				BOOST_CHECK_EQUAL(cursor.memory[i], i);
+				for (std::uint32_t j = 0; j < 80; ++j)
+					BOOST_REQUIRE_EQUAL(*reinterpret_cast<const std::uint32_t*>(cursor.registers.get(0x10 + j)),
+					                    expected[j]);
+			}
+		}
+		BOOST_CHECK(not cursor.read_next_event());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_event_templates)
+{
+	SampleTrace plain_sample(600, 50);
+	TraceFile plain(plain_sample.trace_stream());
+
+	for (bool columnar : { false, true }) {
+		EventsOptions options;
+		options.columnar = columnar;
+		options.block_event_count = 7;
+		options.template_occurrences = 3;
+		SampleTrace sample(600, 50, CachePointsOptions(), options);
+		TraceFile trace(sample.trace_stream());
+		BOOST_CHECK(trace.header().event_templates);
+		BOOST_CHECK(not trace.decoder().templates().empty());
+		if (not columnar)
+			BOOST_CHECK_LT(trace.events_section_size(), plain.events_section_size());
+
+		BOOST_TEST_CONTEXT("columnar " << columnar)
+		{
+			StateCursor expected(plain);
+			StateCursor cursor(trace);
+			while (cursor.read_next_event()) {
+				BOOST_REQUIRE(expected.read_next_event());
+				BOOST_REQUIRE(cursor.registers == expected.registers);
+				BOOST_REQUIRE(cursor.memory == expected.memory);
+			}
+			BOOST_CHECK_EQUAL(cursor.next_event_index(), 600);
+			if (not columnar)
+				BOOST_CHECK_EQUAL(cursor.stream_pos(), trace.events_section_size());
+			BOOST_CHECK_EQUAL(cursor.other_events, 54);
+
+			// Cache points designate templated events too
+			CacheReader cache(sample.cache_stream(), trace.machine());
+			for (auto context_id : sample.cache_point_contexts) {
+				auto cache_point = cache.find_closest(context_id + 1);
+				StateCursor from_cache(trace);
+				from_cache.registers = cache.read_cache_point(cache_point);
+				from_cache.seek(cache_point->first, cache_point->second.trace_stream_offset);
+				while (from_cache.read_next_event())
+					BOOST_REQUIRE_EQUAL(from_cache.rip(), SampleTrace::expected_rip(from_cache.next_event_index()));
+				BOOST_CHECK(from_cache.registers == sample.final_registers);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_register_encodings)
+{
+	SampleTrace plain_sample(600, 50);
+	TraceFile plain(plain_sample.trace_stream());
+
+	// rbx is only written by an operation, and zmm0 is larger than an integer
+	const std::map<RegisterId, MachineDescription::RegisterEncoding> encodings = {
+		{ SampleTrace::rax, MachineDescription::RegisterEncoding::Xor },
+		{ SampleTrace::rbx, MachineDescription::RegisterEncoding::Delta },
+		{ SampleTrace::rip, MachineDescription::RegisterEncoding::Delta },
+		{ SampleTrace::zmm0, MachineDescription::RegisterEncoding::Delta },
+	};
+
+	for (bool columnar : { false, true }) {
+		for (std::uint32_t template_occurrences : { 0, 3 }) {
+			EventsOptions options;
+			options.columnar = columnar;
+			options.block_event_count = 7;
+			options.template_occurrences = template_occurrences;
+			SampleTrace sample(600, 50, CachePointsOptions(), options, encodings);
+			TraceFile trace(sample.trace_stream());
+			BOOST_CHECK(trace.machine().register_encodings == encodings);
+			if (not columnar and template_occurrences == 0)
+				BOOST_CHECK_LT(trace.events_section_size(), plain.events_section_size());
+
+			BOOST_TEST_CONTEXT("columnar " << columnar << ", templates " << template_occurrences)
+			{
+				StateCursor expected(plain);
+				StateCursor cursor(trace);
+				while (cursor.read_next_event()) {
+					BOOST_REQUIRE(expected.read_next_event());
+					BOOST_REQUIRE(cursor.registers == expected.registers);
+					BOOST_REQUIRE(cursor.memory == expected.memory);
+				}
+				BOOST_CHECK_EQUAL(cursor.next_event_index(), 600);
+
+				// Encoded values apply to the registers of cache points
+				CacheReader cache(sample.cache_stream(), trace.machine());
+				for (auto context_id : sample.cache_point_contexts) {
+					auto cache_point = cache.find_closest(context_id + 1);
+					StateCursor from_cache(trace);
+					from_cache.registers = cache.read_cache_point(cache_point);
+					from_cache.seek(cache_point->first, cache_point->second.trace_stream_offset);
+					while (from_cache.read_next_event())
+						BOOST_REQUIRE_EQUAL(from_cache.rip(), SampleTrace::expected_rip(from_cache.next_event_index()));
+					BOOST_CHECK(from_cache.registers == sample.final_registers);
+				}
+			}
+		}
+	}
+}
@@ -253,3 +253,164 @@ BOOST_AUTO_TEST_CASE(test_incompatible_version_bin)
 	BOOST_CHECK_THROW(TraceReaderTester(s.reset(), "0.0.0"), IncompatibleVersionException);
 	BOOST_CHECK_THROW(TraceReaderTester(s.reset(), "2.0.0"), IncompatibleVersionException);
 }
+
+BOOST_AUTO_TEST_CASE(test_reader_columnar)
+{
+	StreamWrapper s;
+	s.reset();
+
+	uint64_t header_size = 17;
+	s.write<uint64_t>(header_size)
+		.write<uint8_t>(0).write<uint8_t>(1) // columnar events
+
+		.write<uint64_t>(0).write<uint32_t>(0).write<uint16_t>(0).write<uint8_t>(0) // artifical padding
+	;
+
+	// Machine description
+	uint64_t description_size = 39;
+	s.write<uint64_t>(description_size)
+	    .write({ 'x', '6', '4', '1' }).write<uint8_t>(1)
+		.write<uint32_t>(1) // memory regions
+			.write<uint8_t>(0).write<uint8_t>(0x8)
+		.write<uint32_t>(2) // registers
+			.write<uint16_t>(0).write<uint16_t>(4).write<uint8_t>(3).write({ 'e', 'a', 'x' })
+			.write<uint16_t>(1).write<uint16_t>(8).write<uint8_t>(3).write({ 'r', 'a', 'x' })
+		.write<uint32_t>(0) // actions
+		.write<uint32_t>(0) // static register
+	;
+
+	// Memory regions
+	s.write<uint64_t>(0x8).write<uint64_t>(0x0102030410121314);
+
+	// Initial context
+	s.write<uint64_t>(20).write<uint32_t>(2)
+		.write<uint16_t>(0).write<uint32_t>(0x00000000)
+		.write<uint16_t>(1).write<uint64_t>(0xff000000000000aa);
+
+	// Packet section
+	s.write<uint64_t>(217)
+	 .write<uint64_t>(3) // Number of events below
+
+	 // Block of 2 events, at 8
+	 .write<uint64_t>(81).write<uint32_t>(2)
+		.write<uint64_t>(7).write<uint64_t>(2).write<uint64_t>(16) // headers, register ids and contents
+		.write<uint64_t>(1).write<uint64_t>(1).write<uint64_t>(2)  // memory addresses, sizes and contents
+		.write<uint8_t>(0x11) // Registers and Memory
+		.write<uint8_t>(0xff).write<uint8_t>(0xff).write<uint8_t>(2).write({ 'e', 'v' }).write<uint8_t>(0x10)
+		.write<uint8_t>(0).write<uint8_t>(0)
+		.write<uint16_t>(1).write<uint16_t>(0).write<uint32_t>(2) // eax is written twice
+			.write<uint32_t>(0xffaabbdd).write<uint32_t>(0x12345678)
+		.write<uint8_t>(0x42)
+		.write<uint8_t>(2)
+		.write<uint16_t>(0xbbcc)
+
+	 // Block of 1 event, at 97
+	 .write<uint64_t>(72).write<uint32_t>(1)
+		.write<uint64_t>(1).write<uint64_t>(3).write<uint64_t>(16)
+		.write<uint64_t>(0).write<uint64_t>(0).write<uint64_t>(0)
+		.write<uint8_t>(0x10)
+		.write<uint8_t>(0xff).write<uint16_t>(1) // register ID is specified on 2 bytes
+		.write<uint16_t>(1).write<uint16_t>(1).write<uint32_t>(1)
+			.write<uint64_t>(0x1122334455667788)
+
+	 // Table of blocks
+	 .write<uint64_t>(0).write<uint64_t>(8)
+	 .write<uint64_t>(2).write<uint64_t>(97)
+	 .write<uint64_t>(2)
+	;
+
+	auto trace = TraceReaderTester(s, "1.3.0");
+	BOOST_CHECK(trace.header().events_layout == EventsLayout::Columnar);
+	BOOST_CHECK_EQUAL(trace.stream_pos(), 8);
+
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_event, "instruction");
+	BOOST_CHECK_EQUAL(trace.memory[0x42], 0xbbcc);
+	BOOST_CHECK_EQUAL(trace.last_register, "eax");
+	BOOST_CHECK_EQUAL(trace.last_value, 0xffaabbdd);
+	BOOST_CHECK_EQUAL(trace.stream_pos(), 8 + 60 + 1);
+
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_event, "ev");
+	BOOST_CHECK_EQUAL(trace.last_register, "eax");
+	BOOST_CHECK_EQUAL(trace.last_value, 0x12345678);
+
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_event, "instruction");
+	BOOST_CHECK_EQUAL(trace.last_register, "rax");
+	BOOST_CHECK_EQUAL(trace.last_value, 0x1122334455667788);
+	BOOST_CHECK(not trace.read_next_event());
+
+	// Seeking inside a block, and to a block
+	trace.seek(1, 8 + 60 + 1);
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_event, "ev");
+	trace.seek(2, 97);
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_register, "rax");
+	BOOST_CHECK_THROW(trace.seek(1, 8 + 60 + 2), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_reader_event_templates)
+{
+	StreamWrapper s;
+	s.reset();
+
+	uint64_t header_size = 17;
+	s.write<uint64_t>(header_size)
+		.write<uint8_t>(0).write<uint8_t>(0).write<uint8_t>(1) // event templates
+
+		.write<uint64_t>(0).write<uint32_t>(0).write<uint16_t>(0) // artifical padding
+	;
+
+	// Machine description
+	uint64_t description_size = 39;
+	s.write<uint64_t>(description_size)
+	    .write({ 'x', '6', '4', '1' }).write<uint8_t>(1)
+		.write<uint32_t>(1) // memory regions
+			.write<uint8_t>(0).write<uint8_t>(0x8)
+		.write<uint32_t>(2) // registers
+			.write<uint16_t>(0).write<uint16_t>(4).write<uint8_t>(3).write({ 'e', 'a', 'x' })
+			.write<uint16_t>(1).write<uint16_t>(8).write<uint8_t>(3).write({ 'r', 'a', 'x' })
+		.write<uint32_t>(0) // actions
+		.write<uint32_t>(0) // static register
+	;
+
+	// Memory regions
+	s.write<uint64_t>(0x8).write<uint64_t>(0x0102030410121314);
+
+	// Initial context
+	s.write<uint64_t>(20).write<uint32_t>(2)
+		.write<uint16_t>(0).write<uint32_t>(0x00000000)
+		.write<uint16_t>(1).write<uint64_t>(0xff000000000000aa);
+
+	// Packet section
+	s.write<uint64_t>(42)
+	 .write<uint64_t>(2) // Number of events below
+		.write<uint8_t>(0xff).write<uint8_t>(0) // Template 0
+			.write<uint8_t>(0x42).write<uint16_t>(0xbbcc)
+			.write<uint32_t>(0xffaabbdd)
+		.write<uint8_t>(0x10) // Regular event
+			.write<uint8_t>(1).write<uint64_t>(0xffaabbccddeeffaa)
+
+	 // Table of templates
+	 .write<uint8_t>(1)
+		.write<uint16_t>(1).write<uint8_t>(2) // one memory write of 2 bytes
+		.write<uint16_t>(1).write<uint8_t>(0) // eax
+	 .write<uint64_t>(7)
+	;
+
+	auto trace = TraceReaderTester(s, "1.5.0");
+	BOOST_CHECK(trace.header().event_templates);
+
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_event, "instruction");
+	BOOST_CHECK_EQUAL(trace.memory[0x42], 0xbbcc);
+	BOOST_CHECK_EQUAL(trace.last_register, "eax");
+	BOOST_CHECK_EQUAL(trace.last_value, 0xffaabbdd);
+
+	BOOST_CHECK(trace.read_next_event());
+	BOOST_CHECK_EQUAL(trace.last_register, "rax");
+	BOOST_CHECK_EQUAL(trace.last_value, 0xffaabbccddeeffaa);
+	BOOST_CHECK(not trace.read_next_event());
+}
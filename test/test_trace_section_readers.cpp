@@ -38,6 +38,14 @@ BOOST_AUTO_TEST_CASE(test_section_reader_helper)
 	BOOST_CHECK_EQUAL(section.stream_pos(), 8);
 	BOOST_CHECK_EQUAL(section.read<uint32_t>(), 2);
 	BOOST_CHECK_EQUAL(section.read<uint32_t>(), 3);
+	section.seek(0);
+	BOOST_CHECK_EQUAL(section.read<uint32_t>(), 0);
+	section.skip(4);
+	BOOST_CHECK_EQUAL(section.read<uint32_t>(), 2);
+	section.seek(0);
+	section.skip(8);
+	BOOST_CHECK_EQUAL(section.read<uint32_t>(), 2);
+	BOOST_CHECK_THROW(section.skip(8), UnexpectedEndOfSection);
 }
 
 BOOST_AUTO_TEST_CASE(test_header_reader)
@@ -58,6 +66,38 @@ BOOST_AUTO_TEST_CASE(test_header_reader)
 
 	BOOST_CHECK_THROW(read_trace_header(reader),
 		              UnsupportedFeature);
+
+	// Before 1.3, bytes after the compression are padding, not an events layout
+	reader = s.reset().write<uint64_t>(2)
+		.write<uint8_t>(0)
+		.write<uint8_t>(1)
+		.to_reader("1.2.0");
+	header = read_trace_header(reader);
+	BOOST_CHECK(header.events_layout == EventsLayout::Interleaved);
+
+	reader = s.reset().write<uint64_t>(2)
+		.write<uint8_t>(0)
+		.write<uint8_t>(static_cast<uint8_t>(EventsLayout::Columnar))
+		.to_reader("1.3.0");
+	header = read_trace_header(reader);
+	BOOST_CHECK(header.events_layout == EventsLayout::Columnar);
+
+	// Likewise for event templates before 1.5
+	reader = s.reset().write<uint64_t>(3)
+		.write<uint8_t>(0)
+		.write<uint8_t>(0)
+		.write<uint8_t>(0xff)
+		.to_reader("1.4.0");
+	header = read_trace_header(reader);
+	BOOST_CHECK(not header.event_templates);
+
+	reader = s.reset().write<uint64_t>(3)
+		.write<uint8_t>(0)
+		.write<uint8_t>(0)
+		.write<uint8_t>(1)
+		.to_reader("1.5.0");
+	header = read_trace_header(reader);
+	BOOST_CHECK(header.event_templates);
 }
 
 BOOST_AUTO_TEST_CASE(test_machine_description_reader)
@@ -93,6 +133,38 @@ BOOST_AUTO_TEST_CASE(test_machine_description_reader)
 		.to_reader();
 	BOOST_CHECK_NO_THROW(read_trace_machine_description(reader));
 
+	// Before 1.6, there are no register encodings, with or without trailing bytes
+	reader = s.reset()
+		.write<uint64_t>(21).write({ 'x', '6', '4', '1' })
+		.write<uint8_t>(8)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.to_reader("1.5.0");
+	BOOST_CHECK(read_trace_machine_description(reader).register_encodings.empty());
+
+	reader = s.reset()
+		.write<uint64_t>(21).write({ 'x', '6', '4', '1' })
+		.write<uint8_t>(8)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.to_reader("1.6.0");
+	BOOST_CHECK_THROW(read_trace_machine_description(reader), UnexpectedEndOfSection);
+
+	reader = s.reset()
+		.write<uint64_t>(25).write({ 'x', '6', '4', '1' })
+		.write<uint8_t>(8)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.to_reader("1.6.0");
+	BOOST_CHECK(read_trace_machine_description(reader).register_encodings.empty());
+
 	reader = s.reset()
 		.write<uint64_t>(0xff).write({ 'x', '6', '4', '1' }).write<uint8_t>(8)
 		.write<std::uint32_t>(0)
@@ -141,6 +213,33 @@ BOOST_AUTO_TEST_CASE(test_machine_description_reader)
 		.to_reader();
 	BOOST_CHECK_THROW(read_trace_machine_description(reader),MalformedSection);
 
+	// Register encodings
+	for (auto encoding : { std::make_pair(1, 1), std::make_pair(0, 3) }) {
+		reader = s.reset()
+			.write<uint64_t>(0xff).write({ 'x', '6', '4', '1' }).write<uint8_t>(8)
+			.write<std::uint32_t>(0)
+			.write<std::uint32_t>(1)
+				.write<std::uint16_t>(0).write<std::uint16_t>(4).write<std::uint8_t>(3).write({ 'e', 'a', 'x' })
+			.write<std::uint32_t>(0)
+			.write<std::uint32_t>(0)
+			.write<std::uint32_t>(1)
+				.write<std::uint16_t>(encoding.first).write<std::uint8_t>(encoding.second)
+			.to_reader("1.6.0");
+		BOOST_CHECK_THROW(read_trace_machine_description(reader),MalformedSection);
+	}
+
+	reader = s.reset()
+		.write<uint64_t>(0xff).write({ 'x', '6', '4', '1' }).write<uint8_t>(8)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(1)
+			.write<std::uint16_t>(0).write<std::uint16_t>(65).write<std::uint8_t>(3).write({ 'z', 'm', 'm' })
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(0)
+		.write<std::uint32_t>(1)
+			.write<std::uint16_t>(0).write<std::uint8_t>(1)
+		.to_reader("1.6.0");
+	BOOST_CHECK_THROW(read_trace_machine_description(reader),MalformedSection);
+
 	reader = s.reset().write<uint64_t>(0xffff).write({ 'x', '6', '4', '1' }).write<std::uint8_t>(6)
 		.write<std::uint32_t>(2) // memory regions
 			.write<std::uint64_t>(0, 6).write<std::uint64_t>(0xff000000, 6)
@@ -155,7 +254,10 @@ BOOST_AUTO_TEST_CASE(test_machine_description_reader)
 		.write<std::uint32_t>(2) // static register
 		    .write<std::uint8_t>(3).write({ 'c', 'p', 'u' }).write<std::uint8_t>(2).write<std::uint16_t>(0x42)
 		    .write<std::uint8_t>(3).write({ 'p', 's', 'e' }).write<std::uint8_t>(4).write<std::uint32_t>(0xffffffff)
-		.to_reader()
+		.write<std::uint32_t>(2) // register encodings
+			.write<std::uint16_t>(1).write<std::uint8_t>(2)
+			.write<std::uint16_t>(2).write<std::uint8_t>(1)
+		.to_reader("1.6.0")
 	;
 
 	auto desc = read_trace_machine_description(reader);
@@ -183,4 +285,7 @@ BOOST_AUTO_TEST_CASE(test_machine_description_reader)
 	BOOST_CHECK_EQUAL(desc.static_registers["cpu"][1], 0x00);
 	BOOST_CHECK_EQUAL(static_cast<std::uint8_t>(desc.static_registers["pse"][0]), 0xff);
 	BOOST_CHECK_EQUAL(static_cast<std::uint8_t>(desc.static_registers["pse"][3]), 0xff);
+	BOOST_CHECK_EQUAL(desc.register_encodings.size(), 2);
+	BOOST_CHECK(desc.register_encodings[1] == MachineDescription::RegisterEncoding::Delta);
+	BOOST_CHECK(desc.register_encodings[2] == MachineDescription::RegisterEncoding::Xor);
 }
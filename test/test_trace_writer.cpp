@@ -5,6 +5,7 @@
 #include <iomanip>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <writer_errors.h>
 #include <trace_writer.h>
@@ -18,9 +19,9 @@ using namespace reven::backend::plugins::file::libbintrace;
 class TraceWriterTester : public TraceWriter
 {
 public:
-	TraceWriterTester(const MachineDescription& desc)
+	TraceWriterTester(const MachineDescription& desc, const EventsOptions& options = EventsOptions())
 	  : TraceWriter(make_unique<stringstream>(), desc,
-	                "TestTraceWriter", "1.0.0", "Tests version 1.0.0") {}
+	                "TestTraceWriter", "1.0.0", "Tests version 1.0.0", options) {}
 
 	StreamWrapper stream() {
 		return StreamWrapper{
@@ -125,3 +126,235 @@ BOOST_AUTO_TEST_CASE(test_writer_base)
 	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0);
 	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0);
 }
+
+BOOST_AUTO_TEST_CASE(test_writer_register_set)
+{
+	unsigned char memory[16+1] = "0123456789abcdef";
+	auto trace = TraceWriterTester(desc);
+
+	auto initial_memory_writer = trace.start_initial_memory_section();
+	initial_memory_writer.write(memory, 16);
+
+	auto initial_cpu_writer = trace.start_initial_registers_section(std::move(initial_memory_writer));
+	auto events_writer = trace.start_events_section(std::move(initial_cpu_writer));
+
+	events_writer.start_event_instruction();
+	events_writer.write_register(1, memory, 4);
+	// Values are written by slot, whatever the order of the writes
+	events_writer.write_register_set({ { 0xf00, memory + 8 }, { 0, memory } });
+	events_writer.finish_event();
+
+	BOOST_CHECK_THROW(events_writer.write_register_set({}), std::logic_error);
+	events_writer.start_event_instruction();
+	BOOST_CHECK_THROW(events_writer.write_register_set({ { 2, memory } }), NonsenseValue);
+	BOOST_CHECK_THROW(events_writer.write_register_set({ { 0, memory }, { 0, memory } }), NonsenseValue);
+	events_writer.finish_event();
+
+	trace.finish_events_section(std::move(events_writer));
+
+	auto s = trace.stream();
+	s.skip_section(); // header
+	s.skip_section(); // machine desc
+	s.skip_section(); // memory
+	s.skip_section(); // initial context
+
+	s.read<std::uint64_t>(); // section size
+	BOOST_CHECK_EQUAL(s.read<std::uint64_t>(), 2);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x20);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 1);
+	BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(0, 4));
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), register_set_id);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x5); // slots of eax and rax
+	BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(0, 4));
+	BOOST_CHECK_EQUAL(s.read_data(8), std::string((char*)memory).substr(8, 8));
+
+	// Failed sets wrote nothing
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_writer_reserved_register_id)
+{
+	auto reserved = desc;
+	reserved.registers[register_set_id] = { 4, "reserved" };
+	BOOST_CHECK_THROW(TraceWriterTester{ reserved }, NonsenseValue);
+}
+
+BOOST_AUTO_TEST_CASE(test_writer_register_encodings)
+{
+	auto encoded = desc;
+	encoded.registers[2] = { 65, "zmm" };
+	encoded.register_encodings[2] = MachineDescription::RegisterEncoding::Xor;
+	BOOST_CHECK_THROW(TraceWriterTester{ encoded }, NonsenseValue);
+
+	encoded = desc;
+	encoded.register_operations[0xfd] = { 0xf00, MachineDescription::RegisterOperator::Add, { 1, 0, 0, 0, 0, 0, 0, 0 } };
+	encoded.register_encodings[1] = MachineDescription::RegisterEncoding::Xor;
+	encoded.register_encodings[0xf00] = MachineDescription::RegisterEncoding::Delta;
+
+	unsigned char memory[16+1] = "0123456789abcdef";
+	auto trace = TraceWriterTester(encoded);
+
+	auto initial_memory_writer = trace.start_initial_memory_section();
+	initial_memory_writer.write(memory, 16);
+	auto initial_cpu_writer = trace.start_initial_registers_section(std::move(initial_memory_writer));
+	std::uint32_t ebx = 0x11223344;
+	std::uint64_t rax = 0x1000;
+	initial_cpu_writer.write(1, reinterpret_cast<std::uint8_t*>(&ebx), 4);
+	initial_cpu_writer.write(0xf00, reinterpret_cast<std::uint8_t*>(&rax), 8);
+	auto events_writer = trace.start_events_section(std::move(initial_cpu_writer));
+
+	auto write_rax = [&events_writer, &rax](std::uint64_t value) {
+		rax = value;
+		events_writer.start_event_instruction();
+		events_writer.write_register(0xf00, reinterpret_cast<std::uint8_t*>(&rax), 8);
+		events_writer.finish_event();
+	};
+	write_rax(0x1008);
+	write_rax(0x1000);
+	write_rax(0x1000);
+	write_rax(0x1080);
+
+	// The operation is applied to the previous value of rax
+	rax += 1;
+	events_writer.start_event_instruction();
+	events_writer.write_register_action(0xfd);
+	events_writer.write_register(0xf00, reinterpret_cast<std::uint8_t*>(&rax), 8);
+	events_writer.finish_event();
+
+	ebx = 0x11223355;
+	events_writer.start_event_instruction();
+	events_writer.write_register(0, memory, 4);
+	events_writer.write_register_set({ { 1, reinterpret_cast<std::uint8_t*>(&ebx) } });
+	events_writer.finish_event();
+
+	trace.finish_events_section(std::move(events_writer));
+
+	auto s = trace.stream();
+	s.skip_section(); // header
+	s.skip_section(); // machine desc
+	s.skip_section(); // memory
+	s.skip_section(); // initial context
+
+	s.read<std::uint64_t>(); // section size
+	BOOST_CHECK_EQUAL(s.read<std::uint64_t>(), 6);
+
+	auto check_rax = [&s](std::uint8_t diff_size, std::vector<std::uint8_t> delta) {
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), diff_size);
+		if (diff_size == 0x20)
+			BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xfd);
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+		BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), 0xf00);
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), delta.size());
+		for (auto byte : delta)
+			BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), byte);
+	};
+	check_rax(0x10, { 0x08 });
+	check_rax(0x10, { 0xf8 }); // Sign extended
+	check_rax(0x10, {});
+	check_rax(0x10, { 0x80, 0x00 });
+	check_rax(0x20, {});
+
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x20);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0);
+	BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(0, 4));
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), register_set_id);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x2);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 1);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x11);
+}
+
+BOOST_AUTO_TEST_CASE(test_writer_event_templates)
+{
+	unsigned char memory[16+1] = "0123456789abcdef";
+	EventsOptions options;
+	options.template_occurrences = 2;
+	auto trace = TraceWriterTester(desc, options);
+	BOOST_CHECK(trace.header().event_templates);
+
+	auto initial_memory_writer = trace.start_initial_memory_section();
+	initial_memory_writer.write(memory, 16);
+	auto initial_cpu_writer = trace.start_initial_registers_section(std::move(initial_memory_writer));
+	auto events_writer = trace.start_events_section(std::move(initial_cpu_writer));
+
+	// The shape becomes a template on its second occurrence
+	for (int i = 0; i < 3; ++i) {
+		events_writer.start_event_instruction();
+		events_writer.write_memory(4 + i, memory + i, 4);
+		events_writer.write_register(0xf00, memory + i, 8);
+		events_writer.write_register_action(0xfe);
+		events_writer.finish_event();
+	}
+
+	// Events with a single write are not worth a template, and register sets are not part of templates
+	for (int i = 0; i < 2; ++i) {
+		events_writer.start_event_instruction();
+		events_writer.write_register(0, memory, 4);
+		events_writer.finish_event();
+	}
+	events_writer.start_event_instruction();
+	events_writer.write_memory(4, memory, 4);
+	events_writer.write_register(0xf00, memory, 8);
+	events_writer.write_register_set({ { 1, memory } });
+	BOOST_CHECK_THROW(events_writer.write_memory(4, memory, 4), std::logic_error);
+	events_writer.write_register_action(0xfe);
+	events_writer.finish_event();
+
+	trace.finish_events_section(std::move(events_writer));
+
+	auto s = trace.stream();
+	s.skip_section(); // header
+	s.skip_section(); // machine desc
+	s.skip_section(); // memory
+	s.skip_section(); // initial context
+
+	s.read<std::uint64_t>(); // section size
+	BOOST_CHECK_EQUAL(s.read<std::uint64_t>(), 6);
+	for (int i = 0; i < 2; ++i) {
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x21);
+		BOOST_CHECK_EQUAL(s.read<std::uint64_t>(5), 4 + i);
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 4);
+		BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(i, 4));
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+		BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), 0xf00);
+		BOOST_CHECK_EQUAL(s.read_data(8), std::string((char*)memory).substr(i, 8));
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xfe);
+	}
+
+	// Template 0: addresses and values only
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0);
+	BOOST_CHECK_EQUAL(s.read<std::uint64_t>(5), 6);
+	BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(2, 4));
+	BOOST_CHECK_EQUAL(s.read_data(8), std::string((char*)memory).substr(2, 8));
+
+	for (int i = 0; i < 2; ++i) {
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x10);
+		BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0);
+		BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(0, 4));
+	}
+
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x31);
+	BOOST_CHECK_EQUAL(s.read<std::uint64_t>(5), 4);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 4);
+	BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(0, 4));
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), 0xf00);
+	BOOST_CHECK_EQUAL(s.read_data(8), std::string((char*)memory).substr(0, 8));
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), register_set_id);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0x2);
+	BOOST_CHECK_EQUAL(s.read_data(4), std::string((char*)memory).substr(0, 4));
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xfe);
+
+	// Table of templates
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 1);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), 1);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 4);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), 2);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xff);
+	BOOST_CHECK_EQUAL(s.read<std::uint16_t>(), 0xf00);
+	BOOST_CHECK_EQUAL(s.read<std::uint8_t>(), 0xfe);
+	BOOST_CHECK_EQUAL(s.read<std::uint64_t>(), 10);
+}
@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <event_boundary_finder.h>
+#include <replay_engine.h>
+#include <watchpoint_scan.h>
+
+#include "helpers.h"
+#include "sample_trace.h"
+
+using namespace std;
+using namespace reven::backend::plugins::file::libbintrace;
+
+namespace {
+
+using Ranges = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+
+//! Memory writes of a SampleTrace overlapping `ranges`, computed from its definition.
+std::vector<WatchpointHit> sample_hits(std::uint64_t event_count, const Ranges& ranges)
+{
+	auto overlaps = [&ranges](std::uint64_t address, std::uint64_t size) {
+		for (const auto& range : ranges) {
+			if (address < range.first + range.second and range.first < address + size)
+				return true;
+		}
+		return false;
+	};
+
+	std::vector<WatchpointHit> hits;
+	for (std::uint64_t i = 0; i < event_count; ++i) {
+		if (SampleTrace::writes_memory(i) and overlaps(SampleTrace::memory_address(i), 8))
+			hits.push_back({ i, SampleTrace::memory_address(i), 8 });
+		auto large_address = (i * 0x100) % (SampleTrace::memory_size - 0x1800);
+		if (SampleTrace::writes_large_memory(i) and overlaps(large_address, 0x1800))
+			hits.push_back({ i, large_address, 0x1800 });
+	}
+	return hits;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_address_ranges)
+{
+	AddressRanges ranges({ { 0x100, 0x10 }, { 0x108, 0x10 }, { 0x200, 0 }, { 0x300, 0x10 }, { 0x118, 8 } });
+	BOOST_CHECK(ranges.ranges() == Ranges({ { 0x100, 0x120 }, { 0x300, 0x310 } }));
+	BOOST_CHECK(ranges.overlaps(0xf0, 0x11));
+	BOOST_CHECK(not ranges.overlaps(0xf0, 0x10));
+	BOOST_CHECK(not ranges.overlaps(0x120, 0x1e0));
+	BOOST_CHECK(ranges.overlaps(0x30f, 1));
+	BOOST_CHECK(not ranges.overlaps(0x200, 1));
+
+	// Enough ranges for a binary search
+	Ranges many;
+	for (std::uint64_t i = 0; i < 100; ++i)
+		many.emplace_back(i * 0x100, 0x10);
+	AddressRanges many_ranges(many);
+	BOOST_CHECK_EQUAL(many_ranges.ranges().size(), 100);
+	for (std::uint64_t address = 0; address < 0x6500; address += 4)
+		BOOST_CHECK_EQUAL(many_ranges.overlaps(address, 4), address < 0x6400 and address % 0x100 < 0x10);
+
+	AddressRanges end_of_space({ { std::uint64_t(-0x10), 0x10 } });
+	BOOST_CHECK(end_of_space.overlaps(std::uint64_t(-2), 0x100));
+	BOOST_CHECK(not end_of_space.overlaps(0, 0x100));
+}
+
+BOOST_AUTO_TEST_CASE(test_watchpoint_scan)
+{
+	SampleTrace sample(2000, 100);
+	TraceFile trace(sample.trace_stream());
+	ThreadPool pool(4);
+
+	auto offsets = EventBoundaryFinder(trace, 0x1000).find(pool);
+	ReplayEngine engine(trace, offsets);
+
+	Ranges few = { { 0x1234, 1 }, { 0x3000, 0x20 } };
+	Ranges many;
+	for (std::uint64_t i = 0; i < 20; ++i)
+		many.emplace_back(i * 0x321, 4);
+
+	for (const auto& ranges : { few, many }) {
+		auto expected = sample_hits(2000, ranges);
+		BOOST_REQUIRE(not expected.empty());
+
+		std::vector<WatchpointHit> hits;
+		auto statistics = WatchpointScan(engine, ranges).run(pool, [&hits](const WatchpointHit& hit) {
+			hits.push_back(hit);
+		});
+		BOOST_CHECK_EQUAL(statistics.events, 2000);
+		BOOST_CHECK_EQUAL(statistics.matches, expected.size());
+
+		BOOST_REQUIRE_EQUAL(hits.size(), expected.size());
+		for (std::size_t i = 0; i < hits.size(); ++i) {
+			BOOST_CHECK_EQUAL(hits[i].event_id, expected[i].event_id);
+			BOOST_CHECK_EQUAL(hits[i].address, expected[i].address);
+			BOOST_CHECK_EQUAL(hits[i].size, expected[i].size);
+		}
+	}
+}